@@ -32,85 +32,131 @@
 
 #include "os/os.h"
 
-void CommandQueueMT::lock() {
+#include <string.h>
 
-	if (mutex)
-		mutex->lock();
+// the claim at p_offset ran past the end of p_block. the rest of the block
+// is marked unused and the next one is linked for the claims to retry in.
+void CommandQueueMT::_link_block(Block *p_block, uint32_t p_offset) {
+
+	if (p_offset < BLOCK_SIZE) {
+		atomic_add((uint32_t *)((uint8_t *)p_block->data + p_offset), ENTRY_END);
+	}
+
+	block_mutex->lock();
+	Block *block = free_blocks;
+	if (block) {
+		free_blocks = block->next;
+	} else {
+		block = (Block *)memalloc(sizeof(Block));
+		stats.allocated_blocks++;
+	}
+	stats.blocks++;
+	stats.max_blocks = MAX(stats.max_blocks, stats.blocks);
+	block_mutex->unlock();
+
+	// a producer that read write_block before this block was consumed may
+	// still claim in it. it sees it past the end until the reset below, and
+	// a claim after the reset is a claim in the next write block anyway.
+	memset(block->data, 0, sizeof(block->data));
+	block->next = NULL;
+	atomic_add(&block->reserved, 0); // full barrier, clean before the reset
+	block->reserved = 0;
+	atomic_add(&block->reserved, 0);
+
+	p_block->next = block;
+	write_block = block;
 }
 
-void CommandQueueMT::unlock() {
+void CommandQueueMT::_wait_for_link(Block *p_block) {
 
-	if (mutex)
-		mutex->unlock();
+	atomic_increment(&stats.producer_stalls);
+	// linking is a memset away, spin a little before sleeping
+	for (int i = 0; write_block == p_block; i++) {
+		if (i >= 64) {
+			OS::get_singleton()->delay_usec(1);
+		}
+	}
 }
 
-void CommandQueueMT::wait_for_flush() {
+void CommandQueueMT::_wait_for_publish() {
 
-	// wait one millisecond for a flush to happen
-	OS::get_singleton()->delay_usec(1000);
+	atomic_increment(&stats.consumer_stalls);
+	OS::get_singleton()->delay_usec(0);
 }
 
-CommandQueueMT::SyncSemaphore *CommandQueueMT::_alloc_sync_sem() {
+// the read block is done with, the one after it is or is about to be linked.
+void CommandQueueMT::_next_block() {
+
+	Block *block = read_block;
+	Block *next;
+	while (!(next = block->next)) {
+		_wait_for_publish();
+	}
+	read_block = next;
+	read_offset = 0;
+
+	// slow producers may still hold the block and bump its reserved count,
+	// so it's never freed while the queue lives. the free list is as long
+	// as the most blocks that were ever in use.
+	block_mutex->lock();
+	block->next = free_blocks;
+	free_blocks = block;
+	stats.blocks--;
+	block_mutex->unlock();
+}
 
-	int idx = -1;
+CommandQueueMT::SyncSemaphore *CommandQueueMT::_alloc_sync_sem() {
 
 	while (true) {
 
-		lock();
 		for (int i = 0; i < SYNC_SEMAPHORES; i++) {
 
-			if (!sync_sems[i].in_use) {
-				sync_sems[i].in_use = true;
-				idx = i;
-				break;
+			if (atomic_increment(&sync_sems[i].in_use) == 1) {
+				return &sync_sems[i];
 			}
+			atomic_decrement(&sync_sems[i].in_use);
 		}
-		unlock();
 
-		if (idx == -1) {
-			wait_for_flush();
-		} else {
-			break;
-		}
+		// every semaphore is out, wait one millisecond for a flush to happen
+		atomic_increment(&stats.producer_stalls);
+		OS::get_singleton()->delay_usec(1000);
 	}
-
-	return &sync_sems[idx];
 }
 
-bool CommandQueueMT::dealloc_one() {
-tryagain:
-	if (dealloc_ptr == write_ptr) {
-		// The queue is empty
-		return false;
-	}
-
-	uint32_t size = *(uint32_t *)&command_mem[dealloc_ptr];
+void CommandQueueMT::get_stats(Stats *r_stats) const {
 
-	if (size == 0) {
-		// End of command buffer wrap down
-		dealloc_ptr = 0;
-		goto tryagain;
-	}
-
-	if (size & 1) {
-		// Still used, nothing can be deallocated
-		return false;
-	}
+	block_mutex->lock();
+	*r_stats = stats;
+	block_mutex->unlock();
 
-	dealloc_ptr += (size >> 1) + sizeof(uint32_t);
-	return true;
+	// the stall and flush counters are bumped outside the mutex
+	Stats *s = const_cast<Stats *>(&stats);
+	r_stats->producer_stalls = atomic_add(&s->producer_stalls, 0);
+	r_stats->consumer_stalls = atomic_add(&s->consumer_stalls, 0);
+	r_stats->flushed = atomic_add(&s->flushed, 0);
 }
 
 CommandQueueMT::CommandQueueMT(bool p_sync) {
 
-	read_ptr = 0;
-	write_ptr = 0;
-	mutex = Mutex::create();
+	block_mutex = Mutex::create();
+	free_blocks = NULL;
+	memset(&stats, 0, sizeof(stats));
+
+	Block *block = (Block *)memalloc(sizeof(Block));
+	memset(block->data, 0, sizeof(block->data));
+	block->next = NULL;
+	block->reserved = 0;
+	write_block = block;
+	read_block = block;
+	read_offset = 0;
+	stats.blocks = 1;
+	stats.max_blocks = 1;
+	stats.allocated_blocks = 1;
 
 	for (int i = 0; i < SYNC_SEMAPHORES; i++) {
 
 		sync_sems[i].sem = Semaphore::create();
-		sync_sems[i].in_use = false;
+		sync_sems[i].in_use = 0;
 	}
 	if (p_sync)
 		sync = Semaphore::create();
@@ -122,9 +168,19 @@ CommandQueueMT::~CommandQueueMT() {
 
 	if (sync)
 		memdelete(sync);
-	memdelete(mutex);
+	memdelete(block_mutex);
 	for (int i = 0; i < SYNC_SEMAPHORES; i++) {
 
 		memdelete(sync_sems[i].sem);
 	}
+	Block *chains[2] = { read_block, free_blocks };
+	for (int i = 0; i < 2; i++) {
+
+		Block *block = chains[i];
+		while (block) {
+			Block *next = block->next;
+			memfree(block);
+			block = next;
+		}
+	}
 }
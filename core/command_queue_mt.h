@@ -34,6 +34,7 @@
 #include "os/memory.h"
 #include "os/mutex.h"
 #include "os/semaphore.h"
+#include "safe_refcount.h"
 #include "simple_type.h"
 #include "typedefs.h"
 /**
@@ -221,11 +222,11 @@
 #define DECL_PUSH(N)                                                         \
 	template <class T, class M COMMA(N) COMMA_SEP_LIST(TYPE_PARAM, N)>       \
 	void push(T *p_instance, M p_method COMMA(N) COMMA_SEP_LIST(PARAM, N)) { \
-		CMD_TYPE(N) *cmd = allocate_and_lock<CMD_TYPE(N)>();                 \
+		CMD_TYPE(N) *cmd = allocate<CMD_TYPE(N)>();                          \
 		cmd->instance = p_instance;                                          \
 		cmd->method = p_method;                                              \
 		SEMIC_SEP_LIST(CMD_ASSIGN_PARAM, N);                                 \
-		unlock();                                                            \
+		publish(cmd);                                                        \
 		if (sync) sync->post();                                              \
 	}
 
@@ -235,15 +236,16 @@
 	template <class T, class M, COMMA_SEP_LIST(TYPE_PARAM, N) COMMA(N) class R>                \
 	void push_and_ret(T *p_instance, M p_method, COMMA_SEP_LIST(PARAM, N) COMMA(N) R *r_ret) { \
 		SyncSemaphore *ss = _alloc_sync_sem();                                                 \
-		CMD_RET_TYPE(N) *cmd = allocate_and_lock<CMD_RET_TYPE(N)>();                           \
+		CMD_RET_TYPE(N) *cmd = allocate<CMD_RET_TYPE(N)>();                                    \
 		cmd->instance = p_instance;                                                            \
 		cmd->method = p_method;                                                                \
 		SEMIC_SEP_LIST(CMD_ASSIGN_PARAM, N);                                                   \
 		cmd->ret = r_ret;                                                                      \
 		cmd->sync_sem = ss;                                                                    \
-		unlock();                                                                              \
+		publish(cmd);                                                                          \
 		if (sync) sync->post();                                                                \
 		ss->sem->wait();                                                                       \
+		atomic_decrement(&ss->in_use);                                                         \
 	}
 
 #define CMD_SYNC_TYPE(N) CommandSync##N<T, M COMMA(N) COMMA_SEP_LIST(TYPE_ARG, N)>
@@ -252,14 +254,15 @@
 	template <class T, class M COMMA(N) COMMA_SEP_LIST(TYPE_PARAM, N)>                \
 	void push_and_sync(T *p_instance, M p_method COMMA(N) COMMA_SEP_LIST(PARAM, N)) { \
 		SyncSemaphore *ss = _alloc_sync_sem();                                        \
-		CMD_SYNC_TYPE(N) *cmd = allocate_and_lock<CMD_SYNC_TYPE(N)>();                \
+		CMD_SYNC_TYPE(N) *cmd = allocate<CMD_SYNC_TYPE(N)>();                         \
 		cmd->instance = p_instance;                                                   \
 		cmd->method = p_method;                                                       \
 		SEMIC_SEP_LIST(CMD_ASSIGN_PARAM, N);                                          \
 		cmd->sync_sem = ss;                                                           \
-		unlock();                                                                     \
+		publish(cmd);                                                                 \
 		if (sync) sync->post();                                                       \
 		ss->sem->wait();                                                              \
+		atomic_decrement(&ss->in_use);                                                \
 	}
 
 #define MAX_CMD_PARAMS 12
@@ -269,7 +272,7 @@ class CommandQueueMT {
 	struct SyncSemaphore {
 
 		Semaphore *sem;
-		bool in_use;
+		uint32_t in_use; // claimed by whoever raised it from 0 to 1
 	};
 
 	struct CommandBase {
@@ -283,9 +286,10 @@ class CommandQueueMT {
 
 		SyncSemaphore *sync_sem;
 
+		// the waiter gives the semaphore back once it woke up, so nobody
+		// claims it while the post is still pending
 		virtual void post() {
 			sync_sem->sem->post();
-			sync_sem->in_use = false;
 		}
 	};
 
@@ -303,131 +307,134 @@ class CommandQueueMT {
 	/***** BASE *******/
 
 	enum {
-		COMMAND_MEM_SIZE_KB = 256,
-		COMMAND_MEM_SIZE = COMMAND_MEM_SIZE_KB * 1024,
-		SYNC_SEMAPHORES = 8
+		BLOCK_SIZE_KB = 64,
+		BLOCK_SIZE = BLOCK_SIZE_KB * 1024,
+		SYNC_SEMAPHORES = 32,
+		ENTRY_ALIGN = 8,
+		ENTRY_HEADER = 8,
+		ENTRY_END = 1 // header of the unused tail of a block
 	};
 
-	uint8_t command_mem[COMMAND_MEM_SIZE];
-	uint32_t read_ptr;
-	uint32_t write_ptr;
-	uint32_t dealloc_ptr;
+	// commands are written to a chain of blocks. a producer claims room in
+	// the last block by adding its entry size to the block's reserved count,
+	// so pushes take no lock. the one claim that runs past the end of the
+	// block links the next one, the claims after it wait for that and retry.
+	// an entry is a header followed by the command, the header turns from 0
+	// to the entry size once the command is written.
+	struct Block {
+
+		Block *volatile next;
+		uint32_t reserved;
+		uint64_t data[BLOCK_SIZE / sizeof(uint64_t)];
+	};
+
+	Block *volatile write_block;
+	Block *read_block; // only touched by the thread that flushes
+	uint32_t read_offset;
+	Block *free_blocks; // consumed blocks, chained through next
 	SyncSemaphore sync_sems[SYNC_SEMAPHORES];
-	Mutex *mutex;
+	Mutex *block_mutex; // guards free_blocks and the block counts
 	Semaphore *sync;
 
-	template <class T>
-	T *allocate() {
-
-		// alloc size is size+T+safeguard
-		uint32_t alloc_size = sizeof(T) + sizeof(uint32_t);
+public:
+	struct Stats {
+
+		uint32_t blocks; // blocks holding commands
+		uint32_t max_blocks; // high-water mark of blocks
+		uint32_t allocated_blocks;
+		uint32_t producer_stalls; // pushes that waited on a block link or a sync semaphore
+		uint32_t consumer_stalls; // flushes that waited on a command being written
+		uint64_t flushed;
+	};
 
-	tryagain:
+private:
+	Stats stats;
 
-		if (write_ptr < dealloc_ptr) {
-			// behind dealloc_ptr, check that there is room
-			if ((dealloc_ptr - write_ptr) <= alloc_size) {
+	template <class T>
+	static _FORCE_INLINE_ uint32_t entry_size() {
 
-				// There is no more room, try to deallocate something
-				if (dealloc_one()) {
-					goto tryagain;
-				}
-				return NULL;
-			}
-		} else if (write_ptr >= dealloc_ptr) {
-			// ahead of dealloc_ptr, check that there is room
+		return ENTRY_HEADER + ((sizeof(T) + ENTRY_ALIGN - 1) & ~(ENTRY_ALIGN - 1));
+	}
 
-			if ((COMMAND_MEM_SIZE - write_ptr) < alloc_size + sizeof(uint32_t)) {
-				// no room at the end, wrap down;
+	template <class T>
+	T *allocate() {
 
-				if (dealloc_ptr == 0) { // don't want write_ptr to become dealloc_ptr
+		uint32_t size = entry_size<T>();
+		// if this happens, it's a bug
+		ERR_FAIL_COND_V(size > BLOCK_SIZE, NULL);
 
-					// There is no more room, try to deallocate something
-					if (dealloc_one()) {
-						goto tryagain;
-					}
-					return NULL;
-				}
+		while (true) {
 
-				// if this happens, it's a bug
-				ERR_FAIL_COND_V((COMMAND_MEM_SIZE - write_ptr) < sizeof(uint32_t), NULL);
-				// zero means, wrap to beginning
+			Block *block = write_block;
+			uint32_t end = atomic_add(&block->reserved, size);
+			uint32_t offset = end - size;
+			if (end <= BLOCK_SIZE) {
+				uint8_t *entry = (uint8_t *)block->data + offset;
+				return memnew_placement(entry + ENTRY_HEADER, T);
+			}
 
-				uint32_t *p = (uint32_t *)&command_mem[write_ptr];
-				*p = 0;
-				write_ptr = 0;
-				goto tryagain;
+			if (offset <= BLOCK_SIZE) {
+				_link_block(block, offset);
+			} else {
+				_wait_for_link(block);
 			}
 		}
-		// Allocate the size and the 'in use' bit.
-		// First bit used to mark if command is still in use (1)
-		// or if it has been destroyed and can be deallocated (0).
-		uint32_t *p = (uint32_t *)&command_mem[write_ptr];
-		*p = (sizeof(T) << 1) | 1;
-		write_ptr += sizeof(uint32_t);
-		// allocate the command
-		T *cmd = memnew_placement(&command_mem[write_ptr], T);
-		write_ptr += sizeof(T);
-		return cmd;
 	}
 
+	// makes the command visible to flush_one, after every field is written.
 	template <class T>
-	T *allocate_and_lock() {
+	_FORCE_INLINE_ void publish(T *p_cmd) {
 
-		lock();
-		T *ret;
-
-		while ((ret = allocate<T>()) == NULL) {
-
-			unlock();
-			// sleep a little until fetch happened and some room is made
-			wait_for_flush();
-			lock();
-		}
-
-		return ret;
+		uint32_t *header = (uint32_t *)((uint8_t *)p_cmd - ENTRY_HEADER);
+		atomic_add(header, entry_size<T>());
 	}
 
-	bool flush_one(bool p_lock = true) {
-		if (p_lock) lock();
-	tryagain:
+	bool flush_one() {
 
-		// tried to read an empty queue
-		if (read_ptr == write_ptr)
-			return false;
+		Block *block = read_block;
+		uint32_t *header;
+		uint32_t size;
 
-		uint32_t size_ptr = read_ptr;
-		uint32_t size = *(uint32_t *)&command_mem[read_ptr] >> 1;
+		while (true) {
 
-		if (size == 0) {
-			//end of ringbuffer, wrap
-			read_ptr = 0;
-			goto tryagain;
-		}
+			if (read_offset < BLOCK_SIZE) {
+				header = (uint32_t *)((uint8_t *)block->data + read_offset);
+				size = atomic_add(header, 0);
+				if (size != 0 && size != ENTRY_END)
+					break;
 
-		read_ptr += sizeof(uint32_t);
+				if (size == 0) {
+					// tried to read an empty queue
+					if (read_offset >= atomic_add(&block->reserved, 0))
+						return false;
+					// claimed, but still being written
+					_wait_for_publish();
+					continue;
+				}
+			} else if (atomic_add(&block->reserved, 0) <= BLOCK_SIZE) {
+				// full, and nothing claimed past it yet
+				return false;
+			}
 
-		CommandBase *cmd = reinterpret_cast<CommandBase *>(&command_mem[read_ptr]);
+			_next_block();
+			block = read_block;
+		}
 
-		read_ptr += size;
+		read_offset += size;
 
-		if (p_lock) unlock();
+		CommandBase *cmd = reinterpret_cast<CommandBase *>((uint8_t *)header + ENTRY_HEADER);
 		cmd->call();
-		if (p_lock) lock();
-
 		cmd->post();
 		cmd->~CommandBase();
-		*(uint32_t *)&command_mem[size_ptr] &= ~1;
-
-		if (p_lock) unlock();
+		atomic_increment(&stats.flushed);
 		return true;
 	}
 
-	void lock();
-	void unlock();
-	void wait_for_flush();
+	void _link_block(Block *p_block, uint32_t p_offset);
+	void _wait_for_link(Block *p_block);
+	void _wait_for_publish();
+	void _next_block();
 	SyncSemaphore *_alloc_sync_sem();
-	bool dealloc_one();
 
 public:
 	/* NORMAL PUSH COMMANDS */
@@ -442,21 +449,29 @@ public:
 	DECL_PUSH_AND_SYNC(0)
 	SPACE_SEP_LIST(DECL_PUSH_AND_SYNC, 12)
 
+	// flushing is for one thread at a time, pushes can come from any.
 	void wait_and_flush_one() {
 		ERR_FAIL_COND(!sync);
 		sync->wait();
 		flush_one();
 	}
 
+	// flushes whatever came in by the time the thread wakes up. pushes
+	// that find it busy leave posts behind that wake it with nothing to do.
+	void wait_and_flush() {
+		ERR_FAIL_COND(!sync);
+		sync->wait();
+		flush_all();
+	}
+
 	void flush_all() {
 
-		//ERR_FAIL_COND(sync);
-		lock();
-		while (flush_one(false))
+		while (flush_one())
 			;
-		unlock();
 	}
 
+	void get_stats(Stats *r_stats) const;
+
 	CommandQueueMT(bool p_sync);
 	~CommandQueueMT();
 };
@@ -30,42 +30,159 @@
 
 #include "dvector.h"
 
-Mutex *dvector_lock = NULL;
+#ifdef _MSC_VER
+#define POOL_VECTOR_THREAD_LOCAL __declspec(thread)
+#else
+#define POOL_VECTOR_THREAD_LOCAL __thread
+#endif
 
-PoolAllocator *MemoryPool::memory_pool = NULL;
-uint8_t *MemoryPool::pool_memory = NULL;
-size_t *MemoryPool::pool_size = NULL;
+MemoryPool::Stats MemoryPool::stats[MemoryPool::STATS_SLOTS];
+size_t MemoryPool::max_memory = 0;
 
-MemoryPool::Alloc *MemoryPool::allocs = NULL;
-MemoryPool::Alloc *MemoryPool::free_list = NULL;
-uint32_t MemoryPool::alloc_count = 0;
-uint32_t MemoryPool::allocs_used = 0;
-Mutex *MemoryPool::alloc_mutex = NULL;
+#ifdef DEBUG_ENABLED
 
-size_t MemoryPool::total_memory = 0;
-size_t MemoryPool::max_memory = 0;
+static POOL_VECTOR_THREAD_LOCAL MemoryPool::Stats *thread_stats = NULL;
+static uint32_t stats_assigned = 0;
 
-void MemoryPool::setup(uint32_t p_max_allocs) {
+static _FORCE_INLINE_ MemoryPool::Stats *_get_thread_stats() {
 
-	allocs = memnew_arr(Alloc, p_max_allocs);
-	alloc_count = p_max_allocs;
-	allocs_used = 0;
+	if (!thread_stats) {
+		// slots are handed out in order on a thread's first allocation
+		thread_stats = &MemoryPool::stats[(atomic_increment(&stats_assigned) - 1) % MemoryPool::STATS_SLOTS];
+	}
+	return thread_stats;
+}
 
-	for (uint32_t i = 0; i < alloc_count - 1; i++) {
+static size_t _sum_memory(uint32_t p_slots) {
 
-		allocs[i].free_list = &allocs[i + 1];
+	// slots wrap below zero when they free other threads' blocks, so they are
+	// added as signed values. the slots aren't read at one instant either, a
+	// free can be seen without the allocation it undoes.
+	int64_t total = 0;
+	for (uint32_t i = 0; i < p_slots; i++) {
+		total += (int64_t)MemoryPool::stats[i].memory;
 	}
+	return total > 0 ? (size_t)total : 0;
+}
 
-	free_list = &allocs[0];
+static void _update_max_memory() {
 
-	alloc_mutex = Mutex::create();
+	// only the slots handed out so far can hold memory, a stale count just
+	// leaves out a thread that is still on its first allocation.
+	uint32_t slots = MIN(stats_assigned, (uint32_t)MemoryPool::STATS_SLOTS);
+	atomic_exchange_if_greater(&MemoryPool::max_memory, _sum_memory(slots));
 }
 
-void MemoryPool::cleanup() {
+// the peak is only refreshed once a slot has grown by MAX_MEMORY_STEP since
+// its last refresh or its lowest point since, so most allocations touch
+// nothing but their own slot. a peak that rises less than that on each slot
+// can be missed.
+#define MAX_MEMORY_STEP (64 * 1024)
+
+static _FORCE_INLINE_ void _memory_grew(MemoryPool::Stats *p_stats) {
+
+	if ((int64_t)(p_stats->memory - p_stats->mark) >= MAX_MEMORY_STEP) {
+		p_stats->mark = p_stats->memory;
+		_update_max_memory();
+	}
+}
+
+static _FORCE_INLINE_ void _memory_shrank(MemoryPool::Stats *p_stats) {
+
+	if ((int64_t)(p_stats->memory - p_stats->mark) < 0) {
+		p_stats->mark = p_stats->memory;
+	}
+}
+
+#endif
+
+MemoryPool::Alloc *MemoryPool::allocate(size_t p_size) {
+
+	Alloc *alloc = (Alloc *)memalloc(DATA_OFFSET + p_size);
+	ERR_FAIL_COND_V(!alloc, NULL);
+
+	alloc->refcount.init();
+	alloc->lock = 0;
+	alloc->size = p_size;
+
+#ifdef DEBUG_ENABLED
+	Stats *s = _get_thread_stats();
+	atomic_add(&s->memory, (uint64_t)p_size);
+	atomic_increment(&s->allocs);
+	_memory_grew(s);
+#endif
+
+	return alloc;
+}
+
+MemoryPool::Alloc *MemoryPool::reallocate(Alloc *p_alloc, size_t p_size) {
 
-	memdelete_arr(allocs);
-	memdelete(alloc_mutex);
+	size_t old_size = p_alloc->size;
+	Alloc *alloc = (Alloc *)memrealloc(p_alloc, DATA_OFFSET + p_size);
+	if (!alloc) {
+		// a shrink can keep the old block, the caller already destroyed the elements
+		ERR_FAIL_COND_V(p_size > old_size, NULL);
+		alloc = p_alloc;
+	}
+
+	alloc->size = p_size;
+
+#ifdef DEBUG_ENABLED
+	Stats *s = _get_thread_stats();
+	if (p_size > old_size) {
+		atomic_add(&s->memory, (uint64_t)(p_size - old_size));
+		_memory_grew(s);
+	} else {
+		atomic_sub(&s->memory, (uint64_t)(old_size - p_size));
+		_memory_shrank(s);
+	}
+#endif
+
+	return alloc;
+}
+
+void MemoryPool::release(Alloc *p_alloc) {
+
+#ifdef DEBUG_ENABLED
+	// may be another thread's allocation, slots only add up to the total
+	Stats *s = _get_thread_stats();
+	atomic_sub(&s->memory, (uint64_t)p_alloc->size);
+	atomic_decrement(&s->allocs);
+	_memory_shrank(s);
+#endif
+
+	memfree(p_alloc);
+}
+
+size_t MemoryPool::get_total_memory() {
+
+#ifdef DEBUG_ENABLED
+	return _sum_memory(STATS_SLOTS);
+#else
+	return 0;
+#endif
+}
+
+size_t MemoryPool::get_max_memory() {
+
+#ifdef DEBUG_ENABLED
+	// also takes what allocations below MAX_MEMORY_STEP have added since
+	_update_max_memory();
+#endif
+	return atomic_add(&max_memory, 0);
+}
+
+uint32_t MemoryPool::get_allocs_used() {
+
+	uint32_t allocs = 0;
+	for (int i = 0; i < STATS_SLOTS; i++) {
+		allocs += stats[i].allocs;
+	}
+	return allocs;
+}
+
+void MemoryPool::cleanup() {
 
 	ERR_EXPLAINC("There are still MemoryPool allocs in use at exit!");
-	ERR_FAIL_COND(allocs_used > 0);
+	ERR_FAIL_COND(get_allocs_used() > 0);
 }
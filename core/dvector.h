@@ -34,46 +34,48 @@
 #include "os/copymem.h"
 #include "os/memory.h"
 #include "os/rw_lock.h"
-#include "pool_allocator.h"
 #include "safe_refcount.h"
 #include "ustring.h"
 
 struct MemoryPool {
 
-	//avoid accessing these directly, must be public for template access
-
-	static PoolAllocator *memory_pool;
-	static uint8_t *pool_memory;
-	static size_t *pool_size;
-
+	// header of a PoolVector allocation, the elements follow it in the same
+	// block. creating, copying and freeing one touches no shared state.
 	struct Alloc {
 
 		SafeRefCount refcount;
 		uint32_t lock;
-		void *mem;
-		PoolAllocator::ID pool_id;
 		size_t size;
+	};
 
-		Alloc *free_list;
+	enum {
+		DATA_OFFSET = (sizeof(Alloc) + 15) & ~15,
+		STATS_SLOTS = 64
+	};
 
-		Alloc() {
-			mem = NULL;
-			lock = 0;
-			pool_id = POOL_ALLOCATOR_INVALID_ID;
-			size = 0;
-			free_list = NULL;
-		}
+	// debug statistics, each thread counts into its own slot (threads past
+	// STATS_SLOTS share them) and the getters add the slots up.
+	struct Stats {
+
+		uint64_t memory; // read as signed, freeing another thread's block can take it below 0
+		uint64_t mark; // where memory stood when the peak was last refreshed
+		uint32_t allocs;
+		uint8_t pad[64 - 2 * sizeof(uint64_t) - sizeof(uint32_t)];
 	};
 
-	static Alloc *allocs;
-	static Alloc *free_list;
-	static uint32_t alloc_count;
-	static uint32_t allocs_used;
-	static Mutex *alloc_mutex;
-	static size_t total_memory;
+	static Stats stats[STATS_SLOTS];
 	static size_t max_memory;
 
-	static void setup(uint32_t p_max_allocs = (1 << 16));
+	static Alloc *allocate(size_t p_size);
+	static Alloc *reallocate(Alloc *p_alloc, size_t p_size);
+	static void release(Alloc *p_alloc);
+
+	_FORCE_INLINE_ static void *get_data(Alloc *p_alloc) { return (uint8_t *)p_alloc + DATA_OFFSET; }
+
+	static size_t get_total_memory();
+	static size_t get_max_memory(); // peak total, refreshed as allocations grow
+	static uint32_t get_allocs_used();
+
 	static void cleanup();
 };
 
@@ -86,53 +88,26 @@ class PoolVector {
 
 	MemoryPool::Alloc *alloc;
 
-	void _copy_on_write() {
+	Error _copy_on_write() {
 
 		if (!alloc)
-			return;
+			return OK;
 
 		//		ERR_FAIL_COND(alloc->lock>0); should not be illegal to lock this for copy on write, as it's a copy on write after all
 
 		// Refcount should not be zero, otherwise it's a misuse of COW
 		if (alloc->refcount.get() == 1)
-			return; //nothing to do
+			return OK; //nothing to do
 
 		//must allocate something
 
-		MemoryPool::alloc_mutex->lock();
-		if (MemoryPool::allocs_used == MemoryPool::alloc_count) {
-			MemoryPool::alloc_mutex->unlock();
-			ERR_EXPLAINC("All memory pool allocations are in use, can't COW.");
-			ERR_FAIL();
-		}
-
 		MemoryPool::Alloc *old_alloc = alloc;
 
-		//take one from the free list
-		alloc = MemoryPool::free_list;
-		MemoryPool::free_list = alloc->free_list;
-		//increment the used counter
-		MemoryPool::allocs_used++;
-
-		//copy the alloc data
-		alloc->size = old_alloc->size;
-		alloc->refcount.init();
-		alloc->pool_id = POOL_ALLOCATOR_INVALID_ID;
-		alloc->lock = 0;
-
-#ifdef DEBUG_ENABLED
-		MemoryPool::total_memory += alloc->size;
-		if (MemoryPool::total_memory > MemoryPool::max_memory) {
-			MemoryPool::max_memory = MemoryPool::total_memory;
-		}
-#endif
-
-		MemoryPool::alloc_mutex->unlock();
-
-		if (MemoryPool::memory_pool) {
-
-		} else {
-			alloc->mem = memalloc(alloc->size);
+		alloc = MemoryPool::allocate(old_alloc->size);
+		if (!alloc) {
+			alloc = old_alloc;
+			ERR_EXPLAINC("Out of memory, can't COW.");
+			ERR_FAIL_V(ERR_OUT_OF_MEMORY);
 		}
 
 		{
@@ -150,13 +125,7 @@ class PoolVector {
 		}
 
 		if (old_alloc->refcount.unref() == true) {
-		//this should never happen but..
-
-#ifdef DEBUG_ENABLED
-			MemoryPool::alloc_mutex->lock();
-			MemoryPool::total_memory -= old_alloc->size;
-			MemoryPool::alloc_mutex->unlock();
-#endif
+			//this should never happen but..
 
 			{
 				Write w;
@@ -169,23 +138,10 @@ class PoolVector {
 				}
 			}
 
-			if (MemoryPool::memory_pool) {
-				//resize memory pool
-				//if none, create
-				//if some resize
-			} else {
-
-				memfree(old_alloc->mem);
-				old_alloc->mem = NULL;
-				old_alloc->size = 0;
-
-				MemoryPool::alloc_mutex->lock();
-				old_alloc->free_list = MemoryPool::free_list;
-				MemoryPool::free_list = old_alloc;
-				MemoryPool::allocs_used--;
-				MemoryPool::alloc_mutex->unlock();
-			}
+			MemoryPool::release(old_alloc);
 		}
+
+		return OK;
 	}
 
 	void _reference(const PoolVector &p_dvector) {
@@ -231,29 +187,7 @@ class PoolVector {
 			}
 		}
 
-#ifdef DEBUG_ENABLED
-		MemoryPool::alloc_mutex->lock();
-		MemoryPool::total_memory -= alloc->size;
-		MemoryPool::alloc_mutex->unlock();
-#endif
-
-		if (MemoryPool::memory_pool) {
-			//resize memory pool
-			//if none, create
-			//if some resize
-		} else {
-
-			memfree(alloc->mem);
-			alloc->mem = NULL;
-			alloc->size = 0;
-
-			MemoryPool::alloc_mutex->lock();
-			alloc->free_list = MemoryPool::free_list;
-			MemoryPool::free_list = alloc;
-			MemoryPool::allocs_used--;
-			MemoryPool::alloc_mutex->unlock();
-		}
-
+		MemoryPool::release(alloc);
 		alloc = NULL;
 	}
 
@@ -268,25 +202,15 @@ public:
 		_FORCE_INLINE_ void _ref(MemoryPool::Alloc *p_alloc) {
 			alloc = p_alloc;
 			if (alloc) {
-				if (atomic_increment(&alloc->lock) == 1) {
-					if (MemoryPool::memory_pool) {
-						//lock it and get mem
-					}
-				}
-
-				mem = (T *)alloc->mem;
+				atomic_increment(&alloc->lock);
+				mem = (T *)MemoryPool::get_data(alloc);
 			}
 		}
 
 		_FORCE_INLINE_ void _unref() {
 
 			if (alloc) {
-				if (atomic_decrement(&alloc->lock) == 0) {
-					if (MemoryPool::memory_pool) {
-						//put mem back
-					}
-				}
-
+				atomic_decrement(&alloc->lock);
 				mem = NULL;
 				alloc = NULL;
 			}
@@ -511,76 +435,51 @@ const T PoolVector<T>::operator[](int p_index) const {
 template <class T>
 Error PoolVector<T>::resize(int p_size) {
 
+	size_t new_size = sizeof(T) * p_size;
+	int cur_elements = 0;
+
 	if (alloc == NULL) {
 
 		if (p_size == 0)
 			return OK; //nothing to do here
 
 		//must allocate something
-		MemoryPool::alloc_mutex->lock();
-		if (MemoryPool::allocs_used == MemoryPool::alloc_count) {
-			MemoryPool::alloc_mutex->unlock();
-			ERR_EXPLAINC("All memory pool allocations are in use.");
-			ERR_FAIL_V(ERR_OUT_OF_MEMORY);
-		}
-
-		//take one from the free list
-		alloc = MemoryPool::free_list;
-		MemoryPool::free_list = alloc->free_list;
-		//increment the used counter
-		MemoryPool::allocs_used++;
-
-		//cleanup the alloc
-		alloc->size = 0;
-		alloc->refcount.init();
-		alloc->pool_id = POOL_ALLOCATOR_INVALID_ID;
-		MemoryPool::alloc_mutex->unlock();
+		alloc = MemoryPool::allocate(new_size);
+		ERR_FAIL_COND_V(!alloc, ERR_OUT_OF_MEMORY);
 
 	} else {
 
 		ERR_FAIL_COND_V(alloc->lock > 0, ERR_LOCKED); //can't resize if locked!
-	}
 
-	size_t new_size = sizeof(T) * p_size;
-
-	if (alloc->size == new_size)
-		return OK; //nothing to do
+		if (alloc->size == new_size)
+			return OK; //nothing to do
 
-	if (p_size == 0) {
-		_unreference();
-		return OK;
-	}
-
-	_copy_on_write(); // make it unique
+		if (p_size == 0) {
+			_unreference();
+			return OK;
+		}
 
-#ifdef DEBUG_ENABLED
-	MemoryPool::alloc_mutex->lock();
-	MemoryPool::total_memory -= alloc->size;
-	MemoryPool::total_memory += new_size;
-	if (MemoryPool::total_memory > MemoryPool::max_memory) {
-		MemoryPool::max_memory = MemoryPool::total_memory;
-	}
-	MemoryPool::alloc_mutex->unlock();
-#endif
+		// make it unique, the block may move below
+		Error err = _copy_on_write();
+		ERR_FAIL_COND_V(err != OK, err);
 
-	int cur_elements = alloc->size / sizeof(T);
+		cur_elements = alloc->size / sizeof(T);
 
-	if (p_size > cur_elements) {
+		if (p_size < cur_elements) {
 
-		if (MemoryPool::memory_pool) {
-			//resize memory pool
-			//if none, create
-			//if some resize
-		} else {
+			Write w = write();
+			for (int i = p_size; i < cur_elements; i++) {
 
-			if (alloc->size == 0) {
-				alloc->mem = memalloc(new_size);
-			} else {
-				alloc->mem = memrealloc(alloc->mem, new_size);
+				w[i].~T();
 			}
 		}
 
-		alloc->size = new_size;
+		MemoryPool::Alloc *new_alloc = MemoryPool::reallocate(alloc, new_size);
+		ERR_FAIL_COND_V(!new_alloc, ERR_OUT_OF_MEMORY);
+		alloc = new_alloc;
+	}
+
+	if (p_size > cur_elements) {
 
 		Write w = write();
 
@@ -588,39 +487,6 @@ Error PoolVector<T>::resize(int p_size) {
 
 			memnew_placement(&w[i], T);
 		}
-
-	} else {
-
-		{
-			Write w = write();
-			for (int i = p_size; i < cur_elements; i++) {
-
-				w[i].~T();
-			}
-		}
-
-		if (MemoryPool::memory_pool) {
-			//resize memory pool
-			//if none, create
-			//if some resize
-		} else {
-
-			if (new_size == 0) {
-				memfree(alloc->mem);
-				alloc->mem = NULL;
-				alloc->size = 0;
-
-				MemoryPool::alloc_mutex->lock();
-				alloc->free_list = MemoryPool::free_list;
-				MemoryPool::free_list = alloc;
-				MemoryPool::allocs_used--;
-				MemoryPool::alloc_mutex->unlock();
-
-			} else {
-				alloc->mem = memrealloc(alloc->mem, new_size);
-				alloc->size = new_size;
-			}
-		}
 	}
 
 	return OK;
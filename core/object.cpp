@@ -1910,56 +1910,243 @@ void postinitialize_handler(Object *p_object) {
 	p_object->_postinitialize();
 }
 
-HashMap<ObjectID, Object *> ObjectDB::instances;
-ObjectID ObjectDB::instance_counter = 1;
-HashMap<Object *, ObjectID, ObjectDB::ObjectPtrHash> ObjectDB::instance_checks;
+#ifdef _MSC_VER
+#define OBJECTDB_THREAD_LOCAL __declspec(thread)
+#else
+#define OBJECTDB_THREAD_LOCAL __thread
+#endif
+
+ObjectDB::Shard ObjectDB::shards[SHARDS];
+ObjectDB::Reader ObjectDB::readers[READER_SLOTS];
+
+static OBJECTDB_THREAD_LOCAL uint32_t *thread_reader = NULL;
+static uint32_t readers_assigned = 0;
+
+#define OBJECTDB_REMOVED ((Object *)1) // a removed object in the checks
+
+ObjectDB::Table *ObjectDB::_alloc_table(uint32_t p_len) {
+
+	Table *table = memnew(Table);
+	table->mask = p_len - 1;
+	table->check_mask = p_len * 2 - 1;
+	table->removed = 0;
+	table->next = NULL;
+	table->slots = (Slot *)memalloc(sizeof(Slot) * p_len);
+	for (uint32_t i = 0; i < p_len; i++) {
+
+		table->slots[i].id = 0;
+		table->slots[i].object = NULL;
+	}
+	table->checks = NULL;
+#ifdef DEBUG_ENABLED
+	table->checks = (Object *volatile *)memalloc(sizeof(Object *) * p_len * 2);
+	for (uint32_t i = 0; i < p_len * 2; i++) {
+
+		table->checks[i] = NULL;
+	}
+#endif
+	return table;
+}
+
+void ObjectDB::_free_table(Table *p_table) {
+
+	memfree(p_table->slots);
+	if (p_table->checks)
+		memfree((void *)p_table->checks);
+	memdelete(p_table);
+}
+
+// moves the live objects to a clean table, twice the size if they fill
+// a quarter of the slots. lookups still on the old one see it as it was.
+void ObjectDB::_rebuild(Shard &p_shard) {
+
+	Table *old = p_shard.table;
+	uint32_t len = old->mask + 1;
+	if (p_shard.count >= len / 4)
+		len *= 2;
+
+	Table *table = _alloc_table(len);
+	for (uint32_t i = 0; i <= old->mask; i++) {
+
+		Slot &slot = old->slots[i];
+		if (!slot.object)
+			continue;
+
+		// live IDs differ in their low bits, so they still do with more of them
+		Slot &to = table->slots[(slot.id >> SHARD_BITS) & table->mask];
+		to.object = slot.object;
+		to.id = slot.id;
+#ifdef DEBUG_ENABLED
+		uint32_t idx = (ObjectPtrHash::hash(slot.object) >> SHARD_BITS) & table->check_mask;
+		while (table->checks[idx]) {
+			idx = (idx + 1) & table->check_mask;
+		}
+		table->checks[idx] = slot.object;
+#endif
+	}
+
+	// full barrier, the table is complete before lookups can reach it
+	atomic_add(&p_shard.count, 0);
+	p_shard.table = table;
+
+	old->next = p_shard.retired;
+	p_shard.retired = old;
+}
+
+_FORCE_INLINE_ uint32_t *ObjectDB::_get_reader() {
+
+	if (unlikely(!thread_reader)) {
+		// slots are handed out round robin on a thread's first lookup
+		thread_reader = &readers[atomic_increment(&readers_assigned) % READER_SLOTS].count;
+	}
+	return thread_reader;
+}
+
+// a lookup counts itself before it loads the table, so a slot seen at 0
+// after a table was retired has no lookup left that could be on it.
+void ObjectDB::_reclaim(Shard &p_shard) {
+
+	if (!p_shard.retired)
+		return;
+
+	for (int i = 0; i < READER_SLOTS; i++) {
+
+		if (atomic_add(&readers[i].count, 0) != 0)
+			return;
+	}
+
+	while (p_shard.retired) {
+
+		Table *table = p_shard.retired;
+		p_shard.retired = table->next;
+		_free_table(table);
+	}
+}
+
 ObjectID ObjectDB::add_instance(Object *p_object) {
 
 	ERR_FAIL_COND_V(p_object->get_instance_id() != 0, 0);
 
-	rw_lock->write_lock();
-	instances[++instance_counter] = p_object;
+	uint32_t hash = ObjectPtrHash::hash(p_object);
+	uint32_t shard_idx = hash & (SHARDS - 1);
+	Shard &shard = shards[shard_idx];
+	shard.lock->lock();
+
+	Table *table = shard.table;
+	if ((shard.count + table->removed + 1) * 2 > table->mask + 1) {
+		_rebuild(shard);
+		table = shard.table;
+	}
+	_reclaim(shard);
+
+	// at most half the slots are taken, this is a step or two
+	Slot *slot;
+	do {
+		shard.counter++;
+		slot = &table->slots[shard.counter & table->mask];
+	} while (slot->id);
+
+	ObjectID id = (shard.counter << SHARD_BITS) | shard_idx;
+	slot->object = p_object;
+	// full barrier, the object is there before its ID is
+	atomic_increment(&shard.count);
+	slot->id = id;
+
 #ifdef DEBUG_ENABLED
-	instance_checks[p_object] = instance_counter;
+	uint32_t idx = (hash >> SHARD_BITS) & table->check_mask;
+	while (table->checks[idx]) {
+		idx = (idx + 1) & table->check_mask;
+	}
+	table->checks[idx] = p_object;
 #endif
-	rw_lock->write_unlock();
 
-	return instance_counter;
+	shard.lock->unlock();
+
+	return id;
 }
 
 void ObjectDB::remove_instance(Object *p_object) {
 
-	rw_lock->write_lock();
+	ObjectID id = p_object->get_instance_id();
+	Shard &shard = shards[id & (SHARDS - 1)];
+	shard.lock->lock();
+
+	Table *table = shard.table;
+	Slot &slot = table->slots[(id >> SHARD_BITS) & table->mask];
+	if (slot.id != id || slot.object != p_object) {
+		shard.lock->unlock();
+		ERR_FAIL();
+	}
+	// the slot is taken until the table is rebuilt
+	slot.object = NULL;
 
-	instances.erase(p_object->get_instance_id());
 #ifdef DEBUG_ENABLED
-	instance_checks.erase(p_object);
+	uint32_t idx = (ObjectPtrHash::hash(p_object) >> SHARD_BITS) & table->check_mask;
+	while (table->checks[idx] != p_object) {
+		idx = (idx + 1) & table->check_mask;
+	}
+	table->checks[idx] = OBJECTDB_REMOVED;
 #endif
 
-	rw_lock->write_unlock();
+	table->removed++;
+	atomic_decrement(&shard.count);
+	_reclaim(shard);
+
+	shard.lock->unlock();
 }
+
 Object *ObjectDB::get_instance(ObjectID p_instance_ID) {
 
-	rw_lock->read_lock();
-	Object **obj = instances.getptr(p_instance_ID);
-	rw_lock->read_unlock();
+	Shard &shard = shards[p_instance_ID & (SHARDS - 1)];
+
+	uint32_t *reader = _get_reader();
+	atomic_increment(reader);
+	Table *table = shard.table;
+	Slot &slot = table->slots[(p_instance_ID >> SHARD_BITS) & table->mask];
+	Object *obj = slot.id == p_instance_ID ? slot.object : NULL;
+	atomic_decrement(reader);
 
-	if (!obj)
-		return NULL;
-	return *obj;
+	return obj;
 }
 
-void ObjectDB::debug_objects(DebugFunc p_func) {
+#ifdef DEBUG_ENABLED
+bool ObjectDB::instance_validate(Object *p_ptr) {
 
-	rw_lock->read_lock();
+	if (!p_ptr)
+		return false;
 
-	const ObjectID *K = NULL;
-	while ((K = instances.next(K))) {
+	uint32_t hash = ObjectPtrHash::hash(p_ptr);
+	Shard &shard = shards[hash & (SHARDS - 1)];
 
-		p_func(instances[*K]);
+	uint32_t *reader = _get_reader();
+	atomic_increment(reader);
+	Table *table = shard.table;
+	uint32_t idx = (hash >> SHARD_BITS) & table->check_mask;
+	Object *check;
+	while ((check = table->checks[idx]) && check != p_ptr) {
+		idx = (idx + 1) & table->check_mask;
 	}
+	atomic_decrement(reader);
 
-	rw_lock->read_unlock();
+	return check != NULL;
+}
+#endif
+
+void ObjectDB::debug_objects(DebugFunc p_func) {
+
+	for (int i = 0; i < SHARDS; i++) {
+
+		shards[i].lock->lock();
+
+		Table *table = shards[i].table;
+		for (uint32_t j = 0; j <= table->mask; j++) {
+
+			if (table->slots[j].object)
+				p_func(table->slots[j].object);
+		}
+
+		shards[i].lock->unlock();
+	}
 }
 
 void Object::get_argument_options(const StringName &p_function, int p_idx, List<String> *r_options) const {
@@ -1967,42 +2154,66 @@ void Object::get_argument_options(const StringName &p_function, int p_idx, List<
 
 int ObjectDB::get_object_count() {
 
-	rw_lock->read_lock();
-	int count = instances.size();
-	rw_lock->read_unlock();
+	int count = 0;
+	for (int i = 0; i < SHARDS; i++) {
+
+		count += atomic_add(&shards[i].count, 0);
+	}
 
 	return count;
 }
 
-RWLock *ObjectDB::rw_lock = NULL;
-
 void ObjectDB::setup() {
 
-	rw_lock = RWLock::create();
+	for (int i = 0; i < SHARDS; i++) {
+
+		Shard &shard = shards[i];
+		shard.table = _alloc_table(TABLE_MIN_LEN);
+		shard.count = 0;
+		shard.counter = 0;
+		shard.lock = Mutex::create();
+		shard.retired = NULL;
+	}
 }
 
 void ObjectDB::cleanup() {
 
-	rw_lock->write_lock();
-	if (instances.size()) {
+	if (get_object_count()) {
 
 		WARN_PRINT("ObjectDB Instances still exist!");
 		if (OS::get_singleton()->is_stdout_verbose()) {
-			const ObjectID *K = NULL;
-			while ((K = instances.next(K))) {
-
-				String node_name;
-				if (instances[*K]->is_class("Node"))
-					node_name = " - Node Name: " + String(instances[*K]->call("get_name"));
-				if (instances[*K]->is_class("Resource"))
-					node_name = " - Resource Name: " + String(instances[*K]->call("get_name")) + " Path: " + String(instances[*K]->call("get_path"));
-				print_line("Leaked Instance: " + String(instances[*K]->get_class()) + ":" + itos(*K) + node_name);
+			for (int i = 0; i < SHARDS; i++) {
+
+				Table *table = shards[i].table;
+				for (uint32_t j = 0; j <= table->mask; j++) {
+
+					Object *obj = table->slots[j].object;
+					if (!obj)
+						continue;
+
+					String node_name;
+					if (obj->is_class("Node"))
+						node_name = " - Node Name: " + String(obj->call("get_name"));
+					if (obj->is_class("Resource"))
+						node_name = " - Resource Name: " + String(obj->call("get_name")) + " Path: " + String(obj->call("get_path"));
+					print_line("Leaked Instance: " + String(obj->get_class()) + ":" + itos(table->slots[j].id) + node_name);
+				}
 			}
 		}
 	}
-	instances.clear();
-	instance_checks.clear();
-	rw_lock->write_unlock();
 
-	memdelete(rw_lock);
+	for (int i = 0; i < SHARDS; i++) {
+
+		Shard &shard = shards[i];
+		// lookups are over by now, whatever the reader slots say
+		while (shard.retired) {
+
+			Table *table = shard.retired;
+			shard.retired = table->next;
+			_free_table(table);
+		}
+		_free_table(shard.table);
+		shard.table = NULL;
+		memdelete(shard.lock);
+	}
 }
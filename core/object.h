@@ -33,6 +33,7 @@
 
 #include "list.h"
 #include "map.h"
+#include "os/mutex.h"
 #include "os/rw_lock.h"
 #include "set.h"
 #include "variant.h"
@@ -741,14 +742,66 @@ class ObjectDB {
 		}
 	};
 
-	static HashMap<ObjectID, Object *> instances;
-	static HashMap<Object *, ObjectID, ObjectPtrHash> instance_checks;
+	enum {
+		SHARD_BITS = 4,
+		SHARDS = 1 << SHARD_BITS,
+		TABLE_MIN_LEN = 256, // slots per shard
+		READER_SLOTS = 64
+	};
+
+	// an ObjectID is a shard's counter shifted over the shard index, and
+	// the counter's low bits are the object's slot in the shard's table.
+	// the counter skips values whose slot is taken, so IDs are never
+	// reused and lookups need no lock, just one compare. a removed
+	// object's slot keeps its ID until the table is rebuilt, so a lookup
+	// can only ever find that object or nothing.
+	struct Slot {
+		volatile ObjectID id; // 0 while free
+		Object *volatile object; // NULL once removed
+	};
+
+	// slots and, for instance_validate, an open addressed set of the
+	// shard's objects. both are kept at most half full, counting the
+	// removed objects, then rebuilt.
+	struct Table {
+		uint32_t mask;
+		uint32_t check_mask; // checks are twice the slots
+		uint32_t removed;
+		Table *next; // while retired
+		Slot *slots;
+		Object *volatile *checks;
+	};
+
+	// replaced tables are retired, and freed by a later add or remove
+	// once no thread is inside a lookup.
+	struct Shard {
+		Table *volatile table;
+		uint32_t count;
+		ObjectID counter;
+		Mutex *lock; // adds and removes
+		Table *retired;
+		uint8_t pad[24]; // one shard per cache line
+	};
+
+	// lookups in progress on a thread. every thread counts in a slot of
+	// its own (threads past READER_SLOTS share them), so lookups don't
+	// write to a cache line other threads use.
+	struct Reader {
+		uint32_t count;
+		uint8_t pad[60];
+	};
+
+	static Shard shards[SHARDS];
+	static Reader readers[READER_SLOTS];
 
-	static ObjectID instance_counter;
 	friend class Object;
 	friend void unregister_core_types();
 
-	static RWLock *rw_lock;
+	static Table *_alloc_table(uint32_t p_len);
+	static void _free_table(Table *p_table);
+	static void _rebuild(Shard &p_shard);
+	static uint32_t *_get_reader();
+	static void _reclaim(Shard &p_shard);
 	static void cleanup();
 	static ObjectID add_instance(Object *p_object);
 	static void remove_instance(Object *p_object);
@@ -763,10 +816,7 @@ public:
 	static int get_object_count();
 
 #ifdef DEBUG_ENABLED
-	_FORCE_INLINE_ static bool instance_validate(Object *p_ptr) {
-
-		return instance_checks.has(p_ptr);
-	}
+	static bool instance_validate(Object *p_ptr);
 #else
 	_FORCE_INLINE_ static bool instance_validate(Object *p_ptr) { return true; }
 
@@ -32,6 +32,7 @@
 #include "copymem.h"
 #include "core/safe_refcount.h"
 #include "error_macros.h"
+#include "size_class_allocator.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -74,13 +75,18 @@ uint64_t Memory::alloc_count = 0;
 
 void *Memory::alloc_static(size_t p_bytes, bool p_pad_align) {
 
-#ifdef DEBUG_ENABLED
+#if defined(DEBUG_ENABLED) || defined(SIZE_CLASS_ALLOCATOR_ENABLED)
 	bool prepad = true;
 #else
 	bool prepad = p_pad_align;
 #endif
 
+#ifdef SIZE_CLASS_ALLOCATOR_ENABLED
+	// the allocator needs the size back on free, prepad is always on
+	void *mem = SizeClassAllocator::alloc(p_bytes + PAD_ALIGN);
+#else
 	void *mem = malloc(p_bytes + (prepad ? PAD_ALIGN : 0));
+#endif
 
 	ERR_FAIL_COND_V(!mem, NULL);
 
@@ -110,7 +116,7 @@ void *Memory::realloc_static(void *p_memory, size_t p_bytes, bool p_pad_align) {
 
 	uint8_t *mem = (uint8_t *)p_memory;
 
-#ifdef DEBUG_ENABLED
+#if defined(DEBUG_ENABLED) || defined(SIZE_CLASS_ALLOCATOR_ENABLED)
 	bool prepad = true;
 #else
 	bool prepad = p_pad_align;
@@ -130,12 +136,20 @@ void *Memory::realloc_static(void *p_memory, size_t p_bytes, bool p_pad_align) {
 #endif
 
 		if (p_bytes == 0) {
+#ifdef SIZE_CLASS_ALLOCATOR_ENABLED
+			SizeClassAllocator::free(mem, *s + PAD_ALIGN);
+#else
 			free(mem);
+#endif
 			return NULL;
 		} else {
+#ifdef SIZE_CLASS_ALLOCATOR_ENABLED
+			mem = (uint8_t *)SizeClassAllocator::realloc(mem, *s + PAD_ALIGN, p_bytes + PAD_ALIGN);
+#else
 			*s = p_bytes;
 
 			mem = (uint8_t *)realloc(mem, p_bytes + PAD_ALIGN);
+#endif
 			ERR_FAIL_COND_V(!mem, NULL);
 
 			s = (uint64_t *)mem;
@@ -160,7 +174,7 @@ void Memory::free_static(void *p_ptr, bool p_pad_align) {
 
 	uint8_t *mem = (uint8_t *)p_ptr;
 
-#ifdef DEBUG_ENABLED
+#if defined(DEBUG_ENABLED) || defined(SIZE_CLASS_ALLOCATOR_ENABLED)
 	bool prepad = true;
 #else
 	bool prepad = p_pad_align;
@@ -176,7 +190,11 @@ void Memory::free_static(void *p_ptr, bool p_pad_align) {
 		atomic_sub(&mem_usage, *s);
 #endif
 
+#ifdef SIZE_CLASS_ALLOCATOR_ENABLED
+		SizeClassAllocator::free(mem, *s + PAD_ALIGN);
+#else
 		free(mem);
+#endif
 	} else {
 
 		free(mem);
@@ -394,7 +394,7 @@ int OS::get_static_memory_usage() const {
 }
 int OS::get_dynamic_memory_usage() const {
 
-	return MemoryPool::total_memory;
+	return MemoryPool::get_total_memory();
 }
 
 int OS::get_static_memory_peak_usage() const {
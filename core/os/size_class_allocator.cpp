@@ -0,0 +1,343 @@
+/*************************************************************************/
+/*  size_class_allocator.cpp                                             */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2018 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2018 Godot Engine contributors (cf. AUTHORS.md)    */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "size_class_allocator.h"
+
+#include "safe_refcount.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef _MSC_VER
+#define SIZE_CLASS_THREAD_LOCAL __declspec(thread)
+#else
+#define SIZE_CLASS_THREAD_LOCAL __thread
+#endif
+
+// everything below is plain data, so the allocator works before static
+// constructors run and without the OS for locks.
+
+enum {
+	ARENA_SIZE = 1024 * 1024,
+	BATCH_BYTES = 8192, // moved between a thread and the shared lists at once
+	BATCH_MIN = 2,
+	BATCH_MAX = 64,
+	CACHE_BATCHES = 2 // a thread gives a batch back past this many
+};
+
+// a free block. the first block of a batch chains the batches.
+struct SizeClassBlock {
+	SizeClassBlock *next;
+	SizeClassBlock *next_batch;
+};
+
+struct SizeClassCache {
+	SizeClassBlock *blocks[SizeClassAllocator::CLASS_COUNT];
+	uint32_t counts[SizeClassAllocator::CLASS_COUNT];
+	bool watched; // the thread's end drains the cache
+};
+
+struct SizeClassShared {
+	uint32_t lock;
+	uint32_t batch_count;
+	SizeClassBlock *batches;
+	uint8_t pad[48]; // one class per cache line
+};
+
+static SIZE_CLASS_THREAD_LOCAL SizeClassCache thread_cache;
+static SizeClassShared shared_classes[SizeClassAllocator::CLASS_COUNT];
+
+#ifdef _WIN32
+static DWORD cache_key = FLS_OUT_OF_INDEXES;
+#else
+static pthread_key_t cache_key;
+#endif
+static uint32_t cache_key_lock = 0;
+static bool cache_key_created = false;
+
+static uint32_t arena_lock = 0;
+static uint8_t *arena_ptr = NULL;
+static uint32_t arena_left = 0;
+static uint64_t arena_bytes = 0;
+static uint64_t carved_bytes = 0;
+static uint32_t arena_count = 0;
+
+// the lock holders only splice lists or bump a pointer
+static _FORCE_INLINE_ void _lock(uint32_t *p_lock) {
+
+	while (atomic_increment(p_lock) != 1) {
+		atomic_decrement(p_lock);
+		while (*(volatile uint32_t *)p_lock) {
+		}
+	}
+}
+
+static _FORCE_INLINE_ void _unlock(uint32_t *p_lock) {
+
+	atomic_decrement(p_lock);
+}
+
+// 16 byte steps up to 256, then four classes per power of two.
+static _FORCE_INLINE_ uint32_t _class_of(size_t p_bytes) {
+
+	if (p_bytes <= 256)
+		return p_bytes ? (uint32_t)(p_bytes + 15) / 16 - 1 : 0;
+
+	uint32_t n = (uint32_t)p_bytes - 1;
+	uint32_t shift = 8;
+	while (n >> (shift + 1))
+		shift++;
+	return 16 + (shift - 8) * 4 + ((n >> (shift - 2)) & 3);
+}
+
+static _FORCE_INLINE_ uint32_t _class_size(uint32_t p_class) {
+
+	if (p_class < 16)
+		return (p_class + 1) * 16;
+
+	uint32_t shift = 8 + (p_class - 16) / 4;
+	return (1 << shift) + ((p_class - 16) % 4 + 1) * (1 << (shift - 2));
+}
+
+static _FORCE_INLINE_ uint32_t _batch_len(uint32_t p_class) {
+
+	uint32_t len = BATCH_BYTES / _class_size(p_class);
+	return CLAMP(len, (uint32_t)BATCH_MIN, (uint32_t)BATCH_MAX);
+}
+
+static SizeClassBlock *_carve(uint32_t p_class, uint32_t *r_count) {
+
+	uint32_t size = _class_size(p_class);
+	uint32_t len = _batch_len(p_class);
+	uint32_t bytes = size * len;
+
+	_lock(&arena_lock);
+	if (arena_left < bytes) {
+		// the rest of the old arena is lost, it's less than a batch
+		uint8_t *arena = (uint8_t *)::malloc(ARENA_SIZE);
+		if (!arena) {
+			_unlock(&arena_lock);
+			return NULL;
+		}
+		arena_ptr = arena;
+		arena_left = ARENA_SIZE;
+		arena_bytes += ARENA_SIZE;
+		arena_count++;
+	}
+	uint8_t *mem = arena_ptr;
+	arena_ptr += bytes;
+	arena_left -= bytes;
+	carved_bytes += bytes;
+	_unlock(&arena_lock);
+
+	for (uint32_t i = 0; i < len; i++) {
+
+		SizeClassBlock *block = (SizeClassBlock *)(mem + i * size);
+		block->next = i + 1 < len ? (SizeClassBlock *)(mem + (i + 1) * size) : NULL;
+	}
+	*r_count = len;
+	return (SizeClassBlock *)mem;
+}
+
+static void _watch_thread();
+
+static SizeClassBlock *_refill(uint32_t p_class) {
+
+	SizeClassShared &shared = shared_classes[p_class];
+
+	_lock(&shared.lock);
+	SizeClassBlock *batch = shared.batches;
+	if (batch) {
+		shared.batches = batch->next_batch;
+		shared.batch_count--;
+	}
+	_unlock(&shared.lock);
+
+	uint32_t count = 0;
+	if (batch) {
+		for (SizeClassBlock *block = batch; block; block = block->next) {
+			count++;
+		}
+	} else {
+		batch = _carve(p_class, &count);
+	}
+
+	thread_cache.blocks[p_class] = batch;
+	thread_cache.counts[p_class] = count;
+	if (unlikely(!thread_cache.watched))
+		_watch_thread();
+	return batch;
+}
+
+// gives up to a batch of the thread's blocks of the class back.
+static void _flush(uint32_t p_class) {
+
+	SizeClassBlock *batch = thread_cache.blocks[p_class];
+	uint32_t len = MIN(_batch_len(p_class), thread_cache.counts[p_class]);
+
+	SizeClassBlock *last = batch;
+	for (uint32_t i = 1; i < len; i++) {
+		last = last->next;
+	}
+	thread_cache.blocks[p_class] = last->next;
+	thread_cache.counts[p_class] -= len;
+	last->next = NULL;
+
+	SizeClassShared &shared = shared_classes[p_class];
+
+	_lock(&shared.lock);
+	batch->next_batch = shared.batches;
+	shared.batches = batch;
+	shared.batch_count++;
+	_unlock(&shared.lock);
+}
+
+void *SizeClassAllocator::alloc(size_t p_bytes) {
+
+	if (p_bytes > SMALL_MAX)
+		return ::malloc(p_bytes);
+
+	uint32_t c = _class_of(p_bytes);
+	SizeClassBlock *block = thread_cache.blocks[c];
+	if (!block) {
+		block = _refill(c);
+		if (!block)
+			return NULL;
+	}
+
+	thread_cache.blocks[c] = block->next;
+	thread_cache.counts[c]--;
+	return block;
+}
+
+void *SizeClassAllocator::realloc(void *p_mem, size_t p_old_bytes, size_t p_bytes) {
+
+	bool small = p_bytes <= SMALL_MAX;
+	bool old_small = p_old_bytes <= SMALL_MAX;
+
+	if (!small && !old_small)
+		return ::realloc(p_mem, p_bytes);
+
+	if (small && old_small && _class_of(p_bytes) == _class_of(p_old_bytes))
+		return p_mem;
+
+	void *mem = alloc(p_bytes);
+	if (!mem)
+		return NULL;
+	memcpy(mem, p_mem, MIN(p_bytes, p_old_bytes));
+	free(p_mem, p_old_bytes);
+	return mem;
+}
+
+void SizeClassAllocator::free(void *p_mem, size_t p_bytes) {
+
+	if (p_bytes > SMALL_MAX) {
+		::free(p_mem);
+		return;
+	}
+
+	uint32_t c = _class_of(p_bytes);
+	SizeClassBlock *block = (SizeClassBlock *)p_mem;
+	block->next = thread_cache.blocks[c];
+	thread_cache.blocks[c] = block;
+	thread_cache.counts[c]++;
+	if (unlikely(!thread_cache.watched))
+		_watch_thread();
+
+	if (thread_cache.counts[c] > CACHE_BATCHES * _batch_len(c))
+		_flush(c);
+}
+
+// hands the blocks of an ending thread's cache to the shared lists, they
+// would be lost otherwise. runs for every thread, however it was started.
+#ifdef _WIN32
+static VOID WINAPI _thread_ended(PVOID p_value) {
+#else
+static void _thread_ended(void *p_value) {
+#endif
+
+	for (uint32_t c = 0; c < SizeClassAllocator::CLASS_COUNT; c++) {
+
+		while (thread_cache.blocks[c]) {
+			_flush(c);
+		}
+	}
+	// a later destructor that frees memory watches the thread again, and
+	// pthreads calls this once more for it
+	thread_cache.watched = false;
+}
+
+// arranges for _thread_ended to run when the calling thread ends, the first
+// time its cache holds blocks.
+static void _watch_thread() {
+
+	_lock(&cache_key_lock);
+	if (!cache_key_created) {
+#ifdef _WIN32
+		cache_key = FlsAlloc(_thread_ended);
+		cache_key_created = cache_key != FLS_OUT_OF_INDEXES;
+#else
+		cache_key_created = pthread_key_create(&cache_key, _thread_ended) == 0;
+#endif
+	}
+	_unlock(&cache_key_lock);
+
+	if (!cache_key_created)
+		return;
+
+	// any value but NULL, the destructor only runs for those
+#ifdef _WIN32
+	FlsSetValue(cache_key, &thread_cache);
+#else
+	pthread_setspecific(cache_key, &thread_cache);
+#endif
+	thread_cache.watched = true;
+}
+
+void SizeClassAllocator::get_stats(Stats *r_stats) {
+
+	_lock(&arena_lock);
+	r_stats->arena_bytes = arena_bytes;
+	r_stats->carved_bytes = carved_bytes;
+	r_stats->arenas = arena_count;
+	_unlock(&arena_lock);
+
+	r_stats->shared_batches = 0;
+	for (uint32_t c = 0; c < CLASS_COUNT; c++) {
+
+		r_stats->shared_batches += atomic_add(&shared_classes[c].batch_count, 0);
+	}
+}
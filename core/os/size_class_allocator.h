@@ -0,0 +1,70 @@
+/*************************************************************************/
+/*  size_class_allocator.h                                               */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2018 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2018 Godot Engine contributors (cf. AUTHORS.md)    */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#ifndef SIZE_CLASS_ALLOCATOR_H
+#define SIZE_CLASS_ALLOCATOR_H
+
+#include "typedefs.h"
+
+#include <stddef.h>
+
+// the allocator behind Memory when built with size_class_allocator=yes. small
+// blocks are rounded up to a size class and come from a cache local to
+// the calling thread, which trades them with the other threads in batches
+// and hands them all back when the thread ends. batches are carved from
+// arenas, which are kept for reuse until exit.
+// larger blocks go to the system allocator, which maps pages for them.
+class SizeClassAllocator {
+public:
+	enum {
+		SMALL_MAX = 32768,
+		CLASS_COUNT = 44
+	};
+
+	struct Stats {
+
+		uint64_t arena_bytes; // reserved for small blocks
+		uint64_t carved_bytes; // cut from the arenas into batches
+		uint32_t arenas;
+		uint32_t shared_batches; // waiting for a thread to take them
+	};
+
+private:
+	SizeClassAllocator();
+
+public:
+	static void *alloc(size_t p_bytes);
+	static void *realloc(void *p_mem, size_t p_old_bytes, size_t p_bytes);
+	static void free(void *p_mem, size_t p_bytes);
+
+	static void get_stats(Stats *r_stats);
+};
+
+#endif
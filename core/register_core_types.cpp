@@ -88,7 +88,6 @@ void register_core_types() {
 
 	ObjectDB::setup();
 	ResourceCache::setup();
-	MemoryPool::setup();
 
 	_global_mutex = Mutex::create();
 
@@ -844,12 +844,28 @@ void ScriptDebuggerRemote::idle_poll() {
 		if (pt - last_perf_time > 1000) {
 
 			last_perf_time = pt;
+
+			int version = performance->call("get_custom_monitors_version");
+			if (version != last_perf_monitors_version) {
+				// custom monitors follow the builtin ones in every "performance"
+				// message, tell the editor what they are first.
+				last_perf_monitors_version = version;
+				packet_peer_stream->put_var("performance_monitors");
+				packet_peer_stream->put_var(2);
+				packet_peer_stream->put_var(performance->call("get_custom_monitor_names"));
+				packet_peer_stream->put_var(performance->call("get_custom_monitor_types"));
+			}
+
 			int max = performance->get("MONITOR_MAX");
+			Array custom = performance->call("get_custom_monitor_values");
 			Array arr;
-			arr.resize(max);
+			arr.resize(max + custom.size());
 			for (int i = 0; i < max; i++) {
 				arr[i] = performance->call("get_monitor", i);
 			}
+			for (int i = 0; i < custom.size(); i++) {
+				arr[max + i] = custom[i];
+			}
 			packet_peer_stream->put_var("performance");
 			packet_peer_stream->put_var(1);
 			packet_peer_stream->put_var(arr);
@@ -1041,6 +1057,7 @@ ScriptDebuggerRemote::ScriptDebuggerRemote() :
 		tcp_client(StreamPeerTCP::create_ref()),
 		packet_peer_stream(Ref<PacketPeerStream>(memnew(PacketPeerStream))),
 		last_perf_time(0),
+		last_perf_monitors_version(-1),
 		performance(Engine::get_singleton()->get_singleton_object("Performance")),
 		requested_quit(false),
 		mutex(Mutex::create()),
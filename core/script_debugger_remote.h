@@ -66,6 +66,7 @@ class ScriptDebuggerRemote : public ScriptDebugger {
 	Ref<PacketPeerStream> packet_peer_stream;
 
 	uint64_t last_perf_time;
+	int last_perf_monitors_version;
 	Object *performance;
 	bool requested_quit;
 	Mutex *mutex;
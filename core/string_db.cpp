@@ -33,13 +33,25 @@
 #include "os/os.h"
 #include "print_string.h"
 
+#include <string.h>
+
 StaticCString StaticCString::create(const char *p_ptr) {
 	StaticCString scs;
 	scs.ptr = p_ptr;
 	return scs;
 }
 
-StringName::_Data *StringName::_table[STRING_TABLE_LEN];
+#ifdef _MSC_VER
+#define STRING_DB_THREAD_LOCAL __declspec(thread)
+#else
+#define STRING_DB_THREAD_LOCAL __thread
+#endif
+
+StringName::_Shard StringName::_shards[STRING_SHARDS];
+StringName::_Reader StringName::_readers[STRING_READER_SLOTS];
+
+static STRING_DB_THREAD_LOCAL uint32_t *thread_reader = NULL;
+static uint32_t readers_assigned = 0;
 
 StringName _scs_create(const char *p_chr) {
 
@@ -47,50 +59,256 @@ StringName _scs_create(const char *p_chr) {
 }
 
 bool StringName::configured = false;
-Mutex *StringName::lock = NULL;
 
-void StringName::setup() {
+bool StringName::_Data::has_name(const char *p_name) const {
 
-	lock = Mutex::create();
+	return cname ? strcmp(cname, p_name) == 0 : name == p_name;
+}
 
-	ERR_FAIL_COND(configured);
-	for (int i = 0; i < STRING_TABLE_LEN; i++) {
+bool StringName::_Data::has_name(const CharType *p_name) const {
+
+	return get_name() == p_name;
+}
+
+bool StringName::_Data::has_name(const String &p_name) const {
+
+	return cname ? p_name == cname : name == p_name;
+}
+
+StringName::_Table *StringName::_alloc_table(uint32_t p_len) {
+
+	_Table *table = (_Table *)memalloc(sizeof(_Table) + (p_len - 1) * sizeof(_Data *));
+	table->mask = p_len - 1;
+	table->next = NULL;
+	for (uint32_t i = 0; i < p_len; i++) {
+
+		table->buckets[i] = NULL;
+	}
+	return table;
+}
+
+// doubles the buckets once there are more names than buckets. moving a name
+// to its new chain may send a lookup still on the old table down the wrong
+// chain, which only makes it miss and look again with the lock.
+void StringName::_grow(_Shard &p_shard) {
+
+	_Table *old = p_shard.table;
+	_Table *table = _alloc_table((old->mask + 1) * 2);
+
+	for (uint32_t i = 0; i <= old->mask; i++) {
+
+		_Data *data = old->buckets[i];
+		while (data) {
+
+			_Data *next = data->next;
+			uint32_t idx = data->hash & table->mask;
+			data->next = table->buckets[idx];
+			table->buckets[idx] = data;
+			data = next;
+		}
+	}
+
+	// full barrier, the table is complete before lookups can reach it
+	atomic_add(&p_shard.count, 0);
+	p_shard.table = table;
+
+	old->next = p_shard.retired_tables;
+	p_shard.retired_tables = old;
+}
+
+_FORCE_INLINE_ uint32_t *StringName::_get_reader() {
+
+	if (unlikely(!thread_reader)) {
+		// slots are handed out round robin on a thread's first lookup
+		thread_reader = &_readers[atomic_increment(&readers_assigned) % STRING_READER_SLOTS].count;
+	}
+	return thread_reader;
+}
+
+// frees what was retired, if no lookup can still be walking it. a lookup
+// counts itself before it loads the table, so a slot seen at 0 after the
+// unlink has no lookup left on what was retired, and lookups that start
+// now can only reach what is still linked.
+void StringName::_reclaim(_Shard &p_shard) {
+
+	if (!p_shard.retired && !p_shard.retired_tables)
+		return;
 
-		_table[i] = NULL;
+	for (int i = 0; i < STRING_READER_SLOTS; i++) {
+
+		if (atomic_add(&_readers[i].count, 0) != 0)
+			return;
+	}
+
+	while (p_shard.retired) {
+
+		_Data *data = p_shard.retired;
+		p_shard.retired = data->next;
+		memdelete(data);
+	}
+	while (p_shard.retired_tables) {
+
+		_Table *table = p_shard.retired_tables;
+		p_shard.retired_tables = table->next;
+		memfree(table);
+	}
+}
+
+// returns the name with a reference taken, skipping the ones being removed.
+template <class T>
+StringName::_Data *StringName::_find(_Data *p_chain, uint32_t p_hash, const T &p_name) {
+
+	for (_Data *data = p_chain; data; data = data->next) {
+
+		// compare hash first
+		if (data->hash == p_hash && data->has_name(p_name) && data->refcount.ref())
+			return data;
+	}
+
+	return NULL;
+}
+
+template <class T>
+StringName::_Data *StringName::_search(uint32_t p_hash, const T &p_name) {
+
+	_Shard &shard = _get_shard(p_hash);
+
+	uint32_t *reader = _get_reader();
+	atomic_increment(reader);
+	_Table *table = shard.table;
+	_Data *data = _find(table->buckets[p_hash & table->mask], p_hash, p_name);
+	atomic_decrement(reader);
+
+	if (data)
+		return data;
+
+	// may have been missed while the table grew
+	shard.lock->lock();
+	shard.locked_lookups++;
+	table = shard.table;
+	data = _find(table->buckets[p_hash & table->mask], p_hash, p_name);
+	shard.lock->unlock();
+
+	return data;
+}
+
+template <class T>
+StringName::_Data *StringName::_intern(uint32_t p_hash, const T &p_name, const char *p_cname) {
+
+	_Shard &shard = _get_shard(p_hash);
+
+	uint32_t *reader = _get_reader();
+	atomic_increment(reader);
+	_Table *table = shard.table;
+	_Data *data = _find(table->buckets[p_hash & table->mask], p_hash, p_name);
+	atomic_decrement(reader);
+
+	if (data) {
+		// exists
+		return data;
+	}
+
+	shard.lock->lock();
+	shard.locked_lookups++;
+
+	// it may have been added meanwhile
+	table = shard.table;
+	uint32_t idx = p_hash & table->mask;
+	data = _find(table->buckets[idx], p_hash, p_name);
+	if (data) {
+		shard.lock->unlock();
+		return data;
+	}
+
+	data = memnew(_Data);
+	if (p_cname)
+		data->cname = p_cname;
+	else
+		data->name = p_name;
+	data->refcount.init();
+	data->hash = p_hash;
+	data->next = table->buckets[idx];
+
+	// full barrier, the name is complete before lookups can reach it
+	atomic_increment(&shard.count);
+	table->buckets[idx] = data;
+
+	if (shard.count > table->mask + 1) {
+		_grow(shard);
+	}
+	_reclaim(shard);
+
+	shard.lock->unlock();
+
+	return data;
+}
+
+void StringName::setup() {
+
+	ERR_FAIL_COND(configured);
+	for (int i = 0; i < STRING_SHARDS; i++) {
+
+		_Shard &shard = _shards[i];
+		shard.table = _alloc_table(STRING_TABLE_MIN_LEN);
+		shard.count = 0;
+		shard.lock = Mutex::create();
+		shard.retired = NULL;
+		shard.retired_tables = NULL;
+		shard.locked_lookups = 0;
 	}
 	configured = true;
 }
 
 void StringName::cleanup() {
 
-	lock->lock();
-
 	int lost_strings = 0;
-	for (int i = 0; i < STRING_TABLE_LEN; i++) {
+	for (int i = 0; i < STRING_SHARDS; i++) {
+
+		_Shard &shard = _shards[i];
+		shard.lock->lock();
 
-		while (_table[i]) {
+		_Table *table = shard.table;
+		for (uint32_t j = 0; j <= table->mask; j++) {
 
-			_Data *d = _table[i];
-			lost_strings++;
-			if (OS::get_singleton()->is_stdout_verbose()) {
+			while (table->buckets[j]) {
 
-				if (d->cname) {
-					print_line("Orphan StringName: " + String(d->cname));
-				} else {
-					print_line("Orphan StringName: " + String(d->name));
+				_Data *d = table->buckets[j];
+				lost_strings++;
+				if (OS::get_singleton()->is_stdout_verbose()) {
+
+					if (d->cname) {
+						print_line("Orphan StringName: " + String(d->cname));
+					} else {
+						print_line("Orphan StringName: " + String(d->name));
+					}
 				}
+
+				table->buckets[j] = d->next;
+				memdelete(d);
 			}
+		}
+
+		// lookups are over by now, whatever the reader slots say
+		while (shard.retired) {
 
-			_table[i] = _table[i]->next;
-			memdelete(d);
+			_Data *data = shard.retired;
+			shard.retired = data->next;
+			memdelete(data);
 		}
+		while (shard.retired_tables) {
+
+			_Table *retired = shard.retired_tables;
+			shard.retired_tables = retired->next;
+			memfree(retired);
+		}
+		memfree(table);
+
+		shard.lock->unlock();
+		memdelete(shard.lock);
 	}
 	if (OS::get_singleton()->is_stdout_verbose() && lost_strings) {
 		print_line("StringName: " + itos(lost_strings) + " unclaimed string names at exit.");
 	}
-	lock->unlock();
-
-	memdelete(lock);
 }
 
 void StringName::unref() {
@@ -99,27 +317,71 @@ void StringName::unref() {
 
 	if (_data && _data->refcount.unref()) {
 
-		lock->lock();
+		_Shard &shard = _get_shard(_data->hash);
+		shard.lock->lock();
 
-		if (_data->prev) {
-			_data->prev->next = _data->next;
-		} else {
-			if (_table[_data->idx] != _data) {
-				ERR_PRINT("BUG!");
-			}
-			_table[_data->idx] = _data->next;
+		_Table *table = shard.table;
+		_Data *volatile *link = &table->buckets[_data->hash & table->mask];
+		while (*link && *link != _data) {
+			link = &(*link)->next;
 		}
 
-		if (_data->next) {
-			_data->next->prev = _data->prev;
+		if (*link) {
+			*link = _data->next;
+			// full barrier, unlinked before the readers are checked. a lookup
+			// still on it follows the retired chain, misses and looks again.
+			atomic_decrement(&shard.count);
+			_data->next = shard.retired;
+			shard.retired = _data;
+			_reclaim(shard);
+		} else {
+			ERR_PRINT("BUG!");
 		}
-		memdelete(_data);
-		lock->unlock();
+
+		shard.lock->unlock();
 	}
 
 	_data = NULL;
 }
 
+void StringName::get_stats(Stats *r_stats) {
+
+	ERR_FAIL_COND(!configured);
+
+	r_stats->names = 0;
+	r_stats->buckets = 0;
+	r_stats->max_chain = 0;
+	r_stats->retired = 0;
+	r_stats->locked_lookups = 0;
+
+	for (int i = 0; i < STRING_SHARDS; i++) {
+
+		_Shard &shard = _shards[i];
+		shard.lock->lock();
+
+		_Table *table = shard.table;
+		r_stats->names += shard.count;
+		r_stats->buckets += table->mask + 1;
+		r_stats->locked_lookups += shard.locked_lookups;
+		for (uint32_t j = 0; j <= table->mask; j++) {
+
+			uint32_t chain = 0;
+			for (_Data *data = table->buckets[j]; data; data = data->next) {
+				chain++;
+			}
+			r_stats->max_chain = MAX(r_stats->max_chain, chain);
+		}
+		for (_Data *data = shard.retired; data; data = data->next) {
+			r_stats->retired++;
+		}
+		for (_Table *retired = shard.retired_tables; retired; retired = retired->next) {
+			r_stats->retired++;
+		}
+
+		shard.lock->unlock();
+	}
+}
+
 bool StringName::operator==(const String &p_name) const {
 
 	if (!_data) {
@@ -183,6 +445,7 @@ StringName::StringName(const StringName &p_name) {
 	}
 }
 
+
 StringName::StringName(const char *p_name) {
 
 	_data = NULL;
@@ -192,44 +455,7 @@ StringName::StringName(const char *p_name) {
 	if (!p_name || p_name[0] == 0)
 		return; //empty, ignore
 
-	lock->lock();
-
-	uint32_t hash = String::hash(p_name);
-
-	uint32_t idx = hash & STRING_TABLE_MASK;
-
-	_data = _table[idx];
-
-	while (_data) {
-
-		// compare hash first
-		if (_data->hash == hash && _data->get_name() == p_name)
-			break;
-		_data = _data->next;
-	}
-
-	if (_data) {
-		if (_data->refcount.ref()) {
-			// exists
-			lock->unlock();
-			return;
-		} else {
-		}
-	}
-
-	_data = memnew(_Data);
-	_data->name = p_name;
-	_data->refcount.init();
-	_data->hash = hash;
-	_data->idx = idx;
-	_data->cname = NULL;
-	_data->next = _table[idx];
-	_data->prev = NULL;
-	if (_table[idx])
-		_table[idx]->prev = _data;
-	_table[idx] = _data;
-
-	lock->unlock();
+	_data = _intern(String::hash(p_name), p_name, NULL);
 }
 
 StringName::StringName(const StaticCString &p_static_string) {
@@ -240,44 +466,7 @@ StringName::StringName(const StaticCString &p_static_string) {
 
 	ERR_FAIL_COND(!p_static_string.ptr || !p_static_string.ptr[0]);
 
-	lock->lock();
-
-	uint32_t hash = String::hash(p_static_string.ptr);
-
-	uint32_t idx = hash & STRING_TABLE_MASK;
-
-	_data = _table[idx];
-
-	while (_data) {
-
-		// compare hash first
-		if (_data->hash == hash && _data->get_name() == p_static_string.ptr)
-			break;
-		_data = _data->next;
-	}
-
-	if (_data) {
-		if (_data->refcount.ref()) {
-			// exists
-			lock->unlock();
-			return;
-		} else {
-		}
-	}
-
-	_data = memnew(_Data);
-
-	_data->refcount.init();
-	_data->hash = hash;
-	_data->idx = idx;
-	_data->cname = p_static_string.ptr;
-	_data->next = _table[idx];
-	_data->prev = NULL;
-	if (_table[idx])
-		_table[idx]->prev = _data;
-	_table[idx] = _data;
-
-	lock->unlock();
+	_data = _intern(String::hash(p_static_string.ptr), p_static_string.ptr, p_static_string.ptr);
 }
 
 StringName::StringName(const String &p_name) {
@@ -289,43 +478,7 @@ StringName::StringName(const String &p_name) {
 	if (p_name == String())
 		return;
 
-	lock->lock();
-
-	uint32_t hash = p_name.hash();
-
-	uint32_t idx = hash & STRING_TABLE_MASK;
-
-	_data = _table[idx];
-
-	while (_data) {
-
-		if (_data->hash == hash && _data->get_name() == p_name)
-			break;
-		_data = _data->next;
-	}
-
-	if (_data) {
-		if (_data->refcount.ref()) {
-			// exists
-			lock->unlock();
-			return;
-		} else {
-		}
-	}
-
-	_data = memnew(_Data);
-	_data->name = p_name;
-	_data->refcount.init();
-	_data->hash = hash;
-	_data->idx = idx;
-	_data->cname = NULL;
-	_data->next = _table[idx];
-	_data->prev = NULL;
-	if (_table[idx])
-		_table[idx]->prev = _data;
-	_table[idx] = _data;
-
-	lock->unlock();
+	_data = _intern(p_name.hash(), p_name, NULL);
 }
 
 StringName StringName::search(const char *p_name) {
@@ -336,29 +489,10 @@ StringName StringName::search(const char *p_name) {
 	if (!p_name[0])
 		return StringName();
 
-	lock->lock();
-
-	uint32_t hash = String::hash(p_name);
-
-	uint32_t idx = hash & STRING_TABLE_MASK;
-
-	_Data *_data = _table[idx];
-
-	while (_data) {
-
-		// compare hash first
-		if (_data->hash == hash && _data->get_name() == p_name)
-			break;
-		_data = _data->next;
-	}
-
-	if (_data && _data->refcount.ref()) {
-		lock->unlock();
-
+	_Data *_data = _search(String::hash(p_name), p_name);
+	if (_data)
 		return StringName(_data);
-	}
 
-	lock->unlock();
 	return StringName(); //does not exist
 }
 
@@ -370,56 +504,20 @@ StringName StringName::search(const CharType *p_name) {
 	if (!p_name[0])
 		return StringName();
 
-	lock->lock();
-
-	uint32_t hash = String::hash(p_name);
-
-	uint32_t idx = hash & STRING_TABLE_MASK;
-
-	_Data *_data = _table[idx];
-
-	while (_data) {
-
-		// compare hash first
-		if (_data->hash == hash && _data->get_name() == p_name)
-			break;
-		_data = _data->next;
-	}
-
-	if (_data && _data->refcount.ref()) {
-		lock->unlock();
+	_Data *_data = _search(String::hash(p_name), p_name);
+	if (_data)
 		return StringName(_data);
-	}
 
-	lock->unlock();
 	return StringName(); //does not exist
 }
 StringName StringName::search(const String &p_name) {
 
 	ERR_FAIL_COND_V(p_name == "", StringName());
 
-	lock->lock();
-
-	uint32_t hash = p_name.hash();
-
-	uint32_t idx = hash & STRING_TABLE_MASK;
-
-	_Data *_data = _table[idx];
-
-	while (_data) {
-
-		// compare hash first
-		if (_data->hash == hash && p_name == _data->get_name())
-			break;
-		_data = _data->next;
-	}
-
-	if (_data && _data->refcount.ref()) {
-		lock->unlock();
+	_Data *_data = _search(p_name.hash(), p_name);
+	if (_data)
 		return StringName(_data);
-	}
 
-	lock->unlock();
 	return StringName(); //does not exist
 }
 
@@ -49,9 +49,12 @@ class StringName {
 
 	enum {
 
-		STRING_TABLE_BITS = 12,
-		STRING_TABLE_LEN = 1 << STRING_TABLE_BITS,
-		STRING_TABLE_MASK = STRING_TABLE_LEN - 1
+		// names are spread over shards by their hash, each shard has its
+		// own lock and a table that grows with it.
+		STRING_SHARD_BITS = 6,
+		STRING_SHARDS = 1 << STRING_SHARD_BITS,
+		STRING_TABLE_MIN_LEN = 64, // per shard
+		STRING_READER_SLOTS = 64
 	};
 
 	struct _Data {
@@ -60,18 +63,48 @@ class StringName {
 		String name;
 
 		String get_name() const { return cname ? String(cname) : name; }
-		int idx;
+		bool has_name(const char *p_name) const;
+		bool has_name(const CharType *p_name) const;
+		bool has_name(const String &p_name) const;
 		uint32_t hash;
-		_Data *prev;
-		_Data *next;
+		_Data *volatile next;
 		_Data() {
 			cname = NULL;
-			next = prev = NULL;
+			next = NULL;
 			hash = 0;
 		}
 	};
 
-	static _Data *_table[STRING_TABLE_LEN];
+	struct _Table {
+		uint32_t mask;
+		_Table *next; // while retired
+		_Data *volatile buckets[1]; // mask + 1 of them
+	};
+
+	// lookups walk the chains without taking the lock, they only count
+	// themselves in their reader slot. whatever is unlinked while a lookup
+	// is counted is retired, and freed by a later insert or removal that
+	// finds every slot at 0.
+	struct _Shard {
+		_Table *volatile table;
+		uint32_t count;
+		Mutex *lock; // inserts and removals
+		_Data *retired; // chained through next
+		_Table *retired_tables;
+		uint32_t locked_lookups; // lookups that missed and looked again with the lock
+		uint8_t pad[20]; // one shard per cache line
+	};
+
+	// lookups in progress on a thread. every thread counts in a slot of
+	// its own (threads past STRING_READER_SLOTS share them), so threads
+	// looking up the same names don't write to a shared cache line.
+	struct _Reader {
+		uint32_t count;
+		uint8_t pad[60];
+	};
+
+	static _Shard _shards[STRING_SHARDS];
+	static _Reader _readers[STRING_READER_SLOTS];
 
 	_Data *_data;
 
@@ -85,7 +118,19 @@ class StringName {
 	friend void register_core_types();
 	friend void unregister_core_types();
 
-	static Mutex *lock;
+	// the top bits of short names hash poorly, mix them in first
+	static _FORCE_INLINE_ _Shard &_get_shard(uint32_t p_hash) { return _shards[(p_hash * 2654435761U) >> (32 - STRING_SHARD_BITS)]; }
+	static _Table *_alloc_table(uint32_t p_len);
+	static void _grow(_Shard &p_shard);
+	static uint32_t *_get_reader();
+	static void _reclaim(_Shard &p_shard);
+	template <class T>
+	static _Data *_find(_Data *p_chain, uint32_t p_hash, const T &p_name);
+	template <class T>
+	static _Data *_search(uint32_t p_hash, const T &p_name);
+	template <class T>
+	static _Data *_intern(uint32_t p_hash, const T &p_name, const char *p_cname);
+
 	static void setup();
 	static void cleanup();
 	static bool configured;
@@ -135,6 +180,17 @@ public:
 	static StringName search(const CharType *p_name);
 	static StringName search(const String &p_name);
 
+	struct Stats {
+
+		uint32_t names;
+		uint32_t buckets;
+		uint32_t max_chain;
+		uint32_t retired; // names and tables waiting for lookups to finish
+		uint32_t locked_lookups;
+	};
+
+	static void get_stats(Stats *r_stats);
+
 	struct AlphCompare {
 
 		_FORCE_INLINE_ bool operator()(const StringName &l, const StringName &r) const {
@@ -666,6 +666,10 @@ void ScriptEditorDebugger::_parse_message(const String &p_msg, const Array &p_da
 		perf_history.push_front(p);
 		perf_draw->update();
 
+	} else if (p_msg == "performance_monitors") {
+
+		_performance_set_custom(p_data[0], p_data[1]);
+
 	} else if (p_msg == "error") {
 
 		Array err = p_data[0];
@@ -864,6 +868,61 @@ void ScriptEditorDebugger::_performance_select() {
 	perf_draw->update();
 }
 
+void ScriptEditorDebugger::_performance_add_item(const String &p_name, int p_type) {
+
+	String base = p_name.get_slice("/", 0);
+	String name = p_name.get_slice("/", 1);
+	if (!perf_bases.has(base)) {
+		TreeItem *b = perf_monitors->create_item(perf_monitors->get_root());
+		b->set_text(0, base.capitalize());
+		b->set_editable(0, false);
+		b->set_selectable(0, false);
+		b->set_expand_right(0, true);
+		perf_bases[base] = b;
+		if (perf_items.size() >= Performance::MONITOR_MAX)
+			perf_custom_bases.push_back(b);
+	}
+
+	TreeItem *it = perf_monitors->create_item(perf_bases[base]);
+	it->set_metadata(1, p_type);
+	it->set_cell_mode(0, TreeItem::CELL_MODE_CHECK);
+	it->set_editable(0, true);
+	it->set_selectable(0, false);
+	it->set_selectable(1, false);
+	it->set_text(0, name.capitalize());
+	perf_items.push_back(it);
+}
+
+void ScriptEditorDebugger::_performance_set_custom(const Array &p_names, const Array &p_types) {
+
+	for (int i = Performance::MONITOR_MAX; i < perf_items.size(); i++) {
+		memdelete(perf_items[i]);
+	}
+	perf_items.resize(Performance::MONITOR_MAX);
+	for (int i = 0; i < perf_custom_bases.size(); i++) {
+		for (Map<String, TreeItem *>::Element *E = perf_bases.front(); E; E = E->next()) {
+			if (E->get() == perf_custom_bases[i]) {
+				perf_bases.erase(E);
+				break;
+			}
+		}
+		memdelete(perf_custom_bases[i]);
+	}
+	perf_custom_bases.clear();
+
+	for (int i = 0; i < p_names.size(); i++) {
+		_performance_add_item(p_names[i], p_types[i]);
+	}
+
+	// older samples have the old monitors, drop them rather than mixing.
+	perf_history.clear();
+	perf_max.resize(perf_items.size());
+	for (int i = Performance::MONITOR_MAX; i < perf_max.size(); i++) {
+		perf_max[i] = 0;
+	}
+	perf_draw->update();
+}
+
 void ScriptEditorDebugger::_performance_draw() {
 
 	Vector<int> which;
@@ -1155,7 +1214,7 @@ void ScriptEditorDebugger::start() {
 	}
 
 	perf_history.clear();
-	for (int i = 0; i < Performance::MONITOR_MAX; i++) {
+	for (int i = 0; i < perf_max.size(); i++) {
 
 		perf_max[i] = 0;
 	}
@@ -1965,32 +2024,13 @@ ScriptEditorDebugger::ScriptEditorDebugger(EditorNode *p_editor) {
 		tabs->add_child(hsp);
 		perf_max.resize(Performance::MONITOR_MAX);
 
-		Map<String, TreeItem *> bases;
-		TreeItem *root = perf_monitors->create_item();
+		perf_monitors->create_item();
 		perf_monitors->set_hide_root(true);
 		for (int i = 0; i < Performance::MONITOR_MAX; i++) {
 
 			String n = Performance::get_singleton()->get_monitor_name(Performance::Monitor(i));
 			Performance::MonitorType mtype = Performance::get_singleton()->get_monitor_type(Performance::Monitor(i));
-			String base = n.get_slice("/", 0);
-			String name = n.get_slice("/", 1);
-			if (!bases.has(base)) {
-				TreeItem *b = perf_monitors->create_item(root);
-				b->set_text(0, base.capitalize());
-				b->set_editable(0, false);
-				b->set_selectable(0, false);
-				b->set_expand_right(0, true);
-				bases[base] = b;
-			}
-
-			TreeItem *it = perf_monitors->create_item(bases[base]);
-			it->set_metadata(1, mtype);
-			it->set_cell_mode(0, TreeItem::CELL_MODE_CHECK);
-			it->set_editable(0, true);
-			it->set_selectable(0, false);
-			it->set_selectable(1, false);
-			it->set_text(0, name.capitalize());
-			perf_items.push_back(it);
+			_performance_add_item(n, mtype);
 			perf_max[i] = 0;
 		}
 	}
@@ -114,6 +114,10 @@ class ScriptEditorDebugger : public Control {
 	List<Vector<float> > perf_history;
 	Vector<float> perf_max;
 	Vector<TreeItem *> perf_items;
+	// perf_items past MONITOR_MAX are the custom monitors of the running
+	// game, perf_custom_bases the categories only they use.
+	Map<String, TreeItem *> perf_bases;
+	Vector<TreeItem *> perf_custom_bases;
 
 	Map<int, String> profiler_signature;
 
@@ -148,6 +152,8 @@ class ScriptEditorDebugger : public Control {
 	bool live_debug;
 
 	void _performance_draw();
+	void _performance_add_item(const String &p_name, int p_type);
+	void _performance_set_custom(const Array &p_names, const Array &p_types);
 	void _performance_select();
 	void _stack_dump_frame_selected();
 	void _output_clear();
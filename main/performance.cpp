@@ -40,6 +40,14 @@ Performance *Performance::singleton = NULL;
 void Performance::_bind_methods() {
 
 	ClassDB::bind_method(D_METHOD("get_monitor", "monitor"), &Performance::get_monitor);
+	ClassDB::bind_method(D_METHOD("add_custom_monitor", "id", "object", "method", "args", "type"), &Performance::add_custom_monitor, DEFVAL(Array()), DEFVAL(MONITOR_TYPE_QUANTITY));
+	ClassDB::bind_method(D_METHOD("remove_custom_monitor", "id"), &Performance::remove_custom_monitor);
+	ClassDB::bind_method(D_METHOD("has_custom_monitor", "id"), &Performance::has_custom_monitor);
+	ClassDB::bind_method(D_METHOD("get_custom_monitor", "id"), &Performance::get_custom_monitor);
+	ClassDB::bind_method(D_METHOD("get_custom_monitors_version"), &Performance::get_custom_monitors_version);
+	ClassDB::bind_method(D_METHOD("get_custom_monitor_names"), &Performance::get_custom_monitor_names);
+	ClassDB::bind_method(D_METHOD("get_custom_monitor_types"), &Performance::get_custom_monitor_types);
+	ClassDB::bind_method(D_METHOD("get_custom_monitor_values"), &Performance::get_custom_monitor_values);
 
 	BIND_ENUM_CONSTANT(TIME_FPS);
 	BIND_ENUM_CONSTANT(TIME_PROCESS);
@@ -70,6 +78,10 @@ void Performance::_bind_methods() {
 	BIND_ENUM_CONSTANT(PHYSICS_3D_ISLAND_COUNT);
 
 	BIND_ENUM_CONSTANT(MONITOR_MAX);
+
+	BIND_ENUM_CONSTANT(MONITOR_TYPE_QUANTITY);
+	BIND_ENUM_CONSTANT(MONITOR_TYPE_MEMORY);
+	BIND_ENUM_CONSTANT(MONITOR_TYPE_TIME);
 }
 
 String Performance::get_monitor_name(Monitor p_monitor) const {
@@ -117,9 +129,9 @@ float Performance::get_monitor(Monitor p_monitor) const {
 		case TIME_PROCESS: return _process_time;
 		case TIME_PHYSICS_PROCESS: return _physics_process_time;
 		case MEMORY_STATIC: return Memory::get_mem_usage();
-		case MEMORY_DYNAMIC: return MemoryPool::total_memory;
+		case MEMORY_DYNAMIC: return MemoryPool::get_total_memory();
 		case MEMORY_STATIC_MAX: return Memory::get_mem_max_usage();
-		case MEMORY_DYNAMIC_MAX: return MemoryPool::max_memory;
+		case MEMORY_DYNAMIC_MAX: return MemoryPool::get_max_memory();
 		case MEMORY_MESSAGE_BUFFER_MAX: return MessageQueue::get_singleton()->get_max_buffer_usage();
 		case OBJECT_COUNT: return ObjectDB::get_object_count();
 		case OBJECT_RESOURCE_COUNT: return ResourceCache::get_cached_resource_count();
@@ -192,6 +204,88 @@ Performance::MonitorType Performance::get_monitor_type(Monitor p_monitor) const
 	return types[p_monitor];
 }
 
+int Performance::_find_custom_monitor(const StringName &p_id) const {
+
+	for (int i = 0; i < custom_monitors.size(); i++) {
+		if (custom_monitors[i].id == p_id)
+			return i;
+	}
+	return -1;
+}
+
+void Performance::add_custom_monitor(const StringName &p_id, Object *p_object, const StringName &p_method, const Array &p_args, MonitorType p_type) {
+
+	ERR_FAIL_NULL(p_object);
+	ERR_FAIL_COND(_find_custom_monitor(p_id) != -1);
+
+	CustomMonitor monitor;
+	monitor.id = p_id;
+	monitor.object = p_object->get_instance_id();
+	monitor.method = p_method;
+	monitor.args = p_args;
+	monitor.type = p_type;
+	custom_monitors.push_back(monitor);
+	custom_monitors_version++;
+}
+
+void Performance::remove_custom_monitor(const StringName &p_id) {
+
+	int index = _find_custom_monitor(p_id);
+	ERR_FAIL_COND(index == -1);
+
+	custom_monitors.remove(index);
+	custom_monitors_version++;
+}
+
+bool Performance::has_custom_monitor(const StringName &p_id) const {
+
+	return _find_custom_monitor(p_id) != -1;
+}
+
+float Performance::get_custom_monitor(const StringName &p_id) const {
+
+	int index = _find_custom_monitor(p_id);
+	ERR_FAIL_COND_V(index == -1, 0);
+
+	const CustomMonitor &monitor = custom_monitors[index];
+	Object *object = ObjectDB::get_instance(monitor.object);
+	if (!object)
+		return 0;
+	return object->callv(monitor.method, monitor.args);
+}
+
+int Performance::get_custom_monitors_version() const {
+
+	return custom_monitors_version;
+}
+
+Array Performance::get_custom_monitor_names() const {
+
+	Array names;
+	for (int i = 0; i < custom_monitors.size(); i++) {
+		names.push_back(String(custom_monitors[i].id));
+	}
+	return names;
+}
+
+Array Performance::get_custom_monitor_types() const {
+
+	Array types;
+	for (int i = 0; i < custom_monitors.size(); i++) {
+		types.push_back(custom_monitors[i].type);
+	}
+	return types;
+}
+
+Array Performance::get_custom_monitor_values() const {
+
+	Array values;
+	for (int i = 0; i < custom_monitors.size(); i++) {
+		values.push_back(get_custom_monitor(custom_monitors[i].id));
+	}
+	return values;
+}
+
 void Performance::set_process_time(float p_pt) {
 
 	_process_time = p_pt;
@@ -206,5 +300,6 @@ Performance::Performance() {
 
 	_process_time = 0;
 	_physics_process_time = 0;
+	custom_monitors_version = 0;
 	singleton = this;
 }
@@ -46,6 +46,21 @@ class Performance : public Object {
 	float _process_time;
 	float _physics_process_time;
 
+	struct CustomMonitor {
+		StringName id;
+		ObjectID object;
+		StringName method;
+		Array args;
+		int type;
+	};
+
+	// monitors other modules register at runtime, polled by the remote
+	// debugger after the builtin ones. version changes whenever the list does.
+	Vector<CustomMonitor> custom_monitors;
+	int custom_monitors_version;
+
+	int _find_custom_monitor(const StringName &p_id) const;
+
 public:
 	enum Monitor {
 
@@ -91,6 +106,17 @@ public:
 
 	MonitorType get_monitor_type(Monitor p_monitor) const;
 
+	// p_id is "category/name" like the builtin monitor names, p_method is
+	// called with p_args and returns a number.
+	void add_custom_monitor(const StringName &p_id, Object *p_object, const StringName &p_method, const Array &p_args = Array(), MonitorType p_type = MONITOR_TYPE_QUANTITY);
+	void remove_custom_monitor(const StringName &p_id);
+	bool has_custom_monitor(const StringName &p_id) const;
+	float get_custom_monitor(const StringName &p_id) const;
+	int get_custom_monitors_version() const;
+	Array get_custom_monitor_names() const;
+	Array get_custom_monitor_types() const;
+	Array get_custom_monitor_values() const;
+
 	void set_process_time(float p_pt);
 	void set_physics_process_time(float p_pt);
 
@@ -100,5 +126,6 @@ public:
 };
 
 VARIANT_ENUM_CAST(Performance::Monitor);
+VARIANT_ENUM_CAST(Performance::MonitorType);
 
 #endif // PERFORMANCE_H
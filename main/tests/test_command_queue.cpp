@@ -0,0 +1,206 @@
+/*************************************************************************/
+/*  test_command_queue.cpp                                               */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2018 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2018 Godot Engine contributors (cf. AUTHORS.md)    */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "test_command_queue.h"
+
+#include "core/command_queue_mt.h"
+#include "core/os/os.h"
+#include "core/os/thread.h"
+
+namespace TestCommandQueue {
+
+enum {
+	PRODUCERS = 4,
+	COMMANDS = 250000, // per producer
+	RET_EVERY = 5000
+};
+
+// checks that every producer's commands come out in the order they went in.
+struct Receiver {
+
+	int last[PRODUCERS];
+	int errors;
+	int total;
+	bool done;
+
+	struct Payload {
+		real_t data[32];
+	};
+
+	void add(int p_producer, int p_value) {
+
+		if (last[p_producer] + 1 != p_value)
+			errors++;
+		last[p_producer] = p_value;
+		total++;
+	}
+
+	void add_payload(Payload p_payload, int p_producer, int p_value) {
+
+		add(p_producer, p_value);
+	}
+
+	int twice(int p_value) {
+
+		return p_value * 2;
+	}
+
+	void finish() {
+
+		done = true;
+	}
+
+	void reset() {
+
+		for (int i = 0; i < PRODUCERS; i++)
+			last[i] = -1;
+		errors = 0;
+		total = 0;
+		done = false;
+	}
+};
+
+struct Bench {
+
+	CommandQueueMT *queue;
+	Receiver receiver;
+	uint32_t bad_returns;
+};
+
+struct Producer {
+
+	Bench *bench;
+	int index;
+};
+
+static void _producer(void *p_userdata) {
+
+	Producer *producer = (Producer *)p_userdata;
+	Bench *bench = producer->bench;
+	Receiver *receiver = &bench->receiver;
+	Receiver::Payload payload = Receiver::Payload();
+
+	for (int i = 0; i < COMMANDS; i++) {
+
+		// mix in a command large enough to straddle block ends often
+		if (i % 7 == 3)
+			bench->queue->push(receiver, &Receiver::add_payload, payload, producer->index, i);
+		else
+			bench->queue->push(receiver, &Receiver::add, producer->index, i);
+
+		if (i % RET_EVERY == 0) {
+			int ret;
+			bench->queue->push_and_ret(receiver, &Receiver::twice, i, &ret);
+			if (ret != i * 2)
+				atomic_increment(&bench->bad_returns);
+		}
+	}
+}
+
+static void _consumer(void *p_userdata) {
+
+	Bench *bench = (Bench *)p_userdata;
+	while (!bench->receiver.done)
+		bench->queue->wait_and_flush();
+}
+
+static void _print_stats(CommandQueueMT *p_queue) {
+
+	CommandQueueMT::Stats stats;
+	p_queue->get_stats(&stats);
+	OS::get_singleton()->print("\tblocks %u, high-water %u, allocated %u\n", stats.blocks, stats.max_blocks, stats.allocated_blocks);
+	OS::get_singleton()->print("\tproducer stalls %u, consumer stalls %u, flushed %u\n", stats.producer_stalls, stats.consumer_stalls, (uint32_t)stats.flushed);
+}
+
+static float _rate(int p_count, uint64_t p_usec) {
+
+	return p_count / (float)MAX(p_usec, (uint64_t)1);
+}
+
+MainLoop *test() {
+
+	OS *os = OS::get_singleton();
+
+	// one thread pushes everything, then flushes everything.
+	{
+		Bench bench;
+		bench.receiver.reset();
+		CommandQueueMT queue(false);
+
+		const int count = PRODUCERS * COMMANDS;
+		uint64_t start = os->get_ticks_usec();
+		for (int i = 0; i < count; i++)
+			queue.push(&bench.receiver, &Receiver::add, 0, i);
+		uint64_t pushed = os->get_ticks_usec();
+		queue.flush_all();
+		uint64_t flushed = os->get_ticks_usec();
+
+		os->print("single thread: push %.2f M/s, flush %.2f M/s\n", _rate(count, pushed - start), _rate(count, flushed - pushed));
+		os->print("\tcommands %d/%d, out of order %d\n", bench.receiver.total, count, bench.receiver.errors);
+		_print_stats(&queue);
+	}
+
+	// several threads push while a server thread flushes in batches.
+	{
+		Bench bench;
+		bench.receiver.reset();
+		bench.bad_returns = 0;
+		bench.queue = memnew(CommandQueueMT(true));
+
+		Producer producers[PRODUCERS];
+		Thread *threads[PRODUCERS];
+		Thread *consumer = Thread::create(_consumer, &bench);
+
+		uint64_t start = os->get_ticks_usec();
+		for (int i = 0; i < PRODUCERS; i++) {
+			producers[i].bench = &bench;
+			producers[i].index = i;
+			threads[i] = Thread::create(_producer, &producers[i]);
+		}
+		for (int i = 0; i < PRODUCERS; i++) {
+			Thread::wait_to_finish(threads[i]);
+			memdelete(threads[i]);
+		}
+		uint64_t pushed = os->get_ticks_usec();
+		bench.queue->push(&bench.receiver, &Receiver::finish);
+		Thread::wait_to_finish(consumer);
+		memdelete(consumer);
+		uint64_t drained = os->get_ticks_usec();
+
+		const int count = PRODUCERS * COMMANDS;
+		os->print("%d producers: push %.2f M/s, drained after %.1f ms\n", PRODUCERS, _rate(count, pushed - start), (drained - start) / 1000.0);
+		os->print("\tcommands %d/%d, out of order %d, bad returns %u\n", bench.receiver.total, count, bench.receiver.errors, bench.bad_returns);
+		_print_stats(bench.queue);
+		memdelete(bench.queue);
+	}
+
+	return NULL;
+}
+} // namespace TestCommandQueue
@@ -33,11 +33,14 @@
 
 #ifdef DEBUG_ENABLED
 
+#include "test_command_queue.h"
 #include "test_gdscript.h"
 #include "test_gui.h"
 #include "test_image.h"
 #include "test_io.h"
 #include "test_math.h"
+#include "test_memory.h"
+#include "test_object_db.h"
 #include "test_oa_hash_map.h"
 #include "test_ordered_hash_map.h"
 #include "test_physics.h"
@@ -45,6 +48,8 @@
 #include "test_render.h"
 #include "test_shader_lang.h"
 #include "test_string.h"
+#include "test_string_name.h"
+#include "test_wc.h"
 
 const char **tests_get_names() {
 
@@ -59,6 +64,25 @@ const char **tests_get_names() {
 		"shaderlang",
 		"physics",
 		"oa_hash_map",
+		"command_queue",
+		"string_name",
+		"memory",
+		"object_db",
+		"wc_stream",
+		"wc_mesh",
+		"wc_storage",
+		"wc_cull",
+		"wc_region",
+		"wc_edit",
+		"wc_noise",
+		"wc_visual",
+		"wc_lod",
+		"wc_light",
+		"wc_collision",
+		"wc_stats",
+		"wc_bench",
+		"wc_sections",
+		"wc_net",
 		NULL
 	};
 
@@ -97,6 +121,26 @@ MainLoop *test_main(String p_test, const List<String> &p_args) {
 		return TestOAHashMap::test();
 	}
 
+	if (p_test == "command_queue") {
+
+		return TestCommandQueue::test();
+	}
+
+	if (p_test == "string_name") {
+
+		return TestStringName::test();
+	}
+
+	if (p_test == "memory") {
+
+		return TestMemory::test();
+	}
+
+	if (p_test == "object_db") {
+
+		return TestObjectDB::test();
+	}
+
 #ifndef _3D_DISABLED
 	if (p_test == "gui") {
 
@@ -144,6 +188,81 @@ MainLoop *test_main(String p_test, const List<String> &p_args) {
 		return TestOrderedHashMap::test();
 	}
 
+	if (p_test == "wc_stream") {
+
+		return TestWC::test(TestWC::TEST_STREAM);
+	}
+
+	if (p_test == "wc_mesh") {
+
+		return TestWC::test(TestWC::TEST_MESH);
+	}
+
+	if (p_test == "wc_storage") {
+
+		return TestWC::test(TestWC::TEST_STORAGE);
+	}
+
+	if (p_test == "wc_cull") {
+
+		return TestWC::test(TestWC::TEST_CULL);
+	}
+
+	if (p_test == "wc_region") {
+
+		return TestWC::test(TestWC::TEST_REGION);
+	}
+
+	if (p_test == "wc_edit") {
+
+		return TestWC::test(TestWC::TEST_EDIT);
+	}
+
+	if (p_test == "wc_noise") {
+
+		return TestWC::test(TestWC::TEST_NOISE);
+	}
+
+	if (p_test == "wc_visual") {
+
+		return TestWC::test(TestWC::TEST_VISUAL);
+	}
+
+	if (p_test == "wc_lod") {
+
+		return TestWC::test(TestWC::TEST_LOD);
+	}
+
+	if (p_test == "wc_light") {
+
+		return TestWC::test(TestWC::TEST_LIGHT);
+	}
+
+	if (p_test == "wc_collision") {
+
+		return TestWC::test(TestWC::TEST_COLLISION);
+	}
+
+	if (p_test == "wc_stats") {
+
+		return TestWC::test(TestWC::TEST_STATS);
+	}
+
+	if (p_test == "wc_bench") {
+
+		return TestWC::test(TestWC::TEST_BENCH);
+	}
+
+	if (p_test == "wc_sections") {
+
+		return TestWC::test(TestWC::TEST_SECTIONS);
+	}
+
+	if (p_test == "wc_net") {
+
+		return TestWC::test(TestWC::TEST_NET);
+	}
+
 	return NULL;
 }
 
@@ -454,9 +454,9 @@ MainLoop *test() {
 		return NULL;
 	}
 
-	print_line("Dvectors: " + itos(MemoryPool::allocs_used));
-	print_line("Mem used: " + itos(MemoryPool::total_memory));
-	print_line("MAx mem used: " + itos(MemoryPool::max_memory));
+	print_line("Dvectors: " + itos(MemoryPool::get_allocs_used()));
+	print_line("Mem used: " + itos(MemoryPool::get_total_memory()));
+	print_line("MAx mem used: " + itos(MemoryPool::get_max_memory()));
 
 	PoolVector<int> ints;
 	ints.resize(20);
@@ -478,9 +478,9 @@ MainLoop *test() {
 		}
 	}
 
-	print_line("later Dvectors: " + itos(MemoryPool::allocs_used));
-	print_line("later Mem used: " + itos(MemoryPool::total_memory));
-	print_line("Mlater Ax mem used: " + itos(MemoryPool::max_memory));
+	print_line("later Dvectors: " + itos(MemoryPool::get_allocs_used()));
+	print_line("later Mem used: " + itos(MemoryPool::get_total_memory()));
+	print_line("Mlater Ax mem used: " + itos(MemoryPool::get_max_memory()));
 
 	return NULL;
 
@@ -0,0 +1,270 @@
+/*************************************************************************/
+/*  test_memory.cpp                                                      */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2018 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2018 Godot Engine contributors (cf. AUTHORS.md)    */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "test_memory.h"
+
+#include "core/os/size_class_allocator.h"
+#include "core/os/os.h"
+#include "core/os/thread.h"
+#include "scene/2d/node_2d.h"
+#include "scene/resources/packed_scene.h"
+
+namespace TestMemory {
+
+enum {
+	THREADS = 4,
+	BLOCKS = 1024, // live at once per thread
+	CHURN = 1000000, // allocations per thread
+	HANDOFF = 200000, // blocks one thread allocates and another frees
+	HANDOFF_RING = 256,
+	SCENE_NODES = 200,
+	INSTANCES = 100,
+	STRINGS = 100000
+};
+
+struct Handoff {
+
+	void *volatile ring[HANDOFF_RING];
+	uint32_t errors;
+};
+
+static _FORCE_INLINE_ size_t _handoff_size(int p_index) {
+
+	return 8 + (p_index * 37) % 600;
+}
+
+static void _churn(void *p_userdata) {
+
+	uint32_t seed = (uint32_t)(uintptr_t)p_userdata * 7919 + 1;
+	void *blocks[BLOCKS] = {};
+
+	for (int i = 0; i < CHURN; i++) {
+
+		seed = seed * 1103515245 + 12345;
+		int idx = (seed >> 8) % BLOCKS;
+		if (blocks[idx])
+			memfree(blocks[idx]);
+		// mostly small, like the nodes, strings and vectors of a scene
+		size_t size = (seed >> 20) % 8 ? 8 + (seed >> 4) % 248 : 256 + (seed >> 4) % 4096;
+		blocks[idx] = memalloc(size);
+	}
+
+	for (int i = 0; i < BLOCKS; i++) {
+		if (blocks[i])
+			memfree(blocks[i]);
+	}
+}
+
+// the producer fills blocks with their index and passes them through the
+// ring, the consumer checks and frees them.
+static void _produce(void *p_userdata) {
+
+	Handoff *handoff = (Handoff *)p_userdata;
+	uint32_t barrier = 0;
+
+	for (int i = 0; i < HANDOFF; i++) {
+
+		size_t size = _handoff_size(i);
+		uint8_t *block = (uint8_t *)memalloc(size);
+		memset(block, i & 0xFF, size);
+
+		void *volatile *slot = &handoff->ring[i % HANDOFF_RING];
+		while (*slot) {
+			OS::get_singleton()->delay_usec(1);
+		}
+		atomic_add(&barrier, 0); // the block is filled before it's passed on
+		*slot = block;
+	}
+}
+
+static void _consume(void *p_userdata) {
+
+	Handoff *handoff = (Handoff *)p_userdata;
+	uint32_t barrier = 0;
+
+	for (int i = 0; i < HANDOFF; i++) {
+
+		void *volatile *slot = &handoff->ring[i % HANDOFF_RING];
+		while (!*slot) {
+			OS::get_singleton()->delay_usec(1);
+		}
+		atomic_add(&barrier, 0);
+		uint8_t *block = (uint8_t *)*slot;
+		*slot = NULL;
+
+		size_t size = _handoff_size(i);
+		if (block[0] != (i & 0xFF) || block[size - 1] != (i & 0xFF))
+			handoff->errors++;
+		memfree(block);
+	}
+}
+
+static uint32_t _run_handoff() {
+
+	Handoff *handoff = memnew(Handoff);
+	for (int i = 0; i < HANDOFF_RING; i++) {
+		handoff->ring[i] = NULL;
+	}
+	handoff->errors = 0;
+
+	Thread *producer = Thread::create(_produce, handoff);
+	Thread *consumer = Thread::create(_consume, handoff);
+	Thread::wait_to_finish(producer);
+	Thread::wait_to_finish(consumer);
+	memdelete(producer);
+	memdelete(consumer);
+
+	uint32_t errors = handoff->errors;
+	memdelete(handoff);
+	return errors;
+}
+
+static void _print_memory() {
+
+	OS *os = OS::get_singleton();
+	os->print("\tstatic memory %s, peak %s\n", String::humanize_size(Memory::get_mem_usage()).utf8().get_data(), String::humanize_size(Memory::get_mem_max_usage()).utf8().get_data());
+#ifdef SIZE_CLASS_ALLOCATOR_ENABLED
+	SizeClassAllocator::Stats stats;
+	SizeClassAllocator::get_stats(&stats);
+	os->print("\tarenas %u (%s), shared batches %u\n", stats.arenas, String::humanize_size(stats.arena_bytes).utf8().get_data(), stats.shared_batches);
+#endif
+}
+
+MainLoop *test() {
+
+	OS *os = OS::get_singleton();
+
+#ifdef SIZE_CLASS_ALLOCATOR_ENABLED
+	os->print("allocator: size classes\n");
+#else
+	os->print("allocator: system\n");
+#endif
+
+	uint32_t errors = 0;
+	uint64_t usage = Memory::get_mem_usage();
+
+	// small blocks, the same threads allocating and freeing
+	for (int threads = 1; threads <= THREADS; threads *= 2) {
+
+		Thread *workers[THREADS];
+		uint64_t start = os->get_ticks_usec();
+		for (int i = 0; i < threads; i++) {
+			workers[i] = Thread::create(_churn, (void *)(uintptr_t)(i + 1));
+		}
+		for (int i = 0; i < threads; i++) {
+			Thread::wait_to_finish(workers[i]);
+			memdelete(workers[i]);
+		}
+		uint64_t usec = MAX(os->get_ticks_usec() - start, (uint64_t)1);
+		os->print("churn, %d threads: %.2f M allocs/s\n", threads, threads * CHURN / (float)usec);
+	}
+	_print_memory();
+
+	// blocks freed on another thread than the one that allocated them
+	{
+		uint64_t start = os->get_ticks_usec();
+		errors += _run_handoff();
+		uint64_t usec = MAX(os->get_ticks_usec() - start, (uint64_t)1);
+		os->print("handoff: %.2f M blocks/s\n", HANDOFF / (float)usec);
+
+#ifdef SIZE_CLASS_ALLOCATOR_ENABLED
+		// the ended threads handed their cached blocks back, so doing it
+		// again carves nothing new from the arenas
+		SizeClassAllocator::Stats before;
+		SizeClassAllocator::get_stats(&before);
+		errors += _run_handoff();
+		SizeClassAllocator::Stats after;
+		SizeClassAllocator::get_stats(&after);
+		if (after.carved_bytes != before.carved_bytes) {
+			os->print("handoff: the second run carved %llu bytes\n", (unsigned long long)(after.carved_bytes - before.carved_bytes));
+			errors++;
+		}
+#endif
+	}
+	_print_memory();
+
+	if (Memory::get_mem_usage() != usage) {
+		os->print("static memory %llu before the threads, %llu after\n", (unsigned long long)usage, (unsigned long long)Memory::get_mem_usage());
+		errors++;
+	}
+	os->print("errors %u\n", errors);
+
+	// instancing a packed scene, freeing it again
+	{
+		Node *root = memnew(Node2D);
+		root->set_name("root");
+		for (int i = 0; i < SCENE_NODES; i++) {
+			Node2D *child = memnew(Node2D);
+			child->set_name("child" + itos(i));
+			child->set_position(Vector2(i, i * 2));
+			root->add_child(child);
+			child->set_owner(root);
+		}
+
+		Ref<PackedScene> scene;
+		scene.instance();
+		scene->pack(root);
+		memdelete(root);
+
+		uint64_t start = os->get_ticks_usec();
+		for (int i = 0; i < INSTANCES; i++) {
+			Node *instance = scene->instance();
+			memdelete(instance);
+		}
+		uint64_t usec = MAX(os->get_ticks_usec() - start, (uint64_t)1);
+		os->print("scene instancing: %.1f instances/s of %d nodes\n", INSTANCES * 1000000.0 / usec, SCENE_NODES + 1);
+	}
+	_print_memory();
+
+	// building strings piece by piece
+	{
+		uint64_t start = os->get_ticks_usec();
+		int length = 0;
+		Vector<String> lines;
+		for (int i = 0; i < STRINGS; i++) {
+
+			String line = "line " + itos(i);
+			line += ": ";
+			line += String::num(i * 0.5);
+			lines.push_back(line);
+			length += line.length();
+		}
+		String text;
+		for (int i = 0; i < lines.size(); i++) {
+			text += lines[i] + "\n";
+		}
+		uint64_t usec = MAX(os->get_ticks_usec() - start, (uint64_t)1);
+		os->print("string building: %.1f ms for %d lines, %d chars\n", usec / 1000.0, STRINGS, text.length());
+	}
+	_print_memory();
+
+	return NULL;
+}
+} // namespace TestMemory
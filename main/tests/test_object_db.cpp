@@ -0,0 +1,171 @@
+/*************************************************************************/
+/*  test_object_db.cpp                                                   */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2018 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2018 Godot Engine contributors (cf. AUTHORS.md)    */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "test_object_db.h"
+
+#include "core/object.h"
+#include "core/os/os.h"
+#include "core/os/thread.h"
+
+namespace TestObjectDB {
+
+enum {
+	MAX_THREADS = 8,
+	SHARED = 1024, // live for the whole run, looked up by every thread
+	OWNED = 2048, // per thread, enough to make the shard tables grow
+	ROUNDS = 20
+};
+
+struct Bench {
+
+	Object *shared[SHARED];
+	ObjectID shared_ids[SHARED];
+	bool churn;
+	uint32_t errors;
+	uint32_t lookups;
+};
+
+struct Worker {
+
+	Bench *bench;
+	int index;
+};
+
+static void _worker(void *p_userdata) {
+
+	Worker *worker = (Worker *)p_userdata;
+	Bench *bench = worker->bench;
+
+	Object **owned = memnew_arr(Object *, OWNED);
+	ObjectID *ids = memnew_arr(ObjectID, OWNED);
+	for (int i = 0; i < OWNED; i++) {
+
+		owned[i] = memnew(Object);
+		ids[i] = owned[i]->get_instance_id();
+	}
+
+	uint32_t lookups = 0;
+	for (int r = 0; r < ROUNDS; r++) {
+
+		for (int i = 0; i < OWNED; i++) {
+
+			if (ObjectDB::get_instance(ids[i]) != owned[i] || !ObjectDB::instance_validate(owned[i]))
+				atomic_increment(&bench->errors);
+			lookups++;
+
+			if (!bench->churn || (i + r + worker->index) % 3)
+				continue;
+
+			// a removed ID finds nothing, and IDs are never handed out twice
+			ObjectID old = ids[i];
+			memdelete(owned[i]);
+			if (ObjectDB::get_instance(old))
+				atomic_increment(&bench->errors);
+			owned[i] = memnew(Object);
+			ids[i] = owned[i]->get_instance_id();
+			if (ids[i] == old)
+				atomic_increment(&bench->errors);
+		}
+
+		// the other threads' adds and removes rebuild the tables under these
+		for (int i = 0; i < SHARED; i++) {
+
+			int idx = (i + worker->index * (SHARED / MAX_THREADS)) % SHARED;
+			if (ObjectDB::get_instance(bench->shared_ids[idx]) != bench->shared[idx] || !ObjectDB::instance_validate(bench->shared[idx]))
+				atomic_increment(&bench->errors);
+		}
+		lookups += SHARED;
+	}
+
+	for (int i = 0; i < OWNED; i++) {
+
+		memdelete(owned[i]);
+	}
+	memdelete_arr(owned);
+	memdelete_arr(ids);
+
+	atomic_add(&bench->lookups, lookups);
+}
+
+static void _run(Bench *p_bench, int p_threads, bool p_churn) {
+
+	OS *os = OS::get_singleton();
+
+	p_bench->churn = p_churn;
+	p_bench->errors = 0;
+	p_bench->lookups = 0;
+	int count = ObjectDB::get_object_count();
+
+	Worker workers[MAX_THREADS];
+	Thread *threads[MAX_THREADS];
+
+	uint64_t start = os->get_ticks_usec();
+	for (int i = 0; i < p_threads; i++) {
+		workers[i].bench = p_bench;
+		workers[i].index = i;
+		threads[i] = Thread::create(_worker, &workers[i]);
+	}
+	for (int i = 0; i < p_threads; i++) {
+		Thread::wait_to_finish(threads[i]);
+		memdelete(threads[i]);
+	}
+	uint64_t usec = MAX(os->get_ticks_usec() - start, (uint64_t)1);
+
+	// every object a worker made is gone again
+	if (ObjectDB::get_object_count() != count)
+		p_bench->errors++;
+
+	os->print("%s, %d threads: %.2f M lookups/s, errors %u\n", p_churn ? "add, remove and look up" : "look up", p_threads, p_bench->lookups / (float)usec, p_bench->errors);
+}
+
+MainLoop *test() {
+
+	Bench *bench = memnew(Bench);
+	for (int i = 0; i < SHARED; i++) {
+
+		bench->shared[i] = memnew(Object);
+		bench->shared_ids[i] = bench->shared[i]->get_instance_id();
+	}
+
+	for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+
+		_run(bench, threads, false);
+		_run(bench, threads, true);
+	}
+
+	for (int i = 0; i < SHARED; i++) {
+
+		memdelete(bench->shared[i]);
+	}
+	memdelete(bench);
+
+	return NULL;
+}
+} // namespace TestObjectDB
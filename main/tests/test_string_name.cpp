@@ -0,0 +1,141 @@
+/*************************************************************************/
+/*  test_string_name.cpp                                                 */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2018 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2018 Godot Engine contributors (cf. AUTHORS.md)    */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "test_string_name.h"
+
+#include "core/os/os.h"
+#include "core/os/thread.h"
+#include "core/string_db.h"
+
+namespace TestStringName {
+
+enum {
+	MAX_THREADS = 8,
+	NAMES = 4096, // kept alive for the whole run
+	ROUNDS = 50,
+	TRANSIENT = 256 // names every thread interns and drops at once
+};
+
+struct Bench {
+
+	String strings[NAMES];
+	StringName names[NAMES];
+	bool transient;
+	uint32_t errors;
+};
+
+struct Worker {
+
+	Bench *bench;
+	int index;
+};
+
+static void _worker(void *p_userdata) {
+
+	Worker *worker = (Worker *)p_userdata;
+	Bench *bench = worker->bench;
+
+	for (int r = 0; r < ROUNDS; r++) {
+
+		if (!bench->transient) {
+			// every thread walks the names from a different start
+			for (int i = 0; i < NAMES; i++) {
+
+				int idx = (i + worker->index * (NAMES / MAX_THREADS)) % NAMES;
+				if (StringName(bench->strings[idx]) != bench->names[idx])
+					atomic_increment(&bench->errors);
+			}
+			continue;
+		}
+
+		// the threads fight over inserting and removing the same names
+		for (int i = 0; i < NAMES; i++) {
+
+			const String &string = bench->strings[i % TRANSIENT];
+			StringName name = string + "_";
+			if (StringName::search(string + "_") != name || String(name) != string + "_")
+				atomic_increment(&bench->errors);
+		}
+	}
+}
+
+static void _run(Bench *p_bench, int p_threads, bool p_transient) {
+
+	OS *os = OS::get_singleton();
+
+	p_bench->transient = p_transient;
+	p_bench->errors = 0;
+
+	Worker workers[MAX_THREADS];
+	Thread *threads[MAX_THREADS];
+
+	uint64_t start = os->get_ticks_usec();
+	for (int i = 0; i < p_threads; i++) {
+		workers[i].bench = p_bench;
+		workers[i].index = i;
+		threads[i] = Thread::create(_worker, &workers[i]);
+	}
+	for (int i = 0; i < p_threads; i++) {
+		Thread::wait_to_finish(threads[i]);
+		memdelete(threads[i]);
+	}
+	uint64_t usec = MAX(os->get_ticks_usec() - start, (uint64_t)1);
+
+	int count = p_threads * ROUNDS * NAMES;
+	os->print("%s, %d threads: %.2f M/s, errors %u\n", p_transient ? "intern and drop" : "look up", p_threads, count / (float)usec, p_bench->errors);
+}
+
+MainLoop *test() {
+
+	OS *os = OS::get_singleton();
+
+	Bench *bench = memnew(Bench);
+	for (int i = 0; i < NAMES; i++) {
+
+		bench->strings[i] = "bench_name_" + itos(i);
+		bench->names[i] = bench->strings[i];
+	}
+
+	for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+
+		_run(bench, threads, false);
+		_run(bench, threads, true);
+	}
+
+	StringName::Stats stats;
+	StringName::get_stats(&stats);
+	os->print("names %u in %u buckets, max chain %u\n", stats.names, stats.buckets, stats.max_chain);
+	os->print("retired %u, locked lookups %u\n", stats.retired, stats.locked_lookups);
+
+	memdelete(bench);
+
+	return NULL;
+}
+} // namespace TestStringName
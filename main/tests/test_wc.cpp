@@ -0,0 +1,1593 @@
+/*************************************************************************/
+/*  test_wc.cpp                                                          */
+/*************************************************************************/
+/*                       This file is part of:                           */
+/*                           GODOT ENGINE                                */
+/*                      https://godotengine.org                          */
+/*************************************************************************/
+/* Copyright (c) 2007-2018 Juan Linietsky, Ariel Manzur.                 */
+/* Copyright (c) 2014-2018 Godot Engine contributors (cf. AUTHORS.md)    */
+/*                                                                       */
+/* Permission is hereby granted, free of charge, to any person obtaining */
+/* a copy of this software and associated documentation files (the       */
+/* "Software"), to deal in the Software without restriction, including   */
+/* without limitation the rights to use, copy, modify, merge, publish,   */
+/* distribute, sublicense, and/or sell copies of the Software, and to    */
+/* permit persons to whom the Software is furnished to do so, subject to */
+/* the following conditions:                                             */
+/*                                                                       */
+/* The above copyright notice and this permission notice shall be        */
+/* included in all copies or substantial portions of the Software.       */
+/*                                                                       */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,       */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF    */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.*/
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY  */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,  */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE     */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                */
+/*************************************************************************/
+
+#include "test_wc.h"
+
+#include "os/dir_access.h"
+#include "os/file_access.h"
+#include "os/main_loop.h"
+#include "os/os.h"
+#include "core/io/json.h"
+#include "core/math/face3.h"
+#include "main/performance.h"
+
+#ifdef MW_ENABLED
+
+#include "modules/mw/deps/noise/noise.h"
+#include "modules/mw/wc/collision.h"
+#include "modules/mw/wc/cstore.h"
+#include "modules/mw/wc/cull.h"
+#include "modules/mw/wc/item.h"
+#include "modules/mw/wc/light.h"
+#include "modules/mw/wc/lod.h"
+#include "modules/mw/wc/net.h"
+#include "modules/mw/wc/section.h"
+#include "modules/mw/wc/wc.h"
+
+namespace TestWC {
+
+static bool _area_ready(WC *p_wc, int p_radius) {
+
+	for (int p = -p_radius; p <= p_radius; p++) {
+		for (int q = -p_radius; q <= p_radius; q++) {
+			Chunk *chunk = p_wc->find_chunk(p, q);
+			if (!chunk || chunk->dirty)
+				return false;
+		}
+	}
+	return p_wc->pending_jobs() == 0;
+}
+
+// streams in a square of chunks around the origin and times each
+// ensure_chunks call, both while filling and once the area is resident.
+static void _test_stream(WC *p_wc, int p_radius) {
+
+	OS *os = OS::get_singleton();
+
+	p_wc->create_radius = p_radius;
+	p_wc->render_radius = p_radius;
+	p_wc->delete_radius = p_radius + 4;
+	p_wc->camera_position = Vector3();
+	p_wc->camera_direction = Vector3(0, 0, -1);
+
+	uint64_t fill_total = 0;
+	uint64_t fill_worst = 0;
+	int fill_frames = 0;
+	uint64_t fill_beg = os->get_ticks_usec();
+
+	while (!_area_ready(p_wc, p_radius)) {
+
+		uint64_t beg = os->get_ticks_usec();
+		p_wc->delete_chunks();
+		p_wc->ensure_chunks(p_wc->camera_position, p_wc->camera_direction);
+		uint64_t elapsed = os->get_ticks_usec() - beg;
+
+		fill_total += elapsed;
+		fill_worst = MAX(fill_worst, elapsed);
+		fill_frames++;
+		os->delay_usec(1000);
+	}
+
+	uint64_t fill_time = os->get_ticks_usec() - fill_beg;
+
+	const int steady_frames = 200;
+	uint64_t steady_total = 0;
+	uint64_t steady_worst = 0;
+
+	for (int i = 0; i < steady_frames; i++) {
+
+		uint64_t beg = os->get_ticks_usec();
+		p_wc->delete_chunks();
+		p_wc->ensure_chunks(p_wc->camera_position, p_wc->camera_direction);
+		uint64_t elapsed = os->get_ticks_usec() - beg;
+
+		steady_total += elapsed;
+		steady_worst = MAX(steady_worst, elapsed);
+	}
+
+	os->print("radius %d, %d workers: %d chunks loaded in %d frames (%.1f ms)\n", p_radius, p_wc->worker_count, p_wc->chunk_count, fill_frames, fill_time / 1000.0);
+	os->print("\tfill   ensure_chunks avg %.1f us, max %d us\n", fill_total / (double)MAX(fill_frames, 1), (int)fill_worst);
+	os->print("\tsteady ensure_chunks avg %.1f us, max %d us\n", steady_total / (double)steady_frames, (int)steady_worst);
+}
+
+static void _test_find_chunk(WC *p_wc) {
+
+	OS *os = OS::get_singleton();
+
+	const int lookups = 1000000;
+	int r = p_wc->create_radius;
+	int found = 0;
+
+	uint64_t beg = os->get_ticks_usec();
+	for (int i = 0; i < lookups; i++) {
+		int p = (i % (2 * r + 5)) - r - 2;
+		int q = ((i / (2 * r + 5)) % (2 * r + 5)) - r - 2;
+		if (p_wc->find_chunk(p, q))
+			found++;
+	}
+	uint64_t elapsed = os->get_ticks_usec() - beg;
+
+	os->print("find_chunk: %d lookups (%d hits) over %d chunks in %d us, %.1f ns/lookup\n", lookups, found, p_wc->chunk_count, (int)elapsed, elapsed * 1000.0 / lookups);
+}
+
+static void _load_map(CMap *p_map, int p_p, int p_q) {
+
+	map_alloc(p_map, p_p * CHUNK_SIZE - 1, 0, p_q * CHUNK_SIZE - 1, 0x7fff);
+	WorkerItem item;
+	item.p = p_p;
+	item.q = p_q;
+	item.store = NULL;
+	item.block_maps[1][1] = p_map;
+	item.light_maps[1][1] = NULL;
+	load_chunk(&item);
+}
+
+// meshes a square of chunks with the naive and the greedy mesher.
+static void _test_mesh() {
+
+	OS *os = OS::get_singleton();
+
+	const int side = 4;
+	CMap maps[side + 2][side + 2];
+	for (int a = 0; a < side + 2; a++) {
+		for (int b = 0; b < side + 2; b++) {
+			_load_map(&maps[a][b], a - 1, b - 1);
+		}
+	}
+
+	uint64_t naive_time = 0;
+	int naive_vertices = 0;
+
+	for (int greedy = 0; greedy < 2; greedy++) {
+
+		uint64_t total_time = 0;
+		int total_faces = 0;
+		int total_vertices = 0;
+		int total_indices = 0;
+
+		for (int p = 0; p < side; p++) {
+			for (int q = 0; q < side; q++) {
+
+				WorkerItem item;
+				item.p = p;
+				item.q = q;
+				item.greedy = greedy;
+				item.lod = 0;
+				item.lod_edges = 0;
+				item.lighting = 0;
+				item.collision = 0;
+				for (int a = 0; a < 3; a++) {
+					for (int b = 0; b < 3; b++) {
+						item.block_maps[a][b] = &maps[p + a][q + b];
+					}
+				}
+
+				uint64_t beg = os->get_ticks_usec();
+				compute_chunk(&item);
+				total_time += os->get_ticks_usec() - beg;
+				total_faces += item.faces;
+				total_vertices += item.vertices;
+				total_indices += item.indices;
+			}
+		}
+
+		if (!greedy) {
+			naive_time = total_time;
+			naive_vertices = total_vertices;
+		}
+
+		os->print("%s: %d chunks, %d exposed faces, %d vertices, %d indices, %d us (%.1f us/chunk)\n", greedy ? "greedy" : "naive", side * side, total_faces, total_vertices, total_indices, (int)total_time, total_time / (double)(side * side));
+		if (greedy) {
+			os->print("\tgreedy/naive vertices %.3f, time %.3f\n", total_vertices / (double)MAX(naive_vertices, 1), total_time / (double)MAX(naive_time, (uint64_t)1));
+		}
+	}
+
+	for (int a = 0; a < side + 2; a++) {
+		for (int b = 0; b < side + 2; b++) {
+			map_free(&maps[a][b]);
+		}
+	}
+}
+
+// meshes a square of chunks at every level of detail, with closed edges and
+// with every side open the way a chunk next to a finer ring is meshed.
+static void _test_lod() {
+
+	OS *os = OS::get_singleton();
+
+	const int side = 4;
+	CMap maps[side + 2][side + 2];
+	for (int a = 0; a < side + 2; a++) {
+		for (int b = 0; b < side + 2; b++) {
+			_load_map(&maps[a][b], a - 1, b - 1);
+		}
+	}
+
+	int full_vertices = 0;
+	bool ok = true;
+	for (int lod = 0; lod < LOD_LEVELS; lod++) {
+		for (int open = 0; open < 2; open++) {
+
+			if (lod == 0 && open) {
+				// full resolution chunks never open their edges
+				continue;
+			}
+
+			uint64_t total_time = 0;
+			int total_faces = 0;
+			int total_vertices = 0;
+
+			for (int p = 0; p < side; p++) {
+				for (int q = 0; q < side; q++) {
+
+					WorkerItem item;
+					item.p = p;
+					item.q = q;
+					item.greedy = 0;
+					item.lighting = 0;
+					item.collision = 0;
+					item.lod = lod;
+					item.lod_edges = open ? (1 << CULL_FACE_LEFT) | (1 << CULL_FACE_RIGHT) | (1 << CULL_FACE_BACK) | (1 << CULL_FACE_FRONT) : 0;
+					for (int a = 0; a < 3; a++) {
+						for (int b = 0; b < 3; b++) {
+							item.block_maps[a][b] = &maps[p + a][q + b];
+						}
+					}
+
+					uint64_t beg = os->get_ticks_usec();
+					compute_chunk(&item);
+					total_time += os->get_ticks_usec() - beg;
+					total_faces += item.faces;
+					total_vertices += item.vertices;
+					if (item.vertices != item.faces * 4) {
+						ok = false;
+					}
+				}
+			}
+
+			if (lod == 0) {
+				full_vertices = total_vertices;
+			} else if (total_vertices >= full_vertices) {
+				ok = false;
+			}
+			os->print("lod %d%s: %d chunks, %d faces, %d vertices (%.3f of full), %.1f us/chunk\n", lod, open ? " open edges" : "", side * side, total_faces, total_vertices, total_vertices / (double)MAX(full_vertices, 1), total_time / (double)(side * side));
+		}
+	}
+	os->print("lod: %s\n", ok ? "coarse levels mesh fewer vertices" : "FAILED");
+
+	for (int a = 0; a < side + 2; a++) {
+		for (int b = 0; b < side + 2; b++) {
+			map_free(&maps[a][b]);
+		}
+	}
+}
+
+static void _store_set_func(int x, int y, int z, int w, void *arg) {
+
+	store_set((CStore *)arg, x, y, z, w);
+}
+
+static int _count_faces(int w, int f1, int f2, int f3, int f4, int f5, int f6) {
+
+	int total = f1 + f2 + f3 + f4 + f5 + f6;
+	if (total && is_plant(w))
+		total = 4;
+	return total;
+}
+
+// exposed faces of the center map the way compute_chunk counts them, by
+// first rasterizing the 3x3 maps into an opaque volume.
+static int _map_faces(CMap *p_maps[3][3], int p_p, int p_q) {
+
+	char *opaque = (char *)memalloc(XZ_SIZE * XZ_SIZE * Y_SIZE);
+	memset(opaque, 0, XZ_SIZE * XZ_SIZE * Y_SIZE);
+
+	int ox = p_p * CHUNK_SIZE - CHUNK_SIZE - 1;
+	int oy = -1;
+	int oz = p_q * CHUNK_SIZE - CHUNK_SIZE - 1;
+
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) {
+			CMap *map = p_maps[a][b];
+			MAP_FOR_EACH(map, ex, ey, ez, ew) {
+				int x = ex - ox;
+				int y = ey - oy;
+				int z = ez - oz;
+				if (x < 0 || y < 0 || z < 0 || x >= XZ_SIZE || y >= Y_SIZE || z >= XZ_SIZE)
+					continue;
+				opaque[XYZ(x, y, z)] = !is_transparent(ew);
+			}
+			END_MAP_FOR_EACH;
+		}
+	}
+
+	int faces = 0;
+	CMap *map = p_maps[1][1];
+	MAP_FOR_EACH(map, ex, ey, ez, ew) {
+		if (ew <= 0)
+			continue;
+		int x = ex - ox;
+		int y = ey - oy;
+		int z = ez - oz;
+		faces += _count_faces(ew,
+				!opaque[XYZ(x - 1, y, z)], !opaque[XYZ(x + 1, y, z)],
+				!opaque[XYZ(x, y + 1, z)], !opaque[XYZ(x, y - 1, z)] && (ey > 0),
+				!opaque[XYZ(x, y, z - 1)], !opaque[XYZ(x, y, z + 1)]);
+	}
+	END_MAP_FOR_EACH;
+
+	memfree(opaque);
+	return faces;
+}
+
+// the same count reading neighbours straight out of the stores.
+static int _store_faces(CStore *p_stores[3][3]) {
+
+	CStoreView view;
+	store_view_init(&view, p_stores);
+
+	int faces = 0;
+	CStore *store = p_stores[1][1];
+	STORE_FOR_EACH(store, ex, ey, ez, ew) {
+		int x = ex - view.dx;
+		int z = ez - view.dz;
+		faces += _count_faces(ew,
+				is_transparent(store_view_get_local(&view, x - 1, ey, z)), is_transparent(store_view_get_local(&view, x + 1, ey, z)),
+				is_transparent(store_view_get_local(&view, x, ey + 1, z)), is_transparent(store_view_get_local(&view, x, ey - 1, z)) && (ey > 0),
+				is_transparent(store_view_get_local(&view, x, ey, z - 1)), is_transparent(store_view_get_local(&view, x, ey, z + 1)));
+	}
+	END_STORE_FOR_EACH;
+
+	return faces;
+}
+
+// CMap against the palette store on the same terrain: generation, memory,
+// iteration, lookups and the exposed face count used by meshing.
+static void _test_storage() {
+
+	OS *os = OS::get_singleton();
+
+	const int side = 4;
+	const int grid = side + 2;
+	CMap maps[grid][grid];
+	CStore stores[grid][grid];
+
+	uint64_t beg = os->get_ticks_usec();
+	for (int a = 0; a < grid; a++) {
+		for (int b = 0; b < grid; b++) {
+			_load_map(&maps[a][b], a - 1, b - 1);
+		}
+	}
+	uint64_t map_fill = os->get_ticks_usec() - beg;
+
+	beg = os->get_ticks_usec();
+	for (int a = 0; a < grid; a++) {
+		for (int b = 0; b < grid; b++) {
+			store_alloc(&stores[a][b], (a - 1) * CHUNK_SIZE, (b - 1) * CHUNK_SIZE);
+			create_world(a - 1, b - 1, _store_set_func, &stores[a][b]);
+		}
+	}
+	uint64_t store_fill = os->get_ticks_usec() - beg;
+
+	uint64_t map_memory = 0;
+	uint64_t store_memory_total = 0;
+	for (int a = 0; a < grid; a++) {
+		for (int b = 0; b < grid; b++) {
+			map_memory += (maps[a][b].mask + 1) * sizeof(CMapEntry);
+			store_memory_total += store_memory(&stores[a][b]);
+		}
+	}
+
+	int map_blocks = 0;
+	// a checksum of the block positions, so both walks visit the same cells.
+	int64_t map_cells = 0;
+	beg = os->get_ticks_usec();
+	for (int a = 1; a <= side; a++) {
+		for (int b = 1; b <= side; b++) {
+			CMap *map = &maps[a][b];
+			MAP_FOR_EACH(map, ex, ey, ez, ew) {
+				if (ew > 0) {
+					map_blocks++;
+					map_cells += ((int64_t)ex * Y_SIZE + ey) * 8191 + ez;
+				}
+			}
+			END_MAP_FOR_EACH;
+		}
+	}
+	uint64_t map_iterate = os->get_ticks_usec() - beg;
+
+	int store_blocks = 0;
+	int64_t store_cells = 0;
+	beg = os->get_ticks_usec();
+	for (int a = 1; a <= side; a++) {
+		for (int b = 1; b <= side; b++) {
+			CStore *store = &stores[a][b];
+			STORE_FOR_EACH(store, ex, ey, ez, ew) {
+				if (ew > 0) {
+					store_blocks++;
+					store_cells += ((int64_t)ex * Y_SIZE + ey) * 8191 + ez;
+				}
+			}
+			END_STORE_FOR_EACH;
+		}
+	}
+	uint64_t store_iterate = os->get_ticks_usec() - beg;
+
+	// every block of the lowest 64 layers, where the terrain is.
+	int map_sum = 0;
+	beg = os->get_ticks_usec();
+	for (int a = 1; a <= side; a++) {
+		for (int b = 1; b <= side; b++) {
+			CMap *map = &maps[a][b];
+			for (int y = 0; y < 64; y++)
+				for (int x = 0; x < CHUNK_SIZE; x++)
+					for (int z = 0; z < CHUNK_SIZE; z++)
+						map_sum += map_get(map, (a - 1) * CHUNK_SIZE + x, y, (b - 1) * CHUNK_SIZE + z);
+		}
+	}
+	uint64_t map_lookup = os->get_ticks_usec() - beg;
+
+	int store_sum = 0;
+	beg = os->get_ticks_usec();
+	for (int a = 1; a <= side; a++) {
+		for (int b = 1; b <= side; b++) {
+			CStore *store = &stores[a][b];
+			for (int y = 0; y < 64; y++)
+				for (int x = 0; x < CHUNK_SIZE; x++)
+					for (int z = 0; z < CHUNK_SIZE; z++)
+						store_sum += store_get(store, (a - 1) * CHUNK_SIZE + x, y, (b - 1) * CHUNK_SIZE + z);
+		}
+	}
+	uint64_t store_lookup = os->get_ticks_usec() - beg;
+
+	int map_faces = 0;
+	int store_faces = 0;
+	uint64_t map_mesh = 0;
+	uint64_t store_mesh = 0;
+	for (int p = 0; p < side; p++) {
+		for (int q = 0; q < side; q++) {
+			CMap *map_view[3][3];
+			CStore *store_view[3][3];
+			for (int a = 0; a < 3; a++) {
+				for (int b = 0; b < 3; b++) {
+					map_view[a][b] = &maps[p + a][q + b];
+					store_view[a][b] = &stores[p + a][q + b];
+				}
+			}
+			beg = os->get_ticks_usec();
+			map_faces += _map_faces(map_view, p, q);
+			map_mesh += os->get_ticks_usec() - beg;
+			beg = os->get_ticks_usec();
+			store_faces += _store_faces(store_view);
+			store_mesh += os->get_ticks_usec() - beg;
+		}
+	}
+
+	os->print("storage: %d chunks generated, %d measured\n", grid * grid, side * side);
+	os->print("\tmemory  cmap %d KiB, store %d KiB (%.3f)\n", (int)(map_memory / 1024), (int)(store_memory_total / 1024), store_memory_total / (double)MAX(map_memory, (uint64_t)1));
+	os->print("\tfill    cmap %d us, store %d us\n", (int)map_fill, (int)store_fill);
+	os->print("\titerate cmap %d us, store %d us (%d / %d blocks)\n", (int)map_iterate, (int)store_iterate, map_blocks, store_blocks);
+	os->print("\tlookup  cmap %d us, store %d us (sums %d / %d)\n", (int)map_lookup, (int)store_lookup, map_sum, store_sum);
+	os->print("\tfaces   cmap %d us, store %d us (%d / %d faces)\n", (int)map_mesh, (int)store_mesh, map_faces, store_faces);
+	if (map_blocks != store_blocks || map_cells != store_cells || map_sum != store_sum || map_faces != store_faces)
+		os->print("\tMISMATCH between cmap and store\n");
+
+	for (int a = 0; a < grid; a++) {
+		for (int b = 0; b < grid; b++) {
+			map_free(&maps[a][b]);
+			store_free(&stores[a][b]);
+		}
+	}
+}
+
+// bit columns of the center chunk filled the way compute_chunk fills them.
+static void _cull_fill(CullMasks *r_masks, CMap *p_maps[3][3], int p_p, int p_q) {
+
+	cull_clear(r_masks);
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) {
+			CMap *map = p_maps[a][b];
+			MAP_FOR_EACH(map, ex, ey, ez, ew) {
+				int cx = ex - p_p * CHUNK_SIZE;
+				int cz = ez - p_q * CHUNK_SIZE;
+				if (cx < -1 || cz < -1 || cx > CHUNK_SIZE || cz > CHUNK_SIZE)
+					continue;
+				cull_set_bit(r_masks->opaque[CULL_OPAQUE(cx, cz)], ey, !is_transparent(ew));
+				if (a == 1 && b == 1 && ew > 0 && cx >= 0 && cz >= 0 && cx < CHUNK_SIZE && cz < CHUNK_SIZE) {
+					cull_set_bit(r_masks->solid[CULL_COLUMN(cx, cz)], ey, 1);
+					cull_set_bit(r_masks->plants[CULL_COLUMN(cx, cz)], ey, is_plant(ew));
+				}
+			}
+			END_MAP_FOR_EACH;
+		}
+	}
+}
+
+// checks every block against single bit lookups of its six neighbours,
+// returns the number of blocks whose faces differ.
+static int _cull_check(const CullMasks *p_masks) {
+
+	int errors = 0;
+	for (int x = 0; x < CULL_CHUNK; x++) {
+		for (int z = 0; z < CULL_CHUNK; z++) {
+			const uint64_t *o = p_masks->opaque[CULL_OPAQUE(x, z)];
+			for (int y = 0; y < CULL_HEIGHT; y++) {
+				int solid = cull_get_bit(p_masks->solid[CULL_COLUMN(x, z)], y);
+				int expected[6] = {
+					solid && !cull_get_bit(p_masks->opaque[CULL_OPAQUE(x - 1, z)], y),
+					solid && !cull_get_bit(p_masks->opaque[CULL_OPAQUE(x + 1, z)], y),
+					solid && (y + 1 == CULL_HEIGHT || !cull_get_bit(o, y + 1)),
+					solid && y > 0 && !cull_get_bit(o, y - 1),
+					solid && !cull_get_bit(p_masks->opaque[CULL_OPAQUE(x, z - 1)], y),
+					solid && !cull_get_bit(p_masks->opaque[CULL_OPAQUE(x, z + 1)], y),
+				};
+				for (int f = 0; f < 6; f++) {
+					if (cull_face(p_masks, f, x, y, z) != expected[f]) {
+						errors++;
+						break;
+					}
+				}
+			}
+		}
+	}
+	return errors;
+}
+
+static bool _cull_same(const CullMasks *p_a, const CullMasks *p_b) {
+
+	return memcmp(p_a->faces, p_b->faces, sizeof(p_a->faces)) == 0;
+}
+
+// compares the vector and scalar kernels with per block lookups on random
+// columns and on terrain, then times them against the byte volume.
+static void _test_cull() {
+
+	OS *os = OS::get_singleton();
+
+	CullMasks *masks = (CullMasks *)memalloc(sizeof(CullMasks));
+	CullMasks *scalar = (CullMasks *)memalloc(sizeof(CullMasks));
+	bool ok = true;
+
+	uint32_t seed = 12345;
+	for (int round = 0; round < 8; round++) {
+		// from sparse to nearly full columns
+		uint32_t density = 32 + round * 28;
+		cull_clear(masks);
+		for (int x = -1; x <= CULL_CHUNK; x++) {
+			for (int z = -1; z <= CULL_CHUNK; z++) {
+				for (int y = 0; y < CULL_HEIGHT; y++) {
+					seed = seed * 1664525 + 1013904223;
+					int opaque = ((seed >> 8) & 255) < density;
+					cull_set_bit(masks->opaque[CULL_OPAQUE(x, z)], y, opaque);
+					if (x >= 0 && z >= 0 && x < CULL_CHUNK && z < CULL_CHUNK && (opaque || ((seed >> 16) & 7) == 0)) {
+						cull_set_bit(masks->solid[CULL_COLUMN(x, z)], y, 1);
+						cull_set_bit(masks->plants[CULL_COLUMN(x, z)], y, !opaque);
+					}
+				}
+			}
+		}
+		memcpy(scalar, masks, sizeof(CullMasks));
+		cull_faces(masks);
+		cull_faces_scalar(scalar);
+		int errors = _cull_check(masks);
+		if (errors || !_cull_same(masks, scalar)) {
+			os->print("cull: random round %d, %d blocks differ\n", round, errors);
+			ok = false;
+		}
+	}
+
+	const int side = 4;
+	const int grid = side + 2;
+	CMap maps[grid][grid];
+	for (int a = 0; a < grid; a++) {
+		for (int b = 0; b < grid; b++) {
+			_load_map(&maps[a][b], a - 1, b - 1);
+		}
+	}
+
+	uint64_t bytes_time = 0;
+	uint64_t bits_time = 0;
+	uint64_t fill_time = 0;
+	int bytes_faces = 0;
+	int bits_faces = 0;
+	for (int p = 0; p < side; p++) {
+		for (int q = 0; q < side; q++) {
+			CMap *view[3][3];
+			for (int a = 0; a < 3; a++) {
+				for (int b = 0; b < 3; b++) {
+					view[a][b] = &maps[p + a][q + b];
+				}
+			}
+			uint64_t beg = os->get_ticks_usec();
+			bytes_faces += _map_faces(view, p, q);
+			bytes_time += os->get_ticks_usec() - beg;
+
+			beg = os->get_ticks_usec();
+			_cull_fill(masks, view, p, q);
+			uint64_t filled = os->get_ticks_usec();
+			cull_faces(masks);
+			int miny;
+			int maxy;
+			bits_faces += cull_count(masks, &miny, &maxy, NULL);
+			bits_time += os->get_ticks_usec() - beg;
+			fill_time += filled - beg;
+
+			memcpy(scalar, masks, sizeof(CullMasks));
+			cull_faces_scalar(scalar);
+			int errors = _cull_check(masks);
+			if (errors || !_cull_same(masks, scalar)) {
+				os->print("cull: chunk %d,%d, %d blocks differ\n", p, q, errors);
+				ok = false;
+			}
+		}
+	}
+	if (bytes_faces != bits_faces) {
+		os->print("cull: %d faces from the byte volume, %d from bit columns\n", bytes_faces, bits_faces);
+		ok = false;
+	}
+
+	const int kernel_runs = 1000;
+	uint64_t beg = os->get_ticks_usec();
+	for (int i = 0; i < kernel_runs; i++) {
+		cull_faces_scalar(masks);
+	}
+	uint64_t scalar_time = os->get_ticks_usec() - beg;
+	beg = os->get_ticks_usec();
+	for (int i = 0; i < kernel_runs; i++) {
+		cull_faces(masks);
+	}
+	uint64_t vector_time = os->get_ticks_usec() - beg;
+
+	os->print("cull: %s\n", ok ? "kernels match per block lookups" : "FAILED");
+	os->print("\t%d chunks, %d faces: byte volume %.1f us/chunk, bit columns %.1f us/chunk (fill %.1f)\n", side * side, bits_faces, bytes_time / (double)(side * side), bits_time / (double)(side * side), fill_time / (double)(side * side));
+	os->print("\tkernel scalar %.2f us, cull_faces %.2f us per chunk\n", scalar_time / (double)kernel_runs, vector_time / (double)kernel_runs);
+
+	for (int a = 0; a < grid; a++) {
+		for (int b = 0; b < grid; b++) {
+			map_free(&maps[a][b]);
+		}
+	}
+	memfree(masks);
+	memfree(scalar);
+}
+
+static bool _maps_equal(CMap *p_a, CMap *p_b) {
+
+	if (p_a->size != p_b->size)
+		return false;
+	MAP_FOR_EACH(p_a, ex, ey, ez, ew) {
+		if (map_get(p_b, ex, ey, ez) != ew)
+			return false;
+	}
+	END_MAP_FOR_EACH;
+	return true;
+}
+
+// saves a square of generated chunks and their light sources through a
+// region store, reopens the store and loads them back, timing generation
+// against loading.
+static void _test_region() {
+
+	OS *os = OS::get_singleton();
+	String path = os->get_user_data_dir().plus_file("wc_region_test");
+
+	const int side = 8;
+	CMap maps[side][side];
+	CMap lights[side][side];
+
+	uint64_t beg = os->get_ticks_usec();
+	for (int p = 0; p < side; p++) {
+		for (int q = 0; q < side; q++) {
+			_load_map(&maps[p][q], p, q);
+		}
+	}
+	uint64_t generate_time = os->get_ticks_usec() - beg;
+
+	// up to three sources per chunk, some chunks save without any
+	for (int p = 0; p < side; p++) {
+		for (int q = 0; q < side; q++) {
+			CMap *map = &lights[p][q];
+			map_alloc(map, p * CHUNK_SIZE - 1, 0, q * CHUNK_SIZE - 1, 0xf);
+			for (int i = 0; i < (p + q) % 4; i++) {
+				map_set(map, p * CHUNK_SIZE + i * 7, 40 + i, q * CHUNK_SIZE + 31 - i * 5, LIGHT_MAX - i);
+			}
+		}
+	}
+
+	RegionStore store;
+	region_open(&store, path);
+	beg = os->get_ticks_usec();
+	for (int p = 0; p < side; p++) {
+		for (int q = 0; q < side; q++) {
+			region_save(&store, &maps[p][q], &lights[p][q], p, q);
+		}
+	}
+	uint64_t queue_time = os->get_ticks_usec() - beg;
+	region_close(&store);
+	uint64_t save_time = os->get_ticks_usec() - beg;
+
+	String file_path = path.plus_file("r.0.0.wcr");
+	FileAccess *f = FileAccess::open(file_path, FileAccess::READ);
+	int file_size = f ? f->get_len() : 0;
+	if (f)
+		memdelete(f);
+
+	int mismatches = 0;
+	region_open(&store, path);
+	beg = os->get_ticks_usec();
+	for (int p = 0; p < side; p++) {
+		for (int q = 0; q < side; q++) {
+			CMap map;
+			CMap light_map;
+			map_alloc(&map, p * CHUNK_SIZE - 1, 0, q * CHUNK_SIZE - 1, 0x7fff);
+			map_alloc(&light_map, p * CHUNK_SIZE - 1, 0, q * CHUNK_SIZE - 1, 0xf);
+			WorkerItem item;
+			item.p = p;
+			item.q = q;
+			item.store = &store;
+			item.block_maps[1][1] = &map;
+			item.light_maps[1][1] = &light_map;
+			load_chunk(&item);
+			if (item.generated || !_maps_equal(&maps[p][q], &map) || !_maps_equal(&lights[p][q], &light_map))
+				mismatches++;
+			map_free(&map);
+			map_free(&light_map);
+		}
+	}
+	uint64_t load_time = os->get_ticks_usec() - beg;
+	region_close(&store);
+
+	int chunks = side * side;
+	os->print("region: %d chunks, %s\n", chunks, mismatches ? "FAILED" : "blocks and light sources loaded back unchanged");
+	if (mismatches)
+		os->print("\t%d chunks differ after loading\n", mismatches);
+	os->print("\tgenerate %.1f us/chunk, load %.1f us/chunk\n", generate_time / (double)chunks, load_time / (double)chunks);
+	os->print("\tsave queued in %d us, written in %d us, %d bytes on disk (%.1f per chunk)\n", (int)queue_time, (int)save_time, file_size, file_size / (double)chunks);
+
+	for (int p = 0; p < side; p++) {
+		for (int q = 0; q < side; q++) {
+			map_free(&maps[p][q]);
+			map_free(&lights[p][q]);
+		}
+	}
+
+	DirAccess *dir = DirAccess::create_for_path(path);
+	dir->remove(file_path);
+	dir->remove(path);
+	memdelete(dir);
+}
+
+// edits a block inside a chunk, on a chunk border and on a chunk corner,
+// and times the main thread remesh that makes each edit visible.
+static void _test_edit() {
+
+	OS *os = OS::get_singleton();
+
+	WC *wc = memnew(WC);
+
+	// the constructor forced the 3x3 chunks around the origin
+	struct {
+		const char *name;
+		int x;
+		int z;
+		int remeshed;
+	} edits[3] = {
+		{ "inside", 10, 10, 1 },
+		{ "border", 0, 10, 2 },
+		// the shadow the block casts down its column reaches the diagonal
+		// chunk's mesh too
+		{ "corner", 0, 0, 4 },
+	};
+	const int y = 100;
+
+	for (int i = 0; i < 3; i++) {
+
+		wc->set_block(edits[i].x, y, edits[i].z, STONE);
+		int remeshed = wc->edited_chunk_count;
+		bool mirrored = edits[i].x != 0 || map_get(&wc->find_chunk(-1, 0)->map, edits[i].x, y, edits[i].z) == -STONE;
+
+		uint64_t beg = os->get_ticks_usec();
+		wc->flush_edits();
+		uint64_t elapsed = os->get_ticks_usec() - beg;
+
+		bool ok = wc->get_block(edits[i].x, y, edits[i].z) == STONE && remeshed == edits[i].remeshed && mirrored;
+		os->print("edit %s: %d chunks remeshed in %d us%s\n", edits[i].name, remeshed, (int)elapsed, ok ? "" : " FAILED");
+
+		wc->set_block(edits[i].x, y, edits[i].z, EMPTY);
+		wc->flush_edits();
+	}
+
+	while (wc->pending_jobs()) {
+		wc->check_workers();
+		os->delay_usec(1000);
+	}
+	memdelete(wc);
+}
+
+static void _light_compute(LightMap *r_light, CMap p_maps[5][5], CMap p_sources[5][5], int p_a, int p_b) {
+
+	CMap *block_maps[3][3];
+	CMap *light_maps[3][3];
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) {
+			block_maps[a][b] = &p_maps[p_a + a - 1][p_b + b - 1];
+			light_maps[a][b] = &p_sources[p_a + a - 1][p_b + b - 1];
+		}
+	}
+	LightVolume volume;
+	light_compute(&volume, block_maps, light_maps, p_a - 2, p_b - 2);
+	light_store(r_light, &volume, p_a - 2, p_b - 2);
+	light_volume_free(&volume);
+}
+
+// cells of the 3x3 chunks around the origin whose light differs from
+// lighting them again from scratch.
+static int _light_mismatches(LightMap p_light[3][3], CMap p_maps[5][5], CMap p_sources[5][5]) {
+
+	int mismatches = 0;
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) {
+			LightMap fresh;
+			light_map_init(&fresh);
+			_light_compute(&fresh, p_maps, p_sources, a + 1, b + 1);
+			for (int y = 0; y < LIGHT_HEIGHT; y++) {
+				for (int x = 0; x < CHUNK_SIZE; x++) {
+					for (int z = 0; z < CHUNK_SIZE; z++) {
+						mismatches += light_map_get(&fresh, x, y, z) != light_map_get(&p_light[a][b], x, y, z);
+					}
+				}
+			}
+			light_map_free(&fresh);
+		}
+	}
+	return mismatches;
+}
+
+// lights the chunks around the origin, then digs, roofs over and lights up
+// a spot in the middle one. every edit is relit in place and checked
+// against lighting the chunks from scratch.
+static void _test_light() {
+
+	OS *os = OS::get_singleton();
+
+	CMap maps[5][5];
+	CMap sources[5][5];
+	for (int a = 0; a < 5; a++) {
+		for (int b = 0; b < 5; b++) {
+			_load_map(&maps[a][b], a - 2, b - 2);
+			map_alloc(&sources[a][b], (a - 2) * CHUNK_SIZE - 1, 0, (b - 2) * CHUNK_SIZE - 1, 0xf);
+		}
+	}
+
+	LightMap light[3][3];
+	LightEdit edit;
+	light_edit_init(&edit, 0, 0);
+	uint64_t beg = os->get_ticks_usec();
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) {
+			light_map_init(&light[a][b]);
+			_light_compute(&light[a][b], maps, sources, a + 1, b + 1);
+			edit.maps[a][b] = &light[a][b];
+			edit.block_maps[a][b] = &maps[a + 1][b + 1];
+			edit.light_maps[a][b] = &sources[a + 1][b + 1];
+		}
+	}
+	uint64_t compute_time = os->get_ticks_usec() - beg;
+
+	const int x = 16;
+	const int z = 16;
+	int top = LIGHT_HEIGHT - 1;
+	while (top > 0 && is_transparent(map_get(&maps[2][2], x, top, z))) {
+		top--;
+	}
+
+	// blocks and sources are set in a square of size around x, z and from
+	// y0 up to y1, source -1 leaves the sources alone
+	struct {
+		const char *name;
+		int y0;
+		int y1;
+		int size;
+		int block;
+		int source;
+	} steps[5] = {
+		{ "dig", top - 3, top, 1, EMPTY, -1 },
+		{ "roof", top + 4, top + 4, 5, STONE, -1 },
+		{ "torch", top - 3, top - 3, 1, -1, LIGHT_MAX },
+		{ "unroof", top + 4, top + 4, 1, EMPTY, -1 },
+		{ "torch off", top - 3, top - 3, 1, -1, 0 },
+	};
+
+	bool ok = true;
+	for (int i = 0; i < 5; i++) {
+		int edits = 0;
+		uint64_t elapsed = 0;
+		int r = steps[i].size / 2;
+		for (int dx = -r; dx <= r; dx++) {
+			for (int dz = -r; dz <= r; dz++) {
+				for (int y = steps[i].y0; y <= steps[i].y1; y++) {
+					if (steps[i].source < 0) {
+						map_set(&maps[2][2], x + dx, y, z + dz, steps[i].block);
+					} else {
+						map_set(&sources[2][2], x + dx, y, z + dz, steps[i].source);
+					}
+					beg = os->get_ticks_usec();
+					light_edit(&edit, x + dx, y, z + dz);
+					elapsed += os->get_ticks_usec() - beg;
+					edits++;
+				}
+			}
+		}
+		int mismatches = _light_mismatches(light, maps, sources);
+		ok = ok && !mismatches;
+		os->print("light %s: %d edits in %d us (%.1f us/edit), %d cells differ%s\n", steps[i].name, edits, (int)elapsed, elapsed / (double)edits, mismatches, mismatches ? " FAILED" : "");
+	}
+	os->print("light: %.1f us/chunk from scratch, %s\n", compute_time / 9.0, ok ? "edits match" : "FAILED");
+
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) {
+			light_map_free(&light[a][b]);
+		}
+	}
+	for (int a = 0; a < 5; a++) {
+		for (int b = 0; b < 5; b++) {
+			map_free(&maps[a][b]);
+			map_free(&sources[a][b]);
+		}
+	}
+}
+
+// samples the terrain noise of a square of chunks with simplex2 and with
+// simplex2_batch, then times create_world on the same chunks.
+static void _test_noise() {
+
+	OS *os = OS::get_singleton();
+
+	const int side = 8;
+	const int size = CHUNK_SIZE + 2;
+	const int count = size * size;
+	float *x = memnew_arr(float, count);
+	float *z = memnew_arr(float, count);
+	float *scalar = memnew_arr(float, count);
+	float *batch = memnew_arr(float, count);
+
+	uint64_t scalar_time = 0;
+	uint64_t batch_time = 0;
+	int mismatches = 0;
+	float max_error = 0;
+	for (int p = 0; p < side; p++) {
+		for (int q = 0; q < side; q++) {
+			for (int i = 0; i < count; i++) {
+				x[i] = (p * CHUNK_SIZE + i / size - 1) * 0.01;
+				z[i] = (q * CHUNK_SIZE + i % size - 1) * 0.01;
+			}
+
+			uint64_t beg = os->get_ticks_usec();
+			for (int i = 0; i < count; i++) {
+				scalar[i] = simplex2(x[i], z[i], 4, 0.5, 2);
+			}
+			scalar_time += os->get_ticks_usec() - beg;
+
+			beg = os->get_ticks_usec();
+			simplex2_batch(batch, x, z, count, 4, 0.5, 2);
+			batch_time += os->get_ticks_usec() - beg;
+
+			for (int i = 0; i < count; i++) {
+				float error = Math::abs(scalar[i] - batch[i]);
+				mismatches += error != 0;
+				max_error = MAX(max_error, error);
+			}
+		}
+	}
+
+	uint64_t world_time = 0;
+	for (int p = 0; p < side; p++) {
+		for (int q = 0; q < side; q++) {
+			CMap map;
+			uint64_t beg = os->get_ticks_usec();
+			_load_map(&map, p, q);
+			world_time += os->get_ticks_usec() - beg;
+			map_free(&map);
+		}
+	}
+
+	int chunks = side * side;
+	os->print("noise: %d of %d samples differ, max error %g\n", mismatches, chunks * count, max_error);
+	os->print("\tsimplex2 %.1f us/chunk, simplex2_batch %.1f us/chunk (%.2fx)\n", scalar_time / (double)chunks, batch_time / (double)chunks, scalar_time / (double)MAX(batch_time, (uint64_t)1));
+	os->print("\tcreate_world %.1f us/chunk, %.1f chunks/s\n", world_time / (double)chunks, chunks * 1000000.0 / MAX(world_time, (uint64_t)1));
+
+	memdelete_arr(x);
+	memdelete_arr(z);
+	memdelete_arr(scalar);
+	memdelete_arr(batch);
+}
+
+static bool _collision_solid(CMap *p_map, const Vector3 &p_point) {
+
+	int y = Math::floor(p_point.y + 0.5);
+	return y >= 0 && is_obstacle(map_get(p_map, Math::floor(p_point.x + 0.5), y, Math::floor(p_point.z + 0.5)));
+}
+
+// builds the collision faces of a square of chunks, checks each triangle
+// faces out of an obstacle block into open space and that the triangles
+// cover the exposed obstacle faces exactly, then checks a WC gives the
+// chunks in its collision radius a static body.
+static void _test_collision() {
+
+	OS *os = OS::get_singleton();
+
+	const int side = 4;
+	CMap maps[side][side];
+	for (int a = 0; a < side; a++) {
+		for (int b = 0; b < side; b++) {
+			_load_map(&maps[a][b], a, b);
+		}
+	}
+
+	uint64_t total_time = 0;
+	int total_triangles = 0;
+	int total_faces = 0;
+	bool ok = true;
+	for (int p = 0; p < side; p++) {
+		for (int q = 0; q < side; q++) {
+
+			CMap *map = &maps[p][q];
+			PoolVector<Vector3> faces;
+			uint64_t beg = os->get_ticks_usec();
+			int triangles = make_collision_faces(&faces, map, p, q);
+			total_time += os->get_ticks_usec() - beg;
+			total_triangles += triangles;
+
+			PoolVector<Vector3>::Read r = faces.read();
+			float area = 0;
+			for (int i = 0; i < triangles; i++) {
+				Face3 face(r[i * 3], r[i * 3 + 1], r[i * 3 + 2]);
+				Vector3 normal = face.get_plane().normal;
+				Vector3 center = face.get_median_point();
+				if (!_collision_solid(map, center - normal * 0.5) || _collision_solid(map, center + normal * 0.5)) {
+					ok = false;
+				}
+				area += face.get_area();
+			}
+
+			int exposed = 0;
+			MAP_FOR_EACH(map, ex, ey, ez, ew) {
+				int lx = ex - p * CHUNK_SIZE;
+				int lz = ez - q * CHUNK_SIZE;
+				if (ew <= 0 || !is_obstacle(ew) || lx < 0 || lz < 0 || lx >= CHUNK_SIZE || lz >= CHUNK_SIZE) {
+					continue;
+				}
+				const int offsets[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+				for (int i = 0; i < 6; i++) {
+					int y = ey + offsets[i][1];
+					exposed += y >= 0 && !is_obstacle(map_get(map, ex + offsets[i][0], y, ez + offsets[i][2]));
+				}
+			} END_MAP_FOR_EACH;
+			total_faces += exposed;
+			if (Math::abs(area - exposed) > 0.01) {
+				ok = false;
+			}
+		}
+	}
+	os->print("collision: %d chunks, %d exposed faces as %d triangles (%.3f per face), %.1f us/chunk%s\n", side * side, total_faces, total_triangles, total_triangles / (double)MAX(total_faces, 1), total_time / (double)(side * side), ok ? "" : " FAILED");
+
+	for (int a = 0; a < side; a++) {
+		for (int b = 0; b < side; b++) {
+			map_free(&maps[a][b]);
+		}
+	}
+
+	WC *wc = memnew(WC);
+	wc->set("collision_radius", 2);
+	_test_stream(wc, 4);
+	int bodies = 0;
+	int inside = 0;
+	for (int i = 0; i < wc->chunk_slots; i++) {
+		Chunk *chunk = wc->chunks + i;
+		if (chunk->active && chunk->body.is_valid()) {
+			bodies++;
+			inside += wc->chunk_collides(chunk->p, chunk->q);
+		}
+	}
+	ok = bodies == 25 && inside == bodies;
+	os->print("collision: %d static bodies within radius 2 of %d chunks%s\n", bodies, wc->chunk_count, ok ? "" : " FAILED");
+	memdelete(wc);
+}
+
+// streams an area in and checks the per stage counters against the chunks,
+// then reads them back through the Performance monitors.
+static void _test_stats() {
+
+	OS *os = OS::get_singleton();
+
+	WC *wc = memnew(WC);
+	int initial = wc->chunk_count;
+	wc->roll_stats();
+	_test_stream(wc, 4);
+	while (wc->pending_jobs()) {
+		wc->check_workers();
+		os->delay_usec(1000);
+	}
+	WCStats stats = wc->stats;
+	wc->roll_stats();
+
+	bool ok = stats.loaded == wc->chunk_count - initial && stats.generated == stats.loaded && stats.meshed >= stats.loaded && stats.faces > 0 && stats.unloaded == 0;
+	ok = ok && wc->get_stat(WC::STAT_CHUNKS_LOADED) == stats.loaded && wc->get_stat(WC::STAT_QUEUE_DEPTH) == 0;
+	os->print("stats: %d chunks loaded, %d meshed, %d faces%s\n", stats.loaded, stats.meshed, stats.faces, ok ? "" : " FAILED");
+	os->print("\tgeneration %.1f us, meshing %.1f us, upload %.1f us per chunk, %.1f KB of maps\n",
+			wc->get_stat(WC::STAT_GENERATION_USEC), wc->get_stat(WC::STAT_MESHING_USEC),
+			wc->get_stat(WC::STAT_UPLOAD_USEC), wc->get_stat(WC::STAT_CMAP_MEMORY) / 1024.0);
+
+	Performance *performance = Performance::get_singleton();
+	wc->register_monitors();
+	Array names = performance->get_custom_monitor_names();
+	Array types = performance->get_custom_monitor_types();
+	ok = names.size() == WC::STAT_MAX && names.find("wc/cmap_memory") != -1;
+	ok = ok && (int)types[names.find("wc/cmap_memory")] == Performance::MONITOR_TYPE_MEMORY;
+	ok = ok && performance->get_custom_monitor("wc/faces") == wc->get_stat(WC::STAT_FACES);
+	wc->unregister_monitors();
+	ok = ok && !performance->has_custom_monitor("wc/faces");
+	os->print("stats: %d monitors registered%s\n", names.size(), ok ? "" : " FAILED");
+
+	memdelete(wc);
+}
+
+static int _held_visuals(WC *p_wc) {
+
+	int held = 0;
+	for (int i = 0; i < p_wc->chunk_slots; i++) {
+		Chunk *chunk = p_wc->chunks + i;
+		for (int s = 0; chunk->active && s < CHUNK_SECTIONS; s++) {
+			held += chunk->sections[s].instance.is_valid();
+		}
+	}
+	return held;
+}
+
+// section visibility of a few hand built sections, then the section meshes
+// of real chunks at every mesher, then cave culling over a streamed area.
+static void _test_sections() {
+
+	OS *os = OS::get_singleton();
+
+	CullMasks *masks = (CullMasks *)Memory::alloc_static(sizeof(CullMasks), true);
+	cull_clear(masks);
+	// section 0 solid, section 1 solid but for a tunnel along x at y 40
+	for (int x = 0; x < CHUNK_SIZE; x++) {
+		for (int z = 0; z < CHUNK_SIZE; z++) {
+			for (int y = 0; y < 2 * CHUNK_SECTION_HEIGHT; y++) {
+				cull_set_bit(masks->opaque[CULL_OPAQUE(x, z)], y, !(y == 40 && z == 5));
+			}
+		}
+	}
+	uint64_t visibility[CHUNK_SECTIONS];
+	section_visibility(visibility, masks);
+	Memory::free_static(masks, true);
+	bool ok = visibility[0] == 0 && visibility[2] == SECTION_OPEN;
+	ok = ok && SECTION_SEES(visibility[1], CULL_FACE_LEFT, CULL_FACE_RIGHT) && !SECTION_SEES(visibility[1], CULL_FACE_TOP, CULL_FACE_BOTTOM);
+	ok = ok && !SECTION_SEES(visibility[1], CULL_FACE_LEFT, CULL_FACE_FRONT);
+	os->print("sections: visibility of solid, tunnel and open sections%s\n", ok ? "" : " FAILED");
+
+	const int side = 2;
+	CMap maps[side + 2][side + 2];
+	for (int a = 0; a < side + 2; a++) {
+		for (int b = 0; b < side + 2; b++) {
+			_load_map(&maps[a][b], a - 1, b - 1);
+		}
+	}
+	ok = true;
+	int meshes = 0;
+	for (int mode = 0; mode < 3; mode++) {
+		for (int p = 0; p < side; p++) {
+			for (int q = 0; q < side; q++) {
+
+				WorkerItem item;
+				item.p = p;
+				item.q = q;
+				item.greedy = mode == 1;
+				item.lod = mode == 2 ? 1 : 0;
+				item.lod_edges = 0;
+				item.lighting = 0;
+				item.collision = 0;
+				for (int a = 0; a < 3; a++) {
+					for (int b = 0; b < 3; b++) {
+						item.block_maps[a][b] = &maps[p + a][q + b];
+					}
+				}
+				compute_chunk(&item);
+
+				int faces = 0;
+				int vertices = 0;
+				for (int s = 0; s < CHUNK_SECTIONS; s++) {
+					faces += item.section_faces[s];
+					if (item.mesh_arrays[s].empty() != !item.section_faces[s]) {
+						ok = false;
+						continue;
+					}
+					if (item.mesh_arrays[s].empty()) {
+						continue;
+					}
+					meshes++;
+					PoolVector<Vector3> points = item.mesh_arrays[s][VS::ARRAY_VERTEX];
+					PoolVector<Vector3>::Read r = points.read();
+					for (int i = 0; i < points.size(); i++) {
+						if (r[i].y < s * CHUNK_SECTION_HEIGHT - 0.5 || r[i].y > (s + 1) * CHUNK_SECTION_HEIGHT - 0.5) {
+							ok = false;
+						}
+					}
+					vertices += points.size();
+				}
+				if (faces != item.faces || vertices != item.vertices) {
+					ok = false;
+				}
+			}
+		}
+	}
+	for (int a = 0; a < side + 2; a++) {
+		for (int b = 0; b < side + 2; b++) {
+			map_free(&maps[a][b]);
+		}
+	}
+	os->print("sections: %d section meshes over %d chunks, naive, greedy and lod, stay in their sections%s\n", meshes, side * side * 3, ok ? "" : " FAILED");
+
+	WC *wc = memnew(WC);
+	_test_stream(wc, 4);
+	int held = _held_visuals(wc);
+
+	// from high above, everything's top sections are in sight
+	Vector<Plane> planes;
+	int shown = wc->cull_sections(Vector3(0, 250, 0), planes);
+	ok = shown > 0 && shown <= held;
+	for (int i = 0; i < wc->chunk_slots; i++) {
+		Chunk *chunk = wc->chunks + i;
+		for (int s = CHUNK_SECTIONS - 1; chunk->active && s >= 0; s--) {
+			if (chunk->sections[s].instance.is_valid()) {
+				ok = ok && chunk->sections[s].visible;
+				break;
+			}
+		}
+	}
+	uint64_t beg = os->get_ticks_usec();
+	int underground = wc->cull_sections(Vector3(0, 2, 0), planes);
+	uint64_t elapsed = os->get_ticks_usec() - beg;
+	wc->set("cave_culling", false);
+	ok = ok && wc->cull_sections(Vector3(0, 2, 0), planes) == held;
+	os->print("sections: %d drawn of %d from above, %d from y 2 (%d us)%s\n", shown, held, underground, (int)elapsed, ok ? "" : " FAILED");
+
+	memdelete(wc);
+}
+
+// streams an area in, moves the camera far enough that every chunk unloads,
+// and checks the new area is drawn with the recycled VisualServer RIDs.
+static void _test_visual() {
+
+	OS *os = OS::get_singleton();
+
+	WC *wc = memnew(WC);
+
+	const int radius = 6;
+	_test_stream(wc, radius);
+	int first_count = wc->chunk_count;
+	int first_pairs = _held_visuals(wc) + wc->visual_pool.size();
+
+	const int far = 64;
+	wc->camera_position = Vector3(far * CHUNK_SIZE, 0, 0);
+	uint64_t beg = os->get_ticks_usec();
+	bool ready = false;
+	while (!ready) {
+		wc->delete_chunks();
+		wc->ensure_chunks(wc->camera_position, wc->camera_direction);
+		ready = wc->pending_jobs() == 0;
+		for (int p = far - radius; ready && p <= far + radius; p++) {
+			for (int q = -radius; ready && q <= radius; q++) {
+				Chunk *chunk = wc->find_chunk(p, q);
+				ready = chunk && !chunk->dirty;
+			}
+		}
+		os->delay_usec(1000);
+	}
+	uint64_t elapsed = os->get_ticks_usec() - beg;
+
+	int held = _held_visuals(wc);
+	int pairs = held + wc->visual_pool.size();
+	// the jump unloads every chunk before the first new one is created
+	bool ok = pairs == MAX(first_pairs, held);
+	os->print("visual: %d chunks, then %d chunks after the move in %.1f ms\n", first_count, wc->chunk_count, elapsed / 1000.0);
+	os->print("\t%d mesh/instance pairs, %d pooled%s\n", pairs, wc->visual_pool.size(), ok ? "" : " FAILED");
+
+	memdelete(wc);
+}
+
+// generates and meshes the chunks within radius of the origin, default 8
+// (a 17x17 area), on every worker from an empty world and prints one line
+// of JSON for tracking throughput across commits:
+//     godot --test wc_bench [radius]
+// the terrain noise is never reseeded, so every run builds the same world.
+static void _test_bench() {
+
+	OS *os = OS::get_singleton();
+
+	int radius = 8;
+	List<String> args = os->get_cmdline_args();
+	if (!args.empty() && args.back()->get().is_valid_integer()) {
+		radius = CLAMP(args.back()->get().to_int(), 1, CREATE_CHUNK_RADIUS * 4);
+	}
+
+	WC *wc = memnew(WC);
+	wc->delete_all_chunks();
+	wc->create_radius = radius;
+	wc->render_radius = radius;
+	wc->delete_radius = radius + 4;
+	wc->camera_position = Vector3();
+	wc->camera_direction = Vector3(0, 0, -1);
+	wc->roll_stats();
+
+	uint64_t peak_map_memory = 0;
+	uint64_t beg = os->get_ticks_usec();
+	while (!_area_ready(wc, radius)) {
+		wc->ensure_chunks(wc->camera_position, wc->camera_direction);
+		peak_map_memory = MAX(peak_map_memory, (uint64_t)wc->get_stat(WC::STAT_CMAP_MEMORY));
+		os->delay_usec(100);
+	}
+	double seconds = (os->get_ticks_usec() - beg) / 1000000.0;
+	WCStats stats = wc->stats;
+
+	Dictionary result;
+	result["bench"] = "wc";
+	result["radius"] = radius;
+	result["chunks"] = stats.loaded;
+	result["meshes"] = stats.meshed;
+	result["faces"] = stats.faces;
+	result["workers"] = wc->worker_count;
+	result["seconds"] = seconds;
+	result["chunks_per_sec"] = stats.loaded / seconds;
+	result["faces_per_sec"] = stats.faces / seconds;
+	result["generation_usec"] = stats.generated ? stats.generate_usec / (double)stats.generated : 0.0;
+	result["meshing_usec"] = stats.meshed ? stats.mesh_usec / (double)stats.meshed : 0.0;
+	result["peak_map_memory"] = peak_map_memory;
+	result["peak_static_memory"] = os->get_static_memory_peak_usage();
+	os->print("%s\n", JSON::print(result).utf8().get_data());
+
+	memdelete(wc);
+}
+
+// chunk streaming between two processes on this machine. start
+//     godot --test wc_net server [port]
+// first, then
+//     godot --test wc_net client [port]
+// the client checks the blocks it was sent against its own generation and
+// makes an edit the server has to send back. the server serves until its
+// client has left.
+static void _test_net() {
+
+	OS *os = OS::get_singleton();
+
+	bool server = false;
+	int port = NET_DEFAULT_PORT;
+	List<String> args = os->get_cmdline_args();
+	for (List<String>::Element *E = args.front(); E; E = E->next()) {
+		if (E->get() == "server") {
+			server = true;
+		} else if (E->get().is_valid_integer()) {
+			port = E->get().to_int();
+		}
+	}
+
+	// snapshots survive the trip through a packet
+	CMap map;
+	_load_map(&map, 3, -2);
+	Vector<uint8_t> packet = net_chunk(&map, 3, -2);
+	NetMessage message;
+	net_read(&message, packet.ptr(), packet.size());
+	CMap decoded;
+	map_alloc(&decoded, map.dx, map.dy, map.dz, map.mask);
+	bool ok = message.type == NET_CHUNK && message.args[0] == 3 && message.args[1] == -2;
+	ok = ok && region_decode(&decoded, NULL, message.blob, message.blob_size) && _maps_equal(&map, &decoded);
+	net_read(&message, packet.ptr(), 5);
+	ok = ok && message.type == 0;
+	os->print("net: %d byte snapshot for %d blocks%s\n", packet.size(), map.size, ok ? "" : " FAILED");
+	map_free(&decoded);
+	map_free(&map);
+
+	int radius = 2;
+	WC *wc = memnew(WC);
+	wc->create_radius = radius;
+	wc->render_radius = radius;
+	wc->delete_radius = radius + 2;
+	wc->set("server_port", port);
+	wc->set("mode", server ? MODE_SERVER : MODE_ONLINE);
+	uint64_t beg = os->get_ticks_usec();
+
+	if (server) {
+		bool served = false;
+		while (os->get_ticks_usec() - beg < 60000000) {
+			wc->poll_network();
+			wc->serve_chunks();
+			bool connected = false;
+			for (int i = 0; i < MAX_PLAYERS; i++) {
+				connected = connected || wc->net_peers[i].id;
+			}
+			if (connected) {
+				served = true;
+			} else if (served) {
+				break;
+			}
+			os->delay_usec(1000);
+		}
+		os->print("net: served %d chunks%s\n", wc->stats.loaded, served ? "" : " FAILED, no client came");
+		memdelete(wc);
+		return;
+	}
+
+	wc->camera_position = Vector3();
+	wc->camera_direction = Vector3(0, 0, -1);
+	while (!_area_ready(wc, radius) && os->get_ticks_usec() - beg < 30000000) {
+		wc->poll_network();
+		wc->delete_chunks();
+		wc->ensure_chunks(wc->camera_position, wc->camera_direction);
+		os->delay_usec(1000);
+	}
+	double seconds = (os->get_ticks_usec() - beg) / 1000000.0;
+
+	int chunks = 0;
+	int mismatches = 0;
+	for (int p = -radius; p <= radius; p++) {
+		for (int q = -radius; q <= radius; q++) {
+			Chunk *chunk = wc->find_chunk(p, q);
+			if (!chunk || !chunk->loaded) {
+				continue;
+			}
+			CMap local;
+			_load_map(&local, p, q);
+			mismatches += !_maps_equal(&local, &chunk->map);
+			map_free(&local);
+			chunks++;
+		}
+	}
+	int expected = (radius * 2 + 1) * (radius * 2 + 1);
+	ok = chunks == expected && mismatches == 0;
+	os->print("net: %d of %d chunks streamed in %.2f s, %d differ from local generation%s\n", chunks, expected, seconds, mismatches, ok ? "" : " FAILED");
+
+	// edits go through the server, nothing changes until it answers
+	int y = wc->highest_block(5, 5) + 1;
+	int w = 3;
+	wc->set_block(5, y, 5, w);
+	ok = wc->get_block(5, y, 5) != w;
+	beg = os->get_ticks_usec();
+	while (wc->get_block(5, y, 5) != w && os->get_ticks_usec() - beg < 5000000) {
+		wc->poll_network();
+		wc->ensure_chunks(wc->camera_position, wc->camera_direction);
+		os->delay_usec(1000);
+	}
+	ok = ok && wc->get_block(5, y, 5) == w;
+	os->print("net: edit came back from the server in %.1f ms%s\n", (os->get_ticks_usec() - beg) / 1000.0, ok ? "" : " FAILED");
+
+	memdelete(wc);
+}
+
+static void _test_streaming() {
+
+	WC *wc = memnew(WC);
+
+	int radii[3] = { 10, 16, 32 };
+	for (int i = 0; i < 3; i++) {
+		_test_stream(wc, radii[i]);
+		_test_find_chunk(wc);
+	}
+
+	while (wc->pending_jobs()) {
+		wc->check_workers();
+		OS::get_singleton()->delay_usec(1000);
+	}
+	memdelete(wc);
+}
+
+MainLoop *test(TestType p_type) {
+
+	switch (p_type) {
+
+		case TEST_STREAM: {
+
+			_test_streaming();
+		} break;
+		case TEST_MESH: {
+
+			_test_mesh();
+		} break;
+		case TEST_STORAGE: {
+
+			_test_storage();
+		} break;
+		case TEST_CULL: {
+
+			_test_cull();
+		} break;
+		case TEST_REGION: {
+
+			_test_region();
+		} break;
+		case TEST_EDIT: {
+
+			_test_edit();
+		} break;
+		case TEST_NOISE: {
+
+			_test_noise();
+		} break;
+		case TEST_VISUAL: {
+
+			_test_visual();
+		} break;
+		case TEST_LOD: {
+
+			_test_lod();
+		} break;
+		case TEST_LIGHT: {
+
+			_test_light();
+		} break;
+		case TEST_COLLISION: {
+
+			_test_collision();
+		} break;
+		case TEST_STATS: {
+
+			_test_stats();
+		} break;
+		case TEST_BENCH: {
+
+			_test_bench();
+		} break;
+		case TEST_SECTIONS: {
+
+			_test_sections();
+		} break;
+		case TEST_NET: {
+
+			_test_net();
+		} break;
+	}
+
+	return NULL;
+}
+} // namespace TestWC
+
+#else
+
+namespace TestWC {
+
+MainLoop *test(TestType p_type) {
+
+	ERR_EXPLAIN("The mw module is not enabled in this build");
+	ERR_FAIL_V(NULL);
+}
+} // namespace TestWC
+
+#endif
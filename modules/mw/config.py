@@ -2,4 +2,4 @@ def can_build(platform):
     return True
 
 def configure(env):
-    pass
\ No newline at end of file
+    env.Append(CPPFLAGS=['-DMW_ENABLED'])
\ No newline at end of file
@@ -28,6 +28,16 @@ SOFTWARE.
 #include <stdlib.h>
 #include <string.h>
 
+#include "noise.h"
+
+#if defined(__AVX2__)
+#define NOISE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NOISE_SSE2
+#include <emmintrin.h>
+#endif
+
 #define F2 0.3660254037844386f
 #define G2 0.21132486540518713f
 #define F3 (1.0f / 3.0f)
@@ -109,6 +119,27 @@ static unsigned char PERM[] = {
     128, 195,  78,  66, 215,  61, 156, 180
 };
 
+// PERM widened to ints and PERM % 12 as gradient indices, for the batched
+// path to look up (and gather) without byte loads.
+static int PERM_I[512];
+static int PERM_G[512];
+static float GRAD_X[12];
+static float GRAD_Y[12];
+
+static int noise_tables() {
+    for (int i = 0; i < 512; i++) {
+        PERM_I[i] = PERM[i];
+        PERM_G[i] = PERM[i] % 12;
+    }
+    for (int i = 0; i < 12; i++) {
+        GRAD_X[i] = GRAD3[i][0];
+        GRAD_Y[i] = GRAD3[i][1];
+    }
+    return 1;
+}
+
+static int noise_tables_ready = noise_tables();
+
 void seed(unsigned int x) {
     srand(x);
     for (int i = 0; i < 256; i++) {
@@ -124,6 +155,7 @@ void seed(unsigned int x) {
         PERM[j] = a;
     }
     memcpy(PERM + 256, PERM, sizeof(unsigned char) * 256);
+    noise_tables();
 }
 
 float noise2(float x, float y) {
@@ -270,3 +302,164 @@ float simplex3(
     }
     return (1 + total / max) / 2;
 }
+
+#if defined(NOISE_SSE2)
+
+#define NOISE_LANES 4
+
+static inline __m128 floor4(__m128 v) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+}
+
+// one simplex corner, f^4 * dot(gradient, offset) where f > 0
+static inline __m128 corner4(__m128 xx, __m128 yy, const int *g) {
+    __m128 gx = _mm_setr_ps(GRAD_X[g[0]], GRAD_X[g[1]], GRAD_X[g[2]], GRAD_X[g[3]]);
+    __m128 gy = _mm_setr_ps(GRAD_Y[g[0]], GRAD_Y[g[1]], GRAD_Y[g[2]], GRAD_Y[g[3]]);
+    __m128 f = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(xx, xx)), _mm_mul_ps(yy, yy));
+    __m128 f4 = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(f, f), f), f);
+    __m128 dot = _mm_add_ps(_mm_mul_ps(gx, xx), _mm_mul_ps(gy, yy));
+    return _mm_and_ps(_mm_cmpgt_ps(f, _mm_setzero_ps()), _mm_mul_ps(f4, dot));
+}
+
+static __m128 noise2_4(__m128 x, __m128 y) {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 g2 = _mm_set1_ps(G2);
+    __m128 s = _mm_mul_ps(_mm_add_ps(x, y), _mm_set1_ps(F2));
+    __m128 i = floor4(_mm_add_ps(x, s));
+    __m128 j = floor4(_mm_add_ps(y, s));
+    __m128 t = _mm_mul_ps(_mm_add_ps(i, j), g2);
+
+    __m128 xx0 = _mm_sub_ps(x, _mm_sub_ps(i, t));
+    __m128 yy0 = _mm_sub_ps(y, _mm_sub_ps(j, t));
+    __m128 i1 = _mm_and_ps(_mm_cmpgt_ps(xx0, yy0), one);
+    __m128 j1 = _mm_and_ps(_mm_cmple_ps(xx0, yy0), one);
+    __m128 xx2 = _mm_sub_ps(_mm_add_ps(xx0, _mm_set1_ps(G2 * 2.0f)), one);
+    __m128 yy2 = _mm_sub_ps(_mm_add_ps(yy0, _mm_set1_ps(G2 * 2.0f)), one);
+    __m128 xx1 = _mm_add_ps(_mm_sub_ps(xx0, i1), g2);
+    __m128 yy1 = _mm_add_ps(_mm_sub_ps(yy0, j1), g2);
+
+    int I[4], J[4], I1[4], J1[4];
+    int g[3][4];
+    const __m128i mask = _mm_set1_epi32(255);
+    _mm_storeu_si128((__m128i *) I, _mm_and_si128(_mm_cvttps_epi32(i), mask));
+    _mm_storeu_si128((__m128i *) J, _mm_and_si128(_mm_cvttps_epi32(j), mask));
+    _mm_storeu_si128((__m128i *) I1, _mm_cvttps_epi32(i1));
+    _mm_storeu_si128((__m128i *) J1, _mm_cvttps_epi32(j1));
+    for (int l = 0; l < 4; l++) {
+        g[0][l] = PERM_G[I[l] + PERM_I[J[l]]];
+        g[1][l] = PERM_G[I[l] + I1[l] + PERM_I[J[l] + J1[l]]];
+        g[2][l] = PERM_G[I[l] + 1 + PERM_I[J[l] + 1]];
+    }
+
+    __m128 noise = _mm_add_ps(corner4(xx0, yy0, g[0]), corner4(xx1, yy1, g[1]));
+    noise = _mm_add_ps(noise, corner4(xx2, yy2, g[2]));
+    return _mm_mul_ps(noise, _mm_set1_ps(70.0f));
+}
+
+static void simplex2_lanes(
+    float *out, const float *x, const float *y,
+    int octaves, float persistence, float lacunarity)
+{
+    __m128 vx = _mm_loadu_ps(x);
+    __m128 vy = _mm_loadu_ps(y);
+    float freq = 1.0f;
+    float amp = 1.0f;
+    float max = 1.0f;
+    __m128 total = noise2_4(vx, vy);
+    for (int i = 1; i < octaves; i++) {
+        freq *= lacunarity;
+        amp *= persistence;
+        max += amp;
+        __m128 vf = _mm_set1_ps(freq);
+        __m128 n = noise2_4(_mm_mul_ps(vx, vf), _mm_mul_ps(vy, vf));
+        total = _mm_add_ps(total, _mm_mul_ps(n, _mm_set1_ps(amp)));
+    }
+    __m128 r = _mm_add_ps(_mm_set1_ps(1.0f), _mm_div_ps(total, _mm_set1_ps(max)));
+    _mm_storeu_ps(out, _mm_div_ps(r, _mm_set1_ps(2.0f)));
+}
+
+#elif defined(NOISE_AVX2)
+
+#define NOISE_LANES 8
+
+static inline __m256 corner8(__m256 xx, __m256 yy, __m256i g) {
+    __m256 gx = _mm256_i32gather_ps(GRAD_X, g, 4);
+    __m256 gy = _mm256_i32gather_ps(GRAD_Y, g, 4);
+    __m256 f = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(xx, xx)), _mm256_mul_ps(yy, yy));
+    __m256 f4 = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(f, f), f), f);
+    __m256 dot = _mm256_add_ps(_mm256_mul_ps(gx, xx), _mm256_mul_ps(gy, yy));
+    return _mm256_and_ps(_mm256_cmp_ps(f, _mm256_setzero_ps(), _CMP_GT_OQ), _mm256_mul_ps(f4, dot));
+}
+
+static __m256 noise2_8(__m256 x, __m256 y) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 g2 = _mm256_set1_ps(G2);
+    __m256 s = _mm256_mul_ps(_mm256_add_ps(x, y), _mm256_set1_ps(F2));
+    __m256 i = _mm256_floor_ps(_mm256_add_ps(x, s));
+    __m256 j = _mm256_floor_ps(_mm256_add_ps(y, s));
+    __m256 t = _mm256_mul_ps(_mm256_add_ps(i, j), g2);
+
+    __m256 xx0 = _mm256_sub_ps(x, _mm256_sub_ps(i, t));
+    __m256 yy0 = _mm256_sub_ps(y, _mm256_sub_ps(j, t));
+    __m256 i1 = _mm256_and_ps(_mm256_cmp_ps(xx0, yy0, _CMP_GT_OQ), one);
+    __m256 j1 = _mm256_and_ps(_mm256_cmp_ps(xx0, yy0, _CMP_LE_OQ), one);
+    __m256 xx2 = _mm256_sub_ps(_mm256_add_ps(xx0, _mm256_set1_ps(G2 * 2.0f)), one);
+    __m256 yy2 = _mm256_sub_ps(_mm256_add_ps(yy0, _mm256_set1_ps(G2 * 2.0f)), one);
+    __m256 xx1 = _mm256_add_ps(_mm256_sub_ps(xx0, i1), g2);
+    __m256 yy1 = _mm256_add_ps(_mm256_sub_ps(yy0, j1), g2);
+
+    const __m256i mask = _mm256_set1_epi32(255);
+    const __m256i one_i = _mm256_set1_epi32(1);
+    __m256i I = _mm256_and_si256(_mm256_cvttps_epi32(i), mask);
+    __m256i J = _mm256_and_si256(_mm256_cvttps_epi32(j), mask);
+    __m256i I1 = _mm256_add_epi32(I, _mm256_cvttps_epi32(i1));
+    __m256i J1 = _mm256_add_epi32(J, _mm256_cvttps_epi32(j1));
+    __m256i g0 = _mm256_i32gather_epi32(PERM_G, _mm256_add_epi32(I, _mm256_i32gather_epi32(PERM_I, J, 4)), 4);
+    __m256i g1 = _mm256_i32gather_epi32(PERM_G, _mm256_add_epi32(I1, _mm256_i32gather_epi32(PERM_I, J1, 4)), 4);
+    __m256i g2i = _mm256_i32gather_epi32(PERM_G, _mm256_add_epi32(_mm256_add_epi32(I, one_i),
+        _mm256_i32gather_epi32(PERM_I, _mm256_add_epi32(J, one_i), 4)), 4);
+
+    __m256 noise = _mm256_add_ps(corner8(xx0, yy0, g0), corner8(xx1, yy1, g1));
+    noise = _mm256_add_ps(noise, corner8(xx2, yy2, g2i));
+    return _mm256_mul_ps(noise, _mm256_set1_ps(70.0f));
+}
+
+static void simplex2_lanes(
+    float *out, const float *x, const float *y,
+    int octaves, float persistence, float lacunarity)
+{
+    __m256 vx = _mm256_loadu_ps(x);
+    __m256 vy = _mm256_loadu_ps(y);
+    float freq = 1.0f;
+    float amp = 1.0f;
+    float max = 1.0f;
+    __m256 total = noise2_8(vx, vy);
+    for (int i = 1; i < octaves; i++) {
+        freq *= lacunarity;
+        amp *= persistence;
+        max += amp;
+        __m256 vf = _mm256_set1_ps(freq);
+        __m256 n = noise2_8(_mm256_mul_ps(vx, vf), _mm256_mul_ps(vy, vf));
+        total = _mm256_add_ps(total, _mm256_mul_ps(n, _mm256_set1_ps(amp)));
+    }
+    __m256 r = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_div_ps(total, _mm256_set1_ps(max)));
+    _mm256_storeu_ps(out, _mm256_div_ps(r, _mm256_set1_ps(2.0f)));
+}
+
+#endif
+
+void simplex2_batch(
+    float *out, const float *x, const float *y, int count,
+    int octaves, float persistence, float lacunarity)
+{
+    int i = 0;
+#if defined(NOISE_LANES)
+    for (; i + NOISE_LANES <= count; i += NOISE_LANES) {
+        simplex2_lanes(out + i, x + i, y + i, octaves, persistence, lacunarity);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = simplex2(x[i], y[i], octaves, persistence, lacunarity);
+    }
+}
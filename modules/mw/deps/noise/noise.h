@@ -37,4 +37,12 @@ float simplex3(
     float x, float y, float z,
     int octaves, float persistence, float lacunarity);
 
+// simplex2 for count samples at once, out[i] = simplex2(x[i], y[i], ...).
+// vectorized with SSE2, or AVX2 when the build enables it. the vector path
+// repeats the scalar float operations in the same order, so results match
+// simplex2 unless the compiler fuses the scalar multiply-adds.
+void simplex2_batch(
+    float *out, const float *x, const float *y, int count,
+    int octaves, float persistence, float lacunarity);
+
 #endif
@@ -1,24 +1,56 @@
 #ifndef _CHUNK_H_
 #define _CHUNK_H_
 
+#include "rid.h"
+#include "light.h"
+#include "section.h"
 #include "scene/resources/mesh.h"
-#include "scene/3d/mesh_instance.h"
+
+// one CHUNK_SECTION_HEIGHT slice of a chunk. the VisualServer mesh and
+// instance come from WC::visual_pool while the section has faces and are
+// updated in place on every remesh.
+typedef struct {
+	RID mesh;
+	RID instance;
+	int faces;
+	uint64_t visibility; // SECTION_SEES pairs, from the last remesh
+	int visible; // instance shown, see WC::cull_sections
+} ChunkSection;
 
 class Chunk //: public Resource
 {
 public:
 	//GDCLASS( Chunk, Resource );
 	CMap map;
-	//Map lights;
+	CMap lights; // light sources placed with WC::set_light, saved with map
+	// sky and block light the chunk was last meshed with, kept up to date
+	// by edits. empty until a worker first lights the chunk, and for chunks
+	// meshed without light.
+	LightMap light;
 	//SignList signs;
 	int p;
 	int q;
+	int active; // slot is in use, see WC::alloc_chunk
 	int faces;
 	//int sign_faces;
 	int dirty;
+	int modified; // blocks differ from what the region store holds
+	int loaded; // map holds the chunk's blocks, not just a pending load
+	int edited; // queued in WC::edited_chunks for a remesh next frame
+	int job; // id of the job in flight for this chunk, 0 if none
+	int lod; // level of detail the chunk is meshed at, see WC::chunk_lod
+	int lod_edges; // sides bordering a finer chunk, see LodCells::edges
 	int miny;
 	int maxy;
-	MeshInstance* mesh_instance; // all nodes need to be allocated, apparently.
+	int meshed; // sections hold the result of a job, see WC::cull_sections
+	// blocks a server sent, handed to the chunk's next load job
+	Vector<uint8_t> snapshot;
+	ChunkSection sections[CHUNK_SECTIONS];
+	// static body and concave shape of the chunk's collision faces, only
+	// while it is within WC::collision_radius and has any.
+	int collision; // collision faces are built for the current blocks
+	RID body;
+	RID shape;
 	//GLuint buffer;
 	//GLuint sign_buffer;
 };
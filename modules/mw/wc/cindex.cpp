@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include "cindex.h"
+
+static unsigned int cindex_hash( int p, int q ) {
+	unsigned int key = ((unsigned int) p * 73856093u) ^ ((unsigned int) q * 19349663u);
+	key ^= key >> 16;
+	key *= 0x85ebca6bu;
+	key ^= key >> 13;
+	return key;
+}
+
+void cindex_alloc( CIndex *index, int mask ) {
+	index->mask = mask;
+	index->size = 0;
+	index->data = (CIndexEntry *) malloc( (index->mask + 1) * sizeof( CIndexEntry ) );
+	cindex_clear( index );
+}
+
+void cindex_free( CIndex *index ) {
+	free( index->data );
+	index->data = 0;
+}
+
+void cindex_clear( CIndex *index ) {
+	for( unsigned int i = 0; i <= index->mask; i++ ) {
+		index->data[i].slot = CINDEX_EMPTY;
+	}
+	index->size = 0;
+}
+
+void cindex_set( CIndex *index, int p, int q, int slot ) {
+	unsigned int i = cindex_hash( p, q ) & index->mask;
+	CIndexEntry *entry = index->data + i;
+	while( entry->slot != CINDEX_EMPTY ) {
+		if( entry->p == p && entry->q == q ) {
+			entry->slot = slot;
+			return;
+		}
+		i = (i + 1) & index->mask;
+		entry = index->data + i;
+	}
+	entry->p = p;
+	entry->q = q;
+	entry->slot = slot;
+	index->size++;
+	if( index->size * 2 > index->mask ) {
+		cindex_grow( index );
+	}
+}
+
+int cindex_get( const CIndex *index, int p, int q ) {
+	unsigned int i = cindex_hash( p, q ) & index->mask;
+	const CIndexEntry *entry = index->data + i;
+	while( entry->slot != CINDEX_EMPTY ) {
+		if( entry->p == p && entry->q == q ) {
+			return entry->slot;
+		}
+		i = (i + 1) & index->mask;
+		entry = index->data + i;
+	}
+	return CINDEX_EMPTY;
+}
+
+// backward shift deletion, keeps probe chains intact without tombstones.
+int cindex_remove( CIndex *index, int p, int q ) {
+	unsigned int i = cindex_hash( p, q ) & index->mask;
+	CIndexEntry *data = index->data;
+	while( data[i].slot != CINDEX_EMPTY ) {
+		if( data[i].p == p && data[i].q == q ) {
+			break;
+		}
+		i = (i + 1) & index->mask;
+	}
+	if( data[i].slot == CINDEX_EMPTY ) {
+		return 0;
+	}
+	unsigned int j = i;
+	for( ;; ) {
+		j = (j + 1) & index->mask;
+		if( data[j].slot == CINDEX_EMPTY ) {
+			break;
+		}
+		unsigned int k = cindex_hash( data[j].p, data[j].q ) & index->mask;
+		// entry j stays put if its home slot lies cyclically in (i, j].
+		if( i <= j ? (i < k && k <= j) : (i < k || k <= j) ) {
+			continue;
+		}
+		data[i] = data[j];
+		i = j;
+	}
+	data[i].slot = CINDEX_EMPTY;
+	index->size--;
+	return 1;
+}
+
+void cindex_grow( CIndex *index ) {
+	CIndex new_index;
+	cindex_alloc( &new_index, (index->mask << 1) | 1 );
+	for( unsigned int i = 0; i <= index->mask; i++ ) {
+		CIndexEntry *entry = index->data + i;
+		if( entry->slot != CINDEX_EMPTY ) {
+			cindex_set( &new_index, entry->p, entry->q, entry->slot );
+		}
+	}
+	free( index->data );
+	index->mask = new_index.mask;
+	index->size = new_index.size;
+	index->data = new_index.data;
+}
@@ -0,0 +1,29 @@
+#ifndef _cindex_h_
+#define _cindex_h_
+
+// open-addressed (p, q) -> chunk slot table, so chunk lookups no longer
+// scan every loaded chunk.
+
+#define CINDEX_EMPTY -1
+
+typedef struct {
+	int p;
+	int q;
+	int slot;
+} CIndexEntry;
+
+typedef struct {
+	unsigned int mask;
+	unsigned int size;
+	CIndexEntry *data;
+} CIndex;
+
+void cindex_alloc( CIndex *index, int mask );
+void cindex_free( CIndex *index );
+void cindex_clear( CIndex *index );
+void cindex_grow( CIndex *index );
+void cindex_set( CIndex *index, int p, int q, int slot );
+int cindex_get( const CIndex *index, int p, int q );
+int cindex_remove( CIndex *index, int p, int q );
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cmap.h"
+#include "safe_refcount.h"
 
 int hash_int( int key ) {
 	key = ~key + (key << 15);
@@ -19,17 +20,53 @@ int hash( int x, int y, int z ) {
 	return x ^ y ^ z;
 }
 
+// entry arrays carry a reference count in front of them, so maps can share
+// one array and copy it only when one of them is written to.
+#define MAP_DATA_HEADER 2
+
+static CMapEntry *map_data_alloc( unsigned int count ) {
+	uint32_t *block = (uint32_t *) calloc( 1, MAP_DATA_HEADER * sizeof( uint32_t ) + count * sizeof( CMapEntry ) );
+	block[0] = 1;
+	return (CMapEntry *) (block + MAP_DATA_HEADER);
+}
+
+static uint32_t *map_data_refcount( CMapEntry *data ) {
+	return ((uint32_t *) data) - MAP_DATA_HEADER;
+}
+
+static void map_data_unref( CMapEntry *data ) {
+	if( data && atomic_decrement( map_data_refcount( data ) ) == 0 ) {
+		free( map_data_refcount( data ) );
+	}
+}
+
+int map_shared( CMap *map ) {
+	return atomic_add( map_data_refcount( map->data ), 0 ) > 1;
+}
+
+// called before any write, gives the map an array of its own.
+static void map_unshare( CMap *map ) {
+	if( !map_shared( map ) ) {
+		return;
+	}
+	CMapEntry *data = map_data_alloc( map->mask + 1 );
+	memcpy( data, map->data, (map->mask + 1) * sizeof( CMapEntry ) );
+	map_data_unref( map->data );
+	map->data = data;
+}
+
 void map_alloc( CMap *map, int dx, int dy, int dz, int mask ) {
 	map->dx = dx;
 	map->dy = dy;
 	map->dz = dz;
 	map->mask = mask;
 	map->size = 0;
-	map->data = (CMapEntry *) calloc( map->mask + 1, sizeof( CMapEntry ) );
+	map->data = map_data_alloc( map->mask + 1 );
 }
 
 void map_free( CMap *map ) {
-	free( map->data );
+	map_data_unref( map->data );
+	map->data = 0;
 }
 
 void map_copy( CMap *dst, CMap *src ) {
@@ -38,10 +75,20 @@ void map_copy( CMap *dst, CMap *src ) {
 	dst->dz = src->dz;
 	dst->mask = src->mask;
 	dst->size = src->size;
-	dst->data = (CMapEntry *) calloc( dst->mask + 1, sizeof( CMapEntry ) );
+	dst->data = map_data_alloc( dst->mask + 1 );
 	memcpy( dst->data, src->data, (dst->mask + 1) * sizeof( CMapEntry ) );
 }
 
+// bytes of the entry array, counted in full even while it is shared.
+unsigned int map_memory( const CMap *map ) {
+	return ( map->mask + 1 ) * sizeof( CMapEntry );
+}
+
+void map_share( CMap *dst, CMap *src ) {
+	*dst = *src;
+	atomic_increment( map_data_refcount( dst->data ) );
+}
+
 int map_set( CMap *map, int x, int y, int z, int w ) {
 	unsigned int index = hash( x, y, z ) & map->mask;
 	x -= map->dx;
@@ -59,11 +106,15 @@ int map_set( CMap *map, int x, int y, int z, int w ) {
 	}
 	if( overwrite ) {
 		if( entry->e.w != w ) {
+			map_unshare( map );
+			entry = map->data + index;
 			entry->e.w = w;
 			return 1;
 		}
 	}
 	else if( w ) {
+		map_unshare( map );
+		entry = map->data + index;
 		entry->e.x = x;
 		entry->e.y = y;
 		entry->e.z = z;
@@ -103,11 +154,11 @@ void map_grow( CMap *map ) {
 	new_map.dz = map->dz;
 	new_map.mask = (map->mask << 1) | 1;
 	new_map.size = 0;
-	new_map.data = (CMapEntry *) calloc( new_map.mask + 1, sizeof( CMapEntry ) );
+	new_map.data = map_data_alloc( new_map.mask + 1 );
 	MAP_FOR_EACH( map, ex, ey, ez, ew ) {
 		map_set( &new_map, ex, ey, ez, ew );
 	} END_MAP_FOR_EACH;
-	free( map->data );
+	map_data_unref( map->data );
 	map->mask = new_map.mask;
 	map->size = new_map.size;
 	map->data = new_map.data;
@@ -38,6 +38,10 @@ typedef struct {
 void map_alloc( CMap *map, int dx, int dy, int dz, int mask );
 void map_free( CMap *map );
 void map_copy( CMap *dst, CMap *src );
+// O(1) copy, dst and src share entries until either one is written to.
+void map_share( CMap *dst, CMap *src );
+int map_shared( CMap *map );
+unsigned int map_memory( const CMap *map );
 void map_grow( CMap *map );
 int map_set( CMap *map, int x, int y, int z, int w );
 int map_get( CMap *map, int x, int y, int z );
@@ -0,0 +1,154 @@
+#include <string.h>
+#include "collision.h"
+#include "item.h"
+#include "wc.h"
+#include "os/memory.h"
+
+// cells of the chunk and its one block border, y from -1 to 256.
+#define COLLISION_SIZE (CHUNK_SIZE + 2)
+#define COLLISION_HEIGHT 258
+#define CELL(x, y, z) (((y) + 1) * COLLISION_SIZE * COLLISION_SIZE + ((x) + 1) * COLLISION_SIZE + ((z) + 1))
+
+static void collision_quad(Vector3 *w, int d, int sign, float plane, float u0, float v0, float u1, float v1)
+{
+	int u = (d + 1) % 3;
+	int v = (d + 2) % 3;
+	Vector3 corners[4];
+	for (int i = 0; i < 4; i++)
+	{
+		corners[i][d] = plane;
+		corners[i][u] = (i == 1 || i == 2) ? u1 : u0;
+		corners[i][v] = (i >= 2) ? v1 : v0;
+	}
+	// u x v points along +d, so a, c, b turns clockwise seen from +d
+	static const int order[2][6] = {
+		{0, 1, 2, 0, 2, 3},
+		{0, 2, 1, 0, 3, 2}
+	};
+	for (int i = 0; i < 6; i++)
+	{
+		w[i] = corners[order[sign > 0][i]];
+	}
+}
+
+int make_collision_faces(PoolVector<Vector3> *faces, CMap *map, int p, int q)
+{
+	uint32_t solid_size = COLLISION_SIZE * COLLISION_SIZE * COLLISION_HEIGHT;
+	char *solid = (char *) Memory::alloc_static(solid_size, true);
+	memset(solid, 0, solid_size);
+	char *mask = (char *) Memory::alloc_static(CHUNK_SIZE * COLLISION_HEIGHT, true);
+
+	int bx = p * CHUNK_SIZE;
+	int bz = q * CHUNK_SIZE;
+	int miny = COLLISION_HEIGHT;
+	int maxy = -1;
+	MAP_FOR_EACH(map, ex, ey, ez, ew)
+	{
+		int lx = ex - bx;
+		int lz = ez - bz;
+		if (lx < -1 || lz < -1 || lx > CHUNK_SIZE || lz > CHUNK_SIZE || ey < 0 || ey >= 256 || !is_obstacle(ew))
+		{
+			continue;
+		}
+		solid[CELL(lx, ey, lz)] = 1;
+		if (ew > 0)
+		{
+			miny = MIN(miny, ey);
+			maxy = MAX(maxy, ey);
+		}
+	} END_MAP_FOR_EACH;
+
+	// quads collect in a scratch buffer, faces is written in one go
+	int capacity = 1024;
+	Vector3 *soup = (Vector3 *) Memory::alloc_static(capacity * 6 * sizeof(Vector3), true);
+	int quads = 0;
+	int size[3] = {CHUNK_SIZE, maxy - miny + 1, CHUNK_SIZE};
+	int base[3] = {bx, miny, bz};
+	if (maxy >= miny)
+	{
+		for (int d = 0; d < 3; d++)
+		{
+			int u = (d + 1) % 3;
+			int v = (d + 2) % 3;
+			for (int sign = -1; sign <= 1; sign += 2)
+			{
+				for (int k = 0; k < size[d]; k++)
+				{
+					int c[3];
+					c[d] = k;
+					int n = 0;
+					for (c[v] = 0; c[v] < size[v]; c[v]++)
+					{
+						for (c[u] = 0; c[u] < size[u]; c[u]++)
+						{
+							int n3[3] = {c[0], c[1] + miny, c[2]};
+							char m = solid[CELL(n3[0], n3[1], n3[2])];
+							n3[d] += sign;
+							// like the render mesh, nothing faces below y 0
+							mask[n++] = m && n3[1] >= 0 && !solid[CELL(n3[0], n3[1], n3[2])];
+						}
+					}
+
+					for (int b = 0; b < size[v]; b++)
+					{
+						for (int a = 0; a < size[u];)
+						{
+							if (!mask[b * size[u] + a])
+							{
+								a++;
+								continue;
+							}
+							int width = 1;
+							while (a + width < size[u] && mask[b * size[u] + a + width])
+							{
+								width++;
+							}
+							int height = 1;
+							for (; b + height < size[v]; height++)
+							{
+								char *row = mask + (b + height) * size[u] + a;
+								int i = 0;
+								while (i < width && row[i])
+								{
+									i++;
+								}
+								if (i < width)
+								{
+									break;
+								}
+							}
+							for (int h = 0; h < height; h++)
+							{
+								memset(mask + (b + h) * size[u] + a, 0, width);
+							}
+							if (quads == capacity)
+							{
+								capacity *= 2;
+								soup = (Vector3 *) Memory::realloc_static(soup, capacity * 6 * sizeof(Vector3), true);
+							}
+							// blocks are centered on their coordinates
+							collision_quad(
+								soup + quads * 6, d, sign,
+								base[d] + k + sign * 0.5f,
+								base[u] + a - 0.5f, base[v] + b - 0.5f,
+								base[u] + a + width - 0.5f, base[v] + b + height - 0.5f);
+							quads++;
+							a += width;
+						}
+					}
+				}
+			}
+		}
+	}
+	faces->resize(quads * 6);
+	if (quads)
+	{
+		PoolVector<Vector3>::Write w = faces->write();
+		memcpy(w.ptr(), soup, quads * 6 * sizeof(Vector3));
+	}
+
+	Memory::free_static(soup, true);
+	Memory::free_static(mask, true);
+	Memory::free_static(solid, true);
+	return quads * 2;
+}
@@ -0,0 +1,15 @@
+#ifndef _collision_h_
+#define _collision_h_
+
+#include "cmap.h"
+#include "core/math/vector3.h"
+#include "core/dvector.h"
+
+// collision for one chunk, the faces between its obstacle blocks and
+// anything that is not, merged into rectangles regardless of block type.
+// faces get 3 vertices per triangle in world space and clockwise from the
+// outside, the layout ConcavePolygonShape takes. the chunk's map is enough,
+// it carries a one block border from its neighbours. returns the triangles.
+int make_collision_faces(PoolVector<Vector3> *faces, CMap *map, int p, int q);
+
+#endif
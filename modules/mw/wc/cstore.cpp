@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cstore.h"
+
+static int section_words( int bits ) {
+	return SECTION_VOLUME * bits / 64;
+}
+
+static void section_free( CSection *section ) {
+	free( section->palette );
+	free( section->indices );
+	memset( section, 0, sizeof( CSection ) );
+}
+
+static void section_set_index( CSection *section, int i, int index ) {
+	int bit = i * section->bits;
+	uint64_t mask = ((uint64_t) 1 << section->bits) - 1;
+	uint64_t *word = section->indices + (bit >> 6);
+	*word = (*word & ~(mask << (bit & 63))) | ((uint64_t) index << (bit & 63));
+}
+
+// doubles the index width once the palette is full, indices never straddle
+// a word since the width stays a power of two.
+static void section_widen( CSection *section ) {
+	CSection wide = *section;
+	wide.bits = section->bits << 1;
+	wide.indices = (uint64_t *) calloc( section_words( wide.bits ), sizeof( uint64_t ) );
+	wide.palette = (signed char *) realloc( section->palette, 1 << wide.bits );
+	for( int i = 0; i < SECTION_VOLUME; i++ ) {
+		section_set_index( &wide, i, section_index( section, i ) );
+	}
+	free( section->indices );
+	*section = wide;
+}
+
+static int section_palette_index( CSection *section, int w ) {
+	for( int i = 0; i < section->palette_size; i++ ) {
+		if( section->palette[i] == w ) {
+			return i;
+		}
+	}
+	if( section->palette_size == (1 << section->bits) ) {
+		section_widen( section );
+	}
+	section->palette[section->palette_size] = w;
+	return section->palette_size++;
+}
+
+void store_alloc( CStore *store, int dx, int dz ) {
+	store->dx = dx;
+	store->dz = dz;
+	memset( store->sections, 0, sizeof( store->sections ) );
+}
+
+void store_free( CStore *store ) {
+	for( int i = 0; i < STORE_SECTIONS; i++ ) {
+		if( store->sections[i].count ) {
+			section_free( store->sections + i );
+		}
+	}
+}
+
+void store_copy( CStore *dst, const CStore *src ) {
+	store_alloc( dst, src->dx, src->dz );
+	for( int i = 0; i < STORE_SECTIONS; i++ ) {
+		const CSection *section = src->sections + i;
+		if( !section->count ) {
+			continue;
+		}
+		CSection *copy = dst->sections + i;
+		*copy = *section;
+		copy->palette = (signed char *) malloc( 1 << section->bits );
+		memcpy( copy->palette, section->palette, section->palette_size );
+		copy->indices = (uint64_t *) malloc( section_words( section->bits ) * sizeof( uint64_t ) );
+		memcpy( copy->indices, section->indices, section_words( section->bits ) * sizeof( uint64_t ) );
+	}
+}
+
+int store_set( CStore *store, int x, int y, int z, int w ) {
+	x -= store->dx;
+	z -= store->dz;
+	if( x < 0 || z < 0 || x >= STORE_SIZE_XZ || z >= STORE_SIZE_XZ || y < 0 || y >= STORE_SIZE_Y ) {
+		return 0;
+	}
+	CSection *section = store->sections + STORE_SECTION( x / SECTION_SIZE, y / SECTION_SIZE, z / SECTION_SIZE );
+	int i = SECTION_INDEX( x % SECTION_SIZE, y % SECTION_SIZE, z % SECTION_SIZE );
+	if( !section->count ) {
+		if( !w ) {
+			return 0;
+		}
+		section->bits = 1;
+		section->palette_size = 1;
+		section->palette = (signed char *) malloc( 2 );
+		section->palette[0] = 0;
+		section->indices = (uint64_t *) calloc( section_words( 1 ), sizeof( uint64_t ) );
+	}
+	int old = section_get( section, i );
+	if( old == w ) {
+		return 0;
+	}
+	section_set_index( section, i, section_palette_index( section, w ) );
+	section->count += (w != 0) - (old != 0);
+	if( !section->count ) {
+		section_free( section );
+	}
+	return 1;
+}
+
+int store_get( const CStore *store, int x, int y, int z ) {
+	x -= store->dx;
+	z -= store->dz;
+	if( x < 0 || z < 0 || x >= STORE_SIZE_XZ || z >= STORE_SIZE_XZ || y < 0 || y >= STORE_SIZE_Y ) {
+		return 0;
+	}
+	return store_get_local( store, x, y, z );
+}
+
+unsigned int store_memory( const CStore *store ) {
+	unsigned int size = sizeof( CStore );
+	for( int i = 0; i < STORE_SECTIONS; i++ ) {
+		const CSection *section = store->sections + i;
+		if( section->count ) {
+			size += (1 << section->bits) + section_words( section->bits ) * sizeof( uint64_t );
+		}
+	}
+	return size;
+}
+
+void store_view_init( CStoreView *view, CStore *stores[3][3] ) {
+	for( int a = 0; a < 3; a++ ) {
+		for( int b = 0; b < 3; b++ ) {
+			view->stores[a][b] = stores[a][b];
+		}
+	}
+	view->dx = stores[1][1]->dx;
+	view->dz = stores[1][1]->dz;
+}
+
+int store_view_get( const CStoreView *view, int x, int y, int z ) {
+	return store_view_get_local( view, x - view->dx, y, z - view->dz );
+}
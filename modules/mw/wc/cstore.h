@@ -0,0 +1,108 @@
+#ifndef _cstore_h_
+#define _cstore_h_
+
+#include <stdint.h>
+
+// dense alternative to CMap. a chunk column is cut into 16^3 sections, each
+// holding a small palette of block values and bit packed palette indices.
+// empty sections own no memory, iteration walks sections in memory order.
+// unlike CMap a store only holds the blocks of its own chunk, neighbours are
+// read from the neighbouring stores through CStoreView.
+
+#define SECTION_SIZE 16
+#define SECTION_VOLUME (SECTION_SIZE * SECTION_SIZE * SECTION_SIZE)
+#define STORE_SIZE_XZ 32
+#define STORE_SIZE_Y 256
+#define STORE_SECTIONS_XZ (STORE_SIZE_XZ / SECTION_SIZE)
+#define STORE_SECTIONS_Y (STORE_SIZE_Y / SECTION_SIZE)
+#define STORE_SECTIONS (STORE_SECTIONS_XZ * STORE_SECTIONS_Y * STORE_SECTIONS_XZ)
+
+// index of a block inside its section, y major like XYZ in wc.h
+#define SECTION_INDEX(x, y, z) (((y) * SECTION_SIZE + (x)) * SECTION_SIZE + (z))
+#define STORE_SECTION(sx, sy, sz) (((sy) * STORE_SECTIONS_XZ + (sx)) * STORE_SECTIONS_XZ + (sz))
+
+typedef struct {
+	int count; // non empty blocks, the section is freed when it drops to 0
+	int bits; // 1, 2, 4 or 8 bits per index
+	int palette_size;
+	signed char *palette;
+	uint64_t *indices;
+} CSection;
+
+typedef struct {
+	int dx;
+	int dz;
+	CSection sections[STORE_SECTIONS];
+} CStore;
+
+typedef struct {
+	CStore *stores[3][3];
+	int dx;
+	int dz;
+} CStoreView;
+
+static inline int section_index( const CSection *section, int i ) {
+	int bit = i * section->bits;
+	return (int) ((section->indices[bit >> 6] >> (bit & 63)) & ((1u << section->bits) - 1));
+}
+
+static inline int section_get( const CSection *section, int i ) {
+	return section->palette[section_index( section, i )];
+}
+
+// x, y, z relative to the first block of the store, no bounds checks.
+static inline int store_get_local( const CStore *store, int x, int y, int z ) {
+	const CSection *section = store->sections + STORE_SECTION( x / SECTION_SIZE, y / SECTION_SIZE, z / SECTION_SIZE );
+	if( !section->count ) {
+		return 0;
+	}
+	return section_get( section, SECTION_INDEX( x % SECTION_SIZE, y % SECTION_SIZE, z % SECTION_SIZE ) );
+}
+
+// x, z relative to the first block of the center store.
+static inline int store_view_get_local( const CStoreView *view, int x, int y, int z ) {
+	x += STORE_SIZE_XZ;
+	z += STORE_SIZE_XZ;
+	if( x < 0 || z < 0 || x >= STORE_SIZE_XZ * 3 || z >= STORE_SIZE_XZ * 3 || y < 0 || y >= STORE_SIZE_Y ) {
+		return 0;
+	}
+	const CStore *store = view->stores[x / STORE_SIZE_XZ][z / STORE_SIZE_XZ];
+	if( !store ) {
+		return 0;
+	}
+	return store_get_local( store, x % STORE_SIZE_XZ, y, z % STORE_SIZE_XZ );
+}
+
+#define STORE_FOR_EACH(store, ex, ey, ez, ew) \
+    for (int s_ = 0; s_ < STORE_SECTIONS; s_++) { \
+        const CSection *section_ = (store)->sections + s_; \
+        if (!section_->count) { \
+            continue; \
+        } \
+        int sx_ = (store)->dx + ((s_ / STORE_SECTIONS_XZ) % STORE_SECTIONS_XZ) * SECTION_SIZE; \
+        int sy_ = (s_ / (STORE_SECTIONS_XZ * STORE_SECTIONS_XZ)) * SECTION_SIZE; \
+        int sz_ = (store)->dz + (s_ % STORE_SECTIONS_XZ) * SECTION_SIZE; \
+        for (int i_ = 0; i_ < SECTION_VOLUME; i_++) { \
+            int ew = section_get(section_, i_); \
+            if (!ew) { \
+                continue; \
+            } \
+            int ex = sx_ + (i_ / SECTION_SIZE) % SECTION_SIZE; \
+            int ey = sy_ + i_ / (SECTION_SIZE * SECTION_SIZE); \
+            int ez = sz_ + i_ % SECTION_SIZE;
+
+#define END_STORE_FOR_EACH } }
+
+void store_alloc( CStore *store, int dx, int dz );
+void store_free( CStore *store );
+void store_copy( CStore *dst, const CStore *src );
+int store_set( CStore *store, int x, int y, int z, int w );
+int store_get( const CStore *store, int x, int y, int z );
+unsigned int store_memory( const CStore *store );
+
+// block lookups across the 3x3 stores around the center chunk, missing
+// stores read as empty. the center store must be present.
+void store_view_init( CStoreView *view, CStore *stores[3][3] );
+int store_view_get( const CStoreView *view, int x, int y, int z );
+
+#endif
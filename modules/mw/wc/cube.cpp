@@ -2,7 +2,7 @@
 #include "cube.h"
 #include "item.h"
 #include "util.h"
-#include "array.h"
+#include "core/color.h"
 #include "core/math/vector3.h"
 #include "core/math/math_2d.h"
 #include "servers/visual_server.h"
@@ -12,57 +12,68 @@ void normalize( float *x, float *y, float *z ) {
 	*x /= d; *y /= d; *z /= d;
 }
 
+static const float cube_positions[6][4][3] = {
+    {{-1, -1, -1}, {-1, -1, +1}, {-1, +1, -1}, {-1, +1, +1}},
+    {{+1, -1, -1}, {+1, -1, +1}, {+1, +1, -1}, {+1, +1, +1}},
+    {{-1, +1, -1}, {-1, +1, +1}, {+1, +1, -1}, {+1, +1, +1}},
+    {{-1, -1, -1}, {-1, -1, +1}, {+1, -1, -1}, {+1, -1, +1}},
+    {{-1, -1, -1}, {-1, +1, -1}, {+1, -1, -1}, {+1, +1, -1}},
+    {{-1, -1, +1}, {-1, +1, +1}, {+1, -1, +1}, {+1, +1, +1}}
+};
+static const float cube_normals[6][3] = {
+    {-1, 0, 0},
+    {+1, 0, 0},
+    {0, +1, 0},
+    {0, -1, 0},
+    {0, 0, -1},
+    {0, 0, +1}
+};
+static const float cube_uvs[6][4][2] = {
+    {{0, 0}, {1, 0}, {0, 1}, {1, 1}},
+    {{1, 0}, {0, 0}, {1, 1}, {0, 1}},
+    {{0, 1}, {0, 0}, {1, 1}, {1, 0}},
+    {{0, 0}, {0, 1}, {1, 0}, {1, 1}},
+    {{0, 0}, {0, 1}, {1, 0}, {1, 1}},
+    {{1, 0}, {1, 1}, {0, 0}, {0, 1}}
+};
+static const float cube_indices[6][6] = {
+    {0, 3, 2, 0, 1, 3},
+    {0, 3, 1, 0, 2, 3},
+    {0, 3, 2, 0, 1, 3},
+    {0, 3, 1, 0, 2, 3},
+    {0, 3, 2, 0, 1, 3},
+    {0, 3, 1, 0, 2, 3}
+};
+// which axis the u and v texture coordinates of each face run along.
+static const int cube_uv_axes[6][2] = {
+    {2, 1},
+    {2, 1},
+    {0, 2},
+    {0, 2},
+    {0, 1},
+    {0, 1}
+};
+static const float cube_flipped[6][6] = {
+    {0, 1, 2, 1, 3, 2},
+    {0, 2, 1, 2, 3, 1},
+    {0, 1, 2, 1, 3, 2},
+    {0, 2, 1, 2, 3, 1},
+    {0, 1, 2, 1, 3, 2},
+    {0, 2, 1, 2, 3, 1}
+};
+
 void make_cube_faces(
-	Array* mesh_array, float ao[6][4], float light[6][4],
+	ChunkMesh* mesh, float ao[6][4], float light[6][4],
     int left, int right, int top, int bottom, int front, int back,
     int wleft, int wright, int wtop, int wbottom, int wfront, int wback,
     float x, float y, float z, float n)
 {
-    static const float positions[6][4][3] = {
-        {{-1, -1, -1}, {-1, -1, +1}, {-1, +1, -1}, {-1, +1, +1}},
-        {{+1, -1, -1}, {+1, -1, +1}, {+1, +1, -1}, {+1, +1, +1}},
-        {{-1, +1, -1}, {-1, +1, +1}, {+1, +1, -1}, {+1, +1, +1}},
-        {{-1, -1, -1}, {-1, -1, +1}, {+1, -1, -1}, {+1, -1, +1}},
-        {{-1, -1, -1}, {-1, +1, -1}, {+1, -1, -1}, {+1, +1, -1}},
-        {{-1, -1, +1}, {-1, +1, +1}, {+1, -1, +1}, {+1, +1, +1}}
-    };
-    static const float normals[6][3] = {
-        {-1, 0, 0},
-        {+1, 0, 0},
-        {0, +1, 0},
-        {0, -1, 0},
-        {0, 0, -1},
-        {0, 0, +1}
-    };
-    static const float uvs[6][4][2] = {
-        {{0, 0}, {1, 0}, {0, 1}, {1, 1}},
-        {{1, 0}, {0, 0}, {1, 1}, {0, 1}},
-        {{0, 1}, {0, 0}, {1, 1}, {1, 0}},
-        {{0, 0}, {0, 1}, {1, 0}, {1, 1}},
-        {{0, 0}, {0, 1}, {1, 0}, {1, 1}},
-        {{1, 0}, {1, 1}, {0, 0}, {0, 1}}
-    };
-    static const float indices[6][6] = {
-        {0, 3, 2, 0, 1, 3},
-        {0, 3, 1, 0, 2, 3},
-        {0, 3, 2, 0, 1, 3},
-        {0, 3, 1, 0, 2, 3},
-        {0, 3, 2, 0, 1, 3},
-        {0, 3, 1, 0, 2, 3}
-    };
-    static const float flipped[6][6] = {
-        {0, 1, 2, 1, 3, 2},
-        {0, 2, 1, 2, 3, 1},
-        {0, 1, 2, 1, 3, 2},
-        {0, 2, 1, 2, 3, 1},
-        {0, 1, 2, 1, 3, 2},
-        {0, 2, 1, 2, 3, 1}
-    };
-
-	PoolVector<Vector3> p = mesh_array->get( VS::ARRAY_VERTEX );
-	PoolVector<Vector3> norms = mesh_array->get( VS::ARRAY_NORMAL );
-	PoolVector<Vector2> uvv = mesh_array->get( VS::ARRAY_TEX_UV );
-	//PoolVector<int> idcs = mesh_array->get( VS::ARRAY_INDEX );
+	Vector3 *p = mesh->points + mesh->offset;
+	Vector3 *norms = mesh->normals + mesh->offset;
+	Vector2 *uvv = mesh->uvs + mesh->offset;
+	Vector2 *uvv2 = mesh->uv2s ? mesh->uv2s + mesh->offset : 0;
+	Color *cols = mesh->colors ? mesh->colors + mesh->offset : 0;
+	int *idx = mesh->indices + mesh->index_offset;
 
     float s = 0.0625;
     float a = 0 + 1 / 512.0f;
@@ -75,40 +86,97 @@ void make_cube_faces(
         }
         float du = (tiles[i] % 16) * s;
         float dv = (tiles[i] / 16) * s;
-        //int flip = ao[i][0] + ao[i][3] > ao[i][1] + ao[i][2];
-		int flip = 0;
+        // split the quad along the darker diagonal when it is shaded
+        int flip = cols && ao[i][0] + ao[i][3] > ao[i][1] + ao[i][2];
         for (int v = 5; v >= 0; v--)
 		{
-            int j = flip ? flipped[i][v] : indices[i][v];
-			Vector3 point;
-			Vector3 normal;
-			Vector2 uv;
-            point.x = x + n * positions[i][j][0];
-			point.y = y + n * positions[i][j][1];
-			point.z = z + n * positions[i][j][2];
-			normal.x = normals[i][0];
-            normal.y = normals[i][1];
-            normal.z = normals[i][2];
-			uv.x = du + (uvs[i][j][0] ? b : a);
-            uv.y = 1.0f - dv - (uvs[i][j][1] ? b : a);
-
-			p.push_back(point);
-			norms.push_back(normal);
-			uvv.push_back(uv);
-			//idcs.push_back( p.size() - 1 );
-            //*(d++) = ao[i][j];
-           // *(d++) = light[i][j];
+            *(idx++) = mesh->offset + (int) (flip ? cube_flipped[i][v] : cube_indices[i][v]);
+		}
+        for (int j = 0; j < 4; j++)
+		{
+            p->x = x + n * cube_positions[i][j][0];
+			p->y = y + n * cube_positions[i][j][1];
+			p->z = z + n * cube_positions[i][j][2];
+			norms->x = cube_normals[i][0];
+            norms->y = cube_normals[i][1];
+            norms->z = cube_normals[i][2];
+			if (uvv2)
+			{
+				uvv->x = cube_uvs[i][j][0];
+				uvv->y = cube_uvs[i][j][1];
+				uvv2->x = du;
+				uvv2->y = 1.0f - dv;
+				uvv2++;
+			}
+			else
+			{
+				uvv->x = du + (cube_uvs[i][j][0] ? b : a);
+				uvv->y = 1.0f - dv - (cube_uvs[i][j][1] ? b : a);
+			}
+			if (cols)
+			{
+				*(cols++) = Color( 1.0f - ao[i][j], light[i][j], 0.0f, 1.0f );
+			}
+			p++;
+			norms++;
+			uvv++;
         }
+		mesh->offset += 4;
+		mesh->index_offset += 6;
     }
+}
+
+void make_cube_quad(
+    ChunkMesh* mesh, int face,
+    float x0, float y0, float z0, float x1, float y1, float z1,
+    float n, int tile)
+{
+	Vector3 *p = mesh->points + mesh->offset;
+	Vector3 *norms = mesh->normals + mesh->offset;
+	Vector2 *uvv = mesh->uvs + mesh->offset;
+	Vector2 *uvv2 = mesh->uv2s + mesh->offset;
+	Color *cols = mesh->colors ? mesh->colors + mesh->offset : 0;
+	int *idx = mesh->indices + mesh->index_offset;
 
-	mesh_array->set( VS::ARRAY_VERTEX, p );
-	mesh_array->set( VS::ARRAY_NORMAL, norms );
-	mesh_array->set( VS::ARRAY_TEX_UV, uvv );
-	//mesh_array->set( VS::ARRAY_INDEX, idcs );
+	float lo[3] = {x0 - n, y0 - n, z0 - n};
+	float hi[3] = {x1 + n, y1 + n, z1 + n};
+	float su = hi[cube_uv_axes[face][0]] - lo[cube_uv_axes[face][0]];
+	float sv = hi[cube_uv_axes[face][1]] - lo[cube_uv_axes[face][1]];
+    float s = 0.0625;
+    float du = (tile % 16) * s;
+    float dv = (tile / 16) * s;
+	for (int v = 5; v >= 0; v--)
+	{
+		*(idx++) = mesh->offset + (int) cube_indices[face][v];
+	}
+	for (int j = 0; j < 4; j++)
+	{
+		p->x = cube_positions[face][j][0] < 0 ? lo[0] : hi[0];
+		p->y = cube_positions[face][j][1] < 0 ? lo[1] : hi[1];
+		p->z = cube_positions[face][j][2] < 0 ? lo[2] : hi[2];
+		norms->x = cube_normals[face][0];
+		norms->y = cube_normals[face][1];
+		norms->z = cube_normals[face][2];
+		uvv->x = cube_uvs[face][j][0] * su;
+		uvv->y = cube_uvs[face][j][1] * sv;
+		uvv2->x = du;
+		uvv2->y = 1.0f - dv;
+		if (cols)
+		{
+			// merged quads span blocks of different light, they stay neutral
+			*(cols++) = Color( 1.0f, 0.0f, 0.0f, 1.0f );
+		}
+		p++;
+		norms++;
+		uvv++;
+		uvv2++;
+	}
+	mesh->offset += 4;
+	mesh->index_offset += 6;
 }
 
 void make_cube(
-    Array* mesh_array, float ao[6][4], float light[6][4],
+    ChunkMesh* mesh, float ao[6][4], float light[6][4],
     int left, int right, int top, int bottom, int front, int back,
     float x, float y, float z, float n, int w)
 {
@@ -119,15 +187,14 @@ void make_cube(
     int wfront = blocks[w][4];
     int wback = blocks[w][5];
     make_cube_faces(
-		mesh_array, ao, light,
+		mesh, ao, light,
         left, right, top, bottom, front, back,
         wleft, wright, wtop, wbottom, wfront, wback,
         x, y, z, n);
 }
 
 void make_plant(
-    //float *data, float ao, float light,
-	Array* mesh_array,
+	ChunkMesh* mesh, float ao, float light,
     float px, float py, float pz, float n, int w, float rotation)
 {
     static const float positions[4][4][3] = {
@@ -155,9 +222,12 @@ void make_plant(
         {0, 3, 1, 0, 2, 3}
     };
 
-	PoolVector<Vector3> p = mesh_array->get( VS::ARRAY_VERTEX );
-	PoolVector<Vector3> norms = mesh_array->get( VS::ARRAY_NORMAL );
-	PoolVector<Vector2> uvv = mesh_array->get( VS::ARRAY_TEX_UV );
+	Vector3 *p = mesh->points + mesh->offset;
+	Vector3 *norms = mesh->normals + mesh->offset;
+	Vector2 *uvv = mesh->uvs + mesh->offset;
+	Vector2 *uvv2 = mesh->uv2s ? mesh->uv2s + mesh->offset : 0;
+	Color *cols = mesh->colors ? mesh->colors + mesh->offset : 0;
+	int *idx = mesh->indices + mesh->index_offset;
 
 	Transform transform;
 	transform.rotate( Vector3( 0.0f, 1.0f, 0.0f ), Math::deg2rad(rotation) );
@@ -172,16 +242,30 @@ void make_plant(
 	{
         for (int v = 0; v < 6; v++)
 		{
-            int j = indices[i][v];
+            *(idx++) = mesh->offset + i * 4 + (int) indices[i][v];
+		}
+        for (int j = 0; j < 4; j++)
+		{
 			Vector3 position( n * positions[i][j][0], n * positions[i][j][1], n * positions[i][j][2] );
-			Vector3 normal( normals[i][0], normals[i][1], normals[i][2] );
-			Vector2 uv( uvs[i][j][0] ? b : a, uvs[i][j][1] ? b : a );
-			position = transform.xform(position);
-			p.push_back(position);
-			norms.push_back(normal);
-			uvv.push_back(uv);
+			*(p++) = transform.xform(position);
+			*(norms++) = Vector3( normals[i][0], normals[i][1], normals[i][2] );
+			if (uvv2)
+			{
+				*(uvv++) = Vector2( uvs[i][j][0], uvs[i][j][1] );
+				*(uvv2++) = Vector2( du, 1.0f - dv );
+			}
+			else
+			{
+				*(uvv++) = Vector2( uvs[i][j][0] ? b : a, uvs[i][j][1] ? b : a );
+			}
+			if (cols)
+			{
+				*(cols++) = Color( 1.0f - ao, light, 0.0f, 1.0f );
+			}
         }
     }
+	mesh->offset += 16;
+	mesh->index_offset += 24;
 }
 
 /*
@@ -1,23 +1,49 @@
 #ifndef _cube_h_
 #define _cube_h_
 
-class Array;
+struct Color;
+struct Vector2;
+struct Vector3;
+
+// output for one indexed chunk mesh. the buffers are sized up front from the
+// face count, each face writes 4 vertices at offset and 6 indices at
+// index_offset and advances both.
+// when uv2s is set, uvs repeat once per block and uv2s hold the atlas tile
+// origin, the material wraps them itself (see WC::set_greedy_meshing).
+// when colors is set, every vertex gets its ambient occlusion and light as
+// Color(1 - ao, light, 0, 1), see WC::set_material.
+typedef struct {
+	Vector3 *points;
+	Vector3 *normals;
+	Vector2 *uvs;
+	Vector2 *uv2s;
+	Color *colors;
+	int *indices;
+	int offset;
+	int index_offset;
+} ChunkMesh;
 
 void make_cube_faces(
-	Array* mesh_array, float ao[6][4], float light[6][4],
+	ChunkMesh* mesh, float ao[6][4], float light[6][4],
     int left, int right, int top, int bottom, int front, int back,
     int wleft, int wright, int wtop, int wbottom, int wfront, int wback,
     float x, float y, float z, float n);
 
+// one face of the box spanning the blocks centered at (x0, y0, z0)..(x1, y1, z1),
+// always written with tiled uvs, so mesh->uv2s must be set.
+void make_cube_quad(
+    ChunkMesh* mesh, int face,
+    float x0, float y0, float z0, float x1, float y1, float z1,
+    float n, int tile);
+
 void make_cube(
-    Array* mesh_array, float ao[6][4], float light[6][4],
+    ChunkMesh* mesh, float ao[6][4], float light[6][4],
     int left, int right, int top, int bottom, int front, int back,
     float x, float y, float z, float n, int w);
 
 
 void make_plant(
-	Array* mesh_array,
-    //float *data, float ao, float light,
+	ChunkMesh* mesh, float ao, float light,
     float px, float py, float pz, float n, int w, float rotation);
 
 /*
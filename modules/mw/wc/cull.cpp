@@ -0,0 +1,227 @@
+#include <string.h>
+#include "cull.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULL_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CULL_NEON
+#include <arm_neon.h>
+#endif
+
+static int cull_popcount( uint64_t v ) {
+	v = v - ((v >> 1) & 0x5555555555555555ull);
+	v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+	v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return (int) ((v * 0x0101010101010101ull) >> 56);
+}
+
+static int cull_lowest( uint64_t v ) {
+	int i = 0;
+	while( !(v & 1) ) {
+		v >>= 1;
+		i++;
+	}
+	return i;
+}
+
+static int cull_highest( uint64_t v ) {
+	int i = 63;
+	while( !(v >> 63) ) {
+		v <<= 1;
+		i--;
+	}
+	return i;
+}
+
+void cull_clear( CullMasks *masks ) {
+	memset( masks->opaque, 0, sizeof( masks->opaque ) );
+	memset( masks->solid, 0, sizeof( masks->solid ) );
+	memset( masks->plants, 0, sizeof( masks->plants ) );
+}
+
+void cull_faces_scalar( CullMasks *masks ) {
+	for( int x = 0; x < CULL_CHUNK; x++ ) {
+		for( int z = 0; z < CULL_CHUNK; z++ ) {
+			const uint64_t *s = masks->solid[CULL_COLUMN( x, z )];
+			const uint64_t *o = masks->opaque[CULL_OPAQUE( x, z )];
+			const uint64_t *neighbors[6] = {
+				masks->opaque[CULL_OPAQUE( x - 1, z )],
+				masks->opaque[CULL_OPAQUE( x + 1, z )],
+				0,
+				0,
+				masks->opaque[CULL_OPAQUE( x, z - 1 )],
+				masks->opaque[CULL_OPAQUE( x, z + 1 )]
+			};
+			for( int w = 0; w < CULL_WORDS; w++ ) {
+				uint64_t up = (o[w] >> 1) | (w + 1 < CULL_WORDS ? o[w + 1] << 63 : 0);
+				uint64_t down = (o[w] << 1) | (w > 0 ? o[w - 1] >> 63 : 0);
+				for( int f = 0; f < 6; f++ ) {
+					uint64_t covered;
+					if( f == CULL_FACE_TOP ) {
+						covered = up;
+					}
+					else if( f == CULL_FACE_BOTTOM ) {
+						// nothing below y 0 gets a face, like ey > 0 in compute_chunk
+						covered = w == 0 ? down | 1 : down;
+					}
+					else {
+						covered = neighbors[f][w];
+					}
+					masks->faces[f][CULL_COLUMN( x, z )][w] = s[w] & ~covered;
+				}
+			}
+		}
+	}
+}
+
+#if defined(CULL_SSE2)
+
+// (a[1], b[0])
+static inline __m128i cull_cross( __m128i a, __m128i b ) {
+	return _mm_castpd_si128( _mm_shuffle_pd( _mm_castsi128_pd( a ), _mm_castsi128_pd( b ), 1 ) );
+}
+
+void cull_faces( CullMasks *masks ) {
+	const __m128i floor_bit = _mm_set_epi32( 0, 0, 0, 1 );
+	for( int x = 0; x < CULL_CHUNK; x++ ) {
+		for( int z = 0; z < CULL_CHUNK; z++ ) {
+			int c = CULL_COLUMN( x, z );
+			const uint64_t *neighbors[6] = {
+				masks->opaque[CULL_OPAQUE( x - 1, z )],
+				masks->opaque[CULL_OPAQUE( x + 1, z )],
+				0,
+				0,
+				masks->opaque[CULL_OPAQUE( x, z - 1 )],
+				masks->opaque[CULL_OPAQUE( x, z + 1 )]
+			};
+			const uint64_t *o = masks->opaque[CULL_OPAQUE( x, z )];
+			__m128i s_lo = _mm_loadu_si128( (const __m128i *) masks->solid[c] );
+			__m128i s_hi = _mm_loadu_si128( (const __m128i *) (masks->solid[c] + 2) );
+			__m128i o_lo = _mm_loadu_si128( (const __m128i *) o );
+			__m128i o_hi = _mm_loadu_si128( (const __m128i *) (o + 2) );
+			__m128i middle = cull_cross( o_lo, o_hi );
+			__m128i up_lo = _mm_or_si128( _mm_srli_epi64( o_lo, 1 ), _mm_slli_epi64( middle, 63 ) );
+			__m128i up_hi = _mm_or_si128( _mm_srli_epi64( o_hi, 1 ), _mm_slli_epi64( _mm_srli_si128( o_hi, 8 ), 63 ) );
+			__m128i down_lo = _mm_or_si128( _mm_slli_epi64( o_lo, 1 ), _mm_srli_epi64( _mm_slli_si128( o_lo, 8 ), 63 ) );
+			__m128i down_hi = _mm_or_si128( _mm_slli_epi64( o_hi, 1 ), _mm_srli_epi64( middle, 63 ) );
+			down_lo = _mm_or_si128( down_lo, floor_bit );
+			for( int f = 0; f < 6; f++ ) {
+				__m128i covered_lo;
+				__m128i covered_hi;
+				if( f == CULL_FACE_TOP ) {
+					covered_lo = up_lo;
+					covered_hi = up_hi;
+				}
+				else if( f == CULL_FACE_BOTTOM ) {
+					covered_lo = down_lo;
+					covered_hi = down_hi;
+				}
+				else {
+					covered_lo = _mm_loadu_si128( (const __m128i *) neighbors[f] );
+					covered_hi = _mm_loadu_si128( (const __m128i *) (neighbors[f] + 2) );
+				}
+				_mm_storeu_si128( (__m128i *) masks->faces[f][c], _mm_andnot_si128( covered_lo, s_lo ) );
+				_mm_storeu_si128( (__m128i *) (masks->faces[f][c] + 2), _mm_andnot_si128( covered_hi, s_hi ) );
+			}
+		}
+	}
+}
+
+#elif defined(CULL_NEON)
+
+void cull_faces( CullMasks *masks ) {
+	const uint64x2_t zero = vdupq_n_u64( 0 );
+	const uint64x2_t floor_bit = vsetq_lane_u64( 1, zero, 0 );
+	for( int x = 0; x < CULL_CHUNK; x++ ) {
+		for( int z = 0; z < CULL_CHUNK; z++ ) {
+			int c = CULL_COLUMN( x, z );
+			const uint64_t *neighbors[6] = {
+				masks->opaque[CULL_OPAQUE( x - 1, z )],
+				masks->opaque[CULL_OPAQUE( x + 1, z )],
+				0,
+				0,
+				masks->opaque[CULL_OPAQUE( x, z - 1 )],
+				masks->opaque[CULL_OPAQUE( x, z + 1 )]
+			};
+			const uint64_t *o = masks->opaque[CULL_OPAQUE( x, z )];
+			uint64x2_t s_lo = vld1q_u64( masks->solid[c] );
+			uint64x2_t s_hi = vld1q_u64( masks->solid[c] + 2 );
+			uint64x2_t o_lo = vld1q_u64( o );
+			uint64x2_t o_hi = vld1q_u64( o + 2 );
+			uint64x2_t middle = vextq_u64( o_lo, o_hi, 1 );
+			uint64x2_t up_lo = vorrq_u64( vshrq_n_u64( o_lo, 1 ), vshlq_n_u64( middle, 63 ) );
+			uint64x2_t up_hi = vorrq_u64( vshrq_n_u64( o_hi, 1 ), vshlq_n_u64( vextq_u64( o_hi, zero, 1 ), 63 ) );
+			uint64x2_t down_lo = vorrq_u64( vshlq_n_u64( o_lo, 1 ), vshrq_n_u64( vextq_u64( zero, o_lo, 1 ), 63 ) );
+			uint64x2_t down_hi = vorrq_u64( vshlq_n_u64( o_hi, 1 ), vshrq_n_u64( middle, 63 ) );
+			down_lo = vorrq_u64( down_lo, floor_bit );
+			for( int f = 0; f < 6; f++ ) {
+				uint64x2_t covered_lo;
+				uint64x2_t covered_hi;
+				if( f == CULL_FACE_TOP ) {
+					covered_lo = up_lo;
+					covered_hi = up_hi;
+				}
+				else if( f == CULL_FACE_BOTTOM ) {
+					covered_lo = down_lo;
+					covered_hi = down_hi;
+				}
+				else {
+					covered_lo = vld1q_u64( neighbors[f] );
+					covered_hi = vld1q_u64( neighbors[f] + 2 );
+				}
+				vst1q_u64( masks->faces[f][c], vbicq_u64( s_lo, covered_lo ) );
+				vst1q_u64( masks->faces[f][c] + 2, vbicq_u64( s_hi, covered_hi ) );
+			}
+		}
+	}
+}
+
+#else
+
+void cull_faces( CullMasks *masks ) {
+	cull_faces_scalar( masks );
+}
+
+#endif
+
+int cull_count( const CullMasks *masks, int *miny, int *maxy, int *sections ) {
+	const int per_word = 64 / CULL_SECTION;
+	const uint64_t section_bits = ((uint64_t) 1 << CULL_SECTION) - 1;
+	int faces = 0;
+	int lo = CULL_HEIGHT;
+	int hi = -1;
+	if( sections ) {
+		memset( sections, 0, CULL_WORDS * per_word * sizeof( int ) );
+	}
+	for( int c = 0; c < CULL_CHUNK * CULL_CHUNK; c++ ) {
+		for( int w = 0; w < CULL_WORDS; w++ ) {
+			uint64_t any = 0;
+			uint64_t plants = masks->plants[c][w];
+			for( int f = 0; f < 6; f++ ) {
+				uint64_t face = masks->faces[f][c][w];
+				any |= face;
+				faces += cull_popcount( face & ~plants );
+				if( sections && face ) {
+					for( int s = 0; s < per_word; s++ ) {
+						sections[w * per_word + s] += cull_popcount( (face & ~plants) >> (s * CULL_SECTION) & section_bits );
+					}
+				}
+			}
+			if( !any ) {
+				continue;
+			}
+			faces += 4 * cull_popcount( any & plants );
+			if( sections && (any & plants) ) {
+				for( int s = 0; s < per_word; s++ ) {
+					sections[w * per_word + s] += 4 * cull_popcount( (any & plants) >> (s * CULL_SECTION) & section_bits );
+				}
+			}
+			lo = lo < w * 64 + cull_lowest( any ) ? lo : w * 64 + cull_lowest( any );
+			hi = hi > w * 64 + cull_highest( any ) ? hi : w * 64 + cull_highest( any );
+		}
+	}
+	*miny = lo;
+	*maxy = hi < 0 ? 0 : hi;
+	return faces;
+}
@@ -0,0 +1,65 @@
+#ifndef _cull_h_
+#define _cull_h_
+
+#include <stdint.h>
+
+// face culling on bit columns. every (x, z) column of a chunk keeps one bit
+// per block along y, so the six face tests of a whole column are a handful
+// of ands and shifts instead of six byte loads per block.
+
+#define CULL_CHUNK 32 // CHUNK_SIZE
+#define CULL_SIZE (CULL_CHUNK + 2)
+#define CULL_HEIGHT 256
+#define CULL_WORDS (CULL_HEIGHT / 64)
+#define CULL_SECTION 32 // CHUNK_SECTION_HEIGHT
+
+// faces in the order compute_chunk passes them to make_cube.
+#define CULL_FACE_LEFT 0
+#define CULL_FACE_RIGHT 1
+#define CULL_FACE_TOP 2
+#define CULL_FACE_BOTTOM 3
+#define CULL_FACE_BACK 4
+#define CULL_FACE_FRONT 5
+
+// x, z from -1 to CULL_CHUNK, the border holds the neighbouring chunks.
+#define CULL_OPAQUE(x, z) (((x) + 1) * CULL_SIZE + ((z) + 1))
+// x, z from 0 to CULL_CHUNK - 1.
+#define CULL_COLUMN(x, z) ((x) * CULL_CHUNK + (z))
+
+typedef struct {
+	uint64_t opaque[CULL_SIZE * CULL_SIZE][CULL_WORDS];
+	// blocks of the center chunk that get faces, and which of them are plants
+	uint64_t solid[CULL_CHUNK * CULL_CHUNK][CULL_WORDS];
+	uint64_t plants[CULL_CHUNK * CULL_CHUNK][CULL_WORDS];
+	uint64_t faces[6][CULL_CHUNK * CULL_CHUNK][CULL_WORDS];
+} CullMasks;
+
+static inline void cull_set_bit( uint64_t *column, int y, int value ) {
+	uint64_t bit = (uint64_t) 1 << (y & 63);
+	if( value ) {
+		column[y >> 6] |= bit;
+	}
+	else {
+		column[y >> 6] &= ~bit;
+	}
+}
+
+static inline int cull_get_bit( const uint64_t *column, int y ) {
+	return (int) ((column[y >> 6] >> (y & 63)) & 1);
+}
+
+static inline int cull_face( const CullMasks *masks, int face, int x, int y, int z ) {
+	return cull_get_bit( masks->faces[face][CULL_COLUMN( x, z )], y );
+}
+
+void cull_clear( CullMasks *masks );
+// fills faces from opaque, solid and plants. cull_faces_scalar is the
+// portable kernel, cull_faces uses SSE2 or NEON when the target has them.
+void cull_faces( CullMasks *masks );
+void cull_faces_scalar( CullMasks *masks );
+// exposed faces the way compute_chunk counts them, plants count 4 when any
+// of their faces is exposed. miny, maxy span the blocks with faces. when
+// sections is set it gets the faces of every CULL_SECTION blocks along y.
+int cull_count( const CullMasks *masks, int *miny, int *maxy, int *sections );
+
+#endif
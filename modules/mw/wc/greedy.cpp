@@ -0,0 +1,157 @@
+#include <string.h>
+#include "greedy.h"
+#include "item.h"
+#include "wc.h"
+#include "section.h"
+#include "os/memory.h"
+
+#define CXYZ(x, y, z) ((y) * CHUNK_SIZE * CHUNK_SIZE + (x) * CHUNK_SIZE + (z))
+
+// normal axis and offset of each face, in make_cube_faces order.
+static const int face_axis[6] = {0, 0, 1, 1, 2, 2};
+static const int face_offsets[6][3] = {
+	{-1, 0, 0},
+	{+1, 0, 0},
+	{0, +1, 0},
+	{0, -1, 0},
+	{0, 0, -1},
+	{0, 0, +1}
+};
+
+int make_greedy_faces(
+	ChunkMesh *meshes, CMap *map, const char *opaque,
+	int p, int q, int miny, int maxy)
+{
+	if (miny > maxy)
+	{
+		return 0;
+	}
+
+	uint32_t types_size = CHUNK_SIZE * CHUNK_SIZE * Y_SIZE * sizeof(char);
+	uint32_t mask_size = CHUNK_SIZE * Y_SIZE * sizeof(char);
+	char *types = (char *) Memory::alloc_static(types_size, true);
+	memset(types, 0, types_size);
+	char *mask = (char *) Memory::alloc_static(mask_size, true);
+
+	int bx = p * CHUNK_SIZE;
+	int bz = q * CHUNK_SIZE;
+	MAP_FOR_EACH(map, ex, ey, ez, ew)
+	{
+		int lx = ex - bx;
+		int lz = ez - bz;
+		if (ew <= 0 || is_plant(ew))
+		{
+			continue;
+		}
+		if (lx < 0 || lz < 0 || lx >= CHUNK_SIZE || lz >= CHUNK_SIZE || ey < miny || ey > maxy)
+		{
+			continue;
+		}
+		types[CXYZ(lx, ey, lz)] = ew;
+	} END_MAP_FOR_EACH;
+
+	int size[3] = {CHUNK_SIZE, maxy - miny + 1, CHUNK_SIZE};
+	int base[3] = {bx, miny, bz};
+	int quads = 0;
+	for (int face = 0; face < 6; face++)
+	{
+		int d = face_axis[face];
+		int u = (d + 1) % 3;
+		int v = (d + 2) % 3;
+		const int *o = face_offsets[face];
+		for (int k = 0; k < size[d]; k++)
+		{
+			// visible faces of this slice, keyed by block type
+			int c[3];
+			c[d] = k;
+			int n = 0;
+			for (c[v] = 0; c[v] < size[v]; c[v]++)
+			{
+				for (c[u] = 0; c[u] < size[u]; c[u]++)
+				{
+					int ey = c[1] + miny;
+					int w = types[CXYZ(c[0], ey, c[2])];
+					char m = 0;
+					if (w > 0 && !(face == 3 && ey == 0))
+					{
+						// opaque is offset by one chunk plus the one block pad
+						int x = c[0] + CHUNK_SIZE + 1 + o[0];
+						int y = ey + 1 + o[1];
+						int z = c[2] + CHUNK_SIZE + 1 + o[2];
+						if (!opaque[XYZ(x, y, z)])
+						{
+							m = w;
+						}
+					}
+					mask[n++] = m;
+				}
+			}
+
+			// grow each face along u, then along v while whole rows match
+			for (int b = 0; b < size[v]; b++)
+			{
+				for (int a = 0; a < size[u];)
+				{
+					char w = mask[b * size[u] + a];
+					if (!w)
+					{
+						a++;
+						continue;
+					}
+					// y runs along u for x faces and along v for z faces
+					int ulimit = size[u];
+					int vlimit = size[v];
+					if (u == 1)
+					{
+						ulimit = MIN(ulimit, ((miny + a) / CHUNK_SECTION_HEIGHT + 1) * CHUNK_SECTION_HEIGHT - miny);
+					}
+					if (v == 1)
+					{
+						vlimit = MIN(vlimit, ((miny + b) / CHUNK_SECTION_HEIGHT + 1) * CHUNK_SECTION_HEIGHT - miny);
+					}
+					int width = 1;
+					while (a + width < ulimit && mask[b * size[u] + a + width] == w)
+					{
+						width++;
+					}
+					int height = 1;
+					for (; b + height < vlimit; height++)
+					{
+						char *row = mask + (b + height) * size[u] + a;
+						int i = 0;
+						while (i < width && row[i] == w)
+						{
+							i++;
+						}
+						if (i < width)
+						{
+							break;
+						}
+					}
+					for (int h = 0; h < height; h++)
+					{
+						memset(mask + (b + h) * size[u] + a, 0, width);
+					}
+
+					int lo[3];
+					int hi[3];
+					lo[d] = hi[d] = base[d] + k;
+					lo[u] = base[u] + a;
+					hi[u] = lo[u] + width - 1;
+					lo[v] = base[v] + b;
+					hi[v] = lo[v] + height - 1;
+					make_cube_quad(
+						meshes + lo[1] / CHUNK_SECTION_HEIGHT, face,
+						lo[0], lo[1], lo[2], hi[0], hi[1], hi[2],
+						0.5, blocks[(int) w][face]);
+					quads++;
+					a += width;
+				}
+			}
+		}
+	}
+
+	Memory::free_static(mask, true);
+	Memory::free_static(types, true);
+	return quads;
+}
@@ -0,0 +1,14 @@
+#ifndef _greedy_h_
+#define _greedy_h_
+
+#include "cmap.h"
+#include "cube.h"
+
+// merges the exposed faces of the center chunk into quads of one block type
+// per face direction and slice. plants are left to the caller. quads stop
+// at section boundaries, each one goes to meshes[y / CHUNK_SECTION_HEIGHT].
+int make_greedy_faces(
+	ChunkMesh *meshes, CMap *map, const char *opaque,
+	int p, int q, int miny, int maxy);
+
+#endif
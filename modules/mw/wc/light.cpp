@@ -0,0 +1,537 @@
+#include <stdlib.h>
+#include <string.h>
+#include "light.h"
+#include "item.h"
+#include "core/typedefs.h"
+
+// sources reach LIGHT_MAX blocks, one more keeps the seeds of every path
+// into the chunk inside the volume.
+#define LIGHT_MARGIN (LIGHT_MAX + 1)
+
+// neighbours in make_cube_faces order, LIGHT_DOWN is the one sky light
+// keeps its level through.
+#define LIGHT_DOWN 3
+static const int light_offsets[6][3] = {
+	{-1, 0, 0},
+	{+1, 0, 0},
+	{0, +1, 0},
+	{0, -1, 0},
+	{0, 0, -1},
+	{0, 0, +1}
+};
+
+typedef struct {
+	int *items;
+	int head;
+	int count;
+	int capacity;
+} LightQueue;
+
+static void queue_init(LightQueue *queue) {
+	memset(queue, 0, sizeof(LightQueue));
+}
+
+static void queue_free(LightQueue *queue) {
+	free(queue->items);
+}
+
+static void queue_push(LightQueue *queue, int item) {
+	if (queue->count == queue->capacity) {
+		queue->capacity = queue->capacity ? queue->capacity * 2 : 1024;
+		queue->items = (int *) realloc(queue->items, queue->capacity * sizeof(int));
+	}
+	queue->items[queue->count++] = item;
+}
+
+static int chunk_of(int x) {
+	return x < 0 ? (x + 1) / LIGHT_CHUNK - 1 : x / LIGHT_CHUNK;
+}
+
+static int level_of(int v, int shift) {
+	return (v >> shift) & 15;
+}
+
+static int with_level(int v, int shift, int level) {
+	return (v & ~(15 << shift)) | (level << shift);
+}
+
+// level a light at level reaches its neighbour through face with
+static int light_step(int level, int shift, int face) {
+	if (shift && face == LIGHT_DOWN && level == LIGHT_MAX) {
+		return LIGHT_MAX;
+	}
+	return level - 1;
+}
+
+void light_map_init(LightMap *map) {
+	map->height = 0;
+	map->data = 0;
+}
+
+void light_map_free(LightMap *map) {
+	free(map->data);
+	light_map_init(map);
+}
+
+void light_map_set(LightMap *map, int x, int y, int z, int v) {
+	if (y < 0 || y >= LIGHT_HEIGHT) {
+		return;
+	}
+	if (y >= map->height) {
+		if (v == LIGHT_OPEN) {
+			return;
+		}
+		int height = MIN((y / 16 + 1) * 16, LIGHT_HEIGHT);
+		int layer = LIGHT_CHUNK * LIGHT_CHUNK;
+		map->data = (uint8_t *) realloc(map->data, height * layer);
+		memset(map->data + map->height * layer, LIGHT_OPEN, (height - map->height) * layer);
+		map->height = height;
+	}
+	map->data[LIGHT_MAP_INDEX(x, y, z)] = v;
+}
+
+unsigned int light_map_memory(const LightMap *map) {
+	return sizeof(LightMap) + map->height * LIGHT_CHUNK * LIGHT_CHUNK;
+}
+
+// spreads every queued cell of one channel, shift 4 for sky and 0 for
+// block light, through the cells that are not opaque.
+static void light_flood(LightVolume *volume, const char *opaque, LightQueue *queue, int shift) {
+	int size = volume->size;
+	int layer = size * size;
+	uint8_t *data = volume->data;
+	while (queue->head < queue->count) {
+		int i = queue->items[queue->head++];
+		int level = level_of(data[i], shift);
+		if (level <= 1) {
+			continue;
+		}
+		int y = i / layer;
+		int x = (i % layer) / size;
+		int z = i % size;
+		for (int face = 0; face < 6; face++) {
+			int nx = x + light_offsets[face][0];
+			int ny = y + light_offsets[face][1];
+			int nz = z + light_offsets[face][2];
+			if (nx < 0 || nz < 0 || ny < 0 || nx >= size || nz >= size || ny >= volume->height) {
+				continue;
+			}
+			int n = (ny * size + nx) * size + nz;
+			int next = light_step(level, shift, face);
+			if (opaque[n] || level_of(data[n], shift) >= next) {
+				continue;
+			}
+			data[n] = with_level(data[n], shift, next);
+			queue_push(queue, n);
+		}
+	}
+	queue->head = 0;
+	queue->count = 0;
+}
+
+void light_compute(LightVolume *volume, CMap *block_maps[3][3], CMap *light_maps[3][3], int p, int q) {
+	int size = LIGHT_CHUNK + 2 * LIGHT_MARGIN;
+	int layer = size * size;
+	volume->ox = p * LIGHT_CHUNK - LIGHT_MARGIN;
+	volume->oz = q * LIGHT_CHUNK - LIGHT_MARGIN;
+	volume->size = size;
+
+	// opaque blocks and the highest one per column in one pass over the
+	// maps, the layers above the volume's height are never looked at
+	int *tops = (int *) malloc(layer * sizeof(int));
+	for (int i = 0; i < layer; i++) {
+		tops[i] = -1;
+	}
+	char *opaque = (char *) malloc(layer * LIGHT_HEIGHT);
+	memset(opaque, 0, layer * LIGHT_HEIGHT);
+	int source_top = -1;
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) {
+			CMap *map = block_maps[a][b];
+			if (map) {
+				MAP_FOR_EACH(map, ex, ey, ez, ew) {
+					int x = ex - volume->ox;
+					int z = ez - volume->oz;
+					if (x < 0 || z < 0 || x >= size || z >= size || ey < 0 || ey >= LIGHT_HEIGHT || is_transparent(ew)) {
+						continue;
+					}
+					opaque[(ey * size + x) * size + z] = 1;
+					tops[x * size + z] = MAX(tops[x * size + z], ey);
+				} END_MAP_FOR_EACH;
+			}
+			map = light_maps[a][b];
+			if (map) {
+				MAP_FOR_EACH(map, ex, ey, ez, ew) {
+					int x = ex - volume->ox;
+					int z = ez - volume->oz;
+					if (x >= 0 && z >= 0 && x < size && z < size && ew > 0) {
+						source_top = MAX(source_top, ey);
+					}
+				} END_MAP_FOR_EACH;
+			}
+		}
+	}
+
+	// columns of missing chunks repeat the nearest column the center map
+	// knows, its border included
+	int top = -1;
+	for (int x = 0; x < size; x++) {
+		for (int z = 0; z < size; z++) {
+			int i = x * size + z;
+			int a = chunk_of(volume->ox + x) - p + 1;
+			int b = chunk_of(volume->oz + z) - q + 1;
+			int cx = CLAMP(x, LIGHT_MARGIN - 1, LIGHT_MARGIN + LIGHT_CHUNK);
+			int cz = CLAMP(z, LIGHT_MARGIN - 1, LIGHT_MARGIN + LIGHT_CHUNK);
+			if (!block_maps[a][b] && (cx != x || cz != z)) {
+				int clamped = cx * size + cz;
+				tops[i] = tops[clamped];
+				for (int y = 0; y <= tops[i]; y++) {
+					opaque[y * layer + i] = opaque[y * layer + clamped];
+				}
+			}
+			top = MAX(top, tops[i]);
+		}
+	}
+	int height = top + 2;
+	if (source_top >= 0) {
+		height = MAX(height, source_top + LIGHT_MAX + 1);
+	}
+	height = CLAMP(height, 1, LIGHT_HEIGHT);
+	volume->height = height;
+
+	volume->data = (uint8_t *) malloc(layer * height);
+	memset(volume->data, 0, layer * height);
+	LightQueue queue;
+	queue_init(&queue);
+
+	// open sky above every column, seeded where it borders a higher column
+	for (int x = 0; x < size; x++) {
+		for (int z = 0; z < size; z++) {
+			int i = x * size + z;
+			int seed_top = -1;
+			for (int face = 0; face < 6; face++) {
+				int nx = x + light_offsets[face][0];
+				int nz = z + light_offsets[face][2];
+				if (light_offsets[face][1] || nx < 0 || nz < 0 || nx >= size || nz >= size) {
+					continue;
+				}
+				seed_top = MAX(seed_top, tops[nx * size + nz]);
+			}
+			for (int y = tops[i] + 1; y < height; y++) {
+				volume->data[y * layer + i] = LIGHT_OPEN;
+				if (y <= seed_top) {
+					queue_push(&queue, y * layer + i);
+				}
+			}
+		}
+	}
+	light_flood(volume, opaque, &queue, 4);
+
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) {
+			CMap *map = light_maps[a][b];
+			if (!map) {
+				continue;
+			}
+			MAP_FOR_EACH(map, ex, ey, ez, ew) {
+				int x = ex - volume->ox;
+				int z = ez - volume->oz;
+				if (x < 0 || z < 0 || x >= size || z >= size || ey < 0 || ey >= height || ew <= 0) {
+					continue;
+				}
+				int i = (ey * size + x) * size + z;
+				if (LIGHT_BLOCK(volume->data[i]) < ew) {
+					volume->data[i] = with_level(volume->data[i], 0, MIN(ew, LIGHT_MAX));
+					queue_push(&queue, i);
+				}
+			} END_MAP_FOR_EACH;
+		}
+	}
+	light_flood(volume, opaque, &queue, 0);
+
+	queue_free(&queue);
+	free(opaque);
+	free(tops);
+}
+
+void light_gather(LightVolume *volume, LightMap *maps[3][3], int p, int q) {
+	int size = LIGHT_CHUNK + 2;
+	volume->ox = p * LIGHT_CHUNK - 1;
+	volume->oz = q * LIGHT_CHUNK - 1;
+	volume->size = size;
+	int height = 1;
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) {
+			if (maps[a][b]) {
+				height = MAX(height, maps[a][b]->height);
+			}
+		}
+	}
+	volume->height = height;
+	volume->data = (uint8_t *) malloc(size * size * height);
+	for (int x = 0; x < size; x++) {
+		int a = chunk_of(volume->ox + x) - p + 1;
+		int lx = volume->ox + x - (p + a - 1) * LIGHT_CHUNK;
+		for (int z = 0; z < size; z++) {
+			int b = chunk_of(volume->oz + z) - q + 1;
+			int lz = volume->oz + z - (q + b - 1) * LIGHT_CHUNK;
+			LightMap *map = maps[a][b];
+			for (int y = 0; y < height; y++) {
+				volume->data[(y * size + x) * size + z] = map ? light_map_get(map, lx, y, lz) : LIGHT_OPEN;
+			}
+		}
+	}
+}
+
+void light_volume_free(LightVolume *volume) {
+	free(volume->data);
+	volume->data = 0;
+}
+
+void light_store(LightMap *map, const LightVolume *volume, int p, int q) {
+	int dx = p * LIGHT_CHUNK - volume->ox;
+	int dz = q * LIGHT_CHUNK - volume->oz;
+	light_map_free(map);
+	map->height = volume->height;
+	map->data = (uint8_t *) malloc(LIGHT_CHUNK * LIGHT_CHUNK * volume->height);
+	for (int y = 0; y < volume->height; y++) {
+		for (int x = 0; x < LIGHT_CHUNK; x++) {
+			const uint8_t *row = volume->data + (y * volume->size + x + dx) * volume->size + dz;
+			memcpy(map->data + LIGHT_MAP_INDEX(x, y, 0), row, LIGHT_CHUNK);
+		}
+	}
+}
+
+// cells of an edit are packed relative to the corner of its 3x3 chunks,
+// with the level of removal entries above them.
+#define EDIT_SIZE (3 * LIGHT_CHUNK)
+#define EDIT_LEVEL_SHIFT 22
+
+void light_edit_init(LightEdit *edit, int p, int q) {
+	memset(edit, 0, sizeof(LightEdit));
+	edit->p = p;
+	edit->q = q;
+}
+
+static int edit_pack(LightEdit *edit, int x, int y, int z) {
+	int rx = x - (edit->p - 1) * LIGHT_CHUNK;
+	int rz = z - (edit->q - 1) * LIGHT_CHUNK;
+	return (y * EDIT_SIZE + rx) * EDIT_SIZE + rz;
+}
+
+static void edit_unpack(LightEdit *edit, int i, int *x, int *y, int *z) {
+	i &= (1 << EDIT_LEVEL_SHIFT) - 1;
+	*y = i / (EDIT_SIZE * EDIT_SIZE);
+	*x = (i / EDIT_SIZE) % EDIT_SIZE + (edit->p - 1) * LIGHT_CHUNK;
+	*z = i % EDIT_SIZE + (edit->q - 1) * LIGHT_CHUNK;
+}
+
+// chunk a, b of the 3x3 holding x, z, 0 outside of them.
+static int edit_chunk(LightEdit *edit, int x, int z, int *a, int *b) {
+	*a = chunk_of(x) - edit->p + 1;
+	*b = chunk_of(z) - edit->q + 1;
+	return *a >= 0 && *b >= 0 && *a < 3 && *b < 3;
+}
+
+static int edit_get(LightEdit *edit, int x, int y, int z) {
+	int a;
+	int b;
+	if (y >= LIGHT_HEIGHT) {
+		return LIGHT_OPEN;
+	}
+	if (y < 0 || !edit_chunk(edit, x, z, &a, &b) || !edit->maps[a][b]) {
+		return 0;
+	}
+	return light_map_get(edit->maps[a][b], x - (edit->p + a - 1) * LIGHT_CHUNK, y, z - (edit->q + b - 1) * LIGHT_CHUNK);
+}
+
+// cells of chunks without stored light, or outside the 3x3, never change.
+static int edit_writable(LightEdit *edit, int x, int y, int z) {
+	int a;
+	int b;
+	return y >= 0 && y < LIGHT_HEIGHT && edit_chunk(edit, x, z, &a, &b) && edit->maps[a][b];
+}
+
+static void edit_set(LightEdit *edit, int x, int y, int z, int v) {
+	int a;
+	int b;
+	edit_chunk(edit, x, z, &a, &b);
+	int lx = x - (edit->p + a - 1) * LIGHT_CHUNK;
+	int lz = z - (edit->q + b - 1) * LIGHT_CHUNK;
+	light_map_set(edit->maps[a][b], lx, y, lz, v);
+	for (int da = (lx == 0 ? -1 : 0); da <= (lx == LIGHT_CHUNK - 1 ? 1 : 0); da++) {
+		for (int db = (lz == 0 ? -1 : 0); db <= (lz == LIGHT_CHUNK - 1 ? 1 : 0); db++) {
+			edit->changed[a + da + 1][b + db + 1] = 1;
+		}
+	}
+}
+
+static int edit_opaque(LightEdit *edit, int x, int y, int z) {
+	int a;
+	int b;
+	if (!edit_chunk(edit, x, z, &a, &b) || !edit->block_maps[a][b]) {
+		return 1;
+	}
+	return !is_transparent(map_get(edit->block_maps[a][b], x, y, z));
+}
+
+static int edit_source(LightEdit *edit, int x, int y, int z) {
+	int a;
+	int b;
+	if (!edit_chunk(edit, x, z, &a, &b) || !edit->light_maps[a][b]) {
+		return 0;
+	}
+	return CLAMP(map_get(edit->light_maps[a][b], x, y, z), 0, LIGHT_MAX);
+}
+
+static void edit_flood(LightEdit *edit, LightQueue *queue, int shift) {
+	while (queue->head < queue->count) {
+		int x;
+		int y;
+		int z;
+		edit_unpack(edit, queue->items[queue->head++], &x, &y, &z);
+		int level = level_of(edit_get(edit, x, y, z), shift);
+		if (level <= 1) {
+			continue;
+		}
+		for (int face = 0; face < 6; face++) {
+			int nx = x + light_offsets[face][0];
+			int ny = y + light_offsets[face][1];
+			int nz = z + light_offsets[face][2];
+			if (!edit_writable(edit, nx, ny, nz) || edit_opaque(edit, nx, ny, nz)) {
+				continue;
+			}
+			int next = light_step(level, shift, face);
+			int v = edit_get(edit, nx, ny, nz);
+			if (level_of(v, shift) < next) {
+				edit_set(edit, nx, ny, nz, with_level(v, shift, next));
+				queue_push(queue, edit_pack(edit, nx, ny, nz));
+			}
+		}
+	}
+	queue->head = 0;
+	queue->count = 0;
+}
+
+// takes out the light of the block and everything that depended on it,
+// then floods the hole again from the light around it. works the same
+// whether the block turned opaque or clear, or its source changed.
+void light_edit(LightEdit *edit, int x, int y, int z) {
+	if (!edit_writable(edit, x, y, z)) {
+		return;
+	}
+	LightQueue removal;
+	LightQueue refill;
+	queue_init(&removal);
+	queue_init(&refill);
+	for (int shift = 4; shift >= 0; shift -= 4) {
+		int v = edit_get(edit, x, y, z);
+		int level = level_of(v, shift);
+		if (level) {
+			edit_set(edit, x, y, z, with_level(v, shift, 0));
+			queue_push(&removal, edit_pack(edit, x, y, z) | (level << EDIT_LEVEL_SHIFT));
+		}
+		while (removal.head < removal.count) {
+			int item = removal.items[removal.head++];
+			int cx;
+			int cy;
+			int cz;
+			edit_unpack(edit, item, &cx, &cy, &cz);
+			level = item >> EDIT_LEVEL_SHIFT;
+			for (int face = 0; face < 6; face++) {
+				int nx = cx + light_offsets[face][0];
+				int ny = cy + light_offsets[face][1];
+				int nz = cz + light_offsets[face][2];
+				if (!edit_writable(edit, nx, ny, nz)) {
+					continue;
+				}
+				int nv = edit_get(edit, nx, ny, nz);
+				int next = level_of(nv, shift);
+				if (!next) {
+					continue;
+				}
+				if (next < level || (shift && face == LIGHT_DOWN && level == LIGHT_MAX && next == LIGHT_MAX)) {
+					edit_set(edit, nx, ny, nz, with_level(nv, shift, 0));
+					queue_push(&removal, edit_pack(edit, nx, ny, nz) | (next << EDIT_LEVEL_SHIFT));
+					int source = shift ? 0 : edit_source(edit, nx, ny, nz);
+					if (source) {
+						edit_set(edit, nx, ny, nz, with_level(nv, shift, source));
+						queue_push(&refill, edit_pack(edit, nx, ny, nz));
+					}
+				}
+				else {
+					queue_push(&refill, edit_pack(edit, nx, ny, nz));
+				}
+			}
+		}
+		removal.head = 0;
+		removal.count = 0;
+
+		// the block itself, from its source and the light around it
+		level = shift ? 0 : edit_source(edit, x, y, z);
+		if (!edit_opaque(edit, x, y, z)) {
+			for (int face = 0; face < 6; face++) {
+				int nx = x - light_offsets[face][0];
+				int ny = y - light_offsets[face][1];
+				int nz = z - light_offsets[face][2];
+				if (edit_opaque(edit, nx, ny, nz) && ny < LIGHT_HEIGHT) {
+					continue;
+				}
+				// light coming in through face from the neighbour behind it
+				level = MAX(level, light_step(level_of(edit_get(edit, nx, ny, nz), shift), shift, face));
+			}
+		}
+		v = edit_get(edit, x, y, z);
+		if (level > level_of(v, shift)) {
+			edit_set(edit, x, y, z, with_level(v, shift, level));
+			queue_push(&refill, edit_pack(edit, x, y, z));
+		}
+		edit_flood(edit, &refill, shift);
+	}
+	queue_free(&removal);
+	queue_free(&refill);
+}
+
+void occlusion(
+	char neighbors[27], char lights[27], float shades[27],
+	float ao[6][4], float light[6][4])
+{
+	static const int lookup3[6][4][3] = {
+		{{0, 1, 3}, {2, 1, 5}, {6, 3, 7}, {8, 5, 7}},
+		{{18, 19, 21}, {20, 19, 23}, {24, 21, 25}, {26, 23, 25}},
+		{{6, 7, 15}, {8, 7, 17}, {24, 15, 25}, {26, 17, 25}},
+		{{0, 1, 9}, {2, 1, 11}, {18, 9, 19}, {20, 11, 19}},
+		{{0, 3, 9}, {6, 3, 15}, {18, 9, 21}, {24, 15, 21}},
+		{{2, 5, 11}, {8, 5, 17}, {20, 11, 23}, {26, 17, 23}}
+	};
+	static const int lookup4[6][4][4] = {
+		{{0, 1, 3, 4}, {1, 2, 4, 5}, {3, 4, 6, 7}, {4, 5, 7, 8}},
+		{{18, 19, 21, 22}, {19, 20, 22, 23}, {21, 22, 24, 25}, {22, 23, 25, 26}},
+		{{6, 7, 15, 16}, {7, 8, 16, 17}, {15, 16, 24, 25}, {16, 17, 25, 26}},
+		{{0, 1, 9, 10}, {1, 2, 10, 11}, {9, 10, 18, 19}, {10, 11, 19, 20}},
+		{{0, 3, 9, 12}, {3, 6, 12, 15}, {9, 12, 18, 21}, {12, 15, 21, 24}},
+		{{2, 5, 11, 14}, {5, 8, 14, 17}, {11, 14, 20, 23}, {14, 17, 23, 26}}
+	};
+	static const float curve[4] = {0.0, 0.25, 0.5, 0.75};
+	for (int i = 0; i < 6; i++) {
+		for (int j = 0; j < 4; j++) {
+			int corner = neighbors[lookup3[i][j][0]];
+			int side1 = neighbors[lookup3[i][j][1]];
+			int side2 = neighbors[lookup3[i][j][2]];
+			int value = side1 && side2 ? 3 : corner + side1 + side2;
+			float shade_sum = 0;
+			float light_sum = 0;
+			int is_light = lights[13] == LIGHT_MAX;
+			for (int k = 0; k < 4; k++) {
+				shade_sum += shades[lookup4[i][j][k]];
+				light_sum += lights[lookup4[i][j][k]];
+			}
+			if (is_light) {
+				light_sum = LIGHT_MAX * 4 * 10;
+			}
+			float total = curve[value] + shade_sum / 4.0;
+			ao[i][j] = MIN(total, 1.0);
+			light[i][j] = light_sum / (float) LIGHT_MAX / 4.0;
+		}
+	}
+}
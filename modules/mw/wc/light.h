@@ -0,0 +1,104 @@
+#ifndef _light_h_
+#define _light_h_
+
+#include <stdint.h>
+#include "cmap.h"
+
+// sky and block light, from 0 to LIGHT_MAX. sky light is LIGHT_MAX above
+// the highest opaque block of a column, keeps that level going straight down
+// and loses one per block in every other direction. block light comes from
+// the sources in a chunk's light map (Chunk::lights) and loses one per block
+// in every direction. opaque blocks stop both.
+
+#define LIGHT_MAX 15
+#define LIGHT_CHUNK 32 // CHUNK_SIZE
+#define LIGHT_HEIGHT 256
+#define LIGHT_SKY(v) ((v) >> 4)
+#define LIGHT_BLOCK(v) ((v) & 15)
+#define LIGHT_PACK(sky, block) (((sky) << 4) | (block))
+#define LIGHT_OPEN LIGHT_PACK(LIGHT_MAX, 0)
+
+// light of one chunk, a sky and a block light nibble per block from y 0 up
+// to height, y major so raising height only appends. everything above
+// height is LIGHT_OPEN.
+typedef struct {
+	int height;
+	uint8_t *data;
+} LightMap;
+
+#define LIGHT_MAP_INDEX(x, y, z) (((y) * LIGHT_CHUNK + (x)) * LIGHT_CHUNK + (z))
+
+void light_map_init(LightMap *map);
+void light_map_free(LightMap *map);
+// x, z local to the chunk.
+void light_map_set(LightMap *map, int x, int y, int z, int v);
+unsigned int light_map_memory(const LightMap *map);
+
+static inline int light_map_get(const LightMap *map, int x, int y, int z) {
+	if (y < 0) {
+		return 0;
+	}
+	if (y >= map->height) {
+		return LIGHT_OPEN;
+	}
+	return map->data[LIGHT_MAP_INDEX(x, y, z)];
+}
+
+// light of a chunk and margin blocks around it, what compute_chunk meshes
+// with. light_compute floods it from the blocks and sources of the 3x3
+// chunks around p, q on a worker, light_gather copies it from the stored
+// light of those chunks. block maps may be NULL where a chunk is missing,
+// its columns then repeat the nearest ones of the center map.
+typedef struct {
+	int ox; // world x, z of the first column
+	int oz;
+	int size; // columns along x and z
+	int height;
+	uint8_t *data;
+} LightVolume;
+
+void light_compute(LightVolume *volume, CMap *block_maps[3][3], CMap *light_maps[3][3], int p, int q);
+void light_gather(LightVolume *volume, LightMap *maps[3][3], int p, int q);
+void light_volume_free(LightVolume *volume);
+// replaces map with the center chunk of volume.
+void light_store(LightMap *map, const LightVolume *volume, int p, int q);
+
+static inline int light_volume_get(const LightVolume *volume, int x, int y, int z) {
+	x -= volume->ox;
+	z -= volume->oz;
+	if (y < 0) {
+		return 0;
+	}
+	if (y >= volume->height || x < 0 || z < 0 || x >= volume->size || z >= volume->size) {
+		return LIGHT_OPEN;
+	}
+	return volume->data[(y * volume->size + x) * volume->size + z];
+}
+
+// incremental update of the stored light around one edit, in place on the
+// chunks around it. light never travels further than LIGHT_MAX blocks, so
+// the 3x3 chunks around the edit hold everything it can change. chunks
+// without stored light are left alone. changed flags the chunks whose mesh
+// sees a changed value, a chunk meshes with one block of its neighbours, so
+// it covers the 5x5 chunks around the edit.
+typedef struct {
+	int p;
+	int q;
+	LightMap *maps[3][3];
+	CMap *block_maps[3][3];
+	CMap *light_maps[3][3];
+	int changed[5][5];
+} LightEdit;
+
+void light_edit_init(LightEdit *edit, int p, int q);
+// relights the block at x, y, z after it or its light source changed.
+void light_edit(LightEdit *edit, int x, int y, int z);
+
+// per vertex ambient occlusion and light of the six faces of a block, from
+// the 3x3x3 blocks around it (dx major, then dy, then dz). shades darken,
+// 1 for a fully covered block.
+void occlusion(
+	char neighbors[27], char lights[27], float shades[27],
+	float ao[6][4], float light[6][4]);
+
+#endif
@@ -0,0 +1,209 @@
+#include <string.h>
+#include "lod.h"
+#include "cull.h"
+#include "item.h"
+#include "wc.h"
+#include "os/memory.h"
+
+// cells of the center chunk, x and z from -1 to size in the opaque array.
+#define LOD_TYPE(c, x, y, z) ((y) * (c)->size * (c)->size + (x) * (c)->size + (z))
+#define LOD_OPAQUE(c, x, y, z) ((y) * ((c)->size + 2) * ((c)->size + 2) + ((x) + 1) * ((c)->size + 2) + ((z) + 1))
+
+// neighbour of each face, in make_cube_faces order.
+static const int lod_offsets[6][3] = {
+	{-1, 0, 0},
+	{+1, 0, 0},
+	{0, +1, 0},
+	{0, -1, 0},
+	{0, 0, -1},
+	{0, 0, +1}
+};
+
+void lod_cells_alloc(LodCells *cells, CMap *maps[3][3], int p, int q, int lod, int edges)
+{
+	int s = 1 << lod;
+	cells->lod = lod;
+	cells->size = CHUNK_SIZE >> lod;
+	cells->height = 256 >> lod;
+	cells->edges = edges;
+
+	uint32_t types_size = cells->size * cells->size * cells->height;
+	uint32_t opaque_size = (cells->size + 2) * (cells->size + 2) * cells->height;
+	cells->types = (signed char *) Memory::alloc_static(types_size, true);
+	memset(cells->types, 0, types_size);
+	cells->opaque = (char *) Memory::alloc_static(opaque_size, true);
+	memset(cells->opaque, 0, opaque_size);
+	// y + 1 of the block each type came from
+	unsigned char *tops = (unsigned char *) Memory::alloc_static(types_size, true);
+	memset(tops, 0, types_size);
+
+	int bx = p * CHUNK_SIZE;
+	int bz = q * CHUNK_SIZE;
+	for (int a = 0; a < 3; a++)
+	{
+		for (int b = 0; b < 3; b++)
+		{
+			CMap *map = maps[a][b];
+			if (!map)
+			{
+				continue;
+			}
+			MAP_FOR_EACH(map, ex, ey, ez, ew)
+			{
+				int lx = ex - bx;
+				int lz = ez - bz;
+				if (lx < -s || lz < -s || lx >= CHUNK_SIZE + s || lz >= CHUNK_SIZE + s || ey < 0 || ey >= 256)
+				{
+					continue;
+				}
+				int x = (lx + s) / s - 1;
+				int y = ey >> lod;
+				int z = (lz + s) / s - 1;
+				if (!is_transparent(ew))
+				{
+					cells->opaque[LOD_OPAQUE(cells, x, y, z)] = 1;
+				}
+				if (a != 1 || b != 1 || ew <= 0 || is_plant(ew))
+				{
+					continue;
+				}
+				if (x < 0 || z < 0 || x >= cells->size || z >= cells->size)
+				{
+					continue;
+				}
+				int i = LOD_TYPE(cells, x, y, z);
+				if (ey + 1 > tops[i])
+				{
+					tops[i] = ey + 1;
+					cells->types[i] = ew;
+				}
+			} END_MAP_FOR_EACH;
+		}
+	}
+	Memory::free_static(tops, true);
+}
+
+void lod_cells_free(LodCells *cells)
+{
+	Memory::free_static(cells->types, true);
+	Memory::free_static(cells->opaque, true);
+	cells->types = 0;
+	cells->opaque = 0;
+}
+
+static int lod_face_exposed(const LodCells *cells, int face, int x, int y, int z)
+{
+	int nx = x + lod_offsets[face][0];
+	int ny = y + lod_offsets[face][1];
+	int nz = z + lod_offsets[face][2];
+	if (ny < 0)
+	{
+		// nothing below y 0 gets a face, like ey > 0 in compute_chunk
+		return 0;
+	}
+	if (ny >= cells->height)
+	{
+		return 1;
+	}
+	if ((nx < 0 || nz < 0 || nx >= cells->size || nz >= cells->size) && (cells->edges & (1 << face)))
+	{
+		return 1;
+	}
+	return !cells->opaque[LOD_OPAQUE(cells, nx, ny, nz)];
+}
+
+int lod_count_faces(const LodCells *cells, int *miny, int *maxy, int sections[CHUNK_SECTIONS])
+{
+	int s = 1 << cells->lod;
+	int faces = 0;
+	memset(sections, 0, CHUNK_SECTIONS * sizeof(int));
+	int lo = 256;
+	int hi = -1;
+	for (int y = 0; y < cells->height; y++)
+	{
+		for (int x = 0; x < cells->size; x++)
+		{
+			for (int z = 0; z < cells->size; z++)
+			{
+				if (cells->types[LOD_TYPE(cells, x, y, z)] <= 0)
+				{
+					continue;
+				}
+				int exposed = 0;
+				for (int face = 0; face < 6; face++)
+				{
+					exposed += lod_face_exposed(cells, face, x, y, z);
+				}
+				if (exposed)
+				{
+					faces += exposed;
+					sections[y * s / CHUNK_SECTION_HEIGHT] += exposed;
+					lo = MIN(lo, y * s);
+					hi = MAX(hi, y * s + s - 1);
+				}
+			}
+		}
+	}
+	*miny = lo;
+	*maxy = hi < 0 ? 0 : hi;
+	return faces;
+}
+
+void make_lod_faces(ChunkMesh *meshes, const LodCells *cells, int p, int q)
+{
+	int s = 1 << cells->lod;
+	float ao[6][4] = {{0}};
+	float light[6][4] = {{0}};
+	for (int y = 0; y < cells->height; y++)
+	{
+		for (int x = 0; x < cells->size; x++)
+		{
+			for (int z = 0; z < cells->size; z++)
+			{
+				int w = cells->types[LOD_TYPE(cells, x, y, z)];
+				if (w <= 0)
+				{
+					continue;
+				}
+				int f[6];
+				int exposed = 0;
+				for (int face = 0; face < 6; face++)
+				{
+					f[face] = lod_face_exposed(cells, face, x, y, z);
+					exposed += f[face];
+				}
+				if (!exposed)
+				{
+					continue;
+				}
+				// first block of the cell
+				int bx = p * CHUNK_SIZE + x * s;
+				int by = y * s;
+				int bz = q * CHUNK_SIZE + z * s;
+				ChunkMesh *mesh = meshes + by / CHUNK_SECTION_HEIGHT;
+				if (mesh->uv2s)
+				{
+					// tiled uvs keep the texture at one tile per block
+					for (int face = 0; face < 6; face++)
+					{
+						if (f[face])
+						{
+							make_cube_quad(
+								mesh, face,
+								bx, by, bz, bx + s - 1, by + s - 1, bz + s - 1,
+								0.5, blocks[w][face]);
+						}
+					}
+				}
+				else
+				{
+					float h = (s - 1) * 0.5f;
+					make_cube(
+						mesh, ao, light,
+						f[0], f[1], f[2], f[3], f[4], f[5],
+						bx + h, by + h, bz + h, s * 0.5f, w);
+				}
+			}
+		}
+	}
+}
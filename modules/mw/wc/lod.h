@@ -0,0 +1,38 @@
+#ifndef _lod_h_
+#define _lod_h_
+
+#include "cmap.h"
+#include "cube.h"
+#include "section.h"
+
+// level of detail rings. a chunk at level l is meshed from cells of
+// (1 << l)^3 blocks. a cell is drawn with the type of its topmost block and
+// covers its neighbours' faces when any of its blocks is opaque, so a coarse
+// cell never shows less than its blocks would. that keeps a finer chunk's
+// border faces safe to cull against a coarser neighbour as usual, only the
+// coarser side of a level change has to leave its border faces uncovered,
+// see LodCells::edges.
+
+#define LOD_LEVELS 3
+
+typedef struct {
+	int lod;
+	int size; // cells along x and z of the chunk
+	int height;
+	int edges; // 1 << CULL_FACE_* of the sides that border a finer chunk
+	signed char *types; // size x height x size, 0 for cells left empty
+	char *opaque; // with a border of one cell from the neighbouring chunks
+} LodCells;
+
+// fills cells for chunk p, q from its 3x3 block maps, any but the center
+// one may be NULL.
+void lod_cells_alloc(LodCells *cells, CMap *maps[3][3], int p, int q, int lod, int edges);
+void lod_cells_free(LodCells *cells);
+// exposed cell faces. miny, maxy span the blocks of the cells with faces,
+// sections gets the faces of each section.
+int lod_count_faces(const LodCells *cells, int *miny, int *maxy, int sections[CHUNK_SECTIONS]);
+// one quad per exposed cell face into the mesh of the cell's section,
+// meshes are sized from lod_count_faces.
+void make_lod_faces(ChunkMesh *meshes, const LodCells *cells, int p, int q);
+
+#endif
@@ -0,0 +1,101 @@
+#include <string.h>
+#include "net.h"
+#include "region.h"
+#include "io/marshalls.h"
+
+#define NET_HEADER_SIZE(count) (1 + (count) * 4)
+
+static Vector<uint8_t> net_message( int type, const int *args, int count, int extra ) {
+	Vector<uint8_t> packet;
+	packet.resize( NET_HEADER_SIZE( count ) + extra );
+	uint8_t *w = packet.ptrw();
+	w[0] = type;
+	for( int i = 0; i < count; i++ ) {
+		encode_uint32( (uint32_t) args[i], w + NET_HEADER_SIZE( i ) );
+	}
+	return packet;
+}
+
+void net_peer_init( NetPeer *peer, int id ) {
+	peer->id = id;
+	peer->located = 0;
+	peer->p = 0;
+	peer->q = 0;
+	cindex_alloc( &peer->sent, 1023 );
+}
+
+void net_peer_free( NetPeer *peer ) {
+	cindex_free( &peer->sent );
+	peer->id = 0;
+}
+
+void net_peer_forget( NetPeer *peer, int radius ) {
+	// removing moves entries around, collect first
+	Vector<int> forget;
+	for( unsigned int i = 0; i <= peer->sent.mask; i++ ) {
+		CIndexEntry *entry = peer->sent.data + i;
+		if( entry->slot == CINDEX_EMPTY ) {
+			continue;
+		}
+		if( MAX( ABS( entry->p - peer->p ), ABS( entry->q - peer->q ) ) > radius ) {
+			forget.push_back( entry->p );
+			forget.push_back( entry->q );
+		}
+	}
+	for( int i = 0; i < forget.size(); i += 2 ) {
+		cindex_remove( &peer->sent, forget[i], forget[i + 1] );
+	}
+}
+
+Vector<uint8_t> net_position( int p, int q ) {
+	int args[2] = { p, q };
+	return net_message( NET_POSITION, args, 2, 0 );
+}
+
+Vector<uint8_t> net_block( int x, int y, int z, int w ) {
+	int args[4] = { x, y, z, w };
+	return net_message( NET_BLOCK, args, 4, 0 );
+}
+
+Vector<uint8_t> net_chunk( CMap *map, int p, int q ) {
+	Vector<uint8_t> blob = region_encode( map, NULL );
+	int args[2] = { p, q };
+	Vector<uint8_t> packet = net_message( NET_CHUNK, args, 2, blob.size() );
+	memcpy( packet.ptrw() + NET_HEADER_SIZE( 2 ), blob.ptr(), blob.size() );
+	return packet;
+}
+
+void net_read( NetMessage *message, const uint8_t *packet, int size ) {
+	int count = 0;
+	message->type = 0;
+	message->blob = 0;
+	message->blob_size = 0;
+	if( size < 1 ) {
+		return;
+	}
+	switch( packet[0] ) {
+		case NET_POSITION:
+		case NET_CHUNK:
+			count = 2;
+			break;
+		case NET_BLOCK:
+			count = 4;
+			break;
+		default:
+			return;
+	}
+	if( size < NET_HEADER_SIZE( count ) ) {
+		return;
+	}
+	for( int i = 0; i < count; i++ ) {
+		message->args[i] = (int32_t) decode_uint32( packet + NET_HEADER_SIZE( i ) );
+	}
+	if( packet[0] == NET_CHUNK ) {
+		message->blob = packet + NET_HEADER_SIZE( count );
+		message->blob_size = size - NET_HEADER_SIZE( count );
+	}
+	else if( size != NET_HEADER_SIZE( count ) ) {
+		return;
+	}
+	message->type = packet[0];
+}
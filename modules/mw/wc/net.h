@@ -0,0 +1,56 @@
+#ifndef _net_h_
+#define _net_h_
+
+#include <stdint.h>
+#include "cindex.h"
+#include "cmap.h"
+#include "vector.h"
+
+// chunk streaming between a WC server and its clients. every message is one
+// reliable packet, a NET_* type byte followed by 32 bit little endian ints.
+//
+// client to server
+//   NET_POSITION p, q        the chunk the camera is in, centers the
+//                            client's interest area
+//   NET_BLOCK x, y, z, w     an edit the client asks for, the server decides
+// server to client
+//   NET_CHUNK p, q, blob     every block of the chunk, see region_encode
+//   NET_BLOCK x, y, z, w     an edit the server made
+//
+// the server pushes the chunks within create_radius of each client's
+// center, nearest first, and forgets what it sent once a chunk is past
+// delete_radius, where the client unloads it too. edits go to every client
+// whose interest area they touch.
+#define NET_POSITION 1
+#define NET_CHUNK 2
+#define NET_BLOCK 3
+
+#define NET_DEFAULT_PORT 4080
+#define NET_SNAPSHOTS_PER_UPDATE 8 // per client, keeps the send queue short
+
+typedef struct {
+	int id; // peer id of the client, 0 for a free slot
+	int located; // a NET_POSITION came in
+	int p;
+	int q;
+	CIndex sent; // chunks the client holds a snapshot of
+} NetPeer;
+
+typedef struct {
+	int type; // 0 for a malformed packet
+	int args[4];
+	const uint8_t *blob; // NET_CHUNK only, points into the packet
+	int blob_size;
+} NetMessage;
+
+void net_peer_init( NetPeer *peer, int id );
+void net_peer_free( NetPeer *peer );
+// drops the chunks past radius of the peer's center from its sent set.
+void net_peer_forget( NetPeer *peer, int radius );
+
+Vector<uint8_t> net_position( int p, int q );
+Vector<uint8_t> net_block( int x, int y, int z, int w );
+Vector<uint8_t> net_chunk( CMap *map, int p, int q );
+void net_read( NetMessage *message, const uint8_t *packet, int size );
+
+#endif
@@ -0,0 +1,307 @@
+#include "region.h"
+#include "io/compression.h"
+#include "io/marshalls.h"
+#include "os/dir_access.h"
+#include "os/file_access.h"
+#include "os/memory.h"
+#include "os/mutex.h"
+#include "os/semaphore.h"
+#include "os/thread.h"
+
+static int region_floor( int v ) {
+	return v < 0 ? (v + 1) / REGION_SIZE - 1 : v / REGION_SIZE;
+}
+
+static String region_file( const String &path, int p, int q ) {
+	return path.plus_file( "r." + itos( region_floor( p ) ) + "." + itos( region_floor( q ) ) + ".wcr" );
+}
+
+static int region_entry( int p, int q ) {
+	int a = p - region_floor( p ) * REGION_SIZE;
+	int b = q - region_floor( q ) * REGION_SIZE;
+	return a * REGION_SIZE + b;
+}
+
+// every entry is stored as its x, y, z, w bytes relative to the map origin.
+static int region_pack( uint8_t *w, CMap *map ) {
+	int count = 0;
+	for( unsigned int i = 0; i <= map->mask; i++ ) {
+		CMapEntry *entry = map->data + i;
+		if( EMPTY_ENTRY( entry ) ) {
+			continue;
+		}
+		w[count * 4 + 0] = entry->e.x;
+		w[count * 4 + 1] = entry->e.y;
+		w[count * 4 + 2] = entry->e.z;
+		w[count * 4 + 3] = (uint8_t) entry->e.w;
+		count++;
+	}
+	return count;
+}
+
+static void region_unpack( CMap *map, const uint8_t *r, int count ) {
+	for( int i = 0; i < count; i++ ) {
+		map_set( map, map->dx + r[i * 4 + 0], map->dy + r[i * 4 + 1], map->dz + r[i * 4 + 2], (signed char) r[i * 4 + 3] );
+	}
+}
+
+Vector<uint8_t> region_encode( CMap *map, CMap *lights ) {
+	Vector<uint8_t> raw;
+	raw.resize( (map->size + (lights ? lights->size : 0)) * 4 );
+	int count = region_pack( raw.ptrw(), map );
+	int light_count = lights ? region_pack( raw.ptrw() + count * 4, lights ) : 0;
+	int raw_size = (count + light_count) * 4;
+
+	Vector<uint8_t> blob;
+	blob.resize( 8 + Compression::get_max_compressed_buffer_size( raw_size, Compression::MODE_ZSTD ) );
+	encode_uint32( count, blob.ptrw() );
+	encode_uint32( raw_size, blob.ptrw() + 4 );
+	int size = Compression::compress( blob.ptrw() + 8, raw.ptr(), raw_size, Compression::MODE_ZSTD );
+	blob.resize( 8 + size );
+	return blob;
+}
+
+int region_decode( CMap *map, CMap *lights, const uint8_t *blob, int size ) {
+	ERR_FAIL_COND_V( size < 8, 0 );
+	// the blob comes from disk or from the network, check the counts before
+	// they size anything
+	int count = decode_uint32( blob );
+	int raw_size = decode_uint32( blob + 4 );
+	ERR_FAIL_COND_V( count < 0 || count > REGION_MAX_ENTRIES, 0 );
+	ERR_FAIL_COND_V( raw_size < count * 4 || raw_size > (count + REGION_MAX_ENTRIES) * 4 || raw_size % 4, 0 );
+	int light_count = raw_size / 4 - count;
+	if( !raw_size ) {
+		return 1;
+	}
+	Vector<uint8_t> raw;
+	raw.resize( raw_size );
+	int decoded = Compression::decompress( raw.ptrw(), raw_size, blob + 8, size - 8, Compression::MODE_ZSTD );
+	ERR_FAIL_COND_V( decoded != raw_size, 0 );
+	region_unpack( map, raw.ptr(), count );
+	if( lights ) {
+		region_unpack( lights, raw.ptr() + count * 4, light_count );
+	}
+	return 1;
+}
+
+static void region_write( RegionStore *store, const String &path, CMap *map, CMap *lights, int p, int q ) {
+	Vector<uint8_t> blob = region_encode( map, lights );
+	String file_path = region_file( path, p, q );
+
+	store->file_mutex->lock();
+	FileAccess *f = FileAccess::open( file_path, FileAccess::READ_WRITE );
+	if( !f ) {
+		f = FileAccess::open( file_path, FileAccess::WRITE );
+		if( !f ) {
+			store->file_mutex->unlock();
+			ERR_EXPLAIN( "Can't create region file: " + file_path );
+			ERR_FAIL();
+		}
+		for( int i = 0; i < REGION_HEADER_SIZE / 4; i++ ) {
+			f->store_32( 0 );
+		}
+		f->close();
+		memdelete( f );
+		f = FileAccess::open( file_path, FileAccess::READ_WRITE );
+		if( !f ) {
+			store->file_mutex->unlock();
+			ERR_EXPLAIN( "Can't open region file: " + file_path );
+			ERR_FAIL();
+		}
+	}
+
+	int entry = region_entry( p, q ) * REGION_ENTRY_SIZE;
+	f->seek( entry );
+	uint32_t offset = f->get_32();
+	f->get_32();
+	uint32_t capacity = f->get_32();
+	if( !offset || (uint32_t) blob.size() > capacity ) {
+		offset = f->get_len();
+		capacity = blob.size();
+	}
+	f->seek( offset );
+	f->store_buffer( blob.ptr(), blob.size() );
+	f->seek( entry );
+	f->store_32( offset );
+	f->store_32( blob.size() );
+	f->store_32( capacity );
+	f->close();
+	memdelete( f );
+	store->file_mutex->unlock();
+}
+
+static void region_save_run( void *arg ) {
+	RegionStore *store = (RegionStore *) arg;
+	while( true ) {
+		store->save_semaphore->wait();
+
+		store->save_mutex->lock();
+		if( !store->saves.size() ) {
+			bool exit = store->save_exit;
+			store->save_mutex->unlock();
+			if( exit ) {
+				break;
+			}
+			continue;
+		}
+		// the save stays queued, and visible to region_load, until written
+		RegionSave *save = store->saves[0];
+		int version = save->version;
+		CMap map;
+		CMap lights;
+		map_share( &map, &save->map );
+		map_share( &lights, &save->lights );
+		store->save_mutex->unlock();
+
+		region_write( store, save->path, &map, &lights, save->p, save->q );
+		map_free( &map );
+		map_free( &lights );
+
+		store->save_mutex->lock();
+		if( save->version == version ) {
+			store->saves.erase( save );
+			map_free( &save->map );
+			map_free( &save->lights );
+			memdelete( save );
+		}
+		else {
+			// replaced while it was written, write the newer blocks too
+			store->save_semaphore->post();
+		}
+		store->save_mutex->unlock();
+	}
+}
+
+void region_open( RegionStore *store, const String &path ) {
+	store->save_exit = false;
+	store->file_mutex = Mutex::create();
+	store->save_mutex = Mutex::create();
+	store->save_semaphore = Semaphore::create();
+	store->save_thread = Thread::create( region_save_run, store );
+	store->open = true;
+	region_set_path( store, path );
+}
+
+void region_set_path( RegionStore *store, const String &path ) {
+	String dir_path = path;
+	if( !dir_path.empty() ) {
+		DirAccess *dir = DirAccess::create_for_path( dir_path );
+		if( !dir->dir_exists( dir_path ) && dir->make_dir_recursive( dir_path ) != OK ) {
+			ERR_PRINTS( "Can't create the chunk store directory: " + dir_path );
+			dir_path = String();
+		}
+		memdelete( dir );
+	}
+	// no region file is open while the path changes
+	store->file_mutex->lock();
+	store->path = dir_path;
+	store->file_mutex->unlock();
+}
+
+void region_close( RegionStore *store ) {
+	if( !store->open ) {
+		return;
+	}
+	store->save_mutex->lock();
+	store->save_exit = true;
+	store->save_mutex->unlock();
+	store->save_semaphore->post();
+	Thread::wait_to_finish( store->save_thread );
+	memdelete( store->save_thread );
+	memdelete( store->save_semaphore );
+	memdelete( store->save_mutex );
+	memdelete( store->file_mutex );
+	store->open = false;
+}
+
+static String region_get_path( RegionStore *store ) {
+	store->file_mutex->lock();
+	String path = store->path;
+	store->file_mutex->unlock();
+	return path;
+}
+
+int region_load( RegionStore *store, CMap *map, CMap *lights, int p, int q ) {
+	String path = region_get_path( store );
+	if( path.empty() ) {
+		return 0;
+	}
+
+	store->save_mutex->lock();
+	for( int i = 0; i < store->saves.size(); i++ ) {
+		RegionSave *save = store->saves[i];
+		if( save->p == p && save->q == q && save->path == path ) {
+			map_free( map );
+			map_share( map, &save->map );
+			if( lights ) {
+				map_free( lights );
+				map_share( lights, &save->lights );
+			}
+			store->save_mutex->unlock();
+			return 1;
+		}
+	}
+	store->save_mutex->unlock();
+
+	String file_path = region_file( path, p, q );
+	Vector<uint8_t> blob;
+
+	store->file_mutex->lock();
+	FileAccess *f = FileAccess::open( file_path, FileAccess::READ );
+	if( f ) {
+		f->seek( region_entry( p, q ) * REGION_ENTRY_SIZE );
+		uint32_t offset = f->get_32();
+		uint32_t size = f->get_32();
+		if( offset && offset + size <= f->get_len() ) {
+			blob.resize( size );
+			f->seek( offset );
+			f->get_buffer( blob.ptrw(), size );
+		}
+		f->close();
+		memdelete( f );
+	}
+	store->file_mutex->unlock();
+
+	if( !blob.size() ) {
+		return 0;
+	}
+	return region_decode( map, lights, blob.ptr(), blob.size() );
+}
+
+void region_save( RegionStore *store, CMap *map, CMap *lights, int p, int q ) {
+	String path = region_get_path( store );
+	if( path.empty() ) {
+		return;
+	}
+
+	store->save_mutex->lock();
+	for( int i = 0; i < store->saves.size(); i++ ) {
+		RegionSave *save = store->saves[i];
+		if( save->p == p && save->q == q && save->path == path ) {
+			map_free( &save->map );
+			map_free( &save->lights );
+			map_share( &save->map, map );
+			map_share( &save->lights, lights );
+			save->version++;
+			store->save_mutex->unlock();
+			return;
+		}
+	}
+	RegionSave *save = memnew( RegionSave );
+	save->p = p;
+	save->q = q;
+	save->version = 0;
+	save->path = path;
+	map_share( &save->map, map );
+	map_share( &save->lights, lights );
+	store->saves.push_back( save );
+	store->save_mutex->unlock();
+	store->save_semaphore->post();
+}
+
+int region_pending( RegionStore *store ) {
+	store->save_mutex->lock();
+	int count = store->saves.size();
+	store->save_mutex->unlock();
+	return count;
+}
@@ -0,0 +1,71 @@
+#ifndef _region_h_
+#define _region_h_
+
+#include "cmap.h"
+#include "ustring.h"
+#include "vector.h"
+
+class Mutex;
+class Semaphore;
+class Thread;
+
+// chunks on disk, grouped into region files of REGION_SIZE x REGION_SIZE
+// chunks. a region file starts with one (offset, size, capacity) entry per
+// chunk, followed by the zstd compressed block and light source entries of
+// each chunk. a chunk is rewritten in place while it still fits its capacity.
+//
+// saves are queued and written by the store's own thread. queued saves are
+// served to region_load until they hit the disk, so a chunk that comes back
+// before its save is written still sees its latest blocks.
+
+#define REGION_SIZE 32
+#define REGION_CHUNKS (REGION_SIZE * REGION_SIZE)
+#define REGION_ENTRY_SIZE 12
+#define REGION_HEADER_SIZE (REGION_CHUNKS * REGION_ENTRY_SIZE)
+#define REGION_MAX_ENTRIES (1 << 24) // one per x, y, z byte triple of a CMapEntry
+
+typedef struct {
+	int p;
+	int q;
+	int version; // bumped when a newer save replaces a queued one
+	String path;
+	CMap map; // shared with the chunk that was saved
+	CMap lights; // the chunk's light sources, shared the same way
+} RegionSave;
+
+typedef struct {
+	String path; // empty when the store is disabled
+	bool open;
+	bool save_exit;
+	Mutex *file_mutex; // region files are touched by one thread at a time
+	Mutex *save_mutex;
+	Semaphore *save_semaphore;
+	Thread *save_thread;
+	Vector<RegionSave *> saves; // oldest first
+} RegionStore;
+
+// path is a directory, created when missing. an empty path disables loads
+// and saves. saves already queued still go to the directory they were
+// queued for when the path changes.
+void region_open( RegionStore *store, const String &path );
+void region_set_path( RegionStore *store, const String &path );
+// writes every queued save before it returns.
+void region_close( RegionStore *store );
+// fills empty block and light maps allocated for chunk p, q, lights may be
+// NULL. returns 0 when the chunk was never saved. safe to call from worker
+// threads.
+int region_load( RegionStore *store, CMap *map, CMap *lights, int p, int q );
+// queues the maps for writing, the store shares them instead of copying.
+void region_save( RegionStore *store, CMap *map, CMap *lights, int p, int q );
+int region_pending( RegionStore *store );
+
+// one chunk's blocks and light sources as stored in a region file, also
+// what a server sends its clients without the light sources. blob layout:
+// block entry count, uncompressed size, zstd data. entries past the block
+// count are light sources.
+Vector<uint8_t> region_encode( CMap *map, CMap *lights );
+// fills empty maps allocated for the chunk, lights may be NULL to skip the
+// light sources. returns 0 for a broken blob.
+int region_decode( CMap *map, CMap *lights, const uint8_t *blob, int size );
+
+#endif
@@ -0,0 +1,106 @@
+#include <string.h>
+#include "section.h"
+#include "os/memory.h"
+
+#define SECTION_CELL(x, y, z) (((x) << 10) | ((z) << 5) | (y))
+
+static uint64_t section_pairs(int faces) {
+	uint64_t visibility = 0;
+	for( int a = 0; a < 6; a++ ) {
+		if( !(faces & (1 << a)) ) {
+			continue;
+		}
+		for( int b = 0; b < 6; b++ ) {
+			if( faces & (1 << b) ) {
+				visibility |= SECTION_PAIR( a, b );
+			}
+		}
+	}
+	return visibility;
+}
+
+// one pocket of open blocks from x, y, z. seen holds a bit per block along
+// y for every column, set for opaque blocks and the ones already flooded.
+static int section_flood( uint32_t *seen, uint16_t *stack, int x, int y, int z ) {
+	static const int offsets[6][3] = {
+		{ -1, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }
+	};
+	int faces = 0;
+	int count = 0;
+	seen[x * CULL_CHUNK + z] |= (uint32_t) 1 << y;
+	stack[count++] = SECTION_CELL( x, y, z );
+	while( count ) {
+		int cell = stack[--count];
+		int cx = cell >> 10;
+		int cz = (cell >> 5) & 31;
+		int cy = cell & 31;
+		faces |= (cx == 0) << CULL_FACE_LEFT;
+		faces |= (cx == CULL_CHUNK - 1) << CULL_FACE_RIGHT;
+		faces |= (cy == CHUNK_SECTION_HEIGHT - 1) << CULL_FACE_TOP;
+		faces |= (cy == 0) << CULL_FACE_BOTTOM;
+		faces |= (cz == 0) << CULL_FACE_BACK;
+		faces |= (cz == CULL_CHUNK - 1) << CULL_FACE_FRONT;
+		for( int i = 0; i < 6; i++ ) {
+			int nx = cx + offsets[i][0];
+			int ny = cy + offsets[i][1];
+			int nz = cz + offsets[i][2];
+			if( nx < 0 || ny < 0 || nz < 0 || nx >= CULL_CHUNK || ny >= CHUNK_SECTION_HEIGHT || nz >= CULL_CHUNK ) {
+				continue;
+			}
+			uint32_t *column = seen + nx * CULL_CHUNK + nz;
+			uint32_t bit = (uint32_t) 1 << ny;
+			if( *column & bit ) {
+				continue;
+			}
+			*column |= bit;
+			stack[count++] = SECTION_CELL( nx, ny, nz );
+		}
+	}
+	return faces;
+}
+
+void section_visibility( uint64_t visibility[CHUNK_SECTIONS], const CullMasks *masks ) {
+	uint32_t *seen = (uint32_t *) Memory::alloc_static( CULL_CHUNK * CULL_CHUNK * sizeof( uint32_t ), true );
+	uint16_t *stack = 0;
+	for( int s = 0; s < CHUNK_SECTIONS; s++ ) {
+		int y0 = s * CHUNK_SECTION_HEIGHT;
+		uint32_t any = 0;
+		uint32_t all = ~(uint32_t) 0;
+		for( int x = 0; x < CULL_CHUNK; x++ ) {
+			for( int z = 0; z < CULL_CHUNK; z++ ) {
+				uint32_t column = (uint32_t) (masks->opaque[CULL_OPAQUE( x, z )][y0 >> 6] >> (y0 & 63));
+				seen[x * CULL_CHUNK + z] = column;
+				any |= column;
+				all &= column;
+			}
+		}
+		// most sections are all air or all rock
+		if( !any ) {
+			visibility[s] = SECTION_OPEN;
+			continue;
+		}
+		visibility[s] = 0;
+		if( all == ~(uint32_t) 0 ) {
+			continue;
+		}
+		if( !stack ) {
+			stack = (uint16_t *) Memory::alloc_static( CULL_CHUNK * CULL_CHUNK * CHUNK_SECTION_HEIGHT * sizeof( uint16_t ), true );
+		}
+		for( int x = 0; x < CULL_CHUNK && visibility[s] != SECTION_OPEN; x++ ) {
+			for( int z = 0; z < CULL_CHUNK && visibility[s] != SECTION_OPEN; z++ ) {
+				uint32_t open;
+				while( (open = ~seen[x * CULL_CHUNK + z]) ) {
+					int y = 0;
+					while( !(open & ((uint32_t) 1 << y)) ) {
+						y++;
+					}
+					visibility[s] |= section_pairs( section_flood( seen, stack, x, y, z ) );
+				}
+			}
+		}
+	}
+	if( stack ) {
+		Memory::free_static( stack, true );
+	}
+	Memory::free_static( seen, true );
+}
@@ -0,0 +1,26 @@
+#ifndef _section_h_
+#define _section_h_
+
+#include <stdint.h>
+#include "cull.h"
+
+// chunks are drawn as vertical sections of CHUNK_SECTION_HEIGHT blocks,
+// each with its own mesh, so whatever the camera can't see can be left out
+// of the draw list one section at a time.
+#define CHUNK_SECTION_HEIGHT 32
+#define CHUNK_SECTIONS 8 // CULL_HEIGHT / CHUNK_SECTION_HEIGHT
+
+// which faces of a section see each other through its open blocks, one bit
+// per ordered pair of CULL_FACE_* faces. a walk that enters a section
+// through one face only leaves it through the faces it sees.
+#define SECTION_PAIR(a, b) ((uint64_t) 1 << ((a) * 6 + (b)))
+#define SECTION_SEES(visibility, a, b) (((visibility) & SECTION_PAIR(a, b)) != 0)
+#define SECTION_OPEN (((uint64_t) 1 << 36) - 1) // every face sees every other
+#define SECTION_OPPOSITE(face) ((face) ^ 1)
+
+// flood fills the blocks of each section of the center chunk that aren't
+// opaque and pairs up the faces every connected pocket touches, cave
+// culling's visibility graph. masks->opaque has to be filled.
+void section_visibility(uint64_t visibility[CHUNK_SECTIONS], const CullMasks *masks);
+
+#endif
@@ -3,20 +3,35 @@
 #define _PROFILE
 #define SHOW_PLANTS 1
 #define SHOW_TREES 1
+#define SHOW_LIGHTS 1
 
 #include "editor_node.h"
 #include "wc.h"
 #include "item.h"
 #include "cube.h"
+#include "greedy.h"
+#include "cull.h"
+#include "lod.h"
+#include "light.h"
+#include "collision.h"
+#include "section.h"
 #include "../deps/noise/noise.h"
 #include "os/memory.h"
-#include "scene/3d/mesh_instance.h"
+#include "scene/main/viewport.h"
+#include "servers/visual_server.h"
+#include "servers/physics_server.h"
 #include "os/thread.h"
 #include "os/semaphore.h"
+#include "os/mutex.h"
+#include "sort.h"
+#include "engine.h"
+#include "safe_refcount.h"
 #include "os/os.h"
 #include "editor/plugins/spatial_editor_plugin.h"
 #include "scene/3d/camera.h"
 #include "os/main_loop.h"
+#include "main/performance.h"
+#include "io/ip.h"
 
 #ifdef _PROFILE
 #include "core/script_language.h"
@@ -26,7 +41,6 @@ bool WC::s_created = false;
 
 static void worker_run(void *arg);
 void load_chunk(WorkerItem *item);
-void create_world(int p, int q, world_func func, void *arg);
 void compute_chunk(WorkerItem *item);
 
 void map_set_func(int x, int y, int z, int w, void *arg)
@@ -35,7 +49,7 @@ void map_set_func(int x, int y, int z, int w, void *arg)
 	map_set(map, x, y, z, w);
 }
 
-int chunk_visible(Vector<Plane> planes, int p, int q, int miny, int maxy)
+int chunk_visible(const Vector<Plane> &planes, int p, int q, int miny, int maxy)
 {
 	int x = p * CHUNK_SIZE - 1;
 	int z = q * CHUNK_SIZE - 1;
@@ -103,10 +117,67 @@ void WC::_bind_methods()
 	ClassDB::bind_method(D_METHOD("get_created"), &WC::get_created);
 	ClassDB::bind_method(D_METHOD("set_material", "material"), &WC::set_material);
 	ClassDB::bind_method(D_METHOD("get_material"), &WC::get_material);
+	ClassDB::bind_method(D_METHOD("set_greedy_meshing", "enable"), &WC::set_greedy_meshing);
+	ClassDB::bind_method(D_METHOD("is_greedy_meshing"), &WC::is_greedy_meshing);
+	ClassDB::bind_method(D_METHOD("set_compress_meshes", "enable"), &WC::set_compress_meshes);
+	ClassDB::bind_method(D_METHOD("is_compress_meshes"), &WC::is_compress_meshes);
+	ClassDB::bind_method(D_METHOD("set_lod_distance", "distance"), &WC::set_lod_distance);
+	ClassDB::bind_method(D_METHOD("get_lod_distance"), &WC::get_lod_distance);
+	ClassDB::bind_method(D_METHOD("set_cave_culling", "enable"), &WC::set_cave_culling);
+	ClassDB::bind_method(D_METHOD("is_cave_culling"), &WC::is_cave_culling);
+	ClassDB::bind_method(D_METHOD("set_collision_radius", "radius"), &WC::set_collision_radius);
+	ClassDB::bind_method(D_METHOD("get_collision_radius"), &WC::get_collision_radius);
+	ClassDB::bind_method(D_METHOD("set_upload_budget_usec", "usec"), &WC::set_upload_budget_usec);
+	ClassDB::bind_method(D_METHOD("get_upload_budget_usec"), &WC::get_upload_budget_usec);
+	ClassDB::bind_method(D_METHOD("set_db_path", "path"), &WC::set_db_path);
+	ClassDB::bind_method(D_METHOD("get_block", "x", "y", "z"), &WC::get_block);
+	ClassDB::bind_method(D_METHOD("set_block", "x", "y", "z", "w"), &WC::set_block);
+	ClassDB::bind_method(D_METHOD("get_light", "x", "y", "z"), &WC::get_light);
+	ClassDB::bind_method(D_METHOD("set_light", "x", "y", "z", "w"), &WC::set_light);
+	ClassDB::bind_method(D_METHOD("get_db_path"), &WC::get_db_path);
+	ClassDB::bind_method(D_METHOD("get_stat", "stat"), &WC::get_stat);
+	ClassDB::bind_method(D_METHOD("set_mode", "mode"), &WC::set_mode);
+	ClassDB::bind_method(D_METHOD("get_mode"), &WC::get_mode);
+	ClassDB::bind_method(D_METHOD("set_server_addr", "addr"), &WC::set_server_addr);
+	ClassDB::bind_method(D_METHOD("get_server_addr"), &WC::get_server_addr);
+	ClassDB::bind_method(D_METHOD("set_server_port", "port"), &WC::set_server_port);
+	ClassDB::bind_method(D_METHOD("get_server_port"), &WC::get_server_port);
+	ClassDB::bind_method(D_METHOD("_peer_connected", "id"), &WC::_peer_connected);
+	ClassDB::bind_method(D_METHOD("_peer_disconnected", "id"), &WC::_peer_disconnected);
+	ClassDB::bind_method(D_METHOD("_server_disconnected"), &WC::_server_disconnected);
+
+	BIND_ENUM_CONSTANT(STAT_GENERATION_USEC);
+	BIND_ENUM_CONSTANT(STAT_MESHING_USEC);
+	BIND_ENUM_CONSTANT(STAT_UPLOAD_USEC);
+	BIND_ENUM_CONSTANT(STAT_FACES);
+	BIND_ENUM_CONSTANT(STAT_QUEUE_DEPTH);
+	BIND_ENUM_CONSTANT(STAT_CHUNKS_LOADED);
+	BIND_ENUM_CONSTANT(STAT_CHUNKS_UNLOADED);
+	BIND_ENUM_CONSTANT(STAT_CMAP_MEMORY);
+	BIND_ENUM_CONSTANT(STAT_MAX);
 
 	ADD_GROUP("Preload Data", "");
 	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "Material", PROPERTY_HINT_RESOURCE_TYPE, "ShaderMaterial,SpatialMaterial"),
 		"set_material", "get_material");
+
+	ADD_GROUP("Meshing", "");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "greedy_meshing"), "set_greedy_meshing", "is_greedy_meshing");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "compress_meshes"), "set_compress_meshes", "is_compress_meshes");
+
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "lod_distance", PROPERTY_HINT_RANGE, "0,64,1"), "set_lod_distance", "get_lod_distance");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "cave_culling"), "set_cave_culling", "is_cave_culling");
+
+	ADD_GROUP("Streaming", "");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "upload_budget_usec", PROPERTY_HINT_RANGE, "0,100000,100"), "set_upload_budget_usec", "get_upload_budget_usec");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "collision_radius", PROPERTY_HINT_RANGE, "0," + itos(RENDER_CHUNK_RADIUS - 1) + ",1"), "set_collision_radius", "get_collision_radius");
+
+	ADD_GROUP("Storage", "");
+	ADD_PROPERTY(PropertyInfo(Variant::STRING, "db_path"), "set_db_path", "get_db_path");
+
+	ADD_GROUP("Network", "");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "mode", PROPERTY_HINT_ENUM, "Offline,Online,Server"), "set_mode", "get_mode");
+	ADD_PROPERTY(PropertyInfo(Variant::STRING, "server_addr"), "set_server_addr", "get_server_addr");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "server_port", PROPERTY_HINT_RANGE, "1,65535,1"), "set_server_port", "get_server_port");
 }
 
 void WC::_notification(int p_what)
@@ -126,6 +197,22 @@ void WC::_notification(int p_what)
 		case NOTIFICATION_READY:
 		{
 			set_process( true );
+			open_store();
+			break;
+		}
+		case NOTIFICATION_ENTER_TREE:
+		{
+			Ref<World> world = get_viewport()->find_world();
+			set_scenario( world.is_valid() ? world->get_scenario() : RID() );
+			set_space( world.is_valid() ? world->get_space() : RID() );
+			register_monitors();
+			break;
+		}
+		case NOTIFICATION_EXIT_TREE:
+		{
+			set_scenario( RID() );
+			set_space( RID() );
+			unregister_monitors();
 			break;
 		}
 	}
@@ -138,9 +225,16 @@ void WC::update(float time_step)
 	uint64_t time_end = 0;
 #endif //_PROFILE
 
+	poll_network();
+
 	SpatialEditor* spatial_editor = SpatialEditor::get_singleton();
 
-	if (spatial_editor)
+	if (mode == MODE_SERVER)
+	{
+		// no camera, the clients' interest areas decide what is loaded
+		serve_chunks();
+	}
+	else if (spatial_editor)
 	{
 		SpatialEditorViewport* sev = spatial_editor->get_editor_viewport(0);
 
@@ -158,9 +252,17 @@ void WC::update(float time_step)
 		camera_direction = camera_node->get_transform().get_basis().get_row(2);
 	}
 
-	delete_chunks();
+	if (mode != MODE_SERVER)
+	{
+		delete_chunks();
 
-	ensure_chunks(camera_position, camera_direction);
+		ensure_chunks(camera_position, camera_direction);
+	}
+
+	if (OS::get_singleton()->get_ticks_usec() - stats_begin >= 1000000)
+	{
+		roll_stats();
+	}
 
 #ifdef _PROFILE
 	if (ScriptDebugger::get_singleton() && ScriptDebugger::get_singleton()->is_profiling())
@@ -181,13 +283,24 @@ void WC::update(float time_step)
 void WC::set_material( const Ref<Material> &p_material )
 {
 	material = p_material;
+	RID material_rid = material.is_valid() ? material->get_rid() : RID();
 	
-	for( int chunk_index = 0; chunk_index < chunk_count; chunk_index++ )
+	for( int chunk_index = 0; chunk_index < chunk_slots; chunk_index++ )
 	{
 		Chunk* chunk = &chunks[chunk_index];
-		chunk->mesh_instance->set_material_override( material );
-		_change_notify();
+		if( !chunk->active )
+		{
+			continue;
+		}
+		for( int s = 0; s < CHUNK_SECTIONS; s++ )
+		{
+			if( chunk->sections[s].instance.is_valid() )
+			{
+				VS::get_singleton()->instance_geometry_set_material_override( chunk->sections[s].instance, material_rid );
+			}
+		}
 	}
+	_change_notify();
 }
 
 Ref<Material> WC::get_material() const
@@ -195,6 +308,337 @@ Ref<Material> WC::get_material() const
 	return material;
 }
 
+void WC::set_greedy_meshing( bool p_enable )
+{
+	if( greedy_meshing == p_enable )
+	{
+		return;
+	}
+	greedy_meshing = p_enable;
+
+	for( int chunk_index = 0; chunk_index < chunk_slots; chunk_index++ )
+	{
+		Chunk* chunk = &chunks[chunk_index];
+		if( chunk->active )
+		{
+			dirty_chunk( chunk );
+		}
+	}
+	_change_notify();
+}
+
+bool WC::is_greedy_meshing() const
+{
+	return greedy_meshing;
+}
+
+void WC::set_compress_meshes( bool p_enable )
+{
+	if( compress_meshes == p_enable )
+	{
+		return;
+	}
+	compress_meshes = p_enable;
+
+	for( int chunk_index = 0; chunk_index < chunk_slots; chunk_index++ )
+	{
+		Chunk* chunk = &chunks[chunk_index];
+		if( chunk->active )
+		{
+			dirty_chunk( chunk );
+		}
+	}
+	_change_notify();
+}
+
+bool WC::is_compress_meshes() const
+{
+	return compress_meshes;
+}
+
+void WC::set_lod_distance( int p_distance )
+{
+	p_distance = MAX( p_distance, 0 );
+	if( lod_distance == p_distance )
+	{
+		return;
+	}
+	lod_distance = p_distance;
+	update_lods( lod_p, lod_q );
+	_change_notify();
+}
+
+int WC::get_lod_distance() const
+{
+	return lod_distance;
+}
+
+// takes effect with the next cull_sections pass, off shows every section.
+void WC::set_cave_culling( bool p_enable )
+{
+	if( cave_culling == p_enable )
+	{
+		return;
+	}
+	cave_culling = p_enable;
+	_change_notify();
+}
+
+bool WC::is_cave_culling() const
+{
+	return cave_culling;
+}
+
+void WC::set_collision_radius( int p_radius )
+{
+	p_radius = CLAMP( p_radius, 0, RENDER_CHUNK_RADIUS - 1 );
+	if( collision_radius == p_radius )
+	{
+		return;
+	}
+	collision_radius = p_radius;
+	update_collisions();
+	_change_notify();
+}
+
+int WC::get_collision_radius() const
+{
+	return collision_radius;
+}
+
+void WC::set_upload_budget_usec( int p_usec )
+{
+	upload_budget_usec = p_usec;
+}
+
+int WC::get_upload_budget_usec() const
+{
+	return upload_budget_usec;
+}
+
+// chunks already loaded are saved to the new path when they unload.
+void WC::set_db_path( const String &p_path )
+{
+	if( db_path == p_path )
+	{
+		return;
+	}
+	db_path = p_path;
+	if( region.open )
+	{
+		region_set_path( &region, db_path );
+	}
+	else
+	{
+		open_store();
+	}
+	_change_notify();
+}
+
+String WC::get_db_path() const
+{
+	return db_path;
+}
+
+// the store opens once the node is in the tree with a db_path, so instances
+// made for ClassDB or the docs never touch the disk. the editor runs without
+// it, region files are only locked within one process and a running game
+// writes the same ones.
+void WC::open_store()
+{
+	if( region.open || db_path.empty() || !is_inside_tree() || Engine::get_singleton()->is_editor_hint() )
+	{
+		return;
+	}
+	region_open( &region, db_path );
+}
+
+// positions stay full floats, chunk meshes sit in world space and half floats
+// lose whole blocks a couple thousand units out.
+uint32_t WC::get_mesh_compress_flags() const
+{
+	if( !compress_meshes )
+	{
+		return 0;
+	}
+	return Mesh::ARRAY_COMPRESS_NORMAL | Mesh::ARRAY_COMPRESS_TEX_UV | Mesh::ARRAY_COMPRESS_TEX_UV2 | Mesh::ARRAY_COMPRESS_COLOR;
+}
+
+// the network follows on the next poll_network, chunks loaded for the old
+// mode are dropped then.
+void WC::set_mode( int p_mode )
+{
+	ERR_FAIL_INDEX( p_mode, MODE_SERVER + 1 );
+	if( mode == p_mode )
+	{
+		return;
+	}
+	mode = p_mode;
+	mode_changed = 1;
+	_change_notify();
+}
+
+int WC::get_mode() const
+{
+	return mode;
+}
+
+void WC::set_server_addr( const String &p_addr )
+{
+	CharString addr = p_addr.utf8();
+	ERR_FAIL_COND( addr.length() >= MAX_ADDR_LENGTH );
+	strcpy( server_addr, addr.get_data() );
+	mode_changed |= mode == MODE_ONLINE;
+}
+
+String WC::get_server_addr() const
+{
+	return String::utf8( server_addr );
+}
+
+void WC::set_server_port( int p_port )
+{
+	server_port = p_port;
+	mode_changed |= mode != MODE_OFFLINE;
+}
+
+int WC::get_server_port() const
+{
+	return server_port;
+}
+
+// moves every active section instance to p_scenario, an empty RID takes
+// them out of the world.
+void WC::set_scenario( RID p_scenario )
+{
+	scenario = p_scenario;
+	for( int chunk_index = 0; chunk_index < chunk_slots; chunk_index++ )
+	{
+		Chunk* chunk = &chunks[chunk_index];
+		if( !chunk->active )
+		{
+			continue;
+		}
+		for( int s = 0; s < CHUNK_SECTIONS; s++ )
+		{
+			if( chunk->sections[s].instance.is_valid() )
+			{
+				VS::get_singleton()->instance_set_scenario( chunk->sections[s].instance, scenario );
+			}
+		}
+	}
+}
+
+// like set_scenario, for the chunks' static bodies.
+void WC::set_space( RID p_space )
+{
+	space = p_space;
+	for( int chunk_index = 0; chunk_index < chunk_slots; chunk_index++ )
+	{
+		Chunk* chunk = &chunks[chunk_index];
+		if( chunk->active && chunk->body.is_valid() )
+		{
+			PhysicsServer::get_singleton()->body_set_space( chunk->body, space );
+		}
+	}
+}
+
+static const char *stat_names[WC::STAT_MAX] = {
+	"wc/generation_usec",
+	"wc/meshing_usec",
+	"wc/upload_usec",
+	"wc/faces",
+	"wc/queue_depth",
+	"wc/chunks_loaded",
+	"wc/chunks_unloaded",
+	"wc/cmap_memory",
+};
+
+// one set of monitors for the first WC in the tree, they read 0 once it is
+// freed and go away with it.
+void WC::register_monitors()
+{
+	Performance *performance = Performance::get_singleton();
+	if (!performance || performance->has_custom_monitor(stat_names[0]))
+	{
+		return;
+	}
+	for (int i = 0; i < STAT_MAX; i++)
+	{
+		Array args;
+		args.push_back(i);
+		Performance::MonitorType type = i == STAT_CMAP_MEMORY ? Performance::MONITOR_TYPE_MEMORY : Performance::MONITOR_TYPE_QUANTITY;
+		performance->add_custom_monitor(stat_names[i], this, "get_stat", args, type);
+	}
+	monitors_registered = true;
+}
+
+void WC::unregister_monitors()
+{
+	if (!monitors_registered)
+	{
+		return;
+	}
+	Performance *performance = Performance::get_singleton();
+	for (int i = 0; i < STAT_MAX; i++)
+	{
+		performance->remove_custom_monitor(stat_names[i]);
+	}
+	monitors_registered = false;
+}
+
+void WC::roll_stats()
+{
+	last_stats = stats;
+	memset(&stats, 0, sizeof(stats));
+	stats_begin = OS::get_singleton()->get_ticks_usec();
+}
+
+float WC::get_stat(Stat p_stat)
+{
+	switch (p_stat)
+	{
+		case STAT_GENERATION_USEC:
+			return last_stats.generated ? last_stats.generate_usec / (float)last_stats.generated : 0;
+		case STAT_MESHING_USEC:
+			return last_stats.meshed ? last_stats.mesh_usec / (float)last_stats.meshed : 0;
+		case STAT_UPLOAD_USEC:
+			return last_stats.meshed ? last_stats.upload_usec / (float)last_stats.meshed : 0;
+		case STAT_FACES:
+			return last_stats.faces;
+		case STAT_QUEUE_DEPTH:
+		{
+			if (!workers)
+			{
+				return 0;
+			}
+			job_mutex->lock();
+			int depth = job_queue_size;
+			job_mutex->unlock();
+			return depth;
+		}
+		case STAT_CHUNKS_LOADED:
+			return last_stats.loaded;
+		case STAT_CHUNKS_UNLOADED:
+			return last_stats.unloaded;
+		case STAT_CMAP_MEMORY:
+		{
+			uint64_t memory = 0;
+			for (int i = 0; i < chunk_slots; i++)
+			{
+				if (chunks[i].active)
+				{
+					memory += map_memory(&chunks[i].map) + map_memory(&chunks[i].lights);
+				}
+			}
+			return memory;
+		}
+		default:
+			break;
+	}
+	ERR_FAIL_V(0);
+}
+
 void WC::create_initial()
 {
 	//if(!EditorNode::get_singleton()) // todo: it would be cool to preview in the editor :(
@@ -210,15 +654,7 @@ void WC::create_initial()
 			sign_radius = RENDER_SIGN_RADIUS;
 
 			// INITIALIZE WORKER THREADS
-			workers = new Worker[WORKERS];
-			for (int i = 0; i < WORKERS; i++)
-			{
-				Worker *worker = workers + i;
-				worker->index = i;
-				worker->state = WORKER_IDLE;
-				worker->smphr = Semaphore::create();
-				worker->thrd = Thread::create(worker_run, worker);
-			}
+			create_workers();
 
 			camera_position = Vector3(0.0f, 0.0f, 0.0f);
 			camera_direction = Vector3(0.0f, 0.0f, 0.0f);
@@ -235,23 +671,135 @@ bool WC::get_created()
 
 WC::WC()
 {
+	chunk_count = 0;
+	chunk_slots = 0;
+	free_chunk_count = 0;
+	edited_chunk_count = 0;
+	cindex_alloc(&chunk_index, MAX_CHUNKS * 2 - 1);
+	workers = NULL;
+	worker_count = 0;
+	upload_budget_usec = 4000;
+	greedy_meshing = false;
+	lod_distance = 0;
+	lod_p = 0;
+	lod_q = 0;
+	collision_radius = 2;
+	cave_culling = true;
+	compress_meshes = true;
+	memset(&stats, 0, sizeof(stats));
+	memset(&last_stats, 0, sizeof(last_stats));
+	stats_begin = OS::get_singleton()->get_ticks_usec();
+	monitors_registered = false;
+	mode = MODE_OFFLINE;
+	mode_changed = 0;
+	strcpy(server_addr, "127.0.0.1");
+	server_port = NET_DEFAULT_PORT;
+	net_p = 0;
+	net_q = 0;
+	net_located = 0;
+	for (int i = 0; i < MAX_PLAYERS; i++)
+	{
+		net_peers[i].id = 0;
+	}
+	region.open = false;
 	create_initial();
 	request_ready();
 }
 
 WC::~WC()
 {
+	unregister_monitors();
+	stop_network();
+	if (workers)
+	{
+		destroy_workers();
+	}
+	for (int i = 0; i < chunk_slots; i++)
+	{
+		if (chunks[i].active)
+		{
+			save_chunk(chunks + i);
+			map_free(&chunks[i].lights);
+			light_map_free(&chunks[i].light);
+			release_visual(chunks + i);
+			release_collision(chunks + i);
+		}
+	}
+	for (int i = 0; i < visual_pool.size(); i++)
+	{
+		VS::get_singleton()->free(visual_pool[i].instance);
+		VS::get_singleton()->free(visual_pool[i].mesh);
+	}
+	visual_pool.clear();
+	region_close(&region);
+	cindex_free(&chunk_index);
 	s_created = false;
 }
 
 
+#define WORLD_PAD 1
+#define WORLD_SIZE (CHUNK_SIZE + 2 * WORLD_PAD)
+#define WORLD_COLUMNS (WORLD_SIZE * WORLD_SIZE)
+
+enum WorldNoise
+{
+	WORLD_HEIGHT,
+	WORLD_MAX_HEIGHT,
+	WORLD_GRASS,
+	WORLD_FLOWER,
+	WORLD_FLOWER_TYPE,
+	WORLD_TREE,
+	WORLD_NOISE_COUNT
+};
+
+typedef struct {
+	float x[WORLD_COLUMNS];
+	float z[WORLD_COLUMNS];
+	float noise[WORLD_NOISE_COUNT][WORLD_COLUMNS];
+} WorldNoiseBuffer;
+
+// samples one noise field for every column of chunk p, q at once. the
+// coordinates are scaled in double and then rounded, like the float
+// arguments of a direct simplex2 call, so the terrain does not change.
+static void world_noise(WorldNoiseBuffer *buffer, int field, int p, int q,
+	double sx, double sz, int octaves, float persistence, float lacunarity)
+{
+	int i = 0;
+	for (int dx = -WORLD_PAD; dx < CHUNK_SIZE + WORLD_PAD; dx++)
+	{
+		for (int dz = -WORLD_PAD; dz < CHUNK_SIZE + WORLD_PAD; dz++)
+		{
+			buffer->x[i] = (p * CHUNK_SIZE + dx) * sx;
+			buffer->z[i] = (q * CHUNK_SIZE + dz) * sz;
+			i++;
+		}
+	}
+	simplex2_batch(buffer->noise[field], buffer->x, buffer->z, WORLD_COLUMNS,
+		octaves, persistence, lacunarity);
+}
+
 void create_world(int p, int q, world_func func, void *arg)
 {
-	int pad = 1;
+	WorldNoiseBuffer *buffer = memnew(WorldNoiseBuffer);
+	world_noise(buffer, WORLD_HEIGHT, p, q, 0.01, 0.01, 4, 0.5, 2);
+	world_noise(buffer, WORLD_MAX_HEIGHT, p, q, -0.01, -0.01, 2, 0.9, 2);
+	if (SHOW_PLANTS)
+	{
+		world_noise(buffer, WORLD_GRASS, p, q, -0.1, 0.1, 4, 0.8, 2);
+		world_noise(buffer, WORLD_FLOWER, p, q, 0.05, -0.05, 4, 0.8, 2);
+		world_noise(buffer, WORLD_FLOWER_TYPE, p, q, 0.1, 0.1, 4, 0.8, 2);
+	}
+	if (SHOW_TREES)
+	{
+		world_noise(buffer, WORLD_TREE, p, q, 1, 1, 6, 0.5, 2);
+	}
+
+	int pad = WORLD_PAD;
 	for (int dx = -pad; dx < CHUNK_SIZE + pad; dx++)
 	{
 		for (int dz = -pad; dz < CHUNK_SIZE + pad; dz++)
 		{
+			int column = (dx + pad) * WORLD_SIZE + (dz + pad);
 			int flag = 1;
 			if (dx < 0 || dz < 0 || dx >= CHUNK_SIZE || dz >= CHUNK_SIZE)
 			{
@@ -259,8 +807,8 @@ void create_world(int p, int q, world_func func, void *arg)
 			}
 			int x = p * CHUNK_SIZE + dx;
 			int z = q * CHUNK_SIZE + dz;
-			float f = simplex2(x * 0.01, z * 0.01, 4, 0.5, 2);
-			float g = simplex2(-x * 0.01, -z * 0.01, 2, 0.9, 2);
+			float f = buffer->noise[WORLD_HEIGHT][column];
+			float g = buffer->noise[WORLD_MAX_HEIGHT][column];
 			int mh = g * 32 + 16;
 			int h = f * mh;
 			int w = 1;
@@ -281,14 +829,14 @@ void create_world(int p, int q, world_func func, void *arg)
 				if (SHOW_PLANTS)
 				{
 					// grass
-					if (simplex2(-x * 0.1, z * 0.1, 4, 0.8, 2) > 0.6)
+					if (buffer->noise[WORLD_GRASS][column] > 0.6)
 					{
 						func(x, h, z, 17 * flag, arg);
 					}
 					// flowers
-					if (simplex2(x * 0.05, -z * 0.05, 4, 0.8, 2) > 0.7)
+					if (buffer->noise[WORLD_FLOWER][column] > 0.7)
 					{
-						int w = 18 + simplex2(x * 0.1, z * 0.1, 4, 0.8, 2) * 7;
+						int w = 18 + buffer->noise[WORLD_FLOWER_TYPE][column] * 7;
 						func(x, h, z, w  * flag, arg);
 					}
 				}
@@ -299,7 +847,7 @@ void create_world(int p, int q, world_func func, void *arg)
 				{
 					ok = 0;
 				}
-				if (ok && simplex2(x, z, 6, 0.5, 2) > 0.84)
+				if (ok && buffer->noise[WORLD_TREE][column] > 0.84)
 				{
 					for (int y = h + 3; y < h + 8; y++)
 					{
@@ -336,59 +884,186 @@ void create_world(int p, int q, world_func func, void *arg)
 			*/
 		}
 	}
+	memdelete(buffer);
 }
 
 
-void compute_chunk(WorkerItem *item)
-{
-	uint32_t opaque_size = XZ_SIZE * XZ_SIZE * Y_SIZE * sizeof(char);
-	uint32_t highest_size = XZ_SIZE * XZ_SIZE * sizeof(char);
-
-	//char *light = (char *) Memory::alloc_static(XZ_SIZE * XZ_SIZE * Y_SIZE *sizeof(char), true);
-	char *opaque = (char *) Memory::alloc_static(opaque_size, true);
-	memset(opaque, 0, opaque_size);
-	char *highest = (char *) Memory::alloc_static(highest_size, true);
-	memset(highest, 0, highest_size);
-
-	int ox = item->p * CHUNK_SIZE - CHUNK_SIZE - 1;
-	int oy = -1;
-	int oz = item->q * CHUNK_SIZE - CHUNK_SIZE - 1;
-
-	Array* mesh_array = &item->mesh_array;
-
+// vertex buffers sized from a face count, written through a ChunkMesh and
+// shrunk to what was used once the mesh is done.
+typedef struct {
 	PoolVector<Vector3> points;
 	PoolVector<Vector3> normals;
 	PoolVector<Vector2> uvs;
-	//PoolVector<int> indices;
-	mesh_array->resize(VS::ARRAY_MAX);
-	mesh_array->set(VS::ARRAY_VERTEX, points);
-	mesh_array->set(VS::ARRAY_NORMAL, normals);
-	mesh_array->set(VS::ARRAY_TEX_UV, uvs);
-	//mesh_array->set( VS::ARRAY_INDEX, indices );
-
-	// check for lights
-	/*
-	int has_light = 0;
-	if (SHOW_LIGHTS) {
-	for (int a = 0; a < 3; a++) {
-	for (int b = 0; b < 3; b++) {
-	CMap *map = item->light_maps[a][b];
-	if (map && map->size) {
-	has_light = 1;
-	}
+	PoolVector<Vector2> uv2s;
+	PoolVector<Color> colors;
+	PoolVector<int> indices;
+	PoolVector<Vector3>::Write points_w;
+	PoolVector<Vector3>::Write normals_w;
+	PoolVector<Vector2>::Write uvs_w;
+	PoolVector<Vector2>::Write uv2s_w;
+	PoolVector<Color>::Write colors_w;
+	PoolVector<int>::Write indices_w;
+	int vertex_count;
+	int greedy;
+} MeshBuffers;
+
+// greedy quads only ever need fewer vertices than faces * 4.
+static void mesh_buffers_begin(MeshBuffers *buffers, ChunkMesh *mesh, int faces, int greedy)
+{
+	buffers->vertex_count = faces * 4;
+	buffers->greedy = greedy;
+	buffers->points.resize(buffers->vertex_count);
+	buffers->normals.resize(buffers->vertex_count);
+	buffers->uvs.resize(buffers->vertex_count);
+	if (greedy)
+	{
+		buffers->uv2s.resize(buffers->vertex_count);
 	}
+	buffers->colors.resize(buffers->vertex_count);
+	buffers->indices.resize(faces * 6);
+	buffers->points_w = buffers->points.write();
+	buffers->normals_w = buffers->normals.write();
+	buffers->uvs_w = buffers->uvs.write();
+	buffers->uv2s_w = buffers->uv2s.write();
+	buffers->colors_w = buffers->colors.write();
+	buffers->indices_w = buffers->indices.write();
+
+	mesh->points = buffers->points_w.ptr();
+	mesh->normals = buffers->normals_w.ptr();
+	mesh->uvs = buffers->uvs_w.ptr();
+	mesh->uv2s = greedy ? buffers->uv2s_w.ptr() : 0;
+	mesh->colors = buffers->colors_w.ptr();
+	mesh->indices = buffers->indices_w.ptr();
+	mesh->offset = 0;
+	mesh->index_offset = 0;
+}
+
+static void mesh_buffers_end(MeshBuffers *buffers, ChunkMesh *mesh, Array *mesh_array)
+{
+	buffers->points_w = PoolVector<Vector3>::Write();
+	buffers->normals_w = PoolVector<Vector3>::Write();
+	buffers->uvs_w = PoolVector<Vector2>::Write();
+	buffers->uv2s_w = PoolVector<Vector2>::Write();
+	buffers->colors_w = PoolVector<Color>::Write();
+	buffers->indices_w = PoolVector<int>::Write();
+
+	if (mesh->offset < buffers->vertex_count)
+	{
+		buffers->points.resize(mesh->offset);
+		buffers->normals.resize(mesh->offset);
+		buffers->uvs.resize(mesh->offset);
+		buffers->uv2s.resize(mesh->offset);
+		buffers->colors.resize(mesh->offset);
+		buffers->indices.resize(mesh->index_offset);
 	}
+
+	mesh_array->resize(VS::ARRAY_MAX);
+	mesh_array->set(VS::ARRAY_VERTEX, buffers->points);
+	mesh_array->set(VS::ARRAY_NORMAL, buffers->normals);
+	mesh_array->set(VS::ARRAY_TEX_UV, buffers->uvs);
+	mesh_array->set(VS::ARRAY_COLOR, buffers->colors);
+	if (buffers->greedy)
+	{
+		mesh_array->set(VS::ARRAY_TEX_UV2, buffers->uv2s);
 	}
-	*/
+	mesh_array->set(VS::ARRAY_INDEX, buffers->indices);
+}
 
-	// populate opaque array
-	for (int a = 0; a < 3; a++)
+// a set of buffers per section, sections without faces get none.
+static void mesh_sections_begin(MeshBuffers buffers[CHUNK_SECTIONS], ChunkMesh meshes[CHUNK_SECTIONS], const int faces[CHUNK_SECTIONS], int greedy)
+{
+	for (int s = 0; s < CHUNK_SECTIONS; s++)
 	{
-		for (int b = 0; b < 3; b++)
+		if (faces[s])
 		{
-			CMap *map = item->block_maps[a][b];
-			if (!map)
-			{
+			mesh_buffers_begin(buffers + s, meshes + s, faces[s], greedy);
+		}
+		else
+		{
+			memset(meshes + s, 0, sizeof(ChunkMesh));
+		}
+	}
+}
+
+static void mesh_sections_end(MeshBuffers buffers[CHUNK_SECTIONS], ChunkMesh meshes[CHUNK_SECTIONS], WorkerItem *item)
+{
+	item->vertices = 0;
+	item->indices = 0;
+	for (int s = 0; s < CHUNK_SECTIONS; s++)
+	{
+		item->mesh_arrays[s] = Array();
+		if (item->section_faces[s])
+		{
+			mesh_buffers_end(buffers + s, meshes + s, &item->mesh_arrays[s]);
+		}
+		item->vertices += meshes[s].offset;
+		item->indices += meshes[s].index_offset;
+	}
+}
+
+// chunks past the first LOD ring, meshed from coarse cells. no plants and no
+// greedy merging, the cells are few enough already.
+static void compute_chunk_lod(WorkerItem *item)
+{
+	LodCells cells;
+	lod_cells_alloc(&cells, item->block_maps, item->p, item->q, item->lod, item->lod_edges);
+	int miny;
+	int maxy;
+	int faces = lod_count_faces(&cells, &miny, &maxy, item->section_faces);
+	// far enough out that nothing is worth hiding behind them
+	for (int s = 0; s < CHUNK_SECTIONS; s++)
+	{
+		item->section_visibility[s] = SECTION_OPEN;
+	}
+
+	MeshBuffers buffers[CHUNK_SECTIONS];
+	ChunkMesh meshes[CHUNK_SECTIONS];
+	mesh_sections_begin(buffers, meshes, item->section_faces, item->greedy);
+	make_lod_faces(meshes, &cells, item->p, item->q);
+	mesh_sections_end(buffers, meshes, item);
+	lod_cells_free(&cells);
+
+	item->miny = miny;
+	item->maxy = maxy;
+	item->faces = faces;
+}
+
+void compute_chunk(WorkerItem *item)
+{
+	uint64_t begin = OS::get_singleton()->get_ticks_usec();
+	if (item->collision)
+	{
+		make_collision_faces(&item->collision_faces, item->block_maps[1][1], item->p, item->q);
+	}
+	if (item->lod > 0)
+	{
+		compute_chunk_lod(item);
+		item->mesh_usec = OS::get_singleton()->get_ticks_usec() - begin;
+		return;
+	}
+
+	uint32_t opaque_size = XZ_SIZE * XZ_SIZE * Y_SIZE * sizeof(char);
+	uint32_t highest_size = XZ_SIZE * XZ_SIZE * sizeof(char);
+
+	char *opaque = (char *) Memory::alloc_static(opaque_size, true);
+	memset(opaque, 0, opaque_size);
+	char *highest = (char *) Memory::alloc_static(highest_size, true);
+	memset(highest, 0, highest_size);
+	CullMasks *cull = (CullMasks *) Memory::alloc_static(sizeof(CullMasks), true);
+	cull_clear(cull);
+
+	int ox = item->p * CHUNK_SIZE - CHUNK_SIZE - 1;
+	int oy = -1;
+	int oz = item->q * CHUNK_SIZE - CHUNK_SIZE - 1;
+
+	// populate opaque array
+	for (int a = 0; a < 3; a++)
+	{
+		for (int b = 0; b < 3; b++)
+		{
+			CMap *map = item->block_maps[a][b];
+			if (!map)
+			{
 				continue;
 			}
 			MAP_FOR_EACH(map, ex, ey, ez, ew)
@@ -412,67 +1087,58 @@ void compute_chunk(WorkerItem *item)
 				{
 					highest[XZ(x, z)] = MAX(highest[XZ(x, z)], y);
 				}
+				// the bit columns cover the center chunk and a border of one block
+				int cx = ex - item->p * CHUNK_SIZE;
+				int cz = ez - item->q * CHUNK_SIZE;
+				if (cx < -1 || cz < -1 || cx > CHUNK_SIZE || cz > CHUNK_SIZE)
+				{
+					continue;
+				}
+				cull_set_bit(cull->opaque[CULL_OPAQUE(cx, cz)], ey, opaque[XYZ(x, y, z)]);
+				if (a == 1 && b == 1 && w > 0 && cx >= 0 && cz >= 0 && cx < CHUNK_SIZE && cz < CHUNK_SIZE)
+				{
+					cull_set_bit(cull->solid[CULL_COLUMN(cx, cz)], ey, 1);
+					cull_set_bit(cull->plants[CULL_COLUMN(cx, cz)], ey, is_plant(w));
+				}
 			} END_MAP_FOR_EACH;
 		}
 	}
 
-	// flood fill light intensities
-	/*
-	if (has_light) {
-	for (int a = 0; a < 3; a++) {
-	for (int b = 0; b < 3; b++) {
-	CMap *map = item->light_maps[a][b];
-	if (!map) {
-	continue;
-	}
-	MAP_FOR_EACH(map, ex, ey, ez, ew) {
-	int x = ex - ox;
-	int y = ey - oy;
-	int z = ez - oz;
-	light_fill(opaque, light, x, y, z, ew, 1);
-	} END_MAP_FOR_EACH;
-	}
-	}
+	// sky and block light. chunks meshed on the main thread after an edit
+	// reuse the light the edit left behind, the rest flood it from scratch
+	// and hand it back to be kept with the chunk.
+	int lighting = item->lighting;
+	LightVolume volume;
+	volume.data = 0;
+	if (lighting)
+	{
+		if (item->lights[1][1])
+		{
+			light_gather(&volume, item->lights, item->p, item->q);
+		}
+		else
+		{
+			light_compute(&volume, item->block_maps, item->light_maps, item->p, item->q);
+			light_store(&item->light, &volume, item->p, item->q);
+		}
 	}
-	*/
 
 	CMap *map = item->block_maps[1][1];
 
 	// count exposed faces
-	int miny = 256;
-	int maxy = 0;
-	int faces = 0;
-	MAP_FOR_EACH(map, ex, ey, ez, ew)
-	{
-		if (ew <= 0) {
-			continue;
-		}
-		int x = ex - ox;
-		int y = ey - oy;
-		int z = ez - oz;
-		int f1 = !opaque[XYZ(x - 1, y, z)]; // left
-		int f2 = !opaque[XYZ(x + 1, y, z)]; // right
-		int f3 = !opaque[XYZ(x, y + 1, z)]; // top
-		int f4 = !opaque[XYZ(x, y - 1, z)] && (ey > 0); // bottom
-		int f5 = !opaque[XYZ(x, y, z - 1)]; // front
-		int f6 = !opaque[XYZ(x, y, z + 1)]; // back
-		int total = f1 + f2 + f3 + f4 + f5 + f6;
-		if (total == 0) {
-			continue;
-		}
-		if (is_plant(ew))
-		{
-			total = 4;
-		}
-		miny = MIN(miny, ey);
-		maxy = MAX(maxy, ey);
-		faces += total;
-	} END_MAP_FOR_EACH;
+	int miny;
+	int maxy;
+	cull_faces(cull);
+	int faces = cull_count(cull, &miny, &maxy, item->section_faces);
+	section_visibility(item->section_visibility, cull);
+
+	// generate geometry straight into buffers sized from the face count
+	MeshBuffers buffers[CHUNK_SECTIONS];
+	ChunkMesh meshes[CHUNK_SECTIONS];
+	mesh_sections_begin(buffers, meshes, item->section_faces, item->greedy);
 
-	// generate geometry
 	int block_count = 0;
 
-	int offset = 0;
 	MAP_FOR_EACH(map, ex, ey, ez, ew)
 	{
 		if (ew <= 0)
@@ -483,16 +1149,21 @@ void compute_chunk(WorkerItem *item)
 		int x = ex - ox;
 		int y = ey - oy;
 		int z = ez - oz;
-		int f1 = !opaque[XYZ(x - 1, y, z)]; // left
-		int f2 = !opaque[XYZ(x + 1, y, z)]; // right
-		int f3 = !opaque[XYZ(x, y + 1, z)]; // top
-		int f4 = !opaque[XYZ(x, y - 1, z)] && (ey > 0); // bottom
-		int f5 = !opaque[XYZ(x, y, z - 1)]; // back
-		int f6 = !opaque[XYZ(x, y, z + 1)]; // front
+		int cx = ex - item->p * CHUNK_SIZE;
+		int cz = ez - item->q * CHUNK_SIZE;
+		int f1 = cull_face(cull, CULL_FACE_LEFT, cx, ey, cz);
+		int f2 = cull_face(cull, CULL_FACE_RIGHT, cx, ey, cz);
+		int f3 = cull_face(cull, CULL_FACE_TOP, cx, ey, cz);
+		int f4 = cull_face(cull, CULL_FACE_BOTTOM, cx, ey, cz);
+		int f5 = cull_face(cull, CULL_FACE_BACK, cx, ey, cz);
+		int f6 = cull_face(cull, CULL_FACE_FRONT, cx, ey, cz);
 		int total = f1 + f2 + f3 + f4 + f5 + f6;
 		if (total == 0) {
 			continue;
 		}
+		if (item->greedy && !is_plant(ew)) {
+			continue;
+		}
 		char neighbors[27] = {0};
 		char lights[27] = {0};
 		float shades[27] = {0};
@@ -504,9 +1175,15 @@ void compute_chunk(WorkerItem *item)
 				for (int dz = -1; dz <= 1; dz++)
 				{
 					neighbors[index] = opaque[XYZ(x + dx, y + dy, z + dz)];
-					//lights[index] = light[XYZ(x + dx, y + dy, z + dz)];
 					shades[index] = 0;
-					if (y + dy <= highest[XZ(x + dx, z + dz)])
+					if (lighting)
+					{
+						// what the sky doesn't reach is in shade
+						int v = light_volume_get(&volume, ex + dx, ey + dy, ez + dz);
+						lights[index] = LIGHT_BLOCK(v);
+						shades[index] = (LIGHT_MAX - LIGHT_SKY(v)) / (float)LIGHT_MAX;
+					}
+					else if (y + dy <= highest[XZ(x + dx, z + dz)])
 					{
 						for (int oy = 0; oy < 8; oy++)
 						{
@@ -523,58 +1200,85 @@ void compute_chunk(WorkerItem *item)
 		}
 		float ao[6][4];
 		float light[6][4];
-		// don't worry about AO for now?
-		//occlusion(neighbors, lights, shades, ao, light);
-		// terrible, terrible hack.  PoolVector has what i can only assume is a threading bug...
-		if (WC::s_created)
+		occlusion(neighbors, lights, shades, ao, light);
+		if (is_plant(ew))
 		{
-			if (is_plant(ew))
-			{
-				total = 4;
-				//float min_ao = 1;
-				//float max_light = 0;
-				//for (int a = 0; a < 6; a++) {
-				//for (int b = 0; b < 4; b++) {
-				//min_ao = MIN(min_ao, ao[a][b]);
-				//max_light = MAX(max_light, light[a][b]);
-				//}
-				//}
-				float rotation = simplex2(ex, ez, 4, 0.5, 2) * 360;
-				make_plant(mesh_array, ex, ey, ez, 0.5, ew, rotation);
-			}
-			else
+			total = 4;
+			float min_ao = 1;
+			float max_light = 0;
+			for (int a = 0; a < 6; a++)
 			{
-				make_cube(
-					mesh_array, ao, light,
-					f1, f2, f3, f4, f5, f6,
-					ex, ey, ez, 0.5, ew);
+				for (int b = 0; b < 4; b++)
+				{
+					min_ao = MIN(min_ao, ao[a][b]);
+					max_light = MAX(max_light, light[a][b]);
+				}
 			}
+			float rotation = simplex2(ex, ez, 4, 0.5, 2) * 360;
+			make_plant(meshes + ey / CHUNK_SECTION_HEIGHT, min_ao, max_light, ex, ey, ez, 0.5, ew, rotation);
+		}
+		else
+		{
+			make_cube(
+				meshes + ey / CHUNK_SECTION_HEIGHT, ao, light,
+				f1, f2, f3, f4, f5, f6,
+				ex, ey, ez, 0.5, ew);
 		}
-		offset += total * 60;
 	} END_MAP_FOR_EACH;
 
 	//print_line( "Block Entry Count: " + itos( block_count ) );
 
+	if (item->greedy)
+	{
+		make_greedy_faces(meshes, map, opaque, item->p, item->q, miny, maxy);
+	}
+
+	mesh_sections_end(buffers, meshes, item);
+
 	Memory::free_static(opaque, true);
-	//free(light);
+	light_volume_free(&volume);
 	Memory::free_static(highest, true);
+	Memory::free_static(cull, true);
 
 	item->miny = miny;
 	item->maxy = maxy;
 	item->faces = faces;
+	item->mesh_usec = OS::get_singleton()->get_ticks_usec() - begin;
 }
 
 Chunk* WC::find_chunk(int p, int q)
 {
-	for (int i = 0; i < chunk_count; i++)
+	int slot = cindex_get(&chunk_index, p, q);
+	if (slot == CINDEX_EMPTY)
 	{
-		Chunk *chunk = chunks + i;
-		if (chunk->p == p && chunk->q == q)
-		{
-			return chunk;
-		}
+		return 0;
 	}
-	return 0;
+	return chunks + slot;
+}
+
+// slots are recycled through free_chunks, so a Chunk never moves once allocated.
+Chunk* WC::alloc_chunk(int p, int q)
+{
+	if (chunk_count >= MAX_CHUNKS)
+	{
+		return 0;
+	}
+	int slot = free_chunk_count ? free_chunks[--free_chunk_count] : chunk_slots++;
+	Chunk *chunk = chunks + slot;
+	chunk->p = p;
+	chunk->q = q;
+	chunk->active = 1;
+	cindex_set(&chunk_index, p, q, slot);
+	chunk_count++;
+	return chunk;
+}
+
+void WC::free_chunk(Chunk *chunk)
+{
+	cindex_remove(&chunk_index, chunk->p, chunk->q);
+	chunk->active = 0;
+	free_chunks[free_chunk_count++] = chunk - chunks;
+	chunk_count--;
 }
 
 void WC::dirty_chunk( Chunk *chunk )
@@ -600,16 +1304,39 @@ void WC::request_chunk(int p, int q)
 	//client_chunk(p, q, key);
 }
 
+// clients hold the server's blocks, they are never saved locally.
+void WC::save_chunk(Chunk *chunk)
+{
+	if (chunk->modified && mode != MODE_ONLINE && region.open)
+	{
+		region_save(&region, &chunk->map, &chunk->lights, chunk->p, chunk->q);
+		chunk->modified = 0;
+	}
+}
+
 void load_chunk(WorkerItem *item)
 {
 	int p = item->p;
 	int q = item->q;
 	CMap *block_map = item->block_maps[1][1];
-	//CMap *light_map = item->light_maps[1][1];
+	CMap *light_map = item->light_maps[1][1];
 	//print_line("Loading Chunk " + itos(p) + ", " + itos(q) );
+	uint64_t begin = OS::get_singleton()->get_ticks_usec();
+	item->generated = 0;
+	if (item->snapshot.size())
+	{
+		region_decode(block_map, light_map, item->snapshot.ptr(), item->snapshot.size());
+		item->generate_usec = OS::get_singleton()->get_ticks_usec() - begin;
+		return;
+	}
+	if (item->store && region_load(item->store, block_map, light_map, p, q))
+	{
+		item->generate_usec = OS::get_singleton()->get_ticks_usec() - begin;
+		return;
+	}
 	create_world(p, q, map_set_func, block_map);
-	//db_load_blocks(block_map, p, q);
-	//db_load_lights(light_map, p, q);
+	item->generated = 1;
+	item->generate_usec = OS::get_singleton()->get_ticks_usec() - begin;
 }
 
 void WC::init_chunk(Chunk *chunk, int p, int q)
@@ -617,7 +1344,23 @@ void WC::init_chunk(Chunk *chunk, int p, int q)
 	chunk->p = p;
 	chunk->q = q;
 	chunk->faces = 0;
-	chunk->mesh_instance = memnew(MeshInstance);
+	chunk->job = 0;
+	chunk->modified = 0;
+	chunk->loaded = 0;
+	chunk->edited = 0;
+	chunk->lod = chunk_lod(p, q);
+	chunk->lod_edges = chunk_lod_edges(p, q);
+	chunk->collision = 0;
+	chunk->meshed = 0;
+	for (int s = 0; s < CHUNK_SECTIONS; s++)
+	{
+		ChunkSection *section = chunk->sections + s;
+		section->mesh = RID();
+		section->instance = RID();
+		section->faces = 0;
+		section->visibility = SECTION_OPEN;
+		section->visible = 0;
+	}
 
 	//chunk->sign_faces = 0;
 	//chunk->sign_buffer = 0;
@@ -626,12 +1369,190 @@ void WC::init_chunk(Chunk *chunk, int p, int q)
 	//sign_list_alloc( signs, 16 );
 	//db_load_signs( signs, p, q );
 	CMap *block_map = &chunk->map;
-	//CMap *light_map = &chunk->lights;
+	CMap *light_map = &chunk->lights;
 	int dx = p * CHUNK_SIZE - 1;
 	int dy = 0;
 	int dz = q * CHUNK_SIZE - 1;
 	map_alloc(block_map, dx, dy, dz, 0x7fff);
-	//map_alloc( light_map, dx, dy, dz, 0xf );
+	map_alloc(light_map, dx, dy, dz, 0xf);
+	light_map_init(&chunk->light);
+	stats.loaded++;
+}
+
+// rings are square like the create radius, every lod_distance chunks out
+// the level goes up by one.
+int WC::chunk_lod(int p, int q) const
+{
+	if (lod_distance <= 0)
+	{
+		return 0;
+	}
+	int distance = MAX(ABS(p - lod_p), ABS(q - lod_q));
+	return MIN(distance / lod_distance, LOD_LEVELS - 1);
+}
+
+int WC::chunk_lod_edges(int p, int q) const
+{
+	int lod = chunk_lod(p, q);
+	int edges = 0;
+	if (chunk_lod(p - 1, q) < lod)
+	{
+		edges |= 1 << CULL_FACE_LEFT;
+	}
+	if (chunk_lod(p + 1, q) < lod)
+	{
+		edges |= 1 << CULL_FACE_RIGHT;
+	}
+	if (chunk_lod(p, q - 1) < lod)
+	{
+		edges |= 1 << CULL_FACE_BACK;
+	}
+	if (chunk_lod(p, q + 1) < lod)
+	{
+		edges |= 1 << CULL_FACE_FRONT;
+	}
+	return edges;
+}
+
+// recenters the rings on chunk p, q. chunks whose level or edges change are
+// dirtied, queue_chunks remeshes them on the workers like any other chunk and
+// the old mesh stays up until the new one lands.
+void WC::update_lods(int p, int q)
+{
+	lod_p = p;
+	lod_q = q;
+	for (int i = 0; i < chunk_slots; i++)
+	{
+		Chunk *chunk = chunks + i;
+		if (!chunk->active)
+		{
+			continue;
+		}
+		int lod = chunk_lod(chunk->p, chunk->q);
+		int edges = chunk_lod_edges(chunk->p, chunk->q);
+		if (lod != chunk->lod || edges != chunk->lod_edges)
+		{
+			chunk->lod = lod;
+			chunk->lod_edges = edges;
+			dirty_chunk(chunk);
+		}
+	}
+}
+
+// gives the section a mesh and instance from the pool, or new ones once the
+// pool runs dry. sections only hold one while they have faces.
+void WC::acquire_section(ChunkSection *section)
+{
+	VisualServer *vs = VS::get_singleton();
+	if (visual_pool.size())
+	{
+		ChunkVisual visual = visual_pool[visual_pool.size() - 1];
+		visual_pool.resize(visual_pool.size() - 1);
+		section->mesh = visual.mesh;
+		section->instance = visual.instance;
+		vs->instance_set_visible(section->instance, true);
+	}
+	else
+	{
+		section->mesh = vs->mesh_create();
+		section->instance = vs->instance_create();
+		vs->instance_set_base(section->instance, section->mesh);
+	}
+	section->visible = 1;
+	vs->instance_geometry_set_material_override(section->instance, material.is_valid() ? material->get_rid() : RID());
+	vs->instance_set_scenario(section->instance, scenario);
+}
+
+// empties the section's mesh and parks the pair in the pool, outside any
+// scenario.
+void WC::release_section(ChunkSection *section)
+{
+	VisualServer *vs = VS::get_singleton();
+	vs->instance_set_scenario(section->instance, RID());
+	vs->mesh_clear(section->mesh);
+	ChunkVisual visual = { section->mesh, section->instance };
+	visual_pool.push_back(visual);
+	section->mesh = RID();
+	section->instance = RID();
+	section->visible = 0;
+}
+
+void WC::release_visual(Chunk *chunk)
+{
+	for (int s = 0; s < CHUNK_SECTIONS; s++)
+	{
+		if (chunk->sections[s].instance.is_valid())
+		{
+			release_section(chunk->sections + s);
+		}
+	}
+}
+
+// square like the LOD rings, around the same center.
+int WC::chunk_collides(int p, int q) const
+{
+	return collision_radius > 0 && MAX(ABS(p - lod_p), ABS(q - lod_q)) <= collision_radius;
+}
+
+// frees the bodies of chunks that left the collision radius and dirties
+// the ones that entered it, their next job builds the faces.
+void WC::update_collisions()
+{
+	for (int i = 0; i < chunk_slots; i++)
+	{
+		Chunk *chunk = chunks + i;
+		if (!chunk->active)
+		{
+			continue;
+		}
+		if (!chunk_collides(chunk->p, chunk->q))
+		{
+			release_collision(chunk);
+		}
+		else if (!chunk->collision && chunk->loaded)
+		{
+			dirty_chunk(chunk);
+		}
+	}
+}
+
+// the body and shape are made once and the shape's faces replaced on
+// every remesh. chunks without faces get no body.
+void WC::set_chunk_collision(Chunk *chunk, const PoolVector<Vector3> &faces)
+{
+	PhysicsServer *ps = PhysicsServer::get_singleton();
+	if (!faces.size())
+	{
+		release_collision(chunk);
+		chunk->collision = 1;
+		return;
+	}
+	if (chunk->body.is_valid())
+	{
+		ps->shape_set_data(chunk->shape, faces);
+	}
+	else
+	{
+		chunk->shape = ps->shape_create(PhysicsServer::SHAPE_CONCAVE_POLYGON);
+		ps->shape_set_data(chunk->shape, faces);
+		chunk->body = ps->body_create(PhysicsServer::BODY_MODE_STATIC);
+		ps->body_add_shape(chunk->body, chunk->shape);
+		ps->body_set_space(chunk->body, space);
+	}
+	chunk->collision = 1;
+}
+
+void WC::release_collision(Chunk *chunk)
+{
+	if (chunk->body.is_valid())
+	{
+		PhysicsServer *ps = PhysicsServer::get_singleton();
+		ps->free(chunk->body);
+		ps->free(chunk->shape);
+		chunk->body = RID();
+		chunk->shape = RID();
+	}
+	chunk->collision = 0;
 }
 
 // called from the main thread for what is essentially debug purposes...
@@ -642,27 +1563,78 @@ void WC::create_chunk(Chunk *chunk, int p, int q)
 	WorkerItem *item = &_item;
 	item->p = chunk->p;
 	item->q = chunk->q;
+	item->store = region.open ? &region : NULL;
 	item->block_maps[1][1] = &chunk->map;
-	//item->light_maps[1][1] = &chunk->lights;
+	item->light_maps[1][1] = &chunk->lights;
 	load_chunk(item);
+	chunk->modified = item->generated;
+	chunk->loaded = 1;
+	stats.generate_usec += item->generate_usec;
+	stats.generated++;
 	request_chunk(p, q);
 }
 
 void WC::set_chunk_render_data(Chunk *chunk, WorkerItem *item)
 {
+	uint64_t begin = OS::get_singleton()->get_ticks_usec();
 	chunk->miny = item->miny;
 	chunk->maxy = item->maxy;
 	chunk->faces = item->faces;
+	// light the job flooded replaces what the chunk had, a job that
+	// gathered the stored light leaves it be. unlit jobs drop it so edits
+	// don't keep a stale copy up to date.
+	if (item->light.data)
+	{
+		light_map_free(&chunk->light);
+		chunk->light = item->light;
+		light_map_init(&item->light);
+	}
+	else if (!item->lighting)
+	{
+		light_map_free(&chunk->light);
+	}
 	//gen_sign_buffer( chunk );
-	ArrayMesh* mesh = memnew(ArrayMesh);
-	mesh->add_surface_from_arrays(Mesh::PrimitiveType::PRIMITIVE_TRIANGLES, item->mesh_array);
-	chunk->mesh_instance->set_mesh(mesh);
-	if (!material.is_null())
+	// remeshed sections replace the surface of the mesh they already have,
+	// sections left without faces give theirs back
+	VisualServer *vs = VS::get_singleton();
+	for (int s = 0; s < CHUNK_SECTIONS; s++)
 	{
-		chunk->mesh_instance->set_material_override(material);
+		ChunkSection *section = chunk->sections + s;
+		section->faces = item->section_faces[s];
+		section->visibility = item->section_visibility[s];
+		if (item->mesh_arrays[s].empty())
+		{
+			if (section->instance.is_valid())
+			{
+				release_section(section);
+			}
+			continue;
+		}
+		if (!section->instance.is_valid())
+		{
+			acquire_section(section);
+		}
+		vs->mesh_clear(section->mesh);
+		vs->mesh_add_surface_from_arrays(section->mesh, VS::PRIMITIVE_TRIANGLES, item->mesh_arrays[s], Array(), get_mesh_compress_flags());
+	}
+	chunk->meshed = 1;
+	if (item->collision)
+	{
+		set_chunk_collision(chunk, item->collision_faces);
+	}
+	else
+	{
+		release_collision(chunk);
+		if (chunk_collides(chunk->p, chunk->q))
+		{
+			// the radius reached the chunk while its job was out
+			dirty_chunk(chunk);
+		}
 	}
-	add_child(chunk->mesh_instance);
-	set_editable_instance(chunk->mesh_instance, false);
+	stats.mesh_usec += item->mesh_usec;
+	stats.upload_usec += OS::get_singleton()->get_ticks_usec() - begin;
+	stats.faces += item->faces;
+	stats.meshed++;
 }
 
 // called from main thread for what is essentially debug purposes?
@@ -672,6 +1644,12 @@ void WC::gen_chunk_buffer(Chunk *chunk )
 	WorkerItem *item = &_item;
 	item->p = chunk->p;
 	item->q = chunk->q;
+	item->greedy = greedy_meshing;
+	item->lod = chunk->lod;
+	item->lod_edges = chunk->lod_edges;
+	item->lighting = SHOW_LIGHTS && !greedy_meshing && !chunk->lod;
+	item->collision = chunk_collides(chunk->p, chunk->q);
+	light_map_init(&item->light);
 	for (int dp = -1; dp <= 1; dp++)
 	{
 		for (int dq = -1; dq <= 1; dq++)
@@ -682,16 +1660,20 @@ void WC::gen_chunk_buffer(Chunk *chunk )
 			}
 			if (other) {
 				item->block_maps[dp + 1][dq + 1] = &other->map;
-				//item->light_maps[dp + 1][dq + 1] = &other->lights;
+				item->light_maps[dp + 1][dq + 1] = &other->lights;
 			}
 			else {
 				item->block_maps[dp + 1][dq + 1] = 0;
-				//item->light_maps[dp + 1][dq + 1] = 0;
+				item->light_maps[dp + 1][dq + 1] = 0;
 			}
+			// without light of its own the chunk floods it from scratch
+			item->lights[dp + 1][dq + 1] = other && chunk->light.data && other->light.data ? &other->light : 0;
 		}
 	}
 	compute_chunk(item);
 	set_chunk_render_data(chunk, item);
+	light_map_free(&item->light);
+	item->collision_faces = PoolVector<Vector3>();
 	chunk->dirty = 0;
 }
 
@@ -719,13 +1701,17 @@ int WC::highest_block(float x, float z)
 
 void WC::delete_chunks()
 {
-	int count = chunk_count;
 	// State *s1 = &g->players->state;
 	//State *s2 = &(g->players + g->observe1)->state;
 	//State *s3 = &(g->players + g->observe2)->state;
 	//State *states[3] = {s1, s2, s3};
-	for (int i = 0; i < count; i++) {
+	int p = chunked(camera_position.x);
+	int q = chunked(camera_position.z);
+	for (int i = 0; i < chunk_slots; i++) {
 		Chunk *chunk = chunks + i;
+		if (!chunk->active) {
+			continue;
+		}
 		/*
 		int del = 1;
 		for (int j = 0; j < 3; j++) {
@@ -738,35 +1724,50 @@ void WC::delete_chunks()
 		}
 		}
 		*/
-		int p = chunked(camera_position.x);
-		int q = chunked(camera_position.z);
-		if (chunk_distance(chunk, p, q) > delete_radius)
+		// servers keep what any client is interested in
+		int distance = mode == MODE_SERVER ? peer_distance(chunk->p, chunk->q) : chunk_distance(chunk, p, q);
+		if (distance > delete_radius)
 		{
+			save_chunk(chunk);
 			map_free(&chunk->map);
-			remove_child(chunk->mesh_instance);
-			// i believe this winds up cleaning up and deallocating the ArrayMesh?  double check.
-			memdelete(chunk->mesh_instance);
+			map_free(&chunk->lights);
+			light_map_free(&chunk->light);
+			release_visual(chunk);
+			release_collision(chunk);
+			chunk->snapshot = Vector<uint8_t>();
 
 			//sign_list_free(&chunk->signs);
 			//del_buffer(chunk->sign_buffer);
-			Chunk *other = chunks + (--count);
-			memcpy(chunk, other, sizeof(Chunk));
+			free_chunk(chunk);
+			stats.unloaded++;
 		}
 	}
-
-	chunk_count = count;
 }
 
 void WC::delete_all_chunks()
 {
-	for (int i = 0; i < chunk_count; i++)
+	for (int i = 0; i < chunk_slots; i++)
 	{
 		Chunk *chunk = chunks + i;
+		if (!chunk->active)
+		{
+			continue;
+		}
+		save_chunk(chunk);
 		map_free(&chunk->map);
-		remove_child(chunk->mesh_instance);
-		memdelete(chunk->mesh_instance);
+		map_free(&chunk->lights);
+		light_map_free(&chunk->light);
+		release_visual(chunk);
+		release_collision(chunk);
+		chunk->snapshot = Vector<uint8_t>();
+		chunk->active = 0;
+		stats.unloaded++;
 	}
+	cindex_clear(&chunk_index);
 	chunk_count = 0;
+	chunk_slots = 0;
+	free_chunk_count = 0;
+	edited_chunk_count = 0;
 }
 
 // does not use threads...
@@ -791,9 +1792,8 @@ void WC::force_chunks(float x, float z)
 					gen_chunk_buffer(chunk);
 				}
 			}
-			else if (chunk_count < MAX_CHUNKS)
+			else if ((chunk = alloc_chunk(a, b)))
 			{
-				chunk = chunks + chunk_count++;
 				create_chunk(chunk, a, b);
 				gen_chunk_buffer(chunk);
 			}
@@ -801,176 +1801,472 @@ void WC::force_chunks(float x, float z)
 	}
 }
 
-void WC::check_workers()
-{
-	for (int i = 0; i < WORKERS; i++)
+// queued jobs form a heap on their score, lowest score on top.
+struct WorkerItemCompare {
+	_FORCE_INLINE_ bool operator()(const WorkerItem *a, const WorkerItem *b) const
 	{
-		Worker *worker = workers + i;
-		if (worker->state == WORKER_DONE)
-		{
-			WorkerItem *item = &worker->item;
-			Chunk *chunk = find_chunk(item->p, item->q);
-
-			if (chunk)
-			{
-				if (item->load)
-				{
-					CMap *block_map = item->block_maps[1][1];
-					CMap *light_map = item->light_maps[1][1];
-					map_free(&chunk->map);
-					//map_free( &chunk->lights );
-					map_copy(&chunk->map, block_map);
-					//map_copy( &chunk->lights, light_map );
-					request_chunk(item->p, item->q);
-				}
-				set_chunk_render_data(chunk, item);
-			}
-			for (int a = 0; a < 3; a++)
-			{
-				for (int b = 0; b < 3; b++)
-				{
-					CMap *block_map = item->block_maps[a][b];
-					//CMap *light_map = item->light_maps[a][b];
-					if (block_map)
-					{
-						Memory::free_static(block_map, true);
-					}
-					//if( light_map ) {
-					//	map_free( light_map );
-					//	free( light_map );
-					//}
-				}
-			}
-			worker->state = WORKER_IDLE;
-		}
+		return a->score > b->score;
+	}
+};
+
+typedef struct {
+	int score;
+	int a;
+	int b;
+	int priority;
+} ChunkCandidate;
+
+// candidates form a heap with the worst score on top, so the best ones are kept.
+struct ChunkCandidateCompare {
+	_FORCE_INLINE_ bool operator()(const ChunkCandidate &a, const ChunkCandidate &b) const
+	{
+		return a.score < b.score;
 	}
+};
+
+static void done_ring_alloc(DoneRing *ring, int capacity)
+{
+	ring->head = 0;
+	ring->tail = 0;
+	ring->mask = next_power_of_2(capacity) - 1;
+	ring->items = new WorkerItem*[ring->mask + 1];
 }
 
-void worker_run(void *arg)
+static void done_ring_free(DoneRing *ring)
 {
-	Worker* worker = (Worker*) arg;
-	int running = 1;
+	delete[] ring->items;
+}
 
-	while (running)
-	{
-		while (worker->state != WORKER_BUSY)
-		{
-			worker->smphr->wait();
+// worker side
+static void done_ring_push(DoneRing *ring, WorkerItem *item)
+{
+	uint32_t head = ring->head;
+	ring->items[head & ring->mask] = item;
+	// full barrier, the slot is visible before the new head
+	atomic_increment(&ring->head);
+}
+
+// main thread side
+static WorkerItem *done_ring_pop(DoneRing *ring)
+{
+	uint32_t tail = ring->tail;
+	if (atomic_add(&ring->head, 0) == tail)
+	{
+		return NULL;
+	}
+	WorkerItem *item = ring->items[tail & ring->mask];
+	atomic_increment(&ring->tail);
+	return item;
+}
+
+int chunk_score(const Vector<Plane> &planes, int p, int q, int a, int b, int priority)
+{
+	int distance = MAX(ABS(a - p), ABS(b - q));
+	int invisible = planes.size() && !chunk_visible(planes, a, b, 0, 256);
+	return (invisible << 24) | (priority << 16) | distance;
+}
+
+void WC::create_workers()
+{
+	worker_count = MAX(OS::get_singleton()->get_processor_count() - 1, 1);
+	workers_exit = false;
+
+	job_capacity = worker_count * (QUEUED_JOBS_PER_WORKER + 2);
+	job_items = new WorkerItem[job_capacity];
+	free_items = new WorkerItem*[job_capacity];
+	job_queue = new WorkerItem*[job_capacity];
+	for (int i = 0; i < job_capacity; i++)
+	{
+		free_items[i] = job_items + i;
+	}
+	free_item_count = job_capacity;
+	job_queue_size = 0;
+	job_counter = 0;
+	next_done_worker = 0;
+	job_mutex = Mutex::create();
+	job_semaphore = Semaphore::create();
+
+	workers = new Worker[worker_count];
+	for (int i = 0; i < worker_count; i++)
+	{
+		Worker *worker = workers + i;
+		worker->index = i;
+		worker->wc = this;
+		done_ring_alloc(&worker->done, job_capacity);
+		worker->thrd = Thread::create(worker_run, worker);
+	}
+}
+
+void WC::destroy_workers()
+{
+	workers_exit = true;
+	for (int i = 0; i < worker_count; i++)
+	{
+		job_semaphore->post();
+	}
+	for (int i = 0; i < worker_count; i++)
+	{
+		Thread::wait_to_finish(workers[i].thrd);
+		memdelete(workers[i].thrd);
+	}
+	for (int i = 0; i < worker_count; i++)
+	{
+		WorkerItem *item;
+		while ((item = done_ring_pop(&workers[i].done)))
+		{
+			release_job(item);
+		}
+		done_ring_free(&workers[i].done);
+	}
+	delete[] workers;
+	workers = NULL;
+
+	for (int i = 0; i < job_queue_size; i++)
+	{
+		release_job(job_queue[i]);
+	}
+	delete[] job_items;
+	delete[] free_items;
+	delete[] job_queue;
+	memdelete(job_mutex);
+	memdelete(job_semaphore);
+}
+
+int WC::pending_jobs() const
+{
+	return job_capacity - free_item_count;
+}
+
+void WC::release_job(WorkerItem *item)
+{
+	for (int a = 0; a < 3; a++)
+	{
+		for (int b = 0; b < 3; b++)
+		{
+			CMap *block_map = item->block_maps[a][b];
+			CMap *light_map = item->light_maps[a][b];
+			if (block_map)
+			{
+				map_free(block_map);
+				Memory::free_static(block_map, true);
+				item->block_maps[a][b] = 0;
+			}
+			if (light_map)
+			{
+				map_free(light_map);
+				Memory::free_static(light_map, true);
+				item->light_maps[a][b] = 0;
+			}
+		}
+	}
+	light_map_free(&item->light);
+	for (int s = 0; s < CHUNK_SECTIONS; s++)
+	{
+		item->mesh_arrays[s] = Array();
+	}
+	item->collision_faces = PoolVector<Vector3>();
+	item->snapshot = Vector<uint8_t>();
+	free_items[free_item_count++] = item;
+}
+
+void WC::apply_job(WorkerItem *item)
+{
+	Chunk *chunk = find_chunk(item->p, item->q);
+
+	// results for chunks that were unloaded or recycled since are dropped
+	if (chunk && chunk->job == item->job)
+	{
+		if (item->load)
+		{
+			CMap *block_map = item->block_maps[1][1];
+			map_free(&chunk->map);
+			map_share(&chunk->map, block_map);
+			map_free(&chunk->lights);
+			map_share(&chunk->lights, item->light_maps[1][1]);
+			chunk->modified = item->generated;
+			chunk->loaded = 1;
+			stats.generate_usec += item->generate_usec;
+			stats.generated++;
+			request_chunk(item->p, item->q);
+		}
+		if (item->mesh)
+		{
+			set_chunk_render_data(chunk, item);
+		}
+		chunk->job = 0;
+	}
+	release_job(item);
+}
+
+// applies every finished job, or as many as fit in upload_budget_usec.
+// rings are visited round robin so one busy worker can't starve the rest.
+void WC::check_workers()
+{
+	if (!workers)
+	{
+		return;
+	}
+
+	OS *os = OS::get_singleton();
+	uint64_t begin = os->get_ticks_usec();
+	for (int i = 0; i < worker_count; i++)
+	{
+		int index = (next_done_worker + i) % worker_count;
+		DoneRing *ring = &workers[index].done;
+		WorkerItem *item;
+		while ((item = done_ring_pop(ring)))
+		{
+			apply_job(item);
+			if (upload_budget_usec > 0 && os->get_ticks_usec() - begin >= (uint64_t)upload_budget_usec)
+			{
+				next_done_worker = (index + 1) % worker_count;
+				return;
+			}
+		}
+	}
+}
+
+void worker_run(void *arg)
+{
+	Worker* worker = (Worker*) arg;
+	WC* wc = worker->wc;
+	SortArray<WorkerItem *, WorkerItemCompare> sorter;
+
+	while (true)
+	{
+		wc->job_semaphore->wait();
+		if (wc->workers_exit)
+		{
+			break;
+		}
+
+		// jobs dropped by the main thread leave extra posts behind
+		wc->job_mutex->lock();
+		WorkerItem *item = NULL;
+		if (wc->job_queue_size)
+		{
+			sorter.pop_heap(0, wc->job_queue_size, wc->job_queue);
+			item = wc->job_queue[--wc->job_queue_size];
 		}
+		wc->job_mutex->unlock();
 
-		WorkerItem *item = &worker->item;
+		if (!item)
+		{
+			continue;
+		}
 
 		if (item->load)
 		{
 			load_chunk(item);
 		}
 
-		compute_chunk(item);
+		if (item->mesh)
+		{
+			compute_chunk(item);
+		}
 
-		worker->state = WORKER_DONE;
+		done_ring_push(&worker->done, item);
 	}
 }
 
 // was player
-void WC::ensure_chunks_worker(
-	Vector3 position,
-	Vector3 normal,
-	Worker *worker)
-{
-	Camera* camera = Object::cast_to<Camera>( get_node( NodePath( "../Camera" ) ) );
-	int p = chunked( position.x );
-	int q = chunked( position.z );
-    int r = create_radius;
-    int start = 0x0fffffff;
-    int best_score = start;
-    int best_a = 0;
-    int best_b = 0;
-    for (int dp = -r; dp <= r; dp++)
-	{
-        for (int dq = -r; dq <= r; dq++)
-		{
-            int a = p + dp;
-            int b = q + dq;
-            int index = (ABS(a) ^ ABS(b)) % WORKERS;
-            if (index != worker->index)
+void WC::queue_chunks(Vector3 position, const Vector<Plane> &planes)
+{
+	int p = chunked(position.x);
+	int q = chunked(position.z);
+	SortArray<WorkerItem *, WorkerItemCompare> sorter;
+
+	if (p != lod_p || q != lod_q)
+	{
+		update_lods(p, q);
+		update_collisions();
+	}
+
+	// rescore what is still queued for the new camera, and drop jobs whose
+	// chunk was unloaded in the meantime
+	WorkerItem **dropped = (WorkerItem **) alloca(sizeof(WorkerItem *) * job_capacity);
+	int dropped_count = 0;
+
+	job_mutex->lock();
+	int count = 0;
+	for (int i = 0; i < job_queue_size; i++)
+	{
+		WorkerItem *item = job_queue[i];
+		Chunk *chunk = find_chunk(item->p, item->q);
+		if (!chunk || chunk->job != item->job)
+		{
+			dropped[dropped_count++] = item;
+			continue;
+		}
+		item->score = chunk_score(planes, p, q, item->p, item->q, item->priority);
+		job_queue[count++] = item;
+	}
+	job_queue_size = count;
+	sorter.make_heap(0, job_queue_size, job_queue);
+	job_mutex->unlock();
+
+	for (int i = 0; i < dropped_count; i++)
+	{
+		release_job(dropped[i]);
+	}
+
+	int slots = MIN(worker_count * QUEUED_JOBS_PER_WORKER - count, free_item_count);
+
+	if (slots <= 0)
+	{
+		return;
+	}
+
+	// keep the best few candidates of one pass over the create radius
+	SortArray<ChunkCandidate, ChunkCandidateCompare> candidate_sorter;
+	ChunkCandidate *candidates = (ChunkCandidate *) alloca(sizeof(ChunkCandidate) * slots);
+	int candidate_count = 0;
+	int r = create_radius;
+	for (int dp = -r; dp <= r; dp++)
+	{
+		for (int dq = -r; dq <= r; dq++)
+		{
+			int a = p + dp;
+			int b = q + dq;
+			Chunk *chunk = find_chunk(a, b);
+			if (chunk && (chunk->job || !chunk->dirty))
 			{
-                continue;
-            }
-            Chunk *chunk = find_chunk(a, b);
-            if (chunk && !chunk->dirty)
+				continue;
+			}
+			// clients only load the chunks the server sent
+			if (!chunk && mode == MODE_ONLINE)
 			{
-                continue;
-            }
-            int distance = MAX(ABS(dp), ABS(dq));
-            int invisible = camera && !chunk_visible(camera->get_frustum(), a, b, 0, 256);
-            int priority = 0;
-            if (chunk)
+				continue;
+			}
+			// remeshes of chunks already on screen go first, ahead of new
+			// chunks and ones never meshed at the same visibility and distance
+			int priority = !(chunk && chunk->meshed);
+			int score = chunk_score(planes, p, q, a, b, priority);
+			if (candidate_count < slots)
 			{
-				// mesh instance might not be what we're looking for...
-                priority = chunk->mesh_instance && chunk->dirty;
+				ChunkCandidate candidate = { score, a, b, priority };
+				candidate_sorter.push_heap(0, candidate_count, 0, candidate, candidates);
+				candidate_count++;
 			}
-            int score = (invisible << 24) | (priority << 16) | distance;
-            if (score < best_score)
+			else if (score < candidates[0].score)
 			{
-				best_score = score;
-				best_a = a;
-				best_b = b;
-            }
-        }
-    }
-    if (best_score == start)
-	{
-        return;
-    }
-    int a = best_a;
-    int b = best_b;
-    int load = 0;
-    Chunk *chunk = find_chunk(a, b);
-    if (!chunk)
-	{
-        load = 1;
-        if (chunk_count < MAX_CHUNKS)
-		{
-            chunk = chunks + chunk_count++;
-            init_chunk(chunk, a, b);
-        }
-        else
-		{
-            return;
-        }
-    }
-    WorkerItem *item = &worker->item;
-    item->p = chunk->p;
-    item->q = chunk->q;
-    item->load = load;
-    for (int dp = -1; dp <= 1; dp++)
-	{
-        for (int dq = -1; dq <= 1; dq++)
-		{
-            Chunk *other = chunk;
-            if (dp || dq)
+				ChunkCandidate candidate = { score, a, b, priority };
+				candidate_sorter.adjust_heap(0, 0, candidate_count, candidate, candidates);
+			}
+		}
+	}
+
+	WorkerItem **ready = (WorkerItem **) alloca(sizeof(WorkerItem *) * slots);
+	int ready_count = 0;
+	for (int i = 0; i < candidate_count; i++)
+	{
+		int a = candidates[i].a;
+		int b = candidates[i].b;
+		Chunk *chunk = find_chunk(a, b);
+		if (!chunk)
+		{
+			chunk = alloc_chunk(a, b);
+			if (!chunk)
+			{
+				break;
+			}
+			init_chunk(chunk, a, b);
+		}
+		ready[ready_count++] = make_job(chunk, !chunk->loaded, 1, candidates[i].priority, candidates[i].score);
+	}
+	submit_jobs(ready, ready_count);
+}
+
+// takes a free job item for chunk. a load job fills the chunk's blocks
+// first, from the snapshot a server sent, the region store or create_world.
+// jobs that mesh see the chunks around as well.
+WorkerItem *WC::make_job(Chunk *chunk, int load, int mesh, int priority, int score)
+{
+	WorkerItem *item = free_items[--free_item_count];
+	item->p = chunk->p;
+	item->q = chunk->q;
+	item->load = load;
+	item->mesh = mesh;
+	item->store = mode == MODE_ONLINE || !region.open ? NULL : &region;
+	item->snapshot = chunk->snapshot;
+	chunk->snapshot = Vector<uint8_t>();
+	item->greedy = greedy_meshing;
+	item->lod = chunk->lod;
+	item->lod_edges = chunk->lod_edges;
+	item->lighting = mesh && SHOW_LIGHTS && !greedy_meshing && !chunk->lod;
+	item->collision = mesh && chunk_collides(chunk->p, chunk->q);
+	light_map_init(&item->light);
+	item->priority = priority;
+	item->score = score;
+	item->job = ++job_counter;
+	for (int dp = -1; dp <= 1; dp++)
+	{
+		for (int dq = -1; dq <= 1; dq++)
+		{
+			Chunk *other = chunk;
+			if (dp || dq)
 			{
-                other = find_chunk(chunk->p + dp, chunk->q + dq);
-            }
-            if (other)
+				other = mesh ? find_chunk(chunk->p + dp, chunk->q + dq) : 0;
+			}
+			if (other)
 			{
-                CMap *block_map = (CMap*) Memory::alloc_static(sizeof(CMap), true );
-                map_copy(block_map, &other->map);
-                //CMap *light_map = malloc(sizeof(CMap));
-                //map_copy(light_map, &other->lights);
-                item->block_maps[dp + 1][dq + 1] = block_map;
-                //item->light_maps[dp + 1][dq + 1] = light_map;
-            }
-            else
+				// shared, not copied. the main thread copies a map on
+				// write while a job still holds it. a chunk being loaded
+				// gets a fresh map for the worker to fill.
+				CMap *block_map = (CMap*) Memory::alloc_static(sizeof(CMap), true );
+				if (load && other == chunk)
+				{
+					map_alloc(block_map, chunk->map.dx, chunk->map.dy, chunk->map.dz, chunk->map.mask);
+				}
+				else
+				{
+					map_share(block_map, &other->map);
+				}
+				item->block_maps[dp + 1][dq + 1] = block_map;
+				// sources only matter to lit jobs, and only once loaded. a
+				// chunk being loaded gets its sources back from the store.
+				CMap *light_map = 0;
+				if (load && other == chunk)
+				{
+					light_map = (CMap*) Memory::alloc_static(sizeof(CMap), true);
+					map_alloc(light_map, chunk->lights.dx, chunk->lights.dy, chunk->lights.dz, chunk->lights.mask);
+				}
+				else if (item->lighting && other->loaded)
+				{
+					light_map = (CMap*) Memory::alloc_static(sizeof(CMap), true);
+					map_share(light_map, &other->lights);
+				}
+				item->light_maps[dp + 1][dq + 1] = light_map;
+			}
+			else
 			{
-                item->block_maps[dp + 1][dq + 1] = 0;
-                //item->light_maps[dp + 1][dq + 1] = 0;
-            }
-        }
-    }
-    chunk->dirty = 0;
-    worker->state = WORKER_BUSY;
-	worker->smphr->post();
+				item->block_maps[dp + 1][dq + 1] = 0;
+				item->light_maps[dp + 1][dq + 1] = 0;
+			}
+			item->lights[dp + 1][dq + 1] = 0;
+		}
+	}
+	chunk->job = item->job;
+	chunk->dirty = 0;
+	return item;
+}
+
+void WC::submit_jobs(WorkerItem **items, int count)
+{
+	SortArray<WorkerItem *, WorkerItemCompare> sorter;
+
+	job_mutex->lock();
+	for (int i = 0; i < count; i++)
+	{
+		sorter.push_heap(0, job_queue_size, 0, items[i], job_queue);
+		job_queue_size++;
+	}
+	job_mutex->unlock();
+
+	for (int i = 0; i < count; i++)
+	{
+		job_semaphore->post();
+	}
 }
 
 
@@ -979,60 +2275,696 @@ void WC::ensure_chunks(
 	Vector3 normal)
 {
 	check_workers();
+	flush_net_blocks();
+	flush_edits();
 	//force_chunks( position.x, position.z );
-	for (int i = 0; i < WORKERS; i++)
+	if (!workers)
 	{
-		Worker *worker = workers + i;
+		return;
+	}
+
+	NodePath camera_path( "../Camera" );
+	Camera* camera = has_node( camera_path ) ? Object::cast_to<Camera>( get_node( camera_path ) ) : NULL;
+	Vector<Plane> planes;
+	if (camera)
+	{
+		planes = camera->get_frustum();
+	}
+	queue_chunks(position, planes);
+	cull_sections(position, planes);
+}
+
+// neighbour of a section through each face, in p, s, q.
+static const int section_steps[6][3] = {
+	{-1, 0, 0},
+	{+1, 0, 0},
+	{0, +1, 0},
+	{0, -1, 0},
+	{0, 0, -1},
+	{0, 0, +1}
+};
+
+// cave culling. a breadth first walk from the camera's section steps into a
+// neighbour only when the section it is in sees the face it would leave by
+// from the face it came in through, never against a direction it already
+// took, and only into sections inside the frustum. sections within
+// delete_radius the walk doesn't reach are hidden, the rest are shown.
+// chunks that haven't been meshed yet count as open so they never hide
+// anything behind them. returns the sections left with an instance shown.
+int WC::cull_sections(Vector3 position, const Vector<Plane> &planes)
+{
+	int p = chunked(position.x);
+	int q = chunked(position.z);
+	int r = delete_radius;
+	int side = 2 * r + 1;
+	int cells = side * side * CHUNK_SECTIONS;
+	if (cull_reached.size() != cells)
+	{
+		cull_reached.resize(cells);
+		cull_steps.resize(cells);
+	}
+	uint8_t *reached = cull_reached.ptrw();
+	memset(reached, 0, cells);
 
-		if (worker->state == WORKER_IDLE)
+	if (cave_culling)
+	{
+		SectionStep *steps = cull_steps.ptrw();
+		int head = 0;
+		int tail = 0;
+		int s = CLAMP((int)Math::floor(position.y / CHUNK_SECTION_HEIGHT), 0, CHUNK_SECTIONS - 1);
+		SectionStep start = { p, q, s, -1, 0 };
+		steps[tail++] = start;
+		reached[(r * side + r) * CHUNK_SECTIONS + s] = 1;
+		while (head < tail)
 		{
-			ensure_chunks_worker(position, normal, worker);
+			SectionStep step = steps[head++];
+			Chunk *chunk = find_chunk(step.p, step.q);
+			uint64_t visibility = chunk && chunk->meshed ? chunk->sections[step.s].visibility : SECTION_OPEN;
+			for (int face = 0; face < 6; face++)
+			{
+				if (step.dirs & (1 << SECTION_OPPOSITE(face)))
+				{
+					continue;
+				}
+				if (step.from >= 0 && !SECTION_SEES(visibility, step.from, face))
+				{
+					continue;
+				}
+				int np = step.p + section_steps[face][0];
+				int ns = step.s + section_steps[face][1];
+				int nq = step.q + section_steps[face][2];
+				if (ABS(np - p) > r || ABS(nq - q) > r || ns < 0 || ns >= CHUNK_SECTIONS)
+				{
+					continue;
+				}
+				int index = ((np - p + r) * side + (nq - q + r)) * CHUNK_SECTIONS + ns;
+				if (reached[index])
+				{
+					continue;
+				}
+				if (planes.size() && !chunk_visible(planes, np, nq, ns * CHUNK_SECTION_HEIGHT, (ns + 1) * CHUNK_SECTION_HEIGHT))
+				{
+					continue;
+				}
+				reached[index] = 1;
+				SectionStep next = { np, nq, ns, SECTION_OPPOSITE(face), step.dirs | (1 << face) };
+				steps[tail++] = next;
+			}
 		}
 	}
-}
 
-/*
-void _set_block( int p, int q, int x, int y, int z, int w, int dirty ) {
-	Chunk *chunk = find_chunk( p, q );
-	if( chunk ) {
-		CMap *map = &chunk->map;
-		if( map_set( map, x, y, z, w ) ) {
-			if( dirty ) {
-				dirty_chunk( chunk );
+	VisualServer *vs = VS::get_singleton();
+	int shown = 0;
+	for (int i = 0; i < chunk_slots; i++)
+	{
+		Chunk *chunk = chunks + i;
+		if (!chunk->active)
+		{
+			continue;
+		}
+		int dp = chunk->p - p;
+		int dq = chunk->q - q;
+		int inside = ABS(dp) <= r && ABS(dq) <= r;
+		for (int s = 0; s < CHUNK_SECTIONS; s++)
+		{
+			ChunkSection *section = chunk->sections + s;
+			if (!section->instance.is_valid())
+			{
+				continue;
 			}
-			db_insert_block( p, q, x, y, z, w );
+			int visible = !cave_culling || (inside && reached[((dp + r) * side + (dq + r)) * CHUNK_SECTIONS + s]);
+			if (visible != section->visible)
+			{
+				vs->instance_set_visible(section->instance, visible);
+				section->visible = visible;
+			}
+			shown += visible;
 		}
 	}
-	else {
-		db_insert_block( p, q, x, y, z, w );
+	return shown;
+}
+
+// edits only reach loaded chunks. returns 1 when the map changed.
+int WC::_set_block(int p, int q, int x, int y, int z, int w, int dirty)
+{
+	Chunk *chunk = find_chunk(p, q);
+	if (!chunk || !chunk->loaded)
+	{
+		return 0;
+	}
+	if (!map_set(&chunk->map, x, y, z, w))
+	{
+		return 0;
+	}
+	chunk->modified = 1;
+	if (dirty)
+	{
+		edit_chunk(chunk);
+	}
+	return 1;
+}
+
+// clients send their edits to the server and see them once it sends them
+// back, servers pass the ones they make on to their clients.
+void WC::set_block(int x, int y, int z, int w)
+{
+	if (mode == MODE_ONLINE)
+	{
+		if (net.is_valid() && net->get_connection_status() == NetworkedMultiplayerPeer::CONNECTION_CONNECTED)
+		{
+			net_send(NetworkedMultiplayerPeer::TARGET_PEER_SERVER, net_block(x, y, z, w));
+		}
+		return;
 	}
-	if( w == 0 && chunked( x ) == p && chunked( z ) == q ) {
-		unset_sign( x, y, z );
-		set_light( p, q, x, y, z, 0 );
+	if (apply_block(x, y, z, w) && mode == MODE_SERVER)
+	{
+		serve_block(x, y, z, w);
 	}
 }
 
-void set_block( int x, int y, int z, int w ) {
-	int p = chunked( x );
-	int q = chunked( z );
-	_set_block( p, q, x, y, z, w, 1 );
-	for( int dx = -1; dx <= 1; dx++ ) {
-		for( int dz = -1; dz <= 1; dz++ ) {
-			if( dx == 0 && dz == 0 ) {
+// neighbours keep a copy of the blocks along their border, so a border
+// edit is mirrored into them. only the chunks sharing a face with the block
+// are remeshed, an edit inside a chunk never touches its neighbours.
+// servers neither mesh nor light. returns 1 when the block changed.
+int WC::apply_block(int x, int y, int z, int w)
+{
+	if (y < 0 || y >= 256)
+	{
+		return 0;
+	}
+	int p = chunked(x);
+	int q = chunked(z);
+	int remesh = mode != MODE_SERVER;
+	int was_transparent = is_transparent(get_block(x, y, z));
+	if (!_set_block(p, q, x, y, z, w, remesh))
+	{
+		return 0;
+	}
+	for (int dx = -1; dx <= 1; dx++)
+	{
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			if (dx == 0 && dz == 0)
+			{
 				continue;
 			}
-			if( dx && chunked( x + dx ) == p ) {
+			if (dx && chunked(x + dx) == p)
+			{
 				continue;
 			}
-			if( dz && chunked( z + dz ) == q ) {
+			if (dz && chunked(z + dz) == q)
+			{
 				continue;
 			}
-			_set_block( p + dx, q + dz, x, y, z, -w, 1 );
+			_set_block(p + dx, q + dz, x, y, z, -w, remesh && !(dx && dz));
+		}
+	}
+	if (remesh && is_transparent(w) != was_transparent)
+	{
+		relight(x, y, z);
+	}
+	return 1;
+}
+
+// updates the stored light of the chunks around the block in place and
+// remeshes every chunk that sees a changed value. chunks still waiting on
+// their first light are skipped, their job floods it from the new blocks.
+void WC::relight(int x, int y, int z)
+{
+	int p = chunked(x);
+	int q = chunked(z);
+	LightEdit edit;
+	light_edit_init(&edit, p, q);
+	for (int a = 0; a < 3; a++)
+	{
+		for (int b = 0; b < 3; b++)
+		{
+			Chunk *other = find_chunk(p + a - 1, q + b - 1);
+			if (other && other->loaded)
+			{
+				edit.block_maps[a][b] = &other->map;
+				edit.light_maps[a][b] = &other->lights;
+				edit.maps[a][b] = other->light.data ? &other->light : 0;
+			}
+		}
+	}
+	light_edit(&edit, x, y, z);
+	for (int a = 0; a < 5; a++)
+	{
+		for (int b = 0; b < 5; b++)
+		{
+			Chunk *other = edit.changed[a][b] ? find_chunk(p + a - 2, q + b - 2) : 0;
+			if (other && other->loaded)
+			{
+				edit_chunk(other);
+			}
+		}
+	}
+}
+
+// sky light in the high nibble, block light in the low one, LIGHT_OPEN
+// where the chunk holds no light.
+int WC::get_light(int x, int y, int z)
+{
+	Chunk *chunk = find_chunk(chunked(x), chunked(z));
+	if (!chunk || !chunk->light.data)
+	{
+		return LIGHT_OPEN;
+	}
+	return light_map_get(&chunk->light, x - chunk->p * CHUNK_SIZE, y, z - chunk->q * CHUNK_SIZE);
+}
+
+// places a light source of strength w, 0 removes it.
+void WC::set_light(int x, int y, int z, int w)
+{
+	if (y < 0 || y >= 256)
+	{
+		return;
+	}
+	Chunk *chunk = find_chunk(chunked(x), chunked(z));
+	if (!chunk || !chunk->loaded)
+	{
+		return;
+	}
+	if (!map_set(&chunk->lights, x, y, z, CLAMP(w, 0, LIGHT_MAX)))
+	{
+		return;
+	}
+	chunk->modified = 1;
+	edit_chunk(chunk);
+	relight(x, y, z);
+}
+
+void WC::edit_chunk(Chunk *chunk)
+{
+	chunk->dirty = 1;
+	if (!chunk->edited)
+	{
+		chunk->edited = 1;
+		edited_chunks[edited_chunk_count++] = chunk - chunks;
+	}
+}
+
+// remeshes edited chunks on the main thread, so edits show up the frame
+// after they are made. results of jobs still in flight for them are stale
+// and get dropped.
+void WC::flush_edits()
+{
+	for (int i = 0; i < edited_chunk_count; i++)
+	{
+		Chunk *chunk = chunks + edited_chunks[i];
+		if (!chunk->active || !chunk->edited)
+		{
+			continue;
+		}
+		chunk->edited = 0;
+		chunk->job = 0;
+		gen_chunk_buffer(chunk);
+	}
+	edited_chunk_count = 0;
+}
+
+// (re)starts the network for mode. chunks loaded so far came from another
+// source of blocks, so they are dropped.
+void WC::start_network()
+{
+	mode_changed = 0;
+	stop_network();
+	delete_all_chunks();
+	if (mode == MODE_OFFLINE)
+	{
+		return;
+	}
+	Object *object = ClassDB::instance("NetworkedMultiplayerENet");
+	NetworkedMultiplayerPeer *peer = Object::cast_to<NetworkedMultiplayerPeer>(object);
+	if (!peer)
+	{
+		if (object)
+		{
+			memdelete(object);
+		}
+		ERR_EXPLAIN("WC streams chunks over ENet, the enet module is not enabled in this build");
+		ERR_FAIL();
+	}
+	net = Ref<NetworkedMultiplayerPeer>(peer);
+	Error err;
+	if (mode == MODE_SERVER)
+	{
+		err = (Error)(int)net->call("create_server", server_port, MAX_PLAYERS);
+	}
+	else
+	{
+		IP_Address ip = IP::get_singleton()->resolve_hostname(get_server_addr(), IP::TYPE_IPV4);
+		err = ip.is_valid() ? (Error)(int)net->call("create_client", ip, server_port) : ERR_CANT_RESOLVE;
+	}
+	if (err != OK)
+	{
+		net = Ref<NetworkedMultiplayerPeer>();
+		ERR_EXPLAIN("Can't " + String(mode == MODE_SERVER ? "serve on port " : "connect to " + get_server_addr() + ":") + itos(server_port));
+		ERR_FAIL();
+	}
+	net->set_transfer_mode(NetworkedMultiplayerPeer::TRANSFER_MODE_RELIABLE);
+	net->connect("peer_connected", this, "_peer_connected");
+	net->connect("peer_disconnected", this, "_peer_disconnected");
+	net->connect("server_disconnected", this, "_server_disconnected");
+}
+
+void WC::stop_network()
+{
+	if (net.is_valid())
+	{
+		net->disconnect("peer_connected", this, "_peer_connected");
+		net->disconnect("peer_disconnected", this, "_peer_disconnected");
+		net->disconnect("server_disconnected", this, "_server_disconnected");
+		net->call("close_connection");
+		net = Ref<NetworkedMultiplayerPeer>();
+	}
+	for (int i = 0; i < MAX_PLAYERS; i++)
+	{
+		if (net_peers[i].id)
+		{
+			net_peer_free(net_peers + i);
+		}
+	}
+	net_located = 0;
+	net_blocks.clear();
+}
+
+// handles what came in since the last poll. clients then tell the server
+// when their camera moved to another chunk.
+void WC::poll_network()
+{
+	if (mode_changed)
+	{
+		start_network();
+	}
+	if (net.is_null())
+	{
+		return;
+	}
+	// the handlers of the signals poll emits leave net be
+	net->poll();
+	while (net->get_available_packet_count())
+	{
+		int from = net->get_packet_peer();
+		const uint8_t *packet;
+		int size;
+		if (net->get_packet(&packet, size) != OK)
+		{
+			break;
+		}
+		net_receive(from, packet, size);
+	}
+	NetworkedMultiplayerPeer::ConnectionStatus status = net->get_connection_status();
+	if (status == NetworkedMultiplayerPeer::CONNECTION_DISCONNECTED)
+	{
+		// refused or lost, the chunks already here stay until mode changes
+		ERR_PRINT("Not connected to the WC server");
+		stop_network();
+		return;
+	}
+	if (mode == MODE_ONLINE && status == NetworkedMultiplayerPeer::CONNECTION_CONNECTED)
+	{
+		int p = chunked(camera_position.x);
+		int q = chunked(camera_position.z);
+		if (!net_located || p != net_p || q != net_q)
+		{
+			net_p = p;
+			net_q = q;
+			net_located = 1;
+			net_send(NetworkedMultiplayerPeer::TARGET_PEER_SERVER, net_position(p, q));
+		}
+	}
+}
+
+void WC::net_send(int peer_id, const Vector<uint8_t> &packet)
+{
+	net->set_target_peer(peer_id);
+	net->put_packet(packet.ptr(), packet.size());
+}
+
+void WC::net_receive(int peer_id, const uint8_t *packet, int size)
+{
+	NetMessage message;
+	net_read(&message, packet, size);
+	int *args = message.args;
+	if (mode == MODE_SERVER)
+	{
+		NetPeer *peer = find_peer(peer_id);
+		if (!peer)
+		{
+			return;
+		}
+		if (message.type == NET_POSITION)
+		{
+			peer->p = args[0];
+			peer->q = args[1];
+			peer->located = 1;
+			net_peer_forget(peer, delete_radius);
+		}
+		else if (message.type == NET_BLOCK)
+		{
+			// clients edit within their interest area and never write the
+			// border copies of neighbouring chunks
+			int distance = MAX(ABS(chunked(args[0]) - peer->p), ABS(chunked(args[2]) - peer->q));
+			if (peer->located && distance <= delete_radius && args[3] >= 0 && args[3] < 128)
+			{
+				set_block(args[0], args[1], args[2], args[3]);
+			}
+		}
+		else
+		{
+			ERR_PRINTS("Dropped a malformed packet from WC client " + itos(peer_id));
+		}
+		return;
+	}
+	if (message.type == NET_CHUNK)
+	{
+		receive_chunk(args[0], args[1], message.blob, message.blob_size);
+	}
+	else if (message.type == NET_BLOCK)
+	{
+		if (block_ready(args[0], args[2]))
+		{
+			apply_block(args[0], args[1], args[2], args[3]);
+		}
+		else
+		{
+			Block block = { args[0], args[1], args[2], args[3] };
+			net_blocks.push_back(block);
+		}
+	}
+	else
+	{
+		ERR_PRINT("Dropped a malformed packet from the WC server");
+	}
+}
+
+NetPeer *WC::find_peer(int peer_id)
+{
+	for (int i = 0; i < MAX_PLAYERS; i++)
+	{
+		if (net_peers[i].id == peer_id)
+		{
+			return net_peers + i;
+		}
+	}
+	return 0;
+}
+
+// distance from p, q to the nearest client's center, in chunks.
+int WC::peer_distance(int p, int q) const
+{
+	int result = 0x7fffffff;
+	for (int i = 0; i < MAX_PLAYERS; i++)
+	{
+		const NetPeer *peer = net_peers + i;
+		if (peer->id && peer->located)
+		{
+			result = MIN(result, MAX(ABS(p - peer->p), ABS(q - peer->q)));
+		}
+	}
+	return result;
+}
+
+// the server's ensure_chunks. loads the chunks around every client with
+// load only jobs and sends each client the loaded ones it doesn't hold yet,
+// nearest first.
+void WC::serve_chunks()
+{
+	check_workers();
+	delete_chunks();
+	if (!workers)
+	{
+		return;
+	}
+
+	job_mutex->lock();
+	int queued = job_queue_size;
+	job_mutex->unlock();
+	int slots = MAX(MIN(worker_count * QUEUED_JOBS_PER_WORKER - queued, free_item_count), 0);
+	WorkerItem **ready = (WorkerItem **) alloca(sizeof(WorkerItem *) * (slots + 1));
+	int ready_count = 0;
+
+	for (int i = 0; i < MAX_PLAYERS; i++)
+	{
+		NetPeer *peer = net_peers + i;
+		if (!peer->id || !peer->located)
+		{
+			continue;
+		}
+		int budget = NET_SNAPSHOTS_PER_UPDATE;
+		for (int r = 0; r <= create_radius; r++)
+		{
+			for (int dp = -r; dp <= r; dp++)
+			{
+				for (int dq = -r; dq <= r; dq++)
+				{
+					if (MAX(ABS(dp), ABS(dq)) != r)
+					{
+						continue;
+					}
+					int a = peer->p + dp;
+					int b = peer->q + dq;
+					Chunk *chunk = find_chunk(a, b);
+					if (!chunk)
+					{
+						if (ready_count < slots && (chunk = alloc_chunk(a, b)))
+						{
+							init_chunk(chunk, a, b);
+							ready[ready_count++] = make_job(chunk, 1, 0, 0, r);
+						}
+						continue;
+					}
+					if (!budget || !chunk->loaded || cindex_get(&peer->sent, a, b) != CINDEX_EMPTY)
+					{
+						continue;
+					}
+					net_send(peer->id, net_chunk(&chunk->map, a, b));
+					cindex_set(&peer->sent, a, b, 1);
+					budget--;
+				}
+			}
+		}
+	}
+	submit_jobs(ready, ready_count);
+}
+
+// an edit reaches every client whose interest area holds the block's
+// chunk or a neighbour with a border copy of it.
+void WC::serve_block(int x, int y, int z, int w)
+{
+	int p = chunked(x);
+	int q = chunked(z);
+	Vector<uint8_t> packet = net_block(x, y, z, w);
+	for (int i = 0; i < MAX_PLAYERS; i++)
+	{
+		NetPeer *peer = net_peers + i;
+		if (peer->id && peer->located && MAX(ABS(p - peer->p), ABS(q - peer->q)) <= delete_radius + 1)
+		{
+			net_send(peer->id, packet);
+		}
+	}
+}
+
+// a snapshot replaces what the client held of the chunk, the next load job
+// decodes it. chunks past delete_radius were unloaded already, the server
+// forgets them as soon as it hears where the camera went.
+void WC::receive_chunk(int p, int q, const uint8_t *blob, int size)
+{
+	if (MAX(ABS(p - net_p), ABS(q - net_q)) > delete_radius)
+	{
+		return;
+	}
+	Chunk *chunk = find_chunk(p, q);
+	if (!chunk)
+	{
+		chunk = alloc_chunk(p, q);
+		if (!chunk)
+		{
+			return;
+		}
+		init_chunk(chunk, p, q);
+	}
+	else
+	{
+		// whatever is out or queued for the chunk is for its old blocks
+		chunk->job = 0;
+		chunk->edited = 0;
+		chunk->loaded = 0;
+		dirty_chunk(chunk);
+	}
+	chunk->snapshot.resize(size);
+	memcpy(chunk->snapshot.ptrw(), blob, size);
+}
+
+// an edit from the server waits while a chunk it may touch is still
+// loading. chunks that aren't there get it with their snapshot.
+int WC::block_ready(int x, int z)
+{
+	int p = chunked(x);
+	int q = chunked(z);
+	for (int dp = -1; dp <= 1; dp++)
+	{
+		for (int dq = -1; dq <= 1; dq++)
+		{
+			Chunk *chunk = find_chunk(p + dp, q + dq);
+			if (chunk && !chunk->loaded)
+			{
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+// edits of one block wait on the same chunks, so they are applied in the
+// order they came.
+void WC::flush_net_blocks()
+{
+	Block *blocks = net_blocks.ptrw();
+	int count = 0;
+	for (int i = 0; i < net_blocks.size(); i++)
+	{
+		if (block_ready(blocks[i].x, blocks[i].z))
+		{
+			apply_block(blocks[i].x, blocks[i].y, blocks[i].z, blocks[i].w);
+		}
+		else
+		{
+			blocks[count++] = blocks[i];
 		}
 	}
-	client_block( x, y, z, w );
+	net_blocks.resize(count);
 }
 
+void WC::_peer_connected(int p_id)
+{
+	// clients hear of each other too
+	if (mode != MODE_SERVER || find_peer(p_id))
+	{
+		return;
+	}
+	NetPeer *peer = find_peer(0);
+	ERR_FAIL_NULL(peer);
+	net_peer_init(peer, p_id);
+}
+
+void WC::_peer_disconnected(int p_id)
+{
+	NetPeer *peer = mode == MODE_SERVER && p_id ? find_peer(p_id) : 0;
+	if (peer)
+	{
+		net_peer_free(peer);
+	}
+}
+
+void WC::_server_disconnected()
+{
+	net_located = 0;
+}
+
+/*
 void record_block( int x, int y, int z, int w ) {
 	memcpy( &g->block1, &g->block0, sizeof( Block ) );
 	g->block0.x = x;
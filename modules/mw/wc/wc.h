@@ -5,11 +5,17 @@
 
 #include "reference.h"
 #include "cmap.h"
+#include "cindex.h"
+#include "region.h"
 #include "chunk.h"
+#include "net.h"
+#include "io/networked_multiplayer_peer.h"
 #include "core/math/vector3.h"
+#include "scene/main/node.h"
 
 class Thread;
 class Semaphore;
+class Mutex;
 class WC;
 
 #define CREATE_CHUNK_RADIUS 10
@@ -19,7 +25,7 @@ class WC;
 #define CHUNK_SIZE 32
 #define MAX_CHUNKS 8192
 #define MAX_PLAYERS 16
-#define WORKERS 4
+#define QUEUED_JOBS_PER_WORKER 2
 #define MAX_TEXT_LENGTH 256
 #define MAX_NAME_LENGTH 32
 #define MAX_PATH_LENGTH 256
@@ -30,11 +36,8 @@ class WC;
 #define ALIGN_RIGHT 2
 
 #define MODE_OFFLINE 0
-#define MODE_ONLINE 1
-
-#define WORKER_IDLE 0
-#define WORKER_BUSY 1
-#define WORKER_DONE 2
+#define MODE_ONLINE 1 // a client, blocks and edits come from the server
+#define MODE_SERVER 2 // serves clients, meshes nothing itself
 
 #define XZ_SIZE (CHUNK_SIZE * 3 + 2)
 #define XZ_LO (CHUNK_SIZE)
@@ -46,23 +49,70 @@ class WC;
 typedef struct {
 	int p;
 	int q;
+	int job;
+	int score;
+	int priority;
 	int load;
+	RegionStore *store; // where load_chunk looks before generating, may be NULL
+	Vector<uint8_t> snapshot; // blocks a server sent, decoded instead of the store
+	int generated; // set by load_chunk when the blocks came from create_world
 	CMap *block_maps[3][3];
 	CMap *light_maps[3][3];
+	// stored light of the chunks around, set for main thread remeshes of
+	// lit chunks so compute_chunk reuses it instead of flooding again.
+	LightMap *lights[3][3];
+	LightMap light; // light flooded by compute_chunk, taken by the chunk
 	int miny;
 	int maxy;
 	int faces;
-	Array mesh_array;
+	int vertices;
+	int indices;
+	int greedy;
+	int lod;
+	int lod_edges;
+	int mesh; // run compute_chunk after the load, servers only load
+	int lighting; // mesh with sky and block light, see compute_chunk
+	int collision; // build collision_faces as well
+	// one mesh per section, empty for sections without faces. faces,
+	// vertices and indices above are the totals.
+	Array mesh_arrays[CHUNK_SECTIONS];
+	int section_faces[CHUNK_SECTIONS];
+	uint64_t section_visibility[CHUNK_SECTIONS];
+	PoolVector<Vector3> collision_faces;
 	Array profile_times;
+	uint64_t generate_usec; // time spent in load_chunk
+	uint64_t mesh_usec; // time spent in compute_chunk
 } WorkerItem;
 
+// counters behind the "wc/..." Performance monitors. workers time their
+// stages into the job items, the main thread adds them up as it applies
+// the jobs and rolls them over once a second.
+typedef struct {
+	uint64_t generate_usec;
+	uint64_t mesh_usec;
+	uint64_t upload_usec;
+	int generated; // chunks through load_chunk
+	int meshed; // chunks through compute_chunk
+	int faces;
+	int loaded;
+	int unloaded;
+} WCStats;
+
+// finished jobs of one worker on their way to the main thread. head only
+// moves on the worker and tail only on the main thread, both through the
+// atomics in safe_refcount.h. sized to hold every job item, so it never fills.
+typedef struct {
+	uint32_t head;
+	uint32_t tail;
+	uint32_t mask;
+	WorkerItem **items;
+} DoneRing;
+
 typedef struct {
 	int index;
-	int state;
 	WC *wc;
 	Thread *thrd;
-	Semaphore *smphr;
-	WorkerItem item;
+	DoneRing done;
 } Worker;
 
 typedef struct {
@@ -83,6 +133,27 @@ typedef struct {
 
 typedef void( *world_func )(int, int, int, int, void *);
 
+void create_world( int p, int q, world_func func, void *arg );
+
+// worker side of chunk creation, run on the main thread by force_chunks and
+// the tests.
+void load_chunk( WorkerItem *item );
+void compute_chunk( WorkerItem *item );
+
+typedef struct {
+	RID mesh;
+	RID instance;
+} ChunkVisual;
+
+// a step of WC::cull_sections' walk, section s of chunk p, q.
+typedef struct {
+	int p;
+	int q;
+	int s;
+	int from; // CULL_FACE_* it was entered through, -1 for the camera's section
+	int dirs; // 1 << CULL_FACE_* of every step taken to get here
+} SectionStep;
+
 class WC : public Node {
 	GDCLASS( WC, Node );
 
@@ -92,8 +163,47 @@ protected:
 	void update( float time_step );
 	void set_material( const Ref<Material> &p_material );
 	Ref<Material> get_material() const;
+	void set_greedy_meshing( bool p_enable );
+	bool is_greedy_meshing() const;
+	void set_compress_meshes( bool p_enable );
+	bool is_compress_meshes() const;
+	void set_upload_budget_usec( int p_usec );
+	int get_upload_budget_usec() const;
+	void set_db_path( const String &p_path );
+	String get_db_path() const;
+	void open_store();
+	void set_lod_distance( int p_distance );
+	int get_lod_distance() const;
+	void set_collision_radius( int p_radius );
+	int get_collision_radius() const;
+	void set_cave_culling( bool p_enable );
+	bool is_cave_culling() const;
+	uint32_t get_mesh_compress_flags() const;
+	void set_mode( int p_mode );
+	int get_mode() const;
+	void set_server_addr( const String &p_addr );
+	String get_server_addr() const;
+	void set_server_port( int p_port );
+	int get_server_port() const;
+	void set_scenario( RID p_scenario );
+	void set_space( RID p_space );
+	void _peer_connected( int p_id );
+	void _peer_disconnected( int p_id );
+	void _server_disconnected();
 
 public:
+	enum Stat {
+		STAT_GENERATION_USEC, // mean per chunk over the last second
+		STAT_MESHING_USEC,
+		STAT_UPLOAD_USEC,
+		STAT_FACES, // faces meshed in the last second
+		STAT_QUEUE_DEPTH, // jobs waiting for a worker
+		STAT_CHUNKS_LOADED, // in the last second
+		STAT_CHUNKS_UNLOADED,
+		STAT_CMAP_MEMORY, // bytes held by the block and light maps of loaded chunks
+		STAT_MAX
+	};
+
 	void create_initial();
 	bool get_created();
 	static bool s_created;
@@ -101,9 +211,25 @@ public:
 	~WC();
 
 	Chunk *find_chunk( int p, int q );
+	Chunk *alloc_chunk( int p, int q );
+	void free_chunk( Chunk *chunk );
 	void dirty_chunk( Chunk *chunk );
 	void request_chunk( int p, int q );
+	void save_chunk( Chunk *chunk );
+	void edit_chunk( Chunk *chunk );
+	void flush_edits();
 	void init_chunk( Chunk *chunk, int p, int q );
+	int chunk_lod( int p, int q ) const;
+	int chunk_lod_edges( int p, int q ) const;
+	void update_lods( int p, int q );
+	void acquire_section( ChunkSection *section );
+	void release_section( ChunkSection *section );
+	void release_visual( Chunk *chunk );
+	int cull_sections( Vector3 position, const Vector<Plane> &planes );
+	int chunk_collides( int p, int q ) const;
+	void update_collisions();
+	void set_chunk_collision( Chunk *chunk, const PoolVector<Vector3> &faces );
+	void release_collision( Chunk *chunk );
 	void create_chunk( Chunk *chunk, int p, int q );
 	void set_chunk_render_data( Chunk *chunk, WorkerItem *item );
 	void gen_chunk_buffer( Chunk *chunk );
@@ -111,15 +237,103 @@ public:
 	void delete_chunks();
 	void delete_all_chunks();
 	void force_chunks( float x, float z );
+	void create_workers();
+	void destroy_workers();
+	int pending_jobs() const;
+	void release_job( WorkerItem *item );
+	void apply_job( WorkerItem *item );
 	void check_workers();
-	void ensure_chunks_worker( Vector3 position, Vector3 normal, Worker *worker );
+	WorkerItem *make_job( Chunk *chunk, int load, int mesh, int priority, int score );
+	void submit_jobs( WorkerItem **items, int count );
+	void queue_chunks( Vector3 position, const Vector<Plane> &planes );
 	void ensure_chunks( Vector3 position, Vector3 normal );
 	int get_block( int x, int y, int z );
+	int _set_block( int p, int q, int x, int y, int z, int w, int dirty );
+	void set_block( int x, int y, int z, int w );
+	int apply_block( int x, int y, int z, int w );
+	void start_network();
+	void stop_network();
+	void poll_network();
+	void net_send( int peer_id, const Vector<uint8_t> &packet );
+	void net_receive( int peer_id, const uint8_t *packet, int size );
+	NetPeer *find_peer( int peer_id );
+	int peer_distance( int p, int q ) const;
+	void serve_chunks();
+	void serve_block( int x, int y, int z, int w );
+	void receive_chunk( int p, int q, const uint8_t *blob, int size );
+	int block_ready( int x, int z );
+	void flush_net_blocks();
+	void relight( int x, int y, int z );
+	int get_light( int x, int y, int z );
+	void set_light( int x, int y, int z, int w );
+	void register_monitors();
+	void unregister_monitors();
+	void roll_stats();
+	float get_stat( Stat p_stat );
 
+	// every chunk vertex carries its ambient occlusion and light as
+	// COLOR.r = 1 - ao and COLOR.g = block light, both 0 to 1. sky light
+	// is folded into the occlusion. a shader material picks them up with
+	//     ALBEDO = tex.rgb * mix(0.3, 1.0, COLOR.r) + tex.rgb * COLOR.g;
+	// greedy and LOD meshes carry neutral colors, 1 and 0.
 	Ref<Material> material;
+	// greedy meshes merge faces across blocks, so UV repeats once per block
+	// and UV2 holds the atlas tile origin. the material has to wrap them:
+	//     vec2 t = fract(UV);
+	//     vec2 atlas_uv = UV2 + vec2(t.x, -t.y) * 0.0625;
+	bool greedy_meshing;
+	bool compress_meshes;
+	// chunks at lod_distance or more from the camera's chunk are meshed at
+	// half resolution, at twice that at quarter resolution. 0 disables LOD.
+	int lod_distance;
+	int lod_p; // chunk the LOD rings were last centered on
+	int lod_q;
+	// chunks render straight through the VisualServer, no node per chunk.
+	// sections put their instances in this scenario, the world's while WC
+	// is inside the tree and empty otherwise. pooled instances sit outside
+	// any scenario.
+	RID scenario;
+	Vector<ChunkVisual> visual_pool; // released mesh, instance pairs
+	// sections the camera can't see through the terrain are hidden every
+	// frame by cull_sections, see SECTION_SEES.
+	bool cave_culling;
+	Vector<uint8_t> cull_reached; // sections within delete_radius the walk reached
+	Vector<SectionStep> cull_steps;
+	// chunks within collision_radius of the camera's chunk (the LOD center)
+	// get a static body in space, built on the worker that meshes them. it
+	// stays below RENDER_CHUNK_RADIUS so bodies never outlive their meshes.
+	// 0 disables collision.
+	int collision_radius;
+	RID space;
+	WCStats stats; // the current second
+	WCStats last_stats; // the last whole second, what get_stat reports
+	uint64_t stats_begin;
+	bool monitors_registered;
 	Node* world_node;
+	// chunk jobs go through one queue shared by all workers. job items
+	// cycle free_items -> job_queue -> a worker -> its done ring -> free_items,
+	// only the free list is private to the main thread.
 	Worker* workers;
+	int worker_count;
+	bool workers_exit;
+	WorkerItem* job_items;
+	WorkerItem** free_items;
+	int free_item_count;
+	WorkerItem** job_queue;
+	int job_queue_size;
+	int job_capacity;
+	int next_done_worker;
+	int upload_budget_usec; // finished chunks applied per frame, <= 0 for no limit
+	int job_counter;
+	Mutex* job_mutex;
+	Semaphore* job_semaphore;
 	Chunk chunks[MAX_CHUNKS];
+	CIndex chunk_index;
+	int free_chunks[MAX_CHUNKS];
+	int free_chunk_count;
+	int edited_chunks[MAX_CHUNKS]; // slots remeshed by flush_edits
+	int edited_chunk_count;
+	int chunk_slots; // high water mark of used slots in chunks
 	int chunk_count;
 	int create_radius;
 	int render_radius;
@@ -142,10 +356,20 @@ public:
 	float fov;
 	int suppress_char;
 	int mode;
-	int mode_changed;
-	char db_path[MAX_PATH_LENGTH];
+	int mode_changed; // the network is restarted for mode on the next poll
+	String db_path;
+	RegionStore region;
 	char server_addr[MAX_ADDR_LENGTH];
 	int server_port;
+	// a NetworkedMultiplayerENet while mode isn't MODE_OFFLINE, see net.h.
+	// servers track their clients in net_peers, clients report the chunk
+	// their camera is in as net_p, net_q.
+	Ref<NetworkedMultiplayerPeer> net;
+	NetPeer net_peers[MAX_PLAYERS];
+	int net_p;
+	int net_q;
+	int net_located;
+	Vector<Block> net_blocks; // edits from the server waiting on a chunk load
 	int day_length;
 	int time_changed;
 	Block block0;
@@ -156,4 +380,6 @@ public:
 	Vector3 camera_direction;
 };
 
+VARIANT_ENUM_CAST(WC::Stat);
+
 #endif
\ No newline at end of file